@@ -0,0 +1,198 @@
+//
+// Created by wei on 18-2-14.
+//
+// What the benchmarks of src/app share: the configuration files, an engine
+// set up from args.yml, one timed frame, order statistics of timings, and
+// a writer for their JSON results.
+
+#ifndef APP_BENCHMARK_UTIL_H
+#define APP_BENCHMARK_UTIL_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "io/config_manager.h"
+
+/// args.yml and synthetic.yml, relative to build/ where the apps are run
+inline void LoadBenchmarkConfig(RuntimeParams &args, ConfigManager &config) {
+  LoadRuntimeParams("../config/args.yml", args);
+  config.LoadConfig("../config/synthetic.yml");
+}
+
+/// @return run_frames of args.yml if set, @param default_count otherwise
+inline int BenchmarkFrameCount(const RuntimeParams &args, int default_count) {
+  return args.run_frames > 0 ? args.run_frames : default_count;
+}
+
+/// Update and meshing options of args.yml; logs go to the working directory
+inline void ConfigBenchmarkEngine(MainEngine &main_engine,
+                                  const RuntimeParams &args,
+                                  bool enable_ply = true) {
+  main_engine.ConfigMappingEngine(args.enable_bayesian_update);
+  main_engine.ConfigLoggingEngine(".", false, enable_ply);
+  main_engine.enable_sdf_gradient() = args.enable_sdf_gradient;
+  main_engine.enable_surface_nets() = args.enable_surface_nets;
+}
+
+/// Preprocessing, mapping, meshing and recycling of one frame,
+/// as reconstruction runs it
+/// @return seconds
+inline double RunFrame(MainEngine &main_engine, Sensor &sensor,
+                       cv::Mat &depth, cv::Mat &color, const float4x4 &wTc) {
+  Timer timer;
+  timer.Tick();
+  sensor.Process(depth, color);
+  sensor.set_transform(wTc);
+  main_engine.Mapping(sensor);
+  main_engine.Meshing();
+  main_engine.Recycle();
+  return timer.Tock();
+}
+
+/// Rank floor(p * n), @param p in [0, 1]
+inline double Percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = std::min(values.size() - 1, (size_t)(p * values.size()));
+  return values[rank];
+}
+
+inline double Median(const std::vector<double> &values) {
+  return Percentile(values, 0.5);
+}
+
+inline double Mean(const std::vector<double> &values) {
+  if (values.empty()) return 0;
+  double sum = 0;
+  for (double value : values) sum += value;
+  return sum / values.size();
+}
+
+/// Streams a JSON document: members and elements are written as they
+/// come, one per line down to @param inline_depth, on one line below.
+/// Keys are not escaped, they are identifiers here.
+class JsonWriter {
+public:
+  explicit JsonWriter(const std::string &path, int inline_depth = 2)
+      : out_(path), inline_depth_(inline_depth) {
+    if (! out_.is_open()) {
+      LOG(ERROR) << "Can't open benchmark results " << path;
+    }
+  }
+  ~JsonWriter() {
+    out_ << "\n";
+  }
+
+  JsonWriter& BeginObject() {
+    return Begin('{');
+  }
+  JsonWriter& EndObject() {
+    return End('}');
+  }
+  JsonWriter& BeginArray() {
+    return Begin('[');
+  }
+  JsonWriter& EndArray() {
+    return End(']');
+  }
+
+  JsonWriter& Key(const std::string &key) {
+    Separate();
+    out_ << "\"" << key << "\": ";
+    is_after_key_ = true;
+    return *this;
+  }
+
+  template <typename T>
+  JsonWriter& Value(const T &value) {
+    Separate();
+    out_ << value;
+    return *this;
+  }
+  JsonWriter& Value(bool value) {
+    Separate();
+    out_ << (value ? "true" : "false");
+    return *this;
+  }
+  JsonWriter& Value(const char *value) {
+    Separate();
+    out_ << "\"" << value << "\"";
+    return *this;
+  }
+  JsonWriter& Value(const std::string &value) {
+    return Value(value.c_str());
+  }
+
+  template <typename T>
+  JsonWriter& Field(const std::string &key, const T &value) {
+    return Key(key).Value(value);
+  }
+  /// Seconds as milliseconds
+  JsonWriter& Millis(const std::string &key, double seconds) {
+    return Key(key).Value(seconds * 1000);
+  }
+  JsonWriter& Millis(const std::string &key,
+                     const std::vector<double> &seconds) {
+    Key(key).BeginArray();
+    for (double s : seconds) Value(s * 1000);
+    return EndArray();
+  }
+  template <typename T>
+  JsonWriter& Array(const std::string &key, const std::vector<T> &values) {
+    Key(key).BeginArray();
+    for (const T &value : values) Value(value);
+    return EndArray();
+  }
+
+private:
+  /// The comma and line break before a value, or nothing after a key
+  void Separate() {
+    if (is_after_key_) {
+      is_after_key_ = false;
+      return;
+    }
+    if (is_empty_.empty()) return;
+    bool is_first = is_empty_.back();
+    is_empty_.back() = false;
+    if (! is_first) out_ << ",";
+    int depth = (int)is_empty_.size();
+    if (depth <= inline_depth_) {
+      out_ << "\n" << std::string(2 * depth, ' ');
+    } else if (! is_first) {
+      out_ << " ";
+    }
+  }
+
+  JsonWriter& Begin(char bracket) {
+    Separate();
+    out_ << bracket;
+    is_empty_.push_back(true);
+    return *this;
+  }
+
+  JsonWriter& End(char bracket) {
+    CHECK(! is_empty_.empty()) << "Unbalanced " << bracket;
+    bool is_empty = is_empty_.back();
+    int depth = (int)is_empty_.size();
+    is_empty_.pop_back();
+    if (! is_empty && depth <= inline_depth_) {
+      out_ << "\n" << std::string(2 * (depth - 1), ' ');
+    }
+    out_ << bracket;
+    return *this;
+  }
+
+  std::ofstream     out_;
+  int               inline_depth_;
+  std::vector<bool> is_empty_;     // per open object or array
+  bool              is_after_key_ = false;
+};
+
+#endif //APP_BENCHMARK_UTIL_H
@@ -0,0 +1,219 @@
+//
+// Created by wei on 18-2-10.
+//
+// Streaming the map to a remote client as deltas: every few frames the
+// blocks and the mesh changed since the previous delta are exported and
+// sent over a local socket, a stand-in for the network, to a client
+// thread that applies the block deltas to a map of its own.
+// Bytes per delta are compared with full exports of the same frames,
+// and the client map with a full export at the end.
+// Results go to a JSON file, by default delta_benchmark.json.
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "engine/delta_exporter.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+enum MessageType {
+  BLOCK_DELTA = 0,
+  FULL_CHECK = 1,
+  END_OF_STREAM = 2
+};
+
+// Observed mask and voxels of a block, as in the delta
+typedef std::map<int3, std::string, Int3Sort> ClientMap;
+
+bool WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written <= 0) return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool ReadAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t read_size = read(fd, data, size);
+    if (read_size <= 0) return false;
+    data += read_size;
+    size -= read_size;
+  }
+  return true;
+}
+
+void SendMessage(int fd, MessageType type, const std::vector<char> &bytes) {
+  int header[2] = {type, (int)bytes.size()};
+  CHECK(WriteAll(fd, (const char*)header, sizeof(header)));
+  CHECK(WriteAll(fd, bytes.data(), bytes.size()));
+}
+
+/// @return the frame of the delta
+int ApplyBlockDelta(const std::vector<char> &delta, ClientMap &client_map) {
+  const char *p = delta.data();
+  DeltaHeader header;
+  memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+  CHECK(memcmp(header.magic, "VHBD", 4) == 0);
+  CHECK_EQ(header.version, DeltaExporter::kVersion);
+  if (header.since_frame < 0) client_map.clear();
+
+  for (int i = 0; i < header.deleted_count; ++i) {
+    int3 pos;
+    memcpy(&pos, p, sizeof(int3));
+    p += sizeof(int3);
+    client_map.erase(pos);
+  }
+
+  const size_t kVoxelBytes = 2 * sizeof(float) + sizeof(uchar3);
+  for (int i = 0; i < header.block_count; ++i) {
+    int3 pos;
+    memcpy(&pos, p, sizeof(int3));
+    p += sizeof(int3);
+    uint64_t observed[BLOCK_SIZE / 64];
+    memcpy(observed, p, sizeof(observed));
+    size_t observed_count = 0;
+    for (uint64_t bits : observed) {
+      observed_count += __builtin_popcountll(bits);
+    }
+    size_t block_bytes = sizeof(observed) + observed_count * kVoxelBytes;
+    client_map[pos].assign(p, block_bytes);
+    p += block_bytes;
+  }
+  CHECK(p == delta.data() + delta.size());
+  return header.frame;
+}
+
+struct ClientResult {
+  int  delta_count = 0;
+  int  last_frame = -1;
+  bool is_consistent = false;
+};
+
+void RunClient(int fd, ClientResult &result) {
+  ClientMap client_map;
+  std::vector<char> bytes;
+  int header[2];
+  while (ReadAll(fd, (char*)header, sizeof(header))) {
+    if (header[0] == END_OF_STREAM) break;
+    bytes.resize(header[1]);
+    CHECK(ReadAll(fd, bytes.data(), bytes.size()));
+
+    if (header[0] == BLOCK_DELTA) {
+      result.last_frame = ApplyBlockDelta(bytes, client_map);
+      ++result.delta_count;
+    } else {
+      ClientMap full_map;
+      ApplyBlockDelta(bytes, full_map);
+      result.is_consistent = full_map == client_map;
+      LOG(INFO) << "Client blocks: " << client_map.size()
+                << ", in the full export: " << full_map.size();
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "delta_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  const int kDeltaInterval = 5;
+
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args, false);
+
+  int fds[2];
+  CHECK_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  ClientResult client_result;
+  std::thread client(RunClient, fds[1], std::ref(client_result));
+
+  std::vector<double> block_delta_bytes, block_full_bytes;
+  std::vector<double> mesh_delta_bytes, mesh_full_bytes;
+  std::vector<double> export_seconds;
+  std::vector<char> delta, full;
+  int block_since_frame = -1, mesh_since_frame = -1;
+
+  SyntheticScene scene(ROOM, 1, kFrameCount, config.sensor_params);
+  cv::Mat color, depth;
+  float4x4 wTc;
+  while (scene.ProvideData(depth, color, wTc)) {
+    RunFrame(main_engine, sensor, depth, color, wTc);
+    if (main_engine.frame_count() % kDeltaInterval != 0) continue;
+
+    Timer timer;
+    timer.Tick();
+    block_since_frame = main_engine.ExportChangedBlocks(block_since_frame,
+                                                        delta);
+    export_seconds.push_back(timer.Tock());
+    SendMessage(fds[0], BLOCK_DELTA, delta);
+    block_delta_bytes.push_back(delta.size());
+    main_engine.ExportChangedBlocks(-1, full);
+    block_full_bytes.push_back(full.size());
+
+    mesh_since_frame = main_engine.ExportChangedMesh(mesh_since_frame, delta);
+    mesh_delta_bytes.push_back(delta.size());
+    main_engine.ExportChangedMesh(-1, full);
+    mesh_full_bytes.push_back(full.size());
+  }
+
+  /// The last changes, then the whole map to compare with
+  block_since_frame = main_engine.ExportChangedBlocks(block_since_frame,
+                                                      delta);
+  SendMessage(fds[0], BLOCK_DELTA, delta);
+  main_engine.ExportChangedBlocks(-1, full);
+  SendMessage(fds[0], FULL_CHECK, full);
+  SendMessage(fds[0], END_OF_STREAM, std::vector<char>());
+  client.join();
+  close(fds[0]);
+  close(fds[1]);
+
+  double block_ratio = Mean(block_full_bytes) > 0
+                       ? Mean(block_delta_bytes) / Mean(block_full_bytes) : 0;
+  double mesh_ratio = Mean(mesh_full_bytes) > 0
+                      ? Mean(mesh_delta_bytes) / Mean(mesh_full_bytes) : 0;
+  {
+    JsonWriter json(output_path);
+    json.BeginObject()
+        .Field("frames", kFrameCount)
+        .Field("delta_interval", kDeltaInterval)
+        .Field("deltas_applied", client_result.delta_count)
+        .Field("block_delta_bytes", Mean(block_delta_bytes))
+        .Field("block_full_bytes", Mean(block_full_bytes))
+        .Field("block_bandwidth_ratio", block_ratio)
+        .Field("mesh_delta_bytes", Mean(mesh_delta_bytes))
+        .Field("mesh_full_bytes", Mean(mesh_full_bytes))
+        .Field("mesh_bandwidth_ratio", mesh_ratio)
+        .Millis("block_export_ms", Mean(export_seconds))
+        .Field("consistent", client_result.is_consistent)
+        .EndObject();
+  }
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return client_result.is_consistent ? 0 : 1;
+}
@@ -0,0 +1,335 @@
+//
+// Created by wei on 18-2-1.
+//
+// Replay sets of block positions into the hash table and report
+// bucket occupancy, linked list lengths, failed inserts and latency
+// per hash function and table parameters.
+// Usage: hash_benchmark [block_positions.txt [output.json]]
+// Without a position file (written by FinalLog), synthetic sets are used.
+// Every hash function runs in the host model of the table;
+// the Teschner hash, the one of the GPU table, also runs on the GPU.
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "core/hash_table.h"
+#include "core/hash_table_model.h"
+#include "core/hash_table_replay.h"
+#include "io/config_manager.h"
+
+struct PositionSet {
+  std::string name;
+  std::vector<int3> positions;
+};
+
+struct TableConfig {
+  std::string name;
+  HashParams params;
+};
+
+namespace {
+const float kPi = 3.14159265f;
+/// GPU inserts are repeated, as over frames, until nothing changes
+const int kMaxGpuPasses = 8;
+
+HashParams MakeHashParams(uint bucket_count, uint bucket_size,
+                          uint linked_list_size, uint value_capacity) {
+  HashParams params;
+  params.bucket_count = bucket_count;
+  params.bucket_size = bucket_size;
+  params.entry_count = bucket_count * bucket_size;
+  params.linked_list_size = linked_list_size;
+  params.value_capacity = value_capacity;
+  return params;
+}
+
+bool ReadBlockPositions(const std::string &path, PositionSet &set) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Can't open block position file " << path;
+    return false;
+  }
+  set.name = path;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    int3 pos;
+    if (ss >> pos.x >> pos.y >> pos.z) {
+      set.positions.push_back(pos);
+    }
+  }
+  return true;
+}
+
+/// Solid cube: the worst case for locality preserving hashes
+PositionSet MakeDenseCube(uint count) {
+  PositionSet set{"dense_cube"};
+  int side = (int)std::ceil(std::cbrt((float)count));
+  for (int x = -side / 2; x < side - side / 2; ++x)
+    for (int y = -side / 2; y < side - side / 2; ++y)
+      for (int z = -side / 2; z < side - side / 2; ++z)
+        set.positions.push_back(make_int3(x, y, z));
+  return set;
+}
+
+/// One block thick sphere, as blocks around an object surface
+PositionSet MakeSphereShell(uint count) {
+  PositionSet set{"sphere_shell"};
+  float radius = std::sqrt(count / (4 * kPi));
+  int bound = (int)radius + 1;
+  for (int x = -bound; x <= bound; ++x)
+    for (int y = -bound; y <= bound; ++y)
+      for (int z = -bound; z <= bound; ++z) {
+        float d = std::sqrt((x + 0.5f) * (x + 0.5f)
+                            + (y + 0.5f) * (y + 0.5f)
+                            + (z + 0.5f) * (z + 0.5f));
+        if (std::fabs(d - radius) < 0.5f)
+          set.positions.push_back(make_int3(x, y, z));
+      }
+  return set;
+}
+
+/// Walls, floor and ceiling of a box room: axis aligned planes
+PositionSet MakeRoomShell(uint count) {
+  PositionSet set{"room_shell"};
+  int half = std::max(1, (int)std::sqrt(count / 24.0f));
+  for (int x = -half; x <= half; ++x)
+    for (int y = -half; y <= half; ++y)
+      for (int z = -half; z <= half; ++z) {
+        if (std::abs(x) == half || std::abs(y) == half || std::abs(z) == half)
+          set.positions.push_back(make_int3(x, y, z));
+      }
+  return set;
+}
+
+/// Scattered blocks, the best case for every hash
+PositionSet MakeRandom(uint count) {
+  PositionSet set{"random"};
+  int range = 8 * (int)std::cbrt((float)count);
+  srand(0);
+  for (uint i = 0; i < count; ++i) {
+    set.positions.push_back(make_int3(rand() % (2 * range) - range,
+                                      rand() % (2 * range) - range,
+                                      rand() % (2 * range) - range));
+  }
+  auto less = [](const int3 &a, const int3 &b) {
+    if (a.x != b.x) return a.x < b.x;
+    if (a.y != b.y) return a.y < b.y;
+    return a.z < b.z;
+  };
+  auto equal = [](const int3 &a, const int3 &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  };
+  std::sort(set.positions.begin(), set.positions.end(), less);
+  set.positions.erase(std::unique(set.positions.begin(),
+                                  set.positions.end(), equal),
+                      set.positions.end());
+  std::random_shuffle(set.positions.begin(), set.positions.end());
+  return set;
+}
+
+void WriteStatsJson(JsonWriter &json, const HashTableStats &stats) {
+  json.Key("table").BeginObject()
+      .Field("load_factor", stats.load_factor)
+      .Field("linked_entries", stats.linked_entry_count)
+      .Field("unreachable", stats.unreachable_count)
+      .Field("duplicates", stats.duplicate_count)
+      .Field("mean_probes", stats.mean_probe_count)
+      .Array("bucket_occupancy", stats.bucket_occupancy)
+      .Array("chain_length", stats.chain_length)
+      .EndObject();
+}
+
+/// Single threaded replay of the insertion policy
+void RunModel(const PositionSet &set, const HashParams &params,
+              HashFunctionType type, JsonWriter &json) {
+  HashTableModel model(params, type);
+  const std::vector<int3> &positions = set.positions;
+
+  uint result_count[4] = {0, 0, 0, 0};
+  Timer timer;
+  timer.Tick();
+  for (const int3 &pos : positions) {
+    result_count[model.AllocEntry(pos)]++;
+  }
+  double insert_seconds = timer.Tock();
+
+  uint found_count = 0, probe_count;
+  timer.Tick();
+  for (const int3 &pos : positions) {
+    if (model.GetEntry(pos, probe_count) >= 0) ++found_count;
+  }
+  double lookup_seconds = timer.Tock();
+
+  HashTableStats stats = model.Analyze();
+
+  /// Lost entries are allocated again on the next frame
+  uint reinserted_count = 0;
+  for (const int3 &pos : positions) {
+    if (model.AllocEntry(pos) == HashTableModel::kInserted)
+      ++reinserted_count;
+  }
+
+  LOG(INFO) << "  " << HashFunctionName(type)
+            << ": overflow " << result_count[HashTableModel::kBucketOverflow]
+            << ", unreachable " << stats.unreachable_count
+            << ", load " << stats.load_factor
+            << ", probes " << stats.mean_probe_count;
+
+  double n = std::max<size_t>(positions.size(), 1);
+  json.BeginObject()
+      .Field("insert_ns", insert_seconds * 1e9 / n)
+      .Field("lookup_ns", lookup_seconds * 1e9 / n)
+      .Field("inserted", result_count[HashTableModel::kInserted])
+      .Field("overflow", result_count[HashTableModel::kBucketOverflow])
+      .Field("heap_exhausted", result_count[HashTableModel::kHeapExhausted])
+      .Field("found", found_count)
+      .Field("reinserted", reinserted_count);
+  WriteStatsJson(json, stats);
+  json.EndObject();
+}
+
+/// Concurrent replay in the real table: bucket lock conflicts
+/// drop inserts, which are retried in the next passes
+void RunGpu(const PositionSet &set, const HashParams &params,
+            JsonWriter &json) {
+  uint count = (uint)set.positions.size();
+  int3 *positions_gpu;
+  checkCudaErrors(cudaMalloc(&positions_gpu, sizeof(int3) * count));
+  checkCudaErrors(cudaMemcpy(positions_gpu, set.positions.data(),
+                             sizeof(int3) * count, cudaMemcpyHostToDevice));
+
+  HashTable hash_table(params);
+  double insert_seconds = 0, lookup_seconds = 0;
+  uint found_count = 0, first_pass_found_count = 0;
+  int pass_count = 0;
+  for (int pass = 0; pass < kMaxGpuPasses; ++pass) {
+    double seconds = ReplayAllocEntries(hash_table, positions_gpu, count);
+    uint prev_found_count = found_count;
+    double get_seconds = ReplayGetEntries(hash_table, positions_gpu, count,
+                                          found_count);
+    ++pass_count;
+    if (pass == 0) {
+      insert_seconds = seconds;
+      lookup_seconds = get_seconds;
+      first_pass_found_count = found_count;
+    } else if (found_count == prev_found_count) {
+      break;
+    }
+  }
+
+  std::vector<HashEntry> entries;
+  hash_table.DownloadEntries(entries);
+  HashTableModel model(params, TESCHNER_HASH);
+  model.Load(entries);
+  HashTableStats stats = model.Analyze();
+
+  hash_table.Free();
+  checkCudaErrors(cudaFree(positions_gpu));
+
+  LOG(INFO) << "  gpu: dropped in the first pass "
+            << count - first_pass_found_count
+            << ", missing after " << pass_count << " passes "
+            << count - found_count;
+
+  double n = std::max<uint>(count, 1);
+  json.BeginObject()
+      .Field("insert_ns", insert_seconds * 1e9 / n)
+      .Field("lookup_ns", lookup_seconds * 1e9 / n)
+      .Field("first_pass_dropped", count - first_pass_found_count)
+      .Field("passes", pass_count)
+      .Field("missing", count - found_count);
+  WriteStatsJson(json, stats);
+  json.EndObject();
+}
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 2 ? argv[2] : "hash_benchmark.json";
+
+  RuntimeParams args;
+  LoadRuntimeParams("../config/args.yml", args);
+  ConfigManager config;
+  config.LoadConfig(DatasetType(args.dataset_type));
+  const HashParams &base = config.hash_params;
+
+  /// Sets fill half of the heap of the configured table
+  std::vector<PositionSet> sets;
+  if (argc > 1) {
+    PositionSet set;
+    if (! ReadBlockPositions(argv[1], set)) return 1;
+    sets.push_back(set);
+  } else {
+    uint count = base.value_capacity / 2;
+    sets.push_back(MakeDenseCube(count));
+    sets.push_back(MakeSphereShell(count));
+    sets.push_back(MakeRoomShell(count));
+    sets.push_back(MakeRandom(count));
+  }
+
+  /// Same entry count, but for the last one
+  const uint kEntryCount = base.bucket_count * base.bucket_size;
+  uint value_capacity = base.value_capacity;
+  for (auto &set : sets) {
+    value_capacity = std::max(value_capacity,
+                              (uint)set.positions.size() + 1);
+  }
+  std::vector<TableConfig> configs = {
+      {"configured", MakeHashParams(base.bucket_count, base.bucket_size,
+                                    base.linked_list_size, value_capacity)},
+      {"small_buckets", MakeHashParams(kEntryCount / 4, 4,
+                                       base.linked_list_size, value_capacity)},
+      {"long_lists", MakeHashParams(base.bucket_count, base.bucket_size,
+                                    2 * base.linked_list_size + 1,
+                                    value_capacity)},
+      {"quarter_buckets", MakeHashParams(base.bucket_count / 4,
+                                         base.bucket_size,
+                                         base.linked_list_size,
+                                         value_capacity)}
+  };
+  const HashFunctionType kHashFunctions[] = {
+      TESCHNER_HASH, MORTON_HASH, MURMUR_HASH
+  };
+
+  JsonWriter json(output_path);
+  json.BeginObject().Key("runs").BeginArray();
+  for (const PositionSet &set : sets) {
+    for (const TableConfig &table_config : configs) {
+      const HashParams &params = table_config.params;
+      LOG(INFO) << set.name << " (" << set.positions.size() << " blocks), "
+                << table_config.name << ": " << params.bucket_count
+                << " x " << params.bucket_size
+                << ", linked list " << params.linked_list_size;
+
+      json.BeginObject()
+          .Field("set", set.name)
+          .Field("blocks", set.positions.size())
+          .Field("config", table_config.name)
+          .Field("bucket_count", params.bucket_count)
+          .Field("bucket_size", params.bucket_size)
+          .Field("linked_list_size", params.linked_list_size)
+          .Key("host").BeginObject();
+      for (HashFunctionType type : kHashFunctions) {
+        json.Key(HashFunctionName(type));
+        RunModel(set, params, type, json);
+      }
+      json.EndObject()
+          .Key("gpu").BeginObject()
+          .Key(HashFunctionName(TESCHNER_HASH));
+      RunGpu(set, params, json);
+      json.EndObject().EndObject();
+    }
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
@@ -0,0 +1,107 @@
+//
+// Created by wei on 18-2-5.
+//
+// The host side of the map with 4 KB, transparent huge and explicit huge
+// pages: download of the blocks for the CPU path, CPU ray casting
+// (random voxel reads by block), and the host-staged defragmentation.
+// Results go to a JSON file, by default host_pages_benchmark.json.
+
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "util/host_memory.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "host_pages_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  /// Every n-th pose of the trajectory is cast again on the CPU
+  const int kCastInterval = 10;
+  const int kRepeatCount = 3;
+  const HostPageMode kModes[] = {HOST_PAGES_DEFAULT,
+                                 HOST_PAGES_TRANSPARENT_HUGE,
+                                 HOST_PAGES_EXPLICIT_HUGE};
+
+  /// One map for all the modes
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args);
+
+  SyntheticScene scene(ROOM, 2, kFrameCount, config.sensor_params);
+  std::vector<float4x4> cast_poses;
+  cv::Mat color, depth;
+  float4x4 wTc;
+  while (scene.ProvideData(depth, color, wTc)) {
+    RunFrame(main_engine, sensor, depth, color, wTc);
+    if (main_engine.frame_count() % kCastInterval == 1) {
+      cast_poses.push_back(wTc.getInverse());
+    }
+  }
+  /// Every block becomes a candidate
+  main_engine.CompressGlobalMesh();
+
+  CpuRayCaster cpu_ray_caster;
+  cpu_ray_caster.Alloc(config.ray_caster_params);
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("frames", kFrameCount)
+      .Field("casts", cast_poses.size())
+      .Key("modes").BeginArray();
+
+  for (HostPageMode mode : kModes) {
+    SetHostPageMode(mode);
+    /// What the system grants, probed with an array of a few huge pages
+    HostPageMode mode_used;
+    const size_t kProbeBytes = 8 * 1024 * 1024;
+    FreeHostPages(AllocHostPages(kProbeBytes, &mode_used), kProbeBytes);
+
+    std::vector<double> download_seconds, cast_seconds, defrag_seconds;
+    uint block_count = 0;
+    for (int r = 0; r < kRepeatCount; ++r) {
+      HostBlocks host_blocks;
+      download_seconds.push_back(main_engine.DownloadBlocks(host_blocks));
+      block_count = host_blocks.block_count();
+      for (const float4x4 &c_T_w : cast_poses) {
+        cast_seconds.push_back(
+            main_engine.RayCast(cpu_ray_caster, host_blocks, c_T_w));
+      }
+      defrag_seconds.push_back(main_engine.Defragment());
+      /// Defragmenting moved the blocks: collect them again
+      main_engine.CompressGlobalMesh();
+    }
+
+    json.BeginObject()
+        .Field("mode", HostPageModeName(mode))
+        .Field("mode_used", HostPageModeName(mode_used))
+        .Field("blocks", block_count)
+        .Millis("download_ms", Median(download_seconds))
+        .Millis("cpu_raycast_ms", Median(cast_seconds))
+        .Millis("defrag_ms", Median(defrag_seconds))
+        .EndObject();
+  }
+  json.EndArray().EndObject();
+  cpu_ray_caster.Free();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
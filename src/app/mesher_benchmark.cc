@@ -0,0 +1,155 @@
+//
+// Created by wei on 18-1-20.
+//
+// Compare Marching Cubes and Surface Nets on the same map:
+// each frame is integrated once and meshed by both methods.
+// Per-frame timings go to mesher_benchmark.txt; a summary with the shared
+// memory and occupancy of each kernel to a JSON file, by default
+// mesher_benchmark.json.
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "meshing/marching_cubes.h"
+#include "meshing/surface_nets.h"
+#include "sensor/rgbd_data_provider.h"
+#include "sensor/rgbd_sensor.h"
+#include "io/config_manager.h"
+
+struct MesherStats {
+  double time = 0;
+  long vertex_count = 0;
+  long triangle_count = 0;
+  std::vector<double> seconds;
+};
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "mesher_benchmark.json";
+
+  RuntimeParams args;
+  LoadRuntimeParams("../config/args.yml", args);
+
+  ConfigManager config;
+  RGBDDataProvider rgbd_local_sequence;
+
+  DatasetType dataset_type = DatasetType(args.dataset_type);
+  config.LoadConfig(dataset_type);
+  rgbd_local_sequence.LoadDataset(dataset_type);
+  Sensor sensor(config.sensor_params);
+
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  main_engine.ConfigMappingEngine(
+      args.enable_bayesian_update
+  );
+  main_engine.enable_sdf_gradient() = args.enable_sdf_gradient;
+
+  const int kMesherCount = 2;
+  const std::string kMesherNames[kMesherCount] = {
+      "marching_cubes", "surface_nets"
+  };
+  MesherStats total[kMesherCount];
+
+  std::ofstream benchmark_file("mesher_benchmark.txt");
+  benchmark_file << "# frame";
+  for (int m = 0; m < kMesherCount; ++m) {
+    benchmark_file << " " << kMesherNames[m] << "_ms"
+                   << " " << kMesherNames[m] << "_vertices"
+                   << " " << kMesherNames[m] << "_triangles";
+  }
+  benchmark_file << "\n";
+
+  cv::Mat color, depth;
+  float4x4 wTc;
+  int frame_count = 0;
+  int meshed_frame_count = 0;
+  Timer timer;
+  while (rgbd_local_sequence.ProvideData(depth, color, wTc)) {
+    frame_count++;
+    if (args.run_frames > 0 && frame_count > args.run_frames)
+      break;
+
+    sensor.Process(depth, color);
+    sensor.set_transform(wTc);
+
+    main_engine.Mapping(sensor);
+
+    benchmark_file << frame_count;
+    for (int m = 0; m < kMesherCount; ++m) {
+      main_engine.enable_surface_nets() = (m == 1);
+      timer.Tick();
+      main_engine.ExtractMesh();
+      double seconds = timer.Tock();
+      uint2 stats = main_engine.mesh_stats();
+
+      total[m].time += seconds;
+      total[m].vertex_count += stats.x;
+      total[m].triangle_count += stats.y;
+      total[m].seconds.push_back(seconds);
+      benchmark_file << " " << seconds * 1000
+                     << " " << stats.x
+                     << " " << stats.y;
+    }
+    benchmark_file << "\n";
+    meshed_frame_count++;
+
+    main_engine.Recycle();
+  }
+
+  if (meshed_frame_count == 0) return 0;
+  for (int m = 0; m < kMesherCount; ++m) {
+    LOG(INFO) << kMesherNames[m] << ": "
+              << total[m].time * 1000 / meshed_frame_count << " ms/frame, "
+              << total[m].vertex_count / meshed_frame_count << " vertices/frame, "
+              << total[m].triangle_count / meshed_frame_count << " triangles/frame";
+  }
+  if (total[0].vertex_count > 0 && total[0].triangle_count > 0) {
+    LOG(INFO) << "surface_nets / marching_cubes: "
+              << "vertices " << (double)total[1].vertex_count
+                                / total[0].vertex_count
+              << ", triangles " << (double)total[1].triangle_count
+                                 / total[0].triangle_count;
+  }
+
+  const MesherOccupancy occupancies[kMesherCount] = {
+      MarchingCubesOccupancy(), SurfaceNetsOccupancy()
+  };
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("frames", meshed_frame_count)
+      .Field("sdf_gradient", args.enable_sdf_gradient)
+      .Key("meshers").BeginArray();
+  for (int m = 0; m < kMesherCount; ++m) {
+    const MesherOccupancy &occupancy = occupancies[m];
+    json.BeginObject()
+        .Field("mesher", kMesherNames[m])
+        .Millis("mean_ms", Mean(total[m].seconds))
+        .Millis("p50_ms", Percentile(total[m].seconds, 0.5))
+        .Millis("p95_ms", Percentile(total[m].seconds, 0.95))
+        .Field("vertices_per_frame",
+               total[m].vertex_count / meshed_frame_count)
+        .Field("triangles_per_frame",
+               total[m].triangle_count / meshed_frame_count)
+        .Field("shared_bytes", occupancy.shared_bytes)
+        .Field("registers", occupancy.register_count)
+        .Field("blocks_per_sm", occupancy.blocks_per_sm)
+        .Field("occupancy", occupancy.occupancy)
+        .EndObject();
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
@@ -0,0 +1,124 @@
+//
+// Created by wei on 18-2-6.
+//
+// Scaling of the CPU path over NUMA nodes: the host map is split into one
+// shard per node, each filled by a thread of its node, and the CPU ray
+// caster runs on the CPUs of those nodes only, each tile on the node of
+// the shard it hit in the previous cast. Poses are cast twice in a row,
+// the first cast placing the tiles; "2_nodes_unplaced" runs the tiles on
+// any node, for the share of locality in the scaling.
+// The unpinned single shard on every CPU is the previous behavior.
+// Results go to a JSON file, by default numa_benchmark.json.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "util/numa_topology.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+/// @param node_count 0: one unpinned shard on every CPU
+struct NumaConfig {
+  const char *name;
+  int node_count;
+  bool enable_tile_placement;
+};
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "numa_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  const int kCastInterval = 10;
+  const int kRepeatCount = 3;
+  const NumaTopology &topology = NumaTopology::Instance();
+  std::vector<NumaConfig> numa_configs = {{"unpinned", 0, true},
+                                          {"1_node", 1, true}};
+  if (topology.node_count() >= 2) {
+    numa_configs.push_back({"2_nodes", 2, true});
+    numa_configs.push_back({"2_nodes_unplaced", 2, false});
+  }
+
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args);
+
+  SyntheticScene scene(ROOM, 3, kFrameCount, config.sensor_params);
+  std::vector<float4x4> cast_poses;
+  cv::Mat color, depth;
+  float4x4 wTc;
+  while (scene.ProvideData(depth, color, wTc)) {
+    RunFrame(main_engine, sensor, depth, color, wTc);
+    if (main_engine.frame_count() % kCastInterval == 1) {
+      cast_poses.push_back(wTc.getInverse());
+    }
+  }
+  /// Every block becomes a candidate
+  main_engine.CompressGlobalMesh();
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("nodes", topology.node_count())
+      .Field("casts", cast_poses.size())
+      .Key("configs").BeginArray();
+
+  for (const NumaConfig &numa_config : numa_configs) {
+    int shard_count = std::max(numa_config.node_count, 1);
+    int thread_count = numa_config.node_count > 0
+                       ? topology.cpu_count(numa_config.node_count)
+                       : topology.cpu_count(topology.node_count());
+    LOG(INFO) << "NUMA config " << numa_config.name << ": "
+              << shard_count << " shards, " << thread_count << " threads";
+
+    CpuRayCaster cpu_ray_caster;
+    cpu_ray_caster.Alloc(config.ray_caster_params,
+                         thread_count, numa_config.node_count);
+    cpu_ray_caster.enable_tile_placement() = numa_config.enable_tile_placement;
+
+    std::vector<double> download_seconds, cast_seconds;
+    uint block_count = 0;
+    for (int r = 0; r < kRepeatCount; ++r) {
+      HostBlocks host_blocks;
+      download_seconds.push_back(
+          main_engine.DownloadBlocks(host_blocks, shard_count));
+      block_count = host_blocks.block_count();
+      for (const float4x4 &c_T_w : cast_poses) {
+        main_engine.RayCast(cpu_ray_caster, host_blocks, c_T_w);
+        cast_seconds.push_back(
+            main_engine.RayCast(cpu_ray_caster, host_blocks, c_T_w));
+      }
+    }
+    cpu_ray_caster.Free();
+
+    json.BeginObject()
+        .Field("config", numa_config.name)
+        .Field("shards", shard_count)
+        .Field("threads", thread_count)
+        .Field("tile_placement", numa_config.enable_tile_placement)
+        .Field("blocks", block_count)
+        .Millis("download_ms", Median(download_seconds))
+        .Millis("cpu_raycast_ms", Median(cast_seconds))
+        .EndObject();
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+#
+# Created by wei on 18-2-15.
+#
+# L2 and texture cache hit rates of heap and Morton block placement,
+# reported with the timings of synthetic_benchmark.
+# For each placement, synthetic_benchmark runs one scene under nvprof
+# (up to Pascal) or ncu (Volta and later), profiling only the frames of
+# the run, before its defragmentation. Hit rates are averaged per kernel
+# over its launches; timings come from a separate run without profiler.
+#
+# Usage, from build/ as the benchmarks:
+#   python3 ../src/app/profile_cache_hit_rates.py [--scene room] [--scale 1]
+#       [--profiler nvprof|ncu] [--output cache_hit_rates.json]
+
+import argparse
+import csv
+import io
+import json
+import os
+import subprocess
+import sys
+
+PLACEMENTS = ['heap', 'morton']
+
+# Metric name of the profiler -> key of the results
+METRICS = {
+    'nvprof': {
+        'l2_tex_read_hit_rate': 'l2_hit_rate',
+        'tex_cache_hit_rate': 'tex_hit_rate',
+    },
+    'ncu': {
+        'lts__t_sector_hit_rate.pct': 'l2_hit_rate',
+        'l1tex__t_sector_hit_rate.pct': 'tex_hit_rate',
+    },
+}
+
+
+def profile_command(profiler, benchmark):
+    """Only the frames between cudaProfilerStart and cudaProfilerStop"""
+    return [profiler, '--csv', '--profile-from-start', 'off',
+            '--metrics', ','.join(sorted(METRICS[profiler]))] + benchmark
+
+
+def parse_value(text):
+    """'87.5%', '87.5' or '1,234.5' as a float, None if not a number"""
+    try:
+        return float(text.strip().rstrip('%').replace(',', ''))
+    except ValueError:
+        return None
+
+
+def kernel_name(name):
+    """MeshExtractionKernel(EntryArray, ...) -> MeshExtractionKernel"""
+    return name.split('(')[0].strip()
+
+
+def parse_csv(profiler, text):
+    """Profiler CSV -> {kernel: {metric key: (sum, launch count)}}"""
+    lines = text.splitlines()
+    # Log lines come first; the table starts at its header
+    header = '"Device"' if profiler == 'nvprof' else '"ID"'
+    starts = [i for i, line in enumerate(lines) if line.startswith(header)]
+    if not starts:
+        return {}
+    rows = csv.DictReader(io.StringIO('\n'.join(lines[starts[0]:])))
+
+    totals = {}
+    for row in rows:
+        name = row.get('Kernel') or row.get('Kernel Name')
+        metric = row.get('Metric Name')
+        if not name or metric not in METRICS[profiler]:
+            continue
+        if profiler == 'nvprof':
+            # One row per kernel: the average over 'Invocations' launches
+            value = parse_value(row.get('Avg', ''))
+            count = int(parse_value(row.get('Invocations', '1')) or 1)
+        else:
+            # One row per launch
+            value = parse_value(row.get('Metric Value', ''))
+            count = 1
+        if value is None:
+            continue
+        key = METRICS[profiler][metric]
+        kernel = totals.setdefault(kernel_name(name), {})
+        total, launches = kernel.get(key, (0.0, 0))
+        kernel[key] = (total + value * count, launches + count)
+    return totals
+
+
+def mean_rates(totals):
+    rates = {}
+    for kernel, metrics in sorted(totals.items()):
+        rates[kernel] = {key: round(total / count, 2)
+                         for key, (total, count) in sorted(metrics.items())
+                         if count > 0}
+        rates[kernel]['launches'] = max(
+            count for _, count in metrics.values())
+    return rates
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--benchmark', default='./synthetic_benchmark')
+    parser.add_argument('--profiler', choices=sorted(METRICS),
+                        default='nvprof')
+    parser.add_argument('--scene', default='room')
+    parser.add_argument('--scale', default='1')
+    parser.add_argument('--output', default='cache_hit_rates.json')
+    args = parser.parse_args()
+
+    results = {'scene': args.scene, 'scale': float(args.scale),
+               'profiler': args.profiler, 'placements': {}}
+    for placement in PLACEMENTS:
+        timings_path = 'cache_hit_rates_%s.json' % placement
+        benchmark = [args.benchmark, timings_path,
+                     args.scene, placement, args.scale]
+
+        # Timings of a run without profiler: metrics replay every kernel
+        print('Timing %s placement' % placement, file=sys.stderr)
+        subprocess.check_call(benchmark)
+        with open(timings_path) as timings_file:
+            runs = json.load(timings_file)['runs']
+
+        print('Profiling %s placement' % placement, file=sys.stderr)
+        process = subprocess.run(profile_command(args.profiler, benchmark),
+                                 stdout=subprocess.PIPE,
+                                 stderr=subprocess.PIPE)
+        os.remove(timings_path)
+        if process.returncode != 0:
+            sys.stderr.write(process.stderr.decode(errors='replace'))
+            sys.exit('%s failed on %s placement'
+                     % (args.profiler, placement))
+        # nvprof writes its table to stderr, ncu to stdout
+        table = process.stderr if args.profiler == 'nvprof' \
+            else process.stdout
+        rates = mean_rates(parse_csv(args.profiler,
+                                     table.decode(errors='replace')))
+        if not rates:
+            print('No %s metrics for %s placement'
+                  % (args.profiler, placement), file=sys.stderr)
+
+        results['placements'][placement] = {
+            'timings': runs[0] if runs else {},
+            'kernels': rates,
+        }
+
+    with open(args.output, 'w') as output:
+        json.dump(results, output, indent=2)
+        output.write('\n')
+    print('Hit rates written to %s' % args.output, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,139 @@
+//
+// Created by wei on 18-2-8.
+//
+// Mapping with concurrent readers: reader threads pin a MapView and
+// query voxels at random points of the room, as fast as they can,
+// while the main thread maps. Frame time should not depend on the
+// reader count beyond the GPU time the queries take.
+// Results go to a JSON file, by default reader_benchmark.json.
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "engine/map_view.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+struct ReaderResult {
+  std::vector<double> query_seconds;
+  long observed_count = 0;
+  long point_count = 0;
+  long retry_count = 0;    // lookups run again, the entries changing
+};
+
+/// Until @param is_done, one fresh MapView per query
+void RunReader(MainEngine &main_engine, int seed,
+               const std::atomic<bool> &is_done, ReaderResult &result) {
+  const uint kPointCount = 4096;
+  /// Around the room of SyntheticScene, in meters
+  const float kExtent = 3.0f;
+
+  VoxelQuery query;
+  query.Alloc(kPointCount);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> uniform(-kExtent, kExtent);
+  std::vector<float3> points(kPointCount);
+  std::vector<Voxel> voxels;
+  while (! is_done.load()) {
+    for (float3 &point : points) {
+      point = make_float3(uniform(rng), uniform(rng), uniform(rng));
+    }
+    MapView view = main_engine.PinMapView();
+    result.query_seconds.push_back(query.Run(view, points, voxels));
+    for (const Voxel &voxel : voxels) {
+      if (voxel.inv_sigma2 > 0) ++result.observed_count;
+    }
+    result.point_count += kPointCount;
+  }
+  result.retry_count = query.retry_count();
+  query.Free();
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "reader_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  const int kReaderCounts[] = {0, 1, 2, 4};
+
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args);
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("frames", kFrameCount)
+      .Key("configs").BeginArray();
+
+  for (int reader_count : kReaderCounts) {
+    LOG(INFO) << "Readers: " << reader_count;
+    /// Readers are all gone here
+    main_engine.Reset(true);
+
+    std::atomic<bool> is_done(false);
+    std::vector<ReaderResult> results(reader_count);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < reader_count; ++i) {
+      readers.emplace_back(RunReader, std::ref(main_engine), i,
+                           std::cref(is_done), std::ref(results[i]));
+    }
+
+    SyntheticScene scene(ROOM, 1, kFrameCount, config.sensor_params);
+    std::vector<double> frame_seconds;
+    cv::Mat color, depth;
+    float4x4 wTc;
+    while (scene.ProvideData(depth, color, wTc)) {
+      frame_seconds.push_back(
+          RunFrame(main_engine, sensor, depth, color, wTc));
+    }
+
+    is_done.store(true);
+    for (auto &reader : readers) {
+      reader.join();
+    }
+
+    std::vector<double> query_seconds;
+    long observed_count = 0, point_count = 0, retry_count = 0;
+    for (const ReaderResult &result : results) {
+      query_seconds.insert(query_seconds.end(),
+                           result.query_seconds.begin(),
+                           result.query_seconds.end());
+      observed_count += result.observed_count;
+      point_count += result.point_count;
+      retry_count += result.retry_count;
+    }
+
+    json.BeginObject()
+        .Field("readers", reader_count)
+        .Millis("frame_ms", Median(frame_seconds))
+        .Field("queries", query_seconds.size())
+        .Millis("query_ms", Median(query_seconds))
+        .Field("query_retries", retry_count)
+        .Field("observed_ratio",
+               point_count > 0 ? (double)observed_count / point_count : 0)
+        .EndObject();
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
@@ -0,0 +1,100 @@
+//
+// Created by wei on 18-2-3.
+//
+// Reset latency, and latency of the first frame after it,
+// for the full reset (every block cleared at once)
+// and the lazy one (blocks cleared when allocated again).
+// Results go to a JSON file, by default reset_benchmark.json.
+
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+/// The next frame of @param scene, as a session would start
+/// @return seconds, 0 past the last frame
+double RunSceneFrame(MainEngine &main_engine, Sensor &sensor,
+                     SyntheticScene &scene) {
+  cv::Mat color, depth;
+  float4x4 wTc;
+  if (! scene.ProvideData(depth, color, wTc)) return 0;
+  return RunFrame(main_engine, sensor, depth, color, wTc);
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "reset_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  /// Frames integrated before each reset, so that there is a map to drop
+  const int kFrameCount = BenchmarkFrameCount(args, 30);
+  const int kRepeatCount = 5;
+  /// Full reset, as before, then the lazy one
+  const bool kClearAlls[] = {true, false};
+
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args);
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("value_capacity", config.hash_params.value_capacity)
+      .Field("block_bytes", sizeof(Block))
+      .Field("max_vertex_count", config.mesh_params.max_vertex_count)
+      .Field("frames_before_reset", kFrameCount)
+      .Key("modes").BeginArray();
+
+  for (bool clear_all : kClearAlls) {
+    const char *mode = clear_all ? "full" : "lazy";
+    LOG(INFO) << "Reset mode " << mode;
+
+    std::vector<double> reset_seconds, first_frame_seconds,
+        steady_frame_seconds;
+    for (int r = 0; r < kRepeatCount; ++r) {
+      SyntheticScene scene(ROOM, 1, kFrameCount + 1, config.sensor_params);
+      /// Start from a clean pool every time, out of the measurement
+      main_engine.Reset(true);
+      for (int i = 0; i < kFrameCount; ++i) {
+        double seconds = RunSceneFrame(main_engine, sensor, scene);
+        if (i > 0) steady_frame_seconds.push_back(seconds);
+      }
+
+      Timer timer;
+      timer.Tick();
+      main_engine.Reset(clear_all);
+      reset_seconds.push_back(timer.Tock());
+
+      /// The first frame again: its blocks are the ones cleared lazily
+      SyntheticScene replay(ROOM, 1, 1, config.sensor_params);
+      first_frame_seconds.push_back(
+          RunSceneFrame(main_engine, sensor, replay));
+    }
+
+    json.BeginObject()
+        .Field("mode", mode)
+        .Millis("reset_ms", reset_seconds)
+        .Millis("first_frame_ms", first_frame_seconds)
+        .Millis("steady_frame_median_ms", Median(steady_frame_seconds))
+        .EndObject();
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
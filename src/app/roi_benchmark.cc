@@ -0,0 +1,130 @@
+//
+// Created by wei on 18-2-12.
+//
+// Mapping the synthetic room with and without a region of interest:
+// the ROI of synthetic.yml (enabled here whatever its enable says),
+// and the same box turned by 30 degrees about y. Walls, floor and
+// ceiling fall outside it.
+// Reports blocks and per-frame time, and what the ROI saves of both.
+// Results go to a JSON file, by default roi_benchmark.json.
+
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+struct RoiConfig {
+  const char *name;
+  bool        enable_roi;
+  float       rotation_y;   // (deg)
+};
+
+struct RoiResult {
+  uint   block_count = 0;
+  double blocks_per_frame = 0;   // allocated, on average
+  double alloc_ms = 0;
+  double update_ms = 0;
+  double frame_ms = 0;
+};
+
+RoiResult RunConfig(const ConfigManager &config, const RoiConfig &roi_config,
+                    const RuntimeParams &args, int frame_count) {
+  VolumeParams volume_params = config.sdf_params;
+  volume_params.enable_roi = roi_config.enable_roi;
+  volume_params.roi_rotation.y += roi_config.rotation_y;
+
+  MainEngine main_engine(
+      config.hash_params,
+      volume_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args, false);
+
+  SensorParams sensor_params = config.sensor_params;
+  Sensor sensor(sensor_params);
+  SyntheticScene scene(ROOM, 1, frame_count, sensor_params);
+  RoiResult result;
+  cv::Mat color, depth;
+  float4x4 wTc;
+  uint prev_block_count = 0;
+  int frames = 0;
+  while (scene.ProvideData(depth, color, wTc)) {
+    result.frame_ms +=
+        RunFrame(main_engine, sensor, depth, color, wTc) * 1000;
+
+    const MappingTimings &timings = main_engine.mapping_timings();
+    result.alloc_ms += timings.alloc * 1000;
+    result.update_ms += timings.update * 1000;
+    uint block_count = main_engine.block_count();
+    if (block_count > prev_block_count) {
+      result.blocks_per_frame += block_count - prev_block_count;
+    }
+    prev_block_count = block_count;
+    ++frames;
+  }
+  if (frames > 0) {
+    result.blocks_per_frame /= frames;
+    result.alloc_ms /= frames;
+    result.update_ms /= frames;
+    result.frame_ms /= frames;
+  }
+  result.block_count = main_engine.block_count();
+  return result;
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "roi_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  const RoiConfig kConfigs[] = {
+      {"none",        false, 0},
+      {"roi",         true,  0},
+      {"roi_rotated", true,  30}
+  };
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("frames", kFrameCount)
+      .Key("configs").BeginArray();
+
+  RoiResult baseline;
+  bool is_first_config = true;
+  for (const RoiConfig &roi_config : kConfigs) {
+    LOG(INFO) << "ROI: " << roi_config.name;
+    RoiResult result = RunConfig(config, roi_config, args, kFrameCount);
+    if (is_first_config) baseline = result;
+
+    json.BeginObject()
+        .Field("roi", roi_config.name)
+        .Field("blocks", result.block_count)
+        .Field("blocks_per_frame", result.blocks_per_frame)
+        .Field("alloc_ms", result.alloc_ms)
+        .Field("update_ms", result.update_ms)
+        .Field("frame_ms", result.frame_ms)
+        .Field("blocks_saved",
+               (long)baseline.block_count - (long)result.block_count)
+        .Field("blocks_per_frame_saved",
+               baseline.blocks_per_frame - result.blocks_per_frame)
+        .Field("frame_ms_saved", baseline.frame_ms - result.frame_ms)
+        .EndObject();
+    is_first_config = false;
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
@@ -0,0 +1,103 @@
+//
+// Created by wei on 18-2-11.
+//
+// Reads the mesh published by reconstruction or slam (publish_interval
+// in args.yml) from shared memory, as a visualization or planning
+// process would: every new version is pinned, its bounding box computed
+// in place, then released.
+// Latency is from the end of the publication to the pin, on the steady
+// clock both processes share.
+// Usage: shared_map_reader [name] [seconds] [output]
+// Results go to a JSON file, by default shared_map_reader.json.
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glog/logging.h>
+
+#include "app/benchmark_util.h"
+#include "io/shared_map.h"
+
+int main(int argc, char **argv) {
+  std::string name = argc > 1 ? argv[1] : "/mesh_hashing_map";
+  double seconds = argc > 2 ? atof(argv[2]) : 30;
+  std::string output_path = argc > 3 ? argv[3] : "shared_map_reader.json";
+
+  const std::chrono::microseconds kPollInterval(200);
+  auto deadline = std::chrono::steady_clock::now()
+                  + std::chrono::milliseconds((long)(seconds * 1000));
+
+  SharedMapReader reader;
+  while (! reader.Open(name)) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      LOG(WARNING) << "No shared map " << name;
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  LOG(INFO) << "Reading " << name;
+
+  std::vector<double> latency_ms, read_ms;
+  uint64_t last_version = 0;
+  long version_count = 0, missed_count = 0, torn_count = 0;
+  SharedMeshFrame frame;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (! reader.Acquire(last_version, frame)) {
+      std::this_thread::sleep_for(kPollInterval);
+      continue;
+    }
+    int64_t pin_ns = SharedMapClock();
+    latency_ms.push_back((pin_ns - frame.publish_ns) * 1e-6);
+    if (last_version > 0) {
+      missed_count += frame.version - last_version - 1;
+    }
+    last_version = frame.version;
+
+    float3 lower = make_float3(FLT_MAX, FLT_MAX, FLT_MAX);
+    float3 upper = make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint i = 0; i < frame.vertex_count; ++i) {
+      const float3 &v = frame.arrays.vertices[i];
+      lower = make_float3(std::min(lower.x, v.x), std::min(lower.y, v.y),
+                          std::min(lower.z, v.z));
+      upper = make_float3(std::max(upper.x, v.x), std::max(upper.y, v.y),
+                          std::max(upper.z, v.z));
+    }
+    uint nonempty_block_count = 0;
+    for (uint i = 0; i < frame.block_count; ++i) {
+      if (frame.arrays.blocks[i].triangle_count > 0) ++nonempty_block_count;
+    }
+
+    bool is_intact = reader.Release();
+    read_ms.push_back((SharedMapClock() - pin_ns) * 1e-6);
+    if (! is_intact) {
+      ++torn_count;
+      continue;
+    }
+    ++version_count;
+    LOG(INFO) << "Frame " << frame.frame << ": "
+              << frame.vertex_count << " vertices, "
+              << frame.triangle_count << " triangles, "
+              << nonempty_block_count << "/" << frame.block_count
+              << " blocks with triangles, within ("
+              << lower.x << " " << lower.y << " " << lower.z << ") ("
+              << upper.x << " " << upper.y << " " << upper.z << ")";
+  }
+  reader.Close();
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("versions", version_count)
+      .Field("missed", missed_count)
+      .Field("torn", torn_count)
+      .Field("latency_p50_ms", Percentile(latency_ms, 0.5))
+      .Field("latency_p99_ms", Percentile(latency_ms, 0.99))
+      .Field("latency_max_ms", Percentile(latency_ms, 1.0))
+      .Field("read_p50_ms", Percentile(read_ms, 0.5))
+      .EndObject();
+
+  LOG(INFO) << "Results written to " << output_path;
+  return 0;
+}
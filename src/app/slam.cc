@@ -18,7 +18,6 @@
 
 #include "util/timer.h"
 #include <queue>
-#include <engine/visualizing_engine.h>
 #include <io/mesh_writer.h>
 #include <meshing/marching_cubes.h>
 #include <visualization/compress_mesh.h>
@@ -29,7 +28,11 @@
 
 #include "io/config_manager.h"
 #include "core/collect_block_array.h"
+#include "util/profiler.h"
+#include "util/host_memory.h"
+#ifndef HEADLESS
 #include "glwrapper.h"
+#endif
 
 #include <sophus/se3.hpp>
 #define DEBUG_
@@ -54,40 +57,68 @@ int main(int argc, char **argv) {
       config.sdf_params,
       config.mesh_params,
       config.sensor_params,
-      config.ray_caster_params
+      config.ray_caster_params,
+      args.enable_lazy_commit
   );
 
   main_engine.ConfigMappingEngine(
       args.enable_bayesian_update
   );
 
-  gl::Light light;
-  light.Load("../config/lights.yaml");
-  main_engine.ConfigVisualizingEngine(
-      light,
-      args.enable_navigation,
-      args.enable_global_mesh,
-      args.enable_bounding_box,
-      args.enable_trajectory,
-      args.enable_polygon_mode,
-      args.enable_ray_casting,
-      args.enable_color
-  );
+#ifndef HEADLESS
+  if (! args.enable_headless) {
+    gl::Light light;
+    light.Load("../config/lights.yaml");
+    main_engine.ConfigVisualizingEngine(
+        light,
+        args.enable_navigation,
+        args.enable_global_mesh,
+        args.enable_bounding_box,
+        args.enable_trajectory,
+        args.enable_polygon_mode,
+        args.enable_ray_casting,
+        args.enable_color
+    );
+  }
+#endif
   main_engine.ConfigLoggingEngine(
       ".",
       args.enable_video_recording,
       args.enable_ply_saving
   );
+  if (args.enable_decimation) {
+    main_engine.ConfigMeshDecimation(
+        args.decimation_max_error,
+        args.decimation_triangle_ratio
+    );
+  }
 
   main_engine.enable_sdf_gradient() = args.enable_sdf_gradient;
+  main_engine.enable_surface_nets() = args.enable_surface_nets;
+  main_engine.enable_cpu_ray_casting() = args.enable_cpu_ray_casting;
+  SetHostPageMode((HostPageMode)args.host_page_mode);
+  main_engine.enable_morton_placement() = args.enable_morton_placement;
+  main_engine.defrag_interval() = args.defrag_interval;
+  main_engine.export_interval() = args.export_interval;
+  main_engine.eviction_occupancy() = args.eviction_occupancy;
+  main_engine.enable_eviction_spill() = args.enable_eviction_spill;
+  if (args.publish_interval > 0
+      && main_engine.ConfigMapPublisher(args.shared_map_name)) {
+    main_engine.publish_interval() = args.publish_interval;
+  }
 
   cv::Mat color, depth;
   float4x4 wTc, cTw;
   int frame_count = 0;
+  /// Per-frame time, including visualization unless headless
+  Timer frame_timer;
+  double total_frame_seconds = 0;
   while (rgbd_local_sequence.ProvideData(depth, color, wTc)) {
     frame_count++;
     if (args.run_frames > 0 && frame_count > args.run_frames)
       break;
+    frame_timer.Tick();
+    PROFILE_SCOPE("frame");
 
     // Preprocess data
     sensor.Process(depth, color);
@@ -106,6 +137,14 @@ int main(int argc, char **argv) {
     main_engine.Log();
     //main_engine.RecordBlocks();
     main_engine.Recycle();
+
+    double frame_seconds = frame_timer.Tock();
+    total_frame_seconds += frame_seconds;
+    LOG(INFO) << "Frame time: " << frame_seconds;
+  }
+  if (total_frame_seconds > 0) {
+    LOG(INFO) << "Average frame rate: "
+              << main_engine.frame_count() / total_frame_seconds << " fps";
   }
 
   main_engine.FinalLog();
@@ -0,0 +1,99 @@
+//
+// Created by wei on 18-2-9.
+//
+// Frame time with periodic exports of the map: none, the synchronous
+// RecordBlocks (a compaction, then a copy of the allocated blocks, on the
+// mapping thread), and the copy-on-write snapshot written on a background
+// thread.
+// Raw blocks go to ./Blocks, which has to exist.
+// Results go to a JSON file, by default snapshot_benchmark.json.
+
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+enum ExportMode {
+  NO_EXPORT = 0,
+  SYNC_EXPORT = 1,
+  SNAPSHOT_EXPORT = 2
+};
+
+const char* ExportModeName(ExportMode mode) {
+  switch (mode) {
+    case SYNC_EXPORT:     return "record_blocks";
+    case SNAPSHOT_EXPORT: return "snapshot";
+    default:              return "none";
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "snapshot_benchmark.json";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  const int kExportInterval = 20;
+  const ExportMode kModes[] = {NO_EXPORT, SYNC_EXPORT, SNAPSHOT_EXPORT};
+
+  MainEngine main_engine(
+      config.hash_params,
+      config.sdf_params,
+      config.mesh_params,
+      config.sensor_params,
+      config.ray_caster_params
+  );
+  ConfigBenchmarkEngine(main_engine, args);
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("frames", kFrameCount)
+      .Field("export_interval", kExportInterval)
+      .Key("modes").BeginArray();
+
+  for (ExportMode mode : kModes) {
+    LOG(INFO) << "Export mode " << ExportModeName(mode);
+    main_engine.Reset(true);
+    main_engine.export_interval() =
+        mode == SNAPSHOT_EXPORT ? kExportInterval : 0;
+
+    SyntheticScene scene(ROOM, 1, kFrameCount, config.sensor_params);
+    std::vector<double> frame_seconds;
+    cv::Mat color, depth;
+    float4x4 wTc;
+    while (scene.ProvideData(depth, color, wTc)) {
+      double seconds = RunFrame(main_engine, sensor, depth, color, wTc);
+      if (mode == SYNC_EXPORT
+          && main_engine.frame_count() % kExportInterval == 0) {
+        Timer timer;
+        timer.Tick();
+        main_engine.RecordBlocks("record_");
+        seconds += timer.Tock();
+      }
+      frame_seconds.push_back(seconds);
+    }
+    main_engine.WaitForExport();
+
+    json.BeginObject()
+        .Field("mode", ExportModeName(mode))
+        .Millis("frame_p50_ms", Percentile(frame_seconds, 0.5))
+        .Millis("frame_p99_ms", Percentile(frame_seconds, 0.99))
+        .Millis("frame_max_ms", Percentile(frame_seconds, 1.0))
+        .EndObject();
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
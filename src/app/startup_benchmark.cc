@@ -0,0 +1,101 @@
+//
+// Created by wei on 18-2-4.
+//
+// Startup latency and GPU memory of MainEngine, with the block pool
+// committed at once and lazily, then the first frames of a synthetic room
+// that pay for the lazy commits.
+// Results go to a JSON file, by default startup_benchmark.json.
+
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+#include "helper_cuda.h"
+
+/// Device memory in use by the whole process
+size_t GPUUsedBytes() {
+  size_t free_bytes, total_bytes;
+  checkCudaErrors(cudaMemGetInfo(&free_bytes, &total_bytes));
+  return total_bytes - free_bytes;
+}
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "startup_benchmark.json";
+  const double kMB = 1024.0 * 1024.0;
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 30);
+  /// Everything committed in the constructor, as before, then lazily
+  const bool kLazyCommits[] = {false, true};
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("value_capacity", config.hash_params.value_capacity)
+      .Field("block_bytes", sizeof(Block))
+      .Field("frames", kFrameCount)
+      .Key("modes").BeginArray();
+
+  for (bool enable_lazy_commit : kLazyCommits) {
+    const char *mode = enable_lazy_commit ? "lazy" : "eager";
+    LOG(INFO) << "Commit mode " << mode;
+
+    size_t base_bytes = GPUUsedBytes();
+    Timer timer;
+    timer.Tick();
+    /// Scoped: the engine frees its pools before the next mode
+    {
+      MainEngine main_engine(
+          config.hash_params,
+          config.sdf_params,
+          config.mesh_params,
+          config.sensor_params,
+          config.ray_caster_params,
+          enable_lazy_commit
+      );
+      double startup_seconds = timer.Tock();
+      size_t startup_bytes = GPUUsedBytes() - base_bytes;
+
+      ConfigBenchmarkEngine(main_engine, args);
+
+      SyntheticScene scene(ROOM, 1, kFrameCount, config.sensor_params);
+      std::vector<double> frame_seconds;
+      cv::Mat color, depth;
+      float4x4 wTc;
+      while (scene.ProvideData(depth, color, wTc)) {
+        frame_seconds.push_back(
+            RunFrame(main_engine, sensor, depth, color, wTc));
+      }
+      size_t final_bytes = GPUUsedBytes() - base_bytes;
+      const std::vector<MemoryUsage> &memory_usages =
+          main_engine.UpdateMemoryUsage();
+
+      json.BeginObject()
+          .Field("mode", mode)
+          .Millis("startup_ms", startup_seconds)
+          .Field("startup_resident_mb", startup_bytes / kMB)
+          .Field("final_resident_mb", final_bytes / kMB)
+          .Millis("frame_ms", frame_seconds)
+          .Key("committed_mb").BeginObject();
+      for (const MemoryUsage &usage : memory_usages) {
+        json.Field(usage.name, usage.committed_bytes / kMB);
+      }
+      json.EndObject().EndObject();
+    }
+  }
+  json.EndArray().EndObject();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
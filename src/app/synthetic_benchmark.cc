@@ -0,0 +1,203 @@
+//
+// Created by wei on 18-1-31.
+//
+// Dataset-free benchmark: every synthetic scene is reconstructed
+// at several scales and block placements, timing each stage per frame.
+// Results go to a JSON file, by default synthetic_benchmark.json.
+//
+// Usage: synthetic_benchmark [output.json [scene [placement [scale]]]]
+// runs only the matching runs, "all" by default. The frames of each run,
+// before its defragmentation, are bracketed by cudaProfilerStart/Stop:
+// profile_cache_hit_rates.py profiles them with --profile-from-start off
+// to report the L2 and texture hit rates of each placement.
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <cuda_profiler_api.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "app/benchmark_util.h"
+#include "util/timer.h"
+#include "engine/main_engine.h"
+#include "sensor/rgbd_sensor.h"
+#include "sensor/synthetic_scene.h"
+#include "io/config_manager.h"
+
+/// Per-frame seconds of one stage
+struct StageSamples {
+  std::string name;
+  std::vector<double> seconds;
+
+  void WriteJson(JsonWriter &json) const {
+    json.Key(name).BeginObject();
+    if (! seconds.empty()) {
+      json.Millis("total_ms", Mean(seconds) * seconds.size())
+          .Millis("mean_ms", Mean(seconds))
+          .Millis("p50_ms", Percentile(seconds, 0.50))
+          .Millis("p95_ms", Percentile(seconds, 0.95))
+          .Millis("max_ms", Percentile(seconds, 1.0));
+    }
+    json.EndObject();
+  }
+};
+
+int main(int argc, char **argv) {
+  std::string output_path = argc > 1 ? argv[1] : "synthetic_benchmark.json";
+  std::string scene_filter = argc > 2 ? argv[2] : "all";
+  std::string placement_filter = argc > 3 ? argv[3] : "all";
+  std::string scale_filter = argc > 4 ? argv[4] : "all";
+
+  RuntimeParams args;
+  ConfigManager config;
+  LoadBenchmarkConfig(args, config);
+  Sensor sensor(config.sensor_params);
+
+  const int kFrameCount = BenchmarkFrameCount(args, 100);
+  const SyntheticSceneType kScenes[] = {ROOM, SPHERES, CORRIDOR};
+  const float kScales[] = {1, 2, 3};
+  /// Heap order, or Morton order of the block positions
+  const bool kMortonPlacements[] = {false, true};
+  RayCaster ray_caster(config.ray_caster_params);
+
+  JsonWriter json(output_path);
+  json.BeginObject()
+      .Field("voxel_size", config.sdf_params.voxel_size)
+      .Field("frames", kFrameCount)
+      .Field("bayesian_update", args.enable_bayesian_update)
+      .Field("surface_nets", args.enable_surface_nets)
+      .Key("runs").BeginArray();
+
+  for (SyntheticSceneType scene_type : kScenes) {
+    for (float scale : kScales) {
+      for (bool enable_morton_placement : kMortonPlacements) {
+        const char *placement = enable_morton_placement ? "morton" : "heap";
+        if ((scene_filter != "all"
+             && scene_filter != SyntheticScene::name(scene_type))
+            || (placement_filter != "all" && placement_filter != placement)
+            || (scale_filter != "all"
+                && std::atof(scale_filter.c_str()) != scale)) {
+          continue;
+        }
+        LOG(INFO) << "Scene " << SyntheticScene::name(scene_type)
+                  << ", scale " << scale << ", placement " << placement;
+        SyntheticScene scene(scene_type, scale, kFrameCount,
+                             config.sensor_params);
+
+        MainEngine main_engine(
+            config.hash_params,
+            config.sdf_params,
+            config.mesh_params,
+            config.sensor_params,
+            config.ray_caster_params
+        );
+        ConfigBenchmarkEngine(main_engine, args);
+        main_engine.enable_morton_placement() = enable_morton_placement;
+
+        StageSamples render{"render"}, preprocess{"preprocess"},
+            alloc{"alloc"}, collect{"collect"}, update{"update"},
+            meshing{"meshing"}, raycast{"raycast"}, recycle{"recycle"};
+
+        cv::Mat color, depth;
+        float4x4 wTc;
+        Timer timer, run_timer;
+        double run_seconds = 0;
+        checkCudaErrors(cudaProfilerStart());
+        while (true) {
+          timer.Tick();
+          if (! scene.ProvideData(depth, color, wTc)) break;
+          render.seconds.push_back(timer.Tock());
+
+          /// Synthesis is not part of the pipeline
+          run_timer.Tick();
+          timer.Tick();
+          sensor.Process(depth, color);
+          sensor.set_transform(wTc);
+          preprocess.seconds.push_back(timer.Tock());
+
+          main_engine.Mapping(sensor);
+          const MappingTimings &timings = main_engine.mapping_timings();
+          alloc.seconds.push_back(timings.alloc);
+          collect.seconds.push_back(timings.collect);
+          update.seconds.push_back(timings.update);
+
+          timer.Tick();
+          main_engine.Meshing();
+          meshing.seconds.push_back(timer.Tock());
+
+          timer.Tick();
+          main_engine.Recycle();
+          recycle.seconds.push_back(timer.Tock());
+          run_seconds += run_timer.Tock();
+
+          /// As the visualizer would, outside the frame rate
+          raycast.seconds.push_back(
+              main_engine.RayCast(ray_caster, wTc.getInverse()));
+        }
+
+        timer.Tick();
+        main_engine.CompressGlobalMesh();
+        double compress_seconds = timer.Tock();
+        double final_raycast_seconds =
+            main_engine.RayCast(ray_caster, wTc.getInverse());
+        /// Profiled kernels are the ones of this placement only
+        checkCudaErrors(cudaProfilerStop());
+
+        /// Same map, blocks re-sorted in Morton order
+        double defrag_seconds = main_engine.Defragment();
+        timer.Tick();
+        main_engine.CompressGlobalMesh();
+        double defrag_compress_seconds = timer.Tock();
+        double defrag_raycast_seconds =
+            main_engine.RayCast(ray_caster, wTc.getInverse());
+
+        timer.Tick();
+        main_engine.SaveGlobalMesh();
+        double export_seconds = timer.Tock();
+
+        uint2 mesh_stats = main_engine.mesh_stats();
+        const std::vector<MemoryUsage> &memory_usages =
+            main_engine.UpdateMemoryUsage();
+
+        json.BeginObject()
+            .Field("scene", SyntheticScene::name(scene_type))
+            .Field("scale", scale)
+            .Field("placement", placement)
+            .Field("frames", main_engine.frame_count())
+            .Field("fps", run_seconds > 0
+                          ? main_engine.frame_count() / run_seconds : 0)
+            .Key("stages").BeginObject();
+        for (const StageSamples *stage : {&render, &preprocess,
+                                          &alloc, &collect, &update,
+                                          &meshing, &raycast, &recycle}) {
+          stage->WriteJson(json);
+        }
+        json.EndObject()
+            .Millis("compress_ms", compress_seconds)
+            .Millis("export_ms", export_seconds)
+            .Millis("final_raycast_ms", final_raycast_seconds)
+            .Millis("defrag_ms", defrag_seconds)
+            .Millis("defrag_compress_ms", defrag_compress_seconds)
+            .Millis("defrag_raycast_ms", defrag_raycast_seconds)
+            .Field("vertices", mesh_stats.x)
+            .Field("triangles", mesh_stats.y)
+            .Key("memory_bytes").BeginObject();
+        for (const MemoryUsage &usage : memory_usages) {
+          json.Key(usage.name).BeginObject()
+              .Field("reserved", usage.reserved_bytes)
+              .Field("committed", usage.committed_bytes)
+              .Field("peak", usage.peak_bytes)
+              .EndObject();
+        }
+        json.EndObject().EndObject();
+      }
+    }
+  }
+  json.EndArray().EndObject();
+  ray_caster.Free();
+
+  LOG(INFO) << "Benchmark written to " << output_path;
+  return 0;
+}
@@ -7,6 +7,7 @@
 
 #include "core/common.h"
 #include "core/voxel.h"
+#include "core/mesh_chunk.h"
 
 #include <helper_math.h>
 
@@ -16,25 +17,43 @@ struct __ALIGN__(8) Block {
   int inner_surfel_count;
   int boundary_surfel_count;
   int life_count_down;
+  int modified_frame;   // last frame its voxels were written, -1 if never
+  int last_observed_frame;  // last frame it was in the frustum, -1 if never
+
+  MeshChunk vertex_chunk;
+  MeshChunk triangle_chunk;
 
   Voxel voxels[BLOCK_SIZE];
   MeshUnit mesh_units[BLOCK_SIZE];
   PrimalDualVariables primal_dual_variables[BLOCK_SIZE];
 
   __host__ __device__
-  void Clear() {
+  void ClearHeader() {
     inner_surfel_count = 0;
     boundary_surfel_count = 0;
     life_count_down = BLOCK_LIFE;
+    modified_frame = -1;
+    last_observed_frame = -1;
+    vertex_chunk.Clear();
+    triangle_chunk.Clear();
+  }
+
+  __host__ __device__
+  void ClearVoxel(int i) {
+    voxels[i].Clear();
+    mesh_units[i].Clear();
+    primal_dual_variables[i].Clear();
+  }
+
+  __host__ __device__
+  void Clear() {
+    ClearHeader();
 
 #ifdef __CUDA_ARCH__ // __CUDA_ARCH__ is only defined for __device__
 #pragma unroll 8
 #endif
     for (int i = 0; i < BLOCK_SIZE; ++i) {
-
-      voxels[i].Clear();
-      mesh_units[i].Clear();
-      primal_dual_variables[i].Clear();
+      ClearVoxel(i);
     }
   }
 };
@@ -1,6 +1,9 @@
 #include "core/block_array.h"
 #include "helper_cuda.h"
 
+#include <algorithm>
+#include <glog/logging.h>
+
 #include <device_launch_parameters.h>
 
 ////////////////////
@@ -9,18 +12,24 @@
 __global__
 void BlockArrayResetKernel(
     Block* blocks,
-    int block_count
+    uint* generations,
+    int block_count,
+    uint generation
 ) {
   const uint block_idx = blockIdx.x * blockDim.x + threadIdx.x;
 
   if (block_idx < block_count) {
     blocks[block_idx].Clear();
+    generations[block_idx] = generation;
   }
 }
 
 ////////////////////
 /// Host code
 //////////////////////
+/// Blocks committed at a time: 32 MB
+const uint kCommitGranularity = 1024;
+
 __host__
 BlockArray::BlockArray(uint block_count) {
   Resize(block_count);
@@ -32,9 +41,18 @@ BlockArray::BlockArray(uint block_count) {
 
 __host__
 void BlockArray::Alloc(uint block_count) {
+  Alloc(block_count, block_count);
+}
+
+__host__
+void BlockArray::Alloc(uint block_count, uint committed_count) {
   if (! is_allocated_on_gpu_) {
     block_count_ = block_count;
-    checkCudaErrors(cudaMalloc(&blocks_, sizeof(Block) * block_count));
+    committed_count_ = std::min(committed_count, block_count);
+    checkCudaErrors(cudaMalloc(&blocks_,
+                               sizeof(Block) * committed_count_));
+    checkCudaErrors(cudaMalloc(&generations_,
+                               sizeof(uint) * committed_count_));
     is_allocated_on_gpu_ = true;
   }
 }
@@ -43,34 +61,111 @@ __host__
 void BlockArray::Free() {
   if (is_allocated_on_gpu_) {
     checkCudaErrors(cudaFree(blocks_));
+    checkCudaErrors(cudaFree(generations_));
     block_count_ = 0;
+    committed_count_ = 0;
     blocks_ = NULL;
+    generations_ = NULL;
     is_allocated_on_gpu_ = false;
   }
 }
 
 __host__
 void BlockArray::Resize(uint block_count) {
+  Resize(block_count, block_count);
+}
+
+__host__
+void BlockArray::Resize(uint block_count, uint committed_count) {
   if (is_allocated_on_gpu_) {
     Free();
   }
-  Alloc(block_count);
+  Alloc(block_count, committed_count);
   Reset();
 }
 
+__host__
+void BlockArray::Commit(uint block_count,
+                        std::vector<void*> *retired_buffers) {
+  if (block_count <= committed_count_) return;
+
+  /// Grow by half at least, so that the copies sum up to O(block_count)
+  uint committed_count = std::max(block_count,
+                                  committed_count_ + committed_count_ / 2);
+  committed_count = (committed_count + kCommitGranularity - 1)
+                    / kCommitGranularity * kCommitGranularity;
+  committed_count = std::min(committed_count, block_count_);
+
+  /// The old arrays and the new ones are held at once: if the slack
+  /// does not fit, grow to what is needed only, and fail with a message
+  /// rather than in cudaMalloc
+  size_t free_bytes, total_bytes;
+  checkCudaErrors(cudaMemGetInfo(&free_bytes, &total_bytes));
+  const size_t kSlotBytes = sizeof(Block) + sizeof(uint);
+  if (kSlotBytes * committed_count > free_bytes) {
+    committed_count = std::min(block_count_,
+                               (block_count + kCommitGranularity - 1)
+                               / kCommitGranularity * kCommitGranularity);
+  }
+  CHECK(kSlotBytes * committed_count <= free_bytes)
+      << "Out of GPU memory to grow the blocks from " << committed_count_
+      << " to " << committed_count << ": " << free_bytes
+      << " bytes free. Commit them all at start (enable_lazy_commit = false)"
+      << " or lower value_capacity";
+
+  Block *blocks;
+  uint  *generations;
+  checkCudaErrors(cudaMalloc(&blocks, sizeof(Block) * committed_count));
+  checkCudaErrors(cudaMalloc(&generations, sizeof(uint) * committed_count));
+  checkCudaErrors(cudaMemcpy(blocks, blocks_,
+                             sizeof(Block) * committed_count_,
+                             cudaMemcpyDeviceToDevice));
+  checkCudaErrors(cudaMemcpy(generations, generations_,
+                             sizeof(uint) * committed_count_,
+                             cudaMemcpyDeviceToDevice));
+  if (retired_buffers != NULL) {
+    retired_buffers->push_back(blocks_);
+    retired_buffers->push_back(generations_);
+  } else {
+    checkCudaErrors(cudaFree(blocks_));
+    checkCudaErrors(cudaFree(generations_));
+  }
+  blocks_ = blocks;
+  generations_ = generations;
+
+  uint prev_committed_count = committed_count_;
+  committed_count_ = committed_count;
+  Reset(prev_committed_count, committed_count_);
+  LOG(INFO) << "Blocks committed: " << prev_committed_count
+            << " -> " << committed_count_ << " / " << block_count_;
+}
+
 __host__
 void BlockArray::Reset() {
+  Reset(0, committed_count_);
+}
+
+__host__
+void BlockArray::Reset(uint begin, uint end) {
   const uint threads_per_block = 64;
 
-  if (block_count_ == 0) return;
+  if (end > committed_count_) end = committed_count_;
+  if (begin >= end) return;
+  uint count = end - begin;
 
   // NOTE: this block is the parallel unit in CUDA, not the data structure Block
-  const uint blocks = (block_count_ + threads_per_block - 1) / threads_per_block;
+  const uint blocks = (count + threads_per_block - 1) / threads_per_block;
 
   const dim3 grid_size(blocks, 1);
   const dim3 block_size(threads_per_block, 1);
 
-  BlockArrayResetKernel<<<grid_size, block_size>>>(blocks_, block_count_);
+  BlockArrayResetKernel<<<grid_size, block_size>>>(
+      blocks_ + begin, generations_ + begin, count, generation_);
   checkCudaErrors(cudaDeviceSynchronize());
   checkCudaErrors(cudaGetLastError());
-}
\ No newline at end of file
+}
+
+__host__
+void BlockArray::ResetLazily() {
+  ++generation_;
+}
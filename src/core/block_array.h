@@ -5,6 +5,7 @@
 #ifndef CORE_BLOCK_ARRAY_H
 #define CORE_BLOCK_ARRAY_H
 
+#include <vector>
 #include "core/block.h"
 
 // Pre-allocated blocks to store the map
@@ -22,10 +23,44 @@ public:
   //__host__ ~BlockArray();
 
   __host__ void Alloc(uint block_count);
+  // Room for @param block_count blocks, of which only
+  // @param committed_count are allocated on the GPU; Commit() adds more
+  __host__ void Alloc(uint block_count, uint committed_count);
   __host__ void Resize(uint block_count);
+  __host__ void Resize(uint block_count, uint committed_count);
   __host__ void Free();
 
+  // Grow the allocated prefix to hold at least @param block_count blocks,
+  // with some slack. Blocks move: kernels get the new pointer with
+  // the next copy of the BlockArray. New blocks are cleared
+  // @param retired_buffers if not NULL, the previous arrays are appended
+  // there instead of freed, for copies still read by other threads
+  __host__ void Commit(uint block_count,
+                       std::vector<void*> *retired_buffers = NULL);
+  __host__ __device__ uint committed_count() const {
+    return committed_count_;
+  }
+
   __host__ void Reset();
+  // Clear the blocks in [begin, end) only
+  __host__ void Reset(uint begin, uint end);
+  // O(1): start a new generation. Blocks of older generations are
+  // stale, and cleared when allocated again
+  __host__ void ResetLazily();
+
+  __device__ bool is_stale(uint i) const {
+    return generations_[i] != generation_;
+  }
+  __device__ void set_fresh(uint i) {
+    generations_[i] = generation_;
+  }
+  // Moved along with block @param i when it changes slot
+  __device__ uint generation(uint i) const {
+    return generations_[i];
+  }
+  __device__ void set_generation(uint i, uint generation) {
+    generations_[i] = generation;
+  }
 
   __host__ __device__ Block& operator[] (uint i) {
     return blocks_[i];
@@ -37,12 +72,19 @@ public:
   __host__ Block* GetGPUPtr() const{
     return blocks_;
   }
+  __host__ uint* GetGenerationGPUPtr() const {
+    return generations_;
+  }
 private:
   bool is_allocated_on_gpu_ = false;
   // @param array
   Block*  blocks_;
+  // @param array, generation in which each block was last cleared
+  uint*   generations_;
   // @param const element
   uint    block_count_;
+  uint    committed_count_;
+  uint    generation_ = 0;
 };
 
 #endif // CORE_BLOCK_ARRAY_H
@@ -0,0 +1,475 @@
+//
+// Created by wei on 18-2-2.
+//
+
+#include <algorithm>
+#include <vector>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+
+#include "util/timer.h"
+#include "util/host_memory.h"
+#include "core/block_placement.h"
+
+namespace {
+/// Blocks gathered on the GPU per copy to the host
+const uint kDefragBatchSize = 1024;
+
+/// Spread the lower 21 bits of @param v to every third bit
+unsigned long long SpreadBits3(unsigned long long v) {
+  v &= 0x1fffff;
+  v = (v | (v << 32)) & 0x1f00000000ffffull;
+  v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+  v = (v | (v << 8))  & 0x100f00f00f00f00full;
+  v = (v | (v << 4))  & 0x10c30c30c30c30c3ull;
+  v = (v | (v << 2))  & 0x1249249249249249ull;
+  return v;
+}
+
+/// Coordinates are biased to be positive, so that the order
+/// does not break at the origin
+unsigned long long MortonCode(const int3 &pos) {
+  const int kBias = 1 << 20;
+  return SpreadBits3((unsigned long long)(pos.x + kBias))
+         | (SpreadBits3((unsigned long long)(pos.y + kBias)) << 1)
+         | (SpreadBits3((unsigned long long)(pos.z + kBias)) << 2);
+}
+
+/// Candidate entries of blocks recycled since they were collected
+/// point to the first free slot once the blocks are moved:
+/// a clear block, as before the move
+int FreeSlot(uint allocated_count, uint value_capacity) {
+  return allocated_count < value_capacity ? (int)allocated_count : FREE_ENTRY;
+}
+
+/// @return indices of @param entries in Morton order
+std::vector<uint> MortonOrder(const std::vector<HashEntry> &entries) {
+  std::vector<unsigned long long> codes(entries.size());
+  std::vector<uint> order(entries.size());
+  for (uint i = 0; i < entries.size(); ++i) {
+    codes[i] = MortonCode(entries[i].pos);
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&codes](uint a, uint b) {
+    return codes[a] < codes[b];
+  });
+  return order;
+}
+}
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void FlagHeapSlotsKernel(
+    HashTable hash_table,
+    uchar *slot_flags,
+    uint   heap_begin,
+    uint   count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx < count) {
+    slot_flags[hash_table.heap(heap_begin + idx)] = 1;
+  }
+}
+
+__global__
+void CollectEntriesKernel(
+    HashTable    hash_table,
+    const uchar *slot_flags,
+    uint        *entry_indices,
+    HashEntry   *entries,
+    uint        *counter
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= hash_table.entry_count) return;
+
+  const HashEntry& entry = hash_table.entry(idx);
+  if (! hash_table.IsLive(entry)) return;
+  if (slot_flags != NULL && slot_flags[entry.ptr] == 0) return;
+
+  uint addr = atomicAdd(counter, 1);
+  entry_indices[addr] = idx;
+  entries[addr] = entry;
+}
+
+__global__
+void AssignPtrsKernel(
+    HashTable   hash_table,
+    const uint *entry_indices,
+    const int  *ptrs,
+    uint        count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx < count) {
+    hash_table.entry(entry_indices[idx]).ptr = ptrs[idx];
+  }
+}
+
+__global__
+void RemapEntryArrayKernel(
+    EntryArray candidate_entries,
+    const int *slot_remap,
+    uint       count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx < count && candidate_entries[idx].ptr != FREE_ENTRY) {
+    candidate_entries[idx].ptr = slot_remap[candidate_entries[idx].ptr];
+  }
+}
+
+/// One thread block per Block, copied word by word, with its generation
+__global__
+void GatherBlocksKernel(
+    BlockArray blocks,
+    const int *ptrs,
+    Block     *gathered_blocks,
+    uint      *gathered_generations
+) {
+  const int *src = (const int *)&blocks[ptrs[blockIdx.x]];
+  int *dst = (int *)&gathered_blocks[blockIdx.x];
+  for (uint i = threadIdx.x; i < sizeof(Block) / sizeof(int);
+       i += blockDim.x) {
+    dst[i] = src[i];
+  }
+  if (threadIdx.x == 0) {
+    gathered_generations[blockIdx.x] = blocks.generation(ptrs[blockIdx.x]);
+  }
+}
+
+/// One thread block per move; sources and destinations are disjoint
+__global__
+void MoveBlocksKernel(
+    BlockArray blocks,
+    const int *src_ptrs,
+    const int *dst_ptrs
+) {
+  const int *src = (const int *)&blocks[src_ptrs[blockIdx.x]];
+  int *dst = (int *)&blocks[dst_ptrs[blockIdx.x]];
+  for (uint i = threadIdx.x; i < sizeof(Block) / sizeof(int);
+       i += blockDim.x) {
+    dst[i] = src[i];
+  }
+  if (threadIdx.x == 0) {
+    blocks.set_generation(dst_ptrs[blockIdx.x],
+                          blocks.generation(src_ptrs[blockIdx.x]));
+  }
+}
+
+/// Cleared now: fresh in the current generation
+__global__
+void ClearBlocksKernel(
+    BlockArray blocks,
+    const int *ptrs,
+    uint       count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx < count) {
+    blocks[ptrs[idx]].Clear();
+    blocks.set_fresh(ptrs[idx]);
+  }
+}
+
+////////////////////
+/// Host code
+////////////////////
+void BlockPlacement::Alloc(const HashParams &params) {
+  if (! is_allocated_on_gpu_) {
+    value_capacity_ = params.value_capacity;
+    checkCudaErrors(cudaMalloc(&slot_flags_,
+                               sizeof(uchar) * value_capacity_));
+    checkCudaErrors(cudaMemset(slot_flags_, 0,
+                               sizeof(uchar) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&slot_remap_,
+                               sizeof(int) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&entry_indices_,
+                               sizeof(uint) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&entries_,
+                               sizeof(HashEntry) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&ptrs_,
+                               sizeof(int) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&counter_, sizeof(uint)));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+void BlockPlacement::Free() {
+  if (is_allocated_on_gpu_) {
+    checkCudaErrors(cudaFree(slot_flags_));
+    checkCudaErrors(cudaFree(slot_remap_));
+    checkCudaErrors(cudaFree(entry_indices_));
+    checkCudaErrors(cudaFree(entries_));
+    checkCudaErrors(cudaFree(ptrs_));
+    checkCudaErrors(cudaFree(counter_));
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+uint BlockPlacement::CollectEntries(HashTable &hash_table,
+                                    const uchar *slot_flags) {
+  checkCudaErrors(cudaMemset(counter_, 0, sizeof(uint)));
+
+  const uint threads_per_block = 256;
+  const dim3 grid_size((hash_table.entry_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  CollectEntriesKernel<<<grid_size, block_size>>>(
+      hash_table, slot_flags, entry_indices_, entries_, counter_);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  uint count;
+  checkCudaErrors(cudaMemcpy(&count, counter_, sizeof(uint),
+                             cudaMemcpyDeviceToHost));
+  return std::min(count, value_capacity_);
+}
+
+double BlockPlacement::SortAllocatedBlocks(
+    HashTable &hash_table,
+    uint prev_allocated_count
+) {
+  Timer timer;
+  timer.Tick();
+
+  uint allocated_count = hash_table.allocated_count();
+  if (allocated_count <= prev_allocated_count + 1) return timer.Tock();
+  uint new_count = allocated_count - prev_allocated_count;
+
+  /// The heap counter went down from value_capacity - 1 - prev_allocated_count:
+  /// the slots handed out are right above it
+  const uint threads_per_block = 64;
+  {
+    const dim3 grid_size((new_count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    FlagHeapSlotsKernel<<<grid_size, block_size>>>(
+        hash_table, slot_flags_,
+        value_capacity_ - allocated_count, new_count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+  }
+
+  uint count = CollectEntries(hash_table, slot_flags_);
+  std::vector<HashEntry> entries(count);
+  checkCudaErrors(cudaMemcpy(entries.data(), entries_,
+                             sizeof(HashEntry) * count,
+                             cudaMemcpyDeviceToHost));
+
+  /// The lowest slot to the first block in Morton order, and so on
+  std::vector<int> slots(count);
+  for (uint i = 0; i < count; ++i) {
+    slots[i] = entries[i].ptr;
+  }
+  std::sort(slots.begin(), slots.end());
+  std::vector<uint> order = MortonOrder(entries);
+  std::vector<int> ptrs(count);
+  for (uint r = 0; r < count; ++r) {
+    ptrs[order[r]] = slots[r];
+  }
+
+  if (count > 0) {
+    checkCudaErrors(cudaMemcpy(ptrs_, ptrs.data(), sizeof(int) * count,
+                               cudaMemcpyHostToDevice));
+    const dim3 grid_size((count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    AssignPtrsKernel<<<grid_size, block_size>>>(
+        hash_table, entry_indices_, ptrs_, count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+  }
+
+  checkCudaErrors(cudaMemset(slot_flags_, 0,
+                             sizeof(uchar) * value_capacity_));
+  return timer.Tock();
+}
+
+double BlockPlacement::Defragment(
+    HashTable &hash_table,
+    BlockArray &blocks,
+    EntryArray &candidate_entries
+) {
+  Timer timer;
+  timer.Tick();
+
+  uint count = CollectEntries(hash_table, NULL);
+  std::vector<HashEntry> entries(count);
+  checkCudaErrors(cudaMemcpy(entries.data(), entries_,
+                             sizeof(HashEntry) * count,
+                             cudaMemcpyDeviceToHost));
+
+  /// r-th block in Morton order moves from src_ptrs[r] to r
+  std::vector<uint> order = MortonOrder(entries);
+  std::vector<int> src_ptrs(count), dst_ptrs(count);
+  std::vector<int> slot_remap(value_capacity_, FreeSlot(count, value_capacity_));
+  for (uint r = 0; r < count; ++r) {
+    src_ptrs[r] = entries[order[r]].ptr;
+    dst_ptrs[order[r]] = r;
+    slot_remap[src_ptrs[r]] = r;
+  }
+
+  if (count > 0) {
+    /// 1. Gather in the new order, to the host
+    Block *block_cpu = (Block*)AllocHostPages(sizeof(Block) * count);
+    CHECK(block_cpu != NULL) << "Out of host memory for the blocks!";
+    std::vector<uint> generations(count);
+    Block *block_batch_gpu;
+    uint  *generation_batch_gpu;
+    checkCudaErrors(cudaMalloc(&block_batch_gpu,
+                               sizeof(Block) * kDefragBatchSize));
+    checkCudaErrors(cudaMalloc(&generation_batch_gpu,
+                               sizeof(uint) * kDefragBatchSize));
+    checkCudaErrors(cudaMemcpy(ptrs_, src_ptrs.data(), sizeof(int) * count,
+                               cudaMemcpyHostToDevice));
+    for (uint begin = 0; begin < count; begin += kDefragBatchSize) {
+      uint batch_size = std::min(kDefragBatchSize, count - begin);
+      GatherBlocksKernel<<<batch_size, 256>>>(
+          blocks, ptrs_ + begin, block_batch_gpu, generation_batch_gpu);
+      checkCudaErrors(cudaDeviceSynchronize());
+      checkCudaErrors(cudaGetLastError());
+      checkCudaErrors(cudaMemcpy(block_cpu + begin, block_batch_gpu,
+                                 sizeof(Block) * batch_size,
+                                 cudaMemcpyDeviceToHost));
+      checkCudaErrors(cudaMemcpy(generations.data() + begin,
+                                 generation_batch_gpu,
+                                 sizeof(uint) * batch_size,
+                                 cudaMemcpyDeviceToHost));
+    }
+    checkCudaErrors(cudaFree(block_batch_gpu));
+    checkCudaErrors(cudaFree(generation_batch_gpu));
+
+    /// 2. Back to the front of the array; the rest is free
+    checkCudaErrors(cudaMemcpy(blocks.GetGPUPtr(), block_cpu,
+                               sizeof(Block) * count,
+                               cudaMemcpyHostToDevice));
+    checkCudaErrors(cudaMemcpy(blocks.GetGenerationGPUPtr(),
+                               generations.data(),
+                               sizeof(uint) * count,
+                               cudaMemcpyHostToDevice));
+    FreeHostPages(block_cpu, sizeof(Block) * count);
+  }
+  blocks.Reset(count, value_capacity_);
+
+  /// 3. Entries point to the new slots
+  UpdatePtrs(hash_table, candidate_entries, dst_ptrs, slot_remap);
+  hash_table.ResetHeap(count);
+
+  double seconds = timer.Tock();
+  LOG(INFO) << "Defragmented " << count << " blocks in "
+            << seconds * 1000 << " ms";
+  return seconds;
+}
+
+double BlockPlacement::Compact(
+    HashTable &hash_table,
+    BlockArray &blocks,
+    EntryArray &candidate_entries
+) {
+  Timer timer;
+  timer.Tick();
+
+  uint count = CollectEntries(hash_table, NULL);
+  std::vector<HashEntry> entries(count);
+  checkCudaErrors(cudaMemcpy(entries.data(), entries_,
+                             sizeof(HashEntry) * count,
+                             cudaMemcpyDeviceToHost));
+
+  std::vector<int> ptrs(count);
+  std::vector<int> slot_remap(value_capacity_, FreeSlot(count, value_capacity_));
+  std::vector<uchar> is_occupied(count, 0);
+  for (uint i = 0; i < count; ++i) {
+    ptrs[i] = entries[i].ptr;
+    if ((uint)ptrs[i] < count) is_occupied[ptrs[i]] = 1;
+    slot_remap[ptrs[i]] = ptrs[i];
+  }
+
+  /// Blocks beyond the prefix go to the holes in it, as many as them
+  std::vector<int> src_ptrs, dst_ptrs;
+  uint hole = 0;
+  for (uint i = 0; i < count; ++i) {
+    if ((uint)ptrs[i] < count) continue;
+    while (hole < count && is_occupied[hole]) ++hole;
+    if (hole == count) break;  /// only if two entries share a block
+    is_occupied[hole] = 1;
+    src_ptrs.push_back(ptrs[i]);
+    dst_ptrs.push_back(hole);
+    slot_remap[ptrs[i]] = hole;
+    ptrs[i] = hole;
+  }
+
+  uint move_count = (uint)src_ptrs.size();
+  if (move_count > 0) {
+    int *src_ptrs_gpu, *dst_ptrs_gpu;
+    checkCudaErrors(cudaMalloc(&src_ptrs_gpu, sizeof(int) * move_count));
+    checkCudaErrors(cudaMalloc(&dst_ptrs_gpu, sizeof(int) * move_count));
+    checkCudaErrors(cudaMemcpy(src_ptrs_gpu, src_ptrs.data(),
+                               sizeof(int) * move_count,
+                               cudaMemcpyHostToDevice));
+    checkCudaErrors(cudaMemcpy(dst_ptrs_gpu, dst_ptrs.data(),
+                               sizeof(int) * move_count,
+                               cudaMemcpyHostToDevice));
+
+    MoveBlocksKernel<<<move_count, 256>>>(blocks, src_ptrs_gpu, dst_ptrs_gpu);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+
+    /// Free slots are expected to be clear
+    const uint threads_per_block = 64;
+    const dim3 grid_size((move_count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    ClearBlocksKernel<<<grid_size, block_size>>>(
+        blocks, src_ptrs_gpu, move_count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+
+    checkCudaErrors(cudaFree(src_ptrs_gpu));
+    checkCudaErrors(cudaFree(dst_ptrs_gpu));
+
+    UpdatePtrs(hash_table, candidate_entries, ptrs, slot_remap);
+  }
+
+  hash_table.ResetHeap(count);
+
+  double seconds = timer.Tock();
+  LOG(INFO) << "Compacted " << count << " blocks, " << move_count
+            << " moved, in " << seconds * 1000 << " ms";
+  return seconds;
+}
+
+void BlockPlacement::UpdatePtrs(
+    HashTable &hash_table,
+    EntryArray &candidate_entries,
+    const std::vector<int> &ptrs,
+    const std::vector<int> &slot_remap
+) {
+  const uint threads_per_block = 64;
+
+  uint count = (uint)ptrs.size();
+  if (count > 0) {
+    checkCudaErrors(cudaMemcpy(ptrs_, ptrs.data(), sizeof(int) * count,
+                               cudaMemcpyHostToDevice));
+    const dim3 grid_size((count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    AssignPtrsKernel<<<grid_size, block_size>>>(
+        hash_table, entry_indices_, ptrs_, count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+  }
+
+  uint candidate_count = candidate_entries.count();
+  if (candidate_count > 0) {
+    checkCudaErrors(cudaMemcpy(slot_remap_, slot_remap.data(),
+                               sizeof(int) * value_capacity_,
+                               cudaMemcpyHostToDevice));
+    const dim3 grid_size((candidate_count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    RemapEntryArrayKernel<<<grid_size, block_size>>>(
+        candidate_entries, slot_remap_, candidate_count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+  }
+}
@@ -0,0 +1,74 @@
+//
+// Created by wei on 18-2-2.
+//
+// Placement of blocks in the BlockArray by the Morton code
+// of their positions, so that neighboring blocks, read together
+// by voxel queries, marching cubes and ray casting, are close in memory.
+
+#ifndef CORE_BLOCK_PLACEMENT_H
+#define CORE_BLOCK_PLACEMENT_H
+
+#include <vector>
+#include "core/hash_table.h"
+#include "core/block_array.h"
+#include "core/entry_array.h"
+
+class BlockPlacement {
+public:
+  BlockPlacement() = default;
+  void Alloc(const HashParams &params);
+  void Free();
+
+  // @function
+  // Exchange the heap slots taken by the AllocEntry calls since
+  // @param prev_allocated_count, so that they follow the Morton order
+  // of the block positions. New blocks are all clear: no copy.
+  // @return seconds
+  double SortAllocatedBlocks(HashTable &hash_table,
+                             uint prev_allocated_count);
+
+  // @function
+  // Move every allocated block to [0, allocated count) in Morton order,
+  // rewriting the ptr of the entries in @param hash_table
+  // and in @param candidate_entries. Blocks are staged on the host:
+  // call it offline or when idle.
+  // @return seconds
+  double Defragment(HashTable &hash_table,
+                    BlockArray &blocks,
+                    EntryArray &candidate_entries);
+
+  // @function
+  // Move the allocated blocks above the allocated count into the holes
+  // below it, so that they fill [0, allocated count) and snapshots copy
+  // only that prefix. Fewer moves than Defragment, and all on the GPU.
+  // @return seconds
+  double Compact(HashTable &hash_table,
+                 BlockArray &blocks,
+                 EntryArray &candidate_entries);
+
+private:
+  /// Entries with an allocated block into entry_indices_ and entries_
+  /// @param slot_flags if not NULL, only those whose block is flagged
+  uint CollectEntries(HashTable &hash_table, const uchar *slot_flags);
+  /// After blocks moved: @param ptrs per collected entry,
+  /// @param slot_remap from old to new slot, FREE_ENTRY if not allocated
+  void UpdatePtrs(HashTable &hash_table,
+                  EntryArray &candidate_entries,
+                  const std::vector<int> &ptrs,
+                  const std::vector<int> &slot_remap);
+
+  bool is_allocated_on_gpu_ = false;
+  uint value_capacity_;
+
+  // @param array, per block slot
+  uchar     *slot_flags_;
+  int       *slot_remap_;
+  // @param array, per allocated block
+  uint      *entry_indices_;
+  HashEntry *entries_;
+  int       *ptrs_;
+  // @param read-write element
+  uint      *counter_;
+};
+
+#endif //CORE_BLOCK_PLACEMENT_H
@@ -0,0 +1,94 @@
+//
+// Created by wei on 18-2-15.
+//
+
+#include <algorithm>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+
+#include "core/block_work_queue.h"
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void FillBlockWorkQueueKernel(
+    EntryArray candidate_entries,
+    BlockArray blocks,
+    HashEntry *entries,
+    uint      *front_counter,
+    uint      *back_counter,
+    uint       count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= count) return;
+
+  const HashEntry &entry = candidate_entries[idx];
+  const Block &block = blocks[entry.ptr];
+  bool is_surface = block.inner_surfel_count > 0
+                    || block.boundary_surfel_count > 0;
+  uint addr = is_surface
+              ? atomicAdd(front_counter, 1)
+              : count - 1 - atomicAdd(back_counter, 1);
+  entries[addr] = entry;
+}
+
+////////////////////
+/// Host code
+////////////////////
+void BlockWorkQueue::Alloc(const HashParams &params) {
+  if (! is_allocated_on_gpu_) {
+    entry_count_ = params.entry_count;
+    checkCudaErrors(cudaMalloc(&entries_,
+                               sizeof(HashEntry) * entry_count_));
+    checkCudaErrors(cudaMalloc(&counters_,
+                               sizeof(uint) * kCounterCount));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+void BlockWorkQueue::Free() {
+  if (is_allocated_on_gpu_) {
+    checkCudaErrors(cudaFree(entries_));
+    checkCudaErrors(cudaFree(counters_));
+    count_ = 0;
+    surface_count_ = 0;
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+uint BlockWorkQueue::Fill(EntryArray &candidate_entries, BlockArray &blocks) {
+  count_ = std::min(candidate_entries.count(), entry_count_);
+  checkCudaErrors(cudaMemset(counters_, 0, sizeof(uint) * kCounterCount));
+  if (count_ == 0) {
+    surface_count_ = 0;
+    return 0;
+  }
+
+  const uint threads_per_block = 256;
+  const dim3 grid_size((count_ + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  FillBlockWorkQueueKernel<<<grid_size, block_size>>>(
+      candidate_entries, blocks, entries_,
+      &counters_[kFront], &counters_[kBack], count_);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  checkCudaErrors(cudaMemcpy(&surface_count_, &counters_[kFront],
+                             sizeof(uint), cudaMemcpyDeviceToHost));
+  return count_;
+}
+
+uint BlockWorkQueue::PersistentGridSize(const void *kernel,
+                                        uint threads_per_block) {
+  int device, sm_count, blocks_per_sm;
+  checkCudaErrors(cudaGetDevice(&device));
+  checkCudaErrors(cudaDeviceGetAttribute(
+      &sm_count, cudaDevAttrMultiProcessorCount, device));
+  checkCudaErrors(cudaOccupancyMaxActiveBlocksPerMultiprocessor(
+      &blocks_per_sm, kernel, threads_per_block, 0));
+  uint resident_count = (uint)std::max(1, blocks_per_sm * sm_count);
+  return std::max(1u, std::min(count_, resident_count));
+}
@@ -0,0 +1,89 @@
+//
+// Created by wei on 18-2-15.
+//
+// Work queue of the per-block kernels. One CUDA block per candidate block
+// balances badly: an empty block exits at once, a surface block probes
+// the hash table for every voxel, and the grid waits on its slowest
+// blocks. Instead as many CUDA blocks as fit on the device stay resident
+// and pop candidate blocks until the queue is drained, the blocks meshed
+// in the last pass first, so that the long ones do not start last.
+// Garbage collection and compaction do the same work for every block,
+// so they keep one CUDA block per candidate block.
+
+#ifndef CORE_BLOCK_WORK_QUEUE_H
+#define CORE_BLOCK_WORK_QUEUE_H
+
+#include "core/common.h"
+#include "core/params.h"
+#include "core/hash_entry.h"
+#include "core/block_array.h"
+#include "core/entry_array.h"
+
+class BlockWorkQueue {
+public:
+  BlockWorkQueue() = default;
+  void Alloc(const HashParams &params);
+  void Free();
+
+  // @function
+  // Queue the blocks of @param candidate_entries: those with surfels in
+  // @param blocks, i.e. meshed in the last pass, first, then the others.
+  // Rewinds the queue, call it before each kernel that drains it.
+  // @return queued count
+  uint Fill(EntryArray &candidate_entries, BlockArray &blocks);
+
+  // @function
+  // CUDA blocks of @param kernel with @param threads_per_block threads
+  // resident on the device at once, at most one per queued block
+  uint PersistentGridSize(const void *kernel, uint threads_per_block);
+
+  uint surface_count() const {
+    return surface_count_;
+  }
+
+  __host__ __device__
+  uint count() const {
+    return count_;
+  }
+
+#ifdef __CUDACC__
+  __device__
+  const HashEntry& operator [] (uint i) const {
+    return entries_[i];
+  }
+
+  /// Called by every thread of a CUDA block, after it is done with its
+  /// last block: the index of its next one, count() once drained
+  __device__
+  uint Pop() {
+    __shared__ uint index;
+    __syncthreads();
+    if (threadIdx.x == 0) {
+      index = atomicAdd(&counters_[kNext], 1);
+    }
+    __syncthreads();
+    return index;
+  }
+#endif
+
+private:
+  /// counters_: front and back ends filled, and the next block to pop
+  enum {
+    kFront = 0,
+    kBack = 1,
+    kNext = 2,
+    kCounterCount = 3
+  };
+
+  bool is_allocated_on_gpu_ = false;
+  uint entry_count_;
+  uint count_ = 0;
+  uint surface_count_ = 0;
+
+  // @param array
+  HashEntry *entries_;
+  // @param read-write elements, kCounterCount
+  uint      *counters_;
+};
+
+#endif //CORE_BLOCK_WORK_QUEUE_H
@@ -0,0 +1,133 @@
+//
+// Created by wei on 18-1-15.
+//
+
+#include "core/chunk_heap.h"
+
+#include <algorithm>
+#include <device_launch_parameters.h>
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void ChunkHeapReleaseRetiredKernel(
+    ChunkHeap chunk_heap,
+    uint retired_count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (idx < retired_count) {
+    int2 chunk = chunk_heap.retired_chunk(idx);
+    chunk_heap.FreeChunk(chunk.x, chunk.y);
+  }
+}
+
+////////////////////
+/// Host code
+////////////////////
+__host__
+void ChunkHeap::Alloc(uint element_count) {
+  if (! is_allocated_on_gpu_) {
+    slab_count_ = element_count / MESH_SLAB_SIZE;
+
+    /// Class k holds at most (slab_count >> k) chunks
+    free_list_size_ = 0;
+    for (int k = 0; k < MESH_CHUNK_CLASSES; ++k) {
+      free_list_offsets_[k] = free_list_size_;
+      free_list_size_ += (slab_count_ >> k) + 1;
+    }
+
+    checkCudaErrors(cudaMalloc(&bump_counter_, sizeof(uint)));
+    checkCudaErrors(cudaMalloc(&free_counters_,
+                               sizeof(int) * MESH_CHUNK_CLASSES));
+    checkCudaErrors(cudaMalloc(&retired_counter_, sizeof(int)));
+    checkCudaErrors(cudaMalloc(&free_lists_,
+                               sizeof(int) * free_list_size_));
+    checkCudaErrors(cudaMalloc(&retired_chunks_,
+                               sizeof(int2) * (slab_count_ + 1)));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+__host__
+void ChunkHeap::Free() {
+  if (is_allocated_on_gpu_) {
+    checkCudaErrors(cudaFree(bump_counter_));
+    checkCudaErrors(cudaFree(free_counters_));
+    checkCudaErrors(cudaFree(retired_counter_));
+    checkCudaErrors(cudaFree(free_lists_));
+    checkCudaErrors(cudaFree(retired_chunks_));
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+__host__
+void ChunkHeap::Resize(uint element_count) {
+  if (is_allocated_on_gpu_) {
+    Free();
+  }
+  Alloc(element_count);
+  Reset();
+}
+
+/// No need to touch the lists: counters tell what is valid
+__host__
+void ChunkHeap::Reset() {
+  checkCudaErrors(cudaMemset(bump_counter_, 0, sizeof(uint)));
+  checkCudaErrors(cudaMemset(free_counters_, 0,
+                             sizeof(int) * MESH_CHUNK_CLASSES));
+  checkCudaErrors(cudaMemset(retired_counter_, 0, sizeof(int)));
+}
+
+__host__
+void ChunkHeap::ReleaseRetired() {
+  int retired_count;
+  checkCudaErrors(cudaMemcpy(&retired_count, retired_counter_,
+                             sizeof(int), cudaMemcpyDeviceToHost));
+  if (retired_count <= 0) return;
+
+  const uint threads_per_block = 256;
+  const dim3 grid_size((retired_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  ChunkHeapReleaseRetiredKernel<<<grid_size, block_size>>>(
+      *this, retired_count);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  checkCudaErrors(cudaMemset(retired_counter_, 0, sizeof(int)));
+}
+
+/// Same sizes as Alloc
+__host__
+size_t ChunkHeap::MetaBytes(uint element_count) {
+  uint slab_count = element_count / MESH_SLAB_SIZE;
+  size_t free_list_size = 0;
+  for (int k = 0; k < MESH_CHUNK_CLASSES; ++k) {
+    free_list_size += (slab_count >> k) + 1;
+  }
+  return sizeof(uint)
+         + sizeof(int) * MESH_CHUNK_CLASSES
+         + sizeof(int)
+         + sizeof(int) * free_list_size
+         + sizeof(int2) * (slab_count + 1);
+}
+
+__host__
+uint ChunkHeap::used_count() {
+  uint bump_count;
+  int  free_counts[MESH_CHUNK_CLASSES];
+  checkCudaErrors(cudaMemcpy(&bump_count, bump_counter_,
+                             sizeof(uint), cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaMemcpy(free_counts, free_counters_,
+                             sizeof(int) * MESH_CHUNK_CLASSES,
+                             cudaMemcpyDeviceToHost));
+
+  long used_slabs = std::min(bump_count, slab_count_);
+  for (int k = 0; k < MESH_CHUNK_CLASSES; ++k) {
+    used_slabs -= (long)free_counts[k] << k;
+  }
+  return (uint)std::max(used_slabs, 0l) * MESH_SLAB_SIZE;
+}
@@ -0,0 +1,107 @@
+//
+// Created by wei on 18-1-15.
+//
+
+#ifndef CORE_CHUNK_HEAP_H
+#define CORE_CHUNK_HEAP_H
+
+#include "core/common.h"
+#include "core/mesh_chunk.h"
+
+#include <helper_cuda.h>
+
+// Slab allocator handing out contiguous chunks of a pool
+// with power-of-two sizes (in slabs of MESH_SLAB_SIZE elements).
+// - Fresh chunks are cut from the top of the pool by a bump counter;
+// - Freed chunks go to a per size-class free list and are reused first.
+// Alloc and Free must NOT be issued in the same kernel:
+// kernels that allocate should Retire old chunks instead,
+// and ReleaseRetired() frees them afterwards.
+class ChunkHeap {
+public:
+  __host__ ChunkHeap() = default;
+  // __host__ ~ChunkHeap();
+
+  __host__ void Alloc(uint element_count);
+  __host__ void Resize(uint element_count);
+  __host__ void Free();
+  __host__ void Reset();
+
+  __host__ void ReleaseRetired();
+
+  // Elements held by chunks in use, including their unused tails
+  __host__ uint used_count();
+  __host__ uint capacity() const {
+    return slab_count_ * MESH_SLAB_SIZE;
+  }
+  // Bytes of the lists and counters of a heap of @param element_count
+  __host__ static size_t MetaBytes(uint element_count);
+
+  // @return the smallest size class holding @param count elements,
+  //         -1 if @param count is too large for any chunk
+  __host__ __device__
+  static int SizeClass(int count) {
+    int size_class = 0;
+    while (size_class < MESH_CHUNK_CLASSES
+           && (MESH_SLAB_SIZE << size_class) < count) {
+      ++size_class;
+    }
+    return size_class < MESH_CHUNK_CLASSES ? size_class : -1;
+  }
+
+private:
+  bool is_allocated_on_gpu_ = false;
+  // @param const element
+  uint  slab_count_;
+  uint  free_list_offsets_[MESH_CHUNK_CLASSES];
+  uint  free_list_size_;
+  // @param read-write element
+  uint *bump_counter_;      /// slabs cut from the pool, may overshoot
+  int  *free_counters_;     /// one per size class
+  int  *retired_counter_;
+  // @param array
+  int  *free_lists_;        /// chunk ptrs, concatenated for all classes
+  int2 *retired_chunks_;    /// (ptr, size_class) freed after a kernel
+
+#ifdef __CUDACC__
+public:
+  // @return element offset of the chunk, FREE_PTR if exhausted
+  __device__
+  int AllocChunk(int size_class) {
+    int free_count = atomicSub(&free_counters_[size_class], 1);
+    if (free_count > 0) {
+      return free_lists_[free_list_offsets_[size_class] + free_count - 1];
+    }
+    atomicAdd(&free_counters_[size_class], 1);
+
+    /// Never roll the bump counter back: concurrent allocations may
+    /// have been served past our range
+    uint slabs = 1u << size_class;
+    uint slab = atomicAdd(bump_counter_, slabs);
+    if (slab + slabs > slab_count_) {
+      printf("Mesh chunk heap exhausted! class %d\n", size_class);
+      return FREE_PTR;
+    }
+    return slab * MESH_SLAB_SIZE;
+  }
+
+  __device__
+  void FreeChunk(int ptr, int size_class) {
+    int free_count = atomicAdd(&free_counters_[size_class], 1);
+    free_lists_[free_list_offsets_[size_class] + free_count] = ptr;
+  }
+
+  __device__
+  void RetireChunk(int ptr, int size_class) {
+    int addr = atomicAdd(retired_counter_, 1);
+    retired_chunks_[addr] = make_int2(ptr, size_class);
+  }
+
+  __device__
+  int2& retired_chunk(uint i) {
+    return retired_chunks_[i];
+  }
+#endif // __CUDACC__
+};
+
+#endif // CORE_CHUNK_HEAP_H
@@ -21,7 +21,7 @@
 /// class MappingEngine - compress, recycle
 ////////////////////
 
-/// Condition: IsBlockInCameraFrustum
+/// Condition: IsBlockInCameraFrustum and IsBlockInRoi
 __global__
 void CollectBlocksInFrustumKernel(
     HashTable hash_table,
@@ -38,9 +38,10 @@ void CollectBlocksInFrustumKernel(
 
   int addr_local = -1;
   if (idx < hash_table.entry_count
-    && hash_table.entry(idx).ptr != FREE_ENTRY
+    && hash_table.IsLive(hash_table.entry(idx))
     && geometry_helper.IsBlockInCameraFrustum(c_T_w, hash_table.entry(idx).pos,
-                                        sensor_params)) {
+                                        sensor_params)
+    && geometry_helper.IsBlockInRoi(hash_table.entry(idx).pos)) {
     addr_local = atomicAdd(&local_counter, 1);
   }
   __syncthreads();
@@ -71,7 +72,7 @@ void CollectAllBlocksKernel(
 
   int addr_local = -1;
   if (idx < hash_table.entry_count
-      && hash_table.entry(idx).ptr != FREE_ENTRY) {
+      && hash_table.IsLive(hash_table.entry(idx))) {
     addr_local = atomicAdd(&local_counter, 1);
   }
 
@@ -90,6 +91,41 @@ void CollectAllBlocksKernel(
   }
 }
 
+/// Condition: modified_frame > since_frame
+__global__
+void CollectBlocksModifiedSinceKernel(
+    HashTable hash_table,
+    BlockArray blocks,
+    int since_frame,
+    EntryArray candidate_entries
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+  __shared__ int local_counter;
+  if (threadIdx.x == 0) local_counter = 0;
+  __syncthreads();
+
+  int addr_local = -1;
+  if (idx < hash_table.entry_count
+      && hash_table.IsLive(hash_table.entry(idx))
+      && blocks[hash_table.entry(idx).ptr].modified_frame > since_frame) {
+    addr_local = atomicAdd(&local_counter, 1);
+  }
+  __syncthreads();
+
+  __shared__ int addr_global;
+  if (threadIdx.x == 0 && local_counter > 0) {
+    addr_global = atomicAdd(&candidate_entries.counter(),
+                            local_counter);
+  }
+  __syncthreads();
+
+  if (addr_local != -1) {
+    const uint addr = addr_global + addr_local;
+    candidate_entries[addr] = hash_table.entry(idx);
+  }
+}
+
 ////////////////////
 /// Host code
 ///////////////////
@@ -150,3 +186,28 @@ double CollectBlocksInFrustum(
   return timer.Tock();
 }
 
+void CollectBlocksModifiedSince(
+    HashTable &hash_table,
+    BlockArray &blocks,
+    int since_frame,
+    EntryArray &candidate_entries
+) {
+  const uint threads_per_block = 256;
+
+  uint entry_count = hash_table.entry_count;
+  const dim3 grid_size((entry_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  candidate_entries.reset_count();
+  CollectBlocksModifiedSinceKernel <<<grid_size, block_size >>>(
+      hash_table,
+      blocks,
+      since_frame,
+      candidate_entries);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  LOG(INFO) << "Block count modified since frame " << since_frame << ": "
+            << candidate_entries.count();
+}
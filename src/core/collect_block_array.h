@@ -7,6 +7,7 @@
 
 #include "core/entry_array.h"
 #include "core/hash_table.h"
+#include "core/block_array.h"
 #include "sensor/rgbd_sensor.h"
 #include "geometry/geometry_helper.h"
 
@@ -30,4 +31,15 @@ double CollectBlocksInFrustum(
     EntryArray &candidate_entries
 );
 
+// @function
+// Read the entries in @param hash_table
+// Filter the blocks written after @param since_frame
+// Write to the @param candidate_entries
+void CollectBlocksModifiedSince(
+    HashTable &hash_table,
+    BlockArray &blocks,
+    int since_frame,
+    EntryArray &candidate_entries
+);
+
 #endif //CORE_COLLECT_H
@@ -59,6 +59,10 @@ typedef signed char schar;
 #define N_VERTEX    3
 #define N_TRIANGLE  5
 
+/// Mesh chunks: each block owns a run of (1 << size_class) slabs
+#define MESH_SLAB_SIZE     32
+#define MESH_CHUNK_CLASSES 8
+
 #define EPSILON    1e-6
 
 //#define STATS
@@ -12,12 +12,13 @@ struct __ALIGN__(8) HashEntry {
   int3	pos;		   // block position (lower left corner of SDFBlock))
   int		ptr;	     // pointer into heap to SDFBlock
   uint	offset;		 // offset for linked lists
+  uint	generation;	 // table generation it was written in, in the padding
 
   __device__
   void operator=(const struct HashEntry& e) {
     ((long long*)this)[0] = ((const long long*)&e)[0];
     ((long long*)this)[1] = ((const long long*)&e)[1];
-    ((int*)this)[4]       = ((const int*)&e)[4];
+    ((long long*)this)[2] = ((const long long*)&e)[2];
   }
 
   __device__
@@ -25,6 +26,7 @@ struct __ALIGN__(8) HashEntry {
     pos    = make_int3(0);
     ptr    = FREE_ENTRY;
     offset = 0;
+    generation = 0;
   }
 };
 
@@ -0,0 +1,99 @@
+//
+// Created by wei on 18-2-1.
+//
+// Block position -> bucket index.
+// The table uses TeschnerHash; the others are alternatives
+// compared by the hash table benchmark.
+
+#ifndef CORE_HASH_FUNCTION_H
+#define CORE_HASH_FUNCTION_H
+
+#include "helper_math.h"
+#include "core/common.h"
+
+enum HashFunctionType {
+  TESCHNER_HASH = 0,  /// XOR of coordinates times large primes
+  MORTON_HASH = 1,    /// interleaved coordinate bits, locality preserving
+  MURMUR_HASH = 2     /// Murmur3 finalizer over a weighted sum
+};
+
+//! see Teschner et al. (but with correct prime values)
+/// Unsigned arithmetic: same buckets as the signed version, no overflow
+__host__ __device__
+inline uint TeschnerHash(const int3& pos, uint bucket_count) {
+  const uint p0 = 73856093;
+  const uint p1 = 19349669;
+  const uint p2 = 83492791;
+
+  return (((uint)pos.x * p0) ^ ((uint)pos.y * p1) ^ ((uint)pos.z * p2))
+         % bucket_count;
+}
+
+/// Spread the lower 10 bits of @param v to every third bit
+__host__ __device__
+inline uint SpreadBits3(uint v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8))  & 0x0300f00f;
+  v = (v | (v << 4))  & 0x030c30c3;
+  v = (v | (v << 2))  & 0x09249249;
+  return v;
+}
+
+/// Neighboring blocks fall into neighboring buckets;
+/// coordinates wrap every 1024 blocks
+__host__ __device__
+inline uint MortonHash(const int3& pos, uint bucket_count) {
+  return (SpreadBits3((uint)pos.x)
+          | (SpreadBits3((uint)pos.y) << 1)
+          | (SpreadBits3((uint)pos.z) << 2)) % bucket_count;
+}
+
+__host__ __device__
+inline uint MurmurHash(const int3& pos, uint bucket_count) {
+  uint h = (uint)pos.x * 0x9e3779b1u
+           + (uint)pos.y * 0x85ebca77u
+           + (uint)pos.z * 0xc2b2ae3du;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h % bucket_count;
+}
+
+__host__ __device__
+inline uint HashBucket(const int3& pos, uint bucket_count,
+                       HashFunctionType type) {
+  switch (type) {
+    case MORTON_HASH: return MortonHash(pos, bucket_count);
+    case MURMUR_HASH: return MurmurHash(pos, bucket_count);
+    default:          return TeschnerHash(pos, bucket_count);
+  }
+}
+
+inline const char* HashFunctionName(HashFunctionType type) {
+  switch (type) {
+    case TESCHNER_HASH: return "teschner";
+    case MORTON_HASH:   return "morton";
+    case MURMUR_HASH:   return "murmur";
+  }
+  return "unknown";
+}
+
+/// Block positions as keys of host hash maps, with the primes of the table
+struct Int3Hash {
+  size_t operator()(const int3 &pos) const {
+    return ((uint)pos.x * 73856093u)
+           ^ ((uint)pos.y * 19349669u)
+           ^ ((uint)pos.z * 83492791u);
+  }
+};
+
+struct Int3Equal {
+  bool operator()(const int3 &a, const int3 &b) const {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+};
+
+#endif //CORE_HASH_FUNCTION_H
@@ -18,18 +18,6 @@ void HashTableResetBucketMutexesKernel(
   }
 }
 
-__global__
-void HashTableResetHeapKernel(
-    uint *heap,
-    uint value_capacity
-) {
-  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
-
-  if (idx < value_capacity) {
-    heap[idx] = value_capacity - idx - 1;
-  }
-}
-
 __global__
 void HashTableResetEntriesKernel(
     HashEntry *entries,
@@ -66,6 +54,8 @@ void HashTable::Alloc(const HashParams &params) {
     /// Values
     checkCudaErrors(cudaMalloc(&heap_,
                                sizeof(uint) * params.value_capacity));
+    checkCudaErrors(cudaMalloc(&heap_generations_,
+                               sizeof(uint) * params.value_capacity));
     checkCudaErrors(cudaMalloc(&heap_counter_,
                                sizeof(uint)));
 
@@ -77,12 +67,29 @@ void HashTable::Alloc(const HashParams &params) {
     checkCudaErrors(cudaMalloc(&bucket_mutexes_,
                                sizeof(int) * params.bucket_count));
     is_allocated_on_gpu_ = true;
+
+    /// The only full clear: generation 0 is older than any Reset
+    generation_ = 0;
+    heap_generation_ = 0;
+    checkCudaErrors(cudaMemset(heap_generations_, 0,
+                               sizeof(uint) * params.value_capacity));
+    ResetMutexes();
+
+    const int threads_per_block = 64;
+    const dim3 grid_size((entry_count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+
+    HashTableResetEntriesKernel <<<grid_size, block_size>>>(entries_, entry_count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
   }
 }
 
 void HashTable::Free() {
   if (is_allocated_on_gpu_) {
     checkCudaErrors(cudaFree(heap_));
+    checkCudaErrors(cudaFree(heap_generations_));
     checkCudaErrors(cudaFree(heap_counter_));
 
     checkCudaErrors(cudaFree(entries_));
@@ -92,43 +99,44 @@ void HashTable::Free() {
   }
 }
 
+/// The heap counter starts at value_capacity - 1 and counts down
+uint HashTable::allocated_count() {
+  uint heap_counter;
+  checkCudaErrors(cudaMemcpy(&heap_counter, heap_counter_,
+                             sizeof(uint), cudaMemcpyDeviceToHost));
+  return value_capacity - 1 - heap_counter;
+}
+
+void HashTable::DownloadEntries(std::vector<HashEntry> &entries) {
+  entries.resize(entry_count);
+  checkCudaErrors(cudaMemcpy(entries.data(), entries_,
+                             sizeof(HashEntry) * entry_count,
+                             cudaMemcpyDeviceToHost));
+  for (HashEntry &entry : entries) {
+    if (! IsLive(entry)) entry.ptr = FREE_ENTRY;
+  }
+}
+
 void HashTable::Resize(const HashParams &params) {
   Alloc(params);
   Reset();
 }
 /// Reset
+/// Mutexes are reset before every kernel that locks them
 void HashTable::Reset() {
-  /// Reset mutexes
-  ResetMutexes();
-
-  {
-    /// Reset entries
-    const int threads_per_block = 64;
-    const dim3 grid_size((entry_count + threads_per_block - 1)
-                         / threads_per_block, 1);
-    const dim3 block_size(threads_per_block, 1);
-
-    HashTableResetEntriesKernel <<<grid_size, block_size>>>(entries_, entry_count);
-    checkCudaErrors(cudaDeviceSynchronize());
-    checkCudaErrors(cudaGetLastError());
-  }
-
-  {
-    /// Reset allocated memory
-    uint heap_counter_init = value_capacity - 1;
-    checkCudaErrors(cudaMemcpy(heap_counter_, &heap_counter_init,
-                               sizeof(uint),
-                               cudaMemcpyHostToDevice));
-
-    const int threads_per_block = 64;
-    const dim3 grid_size((value_capacity + threads_per_block - 1)
-                         / threads_per_block, 1);
-    const dim3 block_size(threads_per_block, 1);
+  ++generation_;
+  ResetHeap(0);
+}
 
-    HashTableResetHeapKernel <<<grid_size, block_size>>>(heap_, value_capacity);
-    checkCudaErrors(cudaDeviceSynchronize());
-    checkCudaErrors(cudaGetLastError());
-  }
+/// The heap counter starts at value_capacity - 1 - allocated_count
+/// and counts down, handing out allocated_count, allocated_count + 1, ...
+/// A new heap generation reads every element as value_capacity - 1 - i
+void HashTable::ResetHeap(uint allocated_count) {
+  ++heap_generation_;
+  uint heap_counter_init = value_capacity - 1 - allocated_count;
+  checkCudaErrors(cudaMemcpy(heap_counter_, &heap_counter_init,
+                             sizeof(uint),
+                             cudaMemcpyHostToDevice));
 }
 
 void HashTable::ResetMutexes() {
@@ -5,12 +5,14 @@
 #ifndef CORE_HASH_TABLE_H
 #define CORE_HASH_TABLE_H
 
+#include <vector>
 #include "helper_cuda.h"
 #include "helper_math.h"
 
 #include "core/common.h"
 #include "core/params.h"
 #include "core/hash_entry.h"
+#include "core/hash_function.h"
 #include "geometry/geometry_helper.h"
 
 class HashTable {
@@ -29,12 +31,30 @@ public:
   __host__ void Free();
 
   __host__ void Resize(const HashParams &params);
+  // O(1): start a new generation. Entries of older generations are free,
+  // and the heap hands out all slots again from 0
   __host__ void Reset();
   __host__ void ResetMutexes();
+  // O(1): slots [0, allocated_count) in use, the others handed out in order
+  __host__ void ResetHeap(uint allocated_count);
+  // Blocks handed out by the heap
+  __host__ uint allocated_count();
+  // All entries, for analysis on the host; those of older generations free
+  __host__ void DownloadEntries(std::vector<HashEntry> &entries);
+  __host__ HashEntry* GetGPUPtr() const {
+    return entries_;
+  }
 
   __host__ __device__ HashEntry& entry(uint i) {
     return entries_[i];
   }
+  __host__ __device__ uint generation() const {
+    return generation_;
+  }
+  // Entries written before the last Reset are free, whatever their ptr
+  __host__ __device__ bool IsLive(const HashEntry &entry) const {
+    return entry.ptr != FREE_ENTRY && entry.generation == generation_;
+  }
   //__host__ void Debug();
 
   /////////////////
@@ -42,8 +62,13 @@ public:
 
 private:
   bool  is_allocated_on_gpu_ = false;
+  // @param const element
+  uint       generation_ = 0;       /// of the entries, bumped by Reset
+  uint       heap_generation_ = 0;  /// of the heap, bumped by ResetHeap
   // @param array
   uint      *heap_;             /// index to free values
+  // @param array
+  uint      *heap_generations_; /// heap_[i] is valid only if written in heap_generation_
   // @param read-write element
   uint      *heap_counter_;     /// single element; used as an atomic counter (points to the next free block)
 
@@ -54,6 +79,14 @@ private:
 
 #ifdef __CUDACC__
 public:
+  /// Slots in (heap counter, value_capacity) are handed out.
+  /// Elements not written since ResetHeap hold their initial slot
+  __device__
+  uint heap(uint i) const {
+    return heap_generations_[i] == heap_generation_
+           ? heap_[i] : value_capacity - i - 1;
+  }
+
   __device__
   HashEntry GetEntry(const int3& pos) const {
     uint bucket_idx             = HashBucketForBlockPos(pos);
@@ -83,7 +116,7 @@ public:
       if (IsPosAllocated(pos, curr_entry)) {
         return curr_entry;
       }
-      if (curr_entry.offset == 0) {
+      if (! IsLive(curr_entry) || curr_entry.offset == 0) {
         break;
       }
       i = (bucket_last_entry_idx + curr_entry.offset) % (entry_count);
@@ -108,7 +141,7 @@ public:
       }
 
       /// wei: should not break and alloc before a thorough searching is over:
-      if (empty_entry_idx == -1 && curr_entry.ptr == FREE_ENTRY) {
+      if (empty_entry_idx == -1 && ! IsLive(curr_entry)) {
         empty_entry_idx = i;
       }
     }
@@ -122,7 +155,7 @@ public:
       if (IsPosAllocated(pos, curr_entry)) {
         return;
       }
-      if (curr_entry.offset == 0) {
+      if (! IsLive(curr_entry) || curr_entry.offset == 0) {
         break;
       }
       i = (bucket_last_entry_idx + curr_entry.offset) % (entry_count);
@@ -137,6 +170,7 @@ public:
         entry.pos    = pos;
         entry.ptr    = Alloc();
         entry.offset = NO_OFFSET;
+        entry.generation = generation_;
       }
       return;
     }
@@ -154,7 +188,7 @@ public:
 
       HashEntry& curr_entry = entries_[i];
 
-      if (curr_entry.ptr == FREE_ENTRY) {
+      if (! IsLive(curr_entry)) {
         int lock = atomicExch(&bucket_mutexes_[bucket_idx], LOCK_ENTRY);
         if (lock != LOCK_ENTRY) {
           HashEntry& bucket_last_entry = entries_[bucket_last_entry_idx];
@@ -166,6 +200,7 @@ public:
             entry.pos    = pos;
             entry.offset = bucket_last_entry.offset; // pointer assignment in linked list
             entry.ptr    = Alloc();	//memory alloc
+            entry.generation = generation_;
 
             // Not sure if it is ok to directly assign to reference
             bucket_last_entry.offset = offset;
@@ -180,8 +215,10 @@ public:
 
   //! deletes a hash entry position for a given pos index
   // returns true uppon successful deletion; otherwise returns false
+  // @param retired_ptr if not NULL, the block is not returned to the heap
+  // but written there, for FreeSlot once no reader can reach it
   __device__
-  bool FreeEntry(const int3& pos) {
+  bool FreeEntry(const int3& pos, uint* retired_ptr = NULL) {
     uint bucket_idx = HashBucketForBlockPos(pos);	//hash bucket
     uint bucket_first_entry_idx = bucket_idx * bucket_size;		//hash position
 
@@ -191,7 +228,7 @@ public:
       if (IsPosAllocated(pos, curr)) {
 
 #ifndef HANDLE_COLLISIONS
-        Free(curr.ptr);
+        Release(curr.ptr, retired_ptr);
         entries_[i].Clear();
         return true;
 #else
@@ -199,7 +236,7 @@ public:
         if (curr.offset != 0) {
           int lock = atomicExch(&bucket_mutexes_[bucket_idx], LOCK_ENTRY);
           if (lock != LOCK_ENTRY) {
-            Free(curr.ptr);
+            Release(curr.ptr, retired_ptr);
             int next_idx = (i + curr.offset) % (entry_count);
             entries_[i] = entries_[next_idx];
             entries_[next_idx].Clear();
@@ -208,7 +245,7 @@ public:
             return false;
           }
         } else {
-          Free(curr.ptr);
+          Release(curr.ptr, retired_ptr);
           entries_[i].Clear();
           return true;
         }
@@ -232,7 +269,7 @@ public:
       if (IsPosAllocated(pos, curr)) {
         int lock = atomicExch(&bucket_mutexes_[bucket_idx], LOCK_ENTRY);
         if (lock != LOCK_ENTRY) {
-          Free(curr.ptr);
+          Release(curr.ptr, retired_ptr);
           entries_[i].Clear();
           HashEntry prev = entries_[prev_idx];
           prev.offset = curr.offset;
@@ -254,18 +291,16 @@ public:
     return false;
   }
 
+  /// Return a block retired by FreeEntry to the heap
+  __device__
+  void FreeSlot(uint ptr) {
+    Free(ptr);
+  }
+
 private:
-  //! see Teschner et al. (but with correct prime values)
   __device__
   uint HashBucketForBlockPos(const int3& pos) const {
-    const int p0 = 73856093;
-    const int p1 = 19349669;
-    const int p2 = 83492791;
-
-    int res = ((pos.x * p0) ^ (pos.y * p1) ^ (pos.z * p2))
-              % bucket_count;
-    if (res < 0) res += bucket_count;
-    return (uint) res;
+    return TeschnerHash(pos, bucket_count);
   }
 
   __device__
@@ -273,22 +308,32 @@ private:
     return pos.x == hash_entry.pos.x
         && pos.y == hash_entry.pos.y
         && pos.z == hash_entry.pos.z
-        && hash_entry.ptr != FREE_ENTRY;
+        && IsLive(hash_entry);
   }
 
   __device__
   uint Alloc() {
     uint addr = atomicSub(&heap_counter_[0], 1);
     if (addr < MEMORY_LIMIT) {
-      printf("Memory nearly exhausted! %d -> %d\n", addr, heap_[addr]);
+      printf("Memory nearly exhausted! %d -> %d\n", addr, heap(addr));
     }
-    return heap_[addr];
+    return heap(addr);
   }
 
   __device__
   void Free(uint ptr) {
-    uint addr = atomicAdd(&heap_counter_[0], 1);
-    heap_[addr + 1] = ptr;
+    uint addr = atomicAdd(&heap_counter_[0], 1) + 1;
+    heap_[addr] = ptr;
+    heap_generations_[addr] = heap_generation_;
+  }
+
+  __device__
+  void Release(uint ptr, uint* retired_ptr) {
+    if (retired_ptr != NULL) {
+      *retired_ptr = ptr;
+    } else {
+      Free(ptr);
+    }
   }
 #endif
 };
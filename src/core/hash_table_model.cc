@@ -0,0 +1,178 @@
+//
+// Created by wei on 18-2-1.
+//
+
+#include "core/hash_table_model.h"
+
+#include <algorithm>
+
+HashTableModel::HashTableModel(
+    const HashParams &params,
+    HashFunctionType type
+) : params_(params),
+    type_(type) {
+  Reset();
+}
+
+void HashTableModel::Reset() {
+  entries_.resize(params_.entry_count);
+  for (HashEntry &entry : entries_) {
+    entry.pos = make_int3(0);
+    entry.ptr = FREE_ENTRY;
+    entry.offset = NO_OFFSET;
+  }
+  allocated_count_ = 0;
+}
+
+void HashTableModel::Fill(uint i, const int3 &pos, uint offset) {
+  entries_[i].pos = pos;
+  entries_[i].ptr = (int)allocated_count_++;
+  entries_[i].offset = offset;
+}
+
+HashTableModel::AllocResult HashTableModel::AllocEntry(const int3 &pos) {
+  const uint bucket_size = params_.bucket_size;
+  const uint entry_count = params_.entry_count;
+  uint bucket_first_entry_idx = bucket(pos) * bucket_size;
+
+  /// 1. Try GetEntry, meanwhile collect an empty entry
+  int empty_entry_idx = -1;
+  for (uint j = 0; j < bucket_size; ++j) {
+    uint i = j + bucket_first_entry_idx;
+    if (IsPosAllocated(pos, entries_[i])) {
+      return kFound;
+    }
+    if (empty_entry_idx == -1 && entries_[i].ptr == FREE_ENTRY) {
+      empty_entry_idx = i;
+    }
+  }
+
+  const uint bucket_last_entry_idx = bucket_first_entry_idx + bucket_size - 1;
+  uint i = bucket_last_entry_idx;
+  for (uint iter = 0; iter < params_.linked_list_size; ++iter) {
+    if (IsPosAllocated(pos, entries_[i])) {
+      return kFound;
+    }
+    if (entries_[i].offset == 0) {
+      break;
+    }
+    i = (bucket_last_entry_idx + entries_[i].offset) % entry_count;
+  }
+
+  if (allocated_count_ >= params_.value_capacity) {
+    return kHeapExhausted;
+  }
+
+  /// 2. NOT FOUND, Allocate
+  if (empty_entry_idx != -1) {
+    Fill(empty_entry_idx, pos, NO_OFFSET);
+    return kInserted;
+  }
+
+  /// 3. Insert at the head of the linked list
+  uint offset = 0;
+  for (uint iter = 0; iter < params_.linked_list_size; ++iter) {
+    offset++;
+    if ((offset % bucket_size) == 0) continue;
+
+    i = (bucket_last_entry_idx + offset) % entry_count;
+    if (entries_[i].ptr == FREE_ENTRY) {
+      Fill(i, pos, entries_[bucket_last_entry_idx].offset);
+      entries_[bucket_last_entry_idx].offset = offset;
+      return kInserted;
+    }
+  }
+  return kBucketOverflow;
+}
+
+int HashTableModel::GetEntry(const int3 &pos, uint &probe_count) const {
+  const uint bucket_size = params_.bucket_size;
+  uint bucket_first_entry_idx = bucket(pos) * bucket_size;
+
+  probe_count = 0;
+  for (uint i = 0; i < bucket_size; ++i) {
+    ++probe_count;
+    if (IsPosAllocated(pos, entries_[i + bucket_first_entry_idx])) {
+      return i + bucket_first_entry_idx;
+    }
+  }
+
+  /// The last entry is visited twice, as on the GPU
+  const uint bucket_last_entry_idx = bucket_first_entry_idx + bucket_size - 1;
+  uint i = bucket_last_entry_idx;
+  for (uint iter = 0; iter < params_.linked_list_size; ++iter) {
+    ++probe_count;
+    if (IsPosAllocated(pos, entries_[i])) {
+      return i;
+    }
+    if (entries_[i].offset == 0) {
+      break;
+    }
+    i = (bucket_last_entry_idx + entries_[i].offset) % params_.entry_count;
+  }
+  return -1;
+}
+
+void HashTableModel::Load(const std::vector<HashEntry> &entries) {
+  Reset();
+  uint count = std::min((uint)entries.size(), params_.entry_count);
+  for (uint i = 0; i < count; ++i) {
+    entries_[i].pos = entries[i].pos;
+    entries_[i].ptr = entries[i].ptr;
+    entries_[i].offset = entries[i].offset;
+    if (entries[i].ptr != FREE_ENTRY) ++allocated_count_;
+  }
+}
+
+HashTableStats HashTableModel::Analyze() const {
+  const uint bucket_size = params_.bucket_size;
+  const uint entry_count = params_.entry_count;
+
+  HashTableStats stats;
+  stats.bucket_occupancy.assign(bucket_size + 1, 0);
+  stats.chain_length.assign(1, 0);
+
+  for (uint b = 0; b < params_.bucket_count; ++b) {
+    uint occupied = 0;
+    for (uint j = 0; j < bucket_size; ++j) {
+      if (entries_[b * bucket_size + j].ptr != FREE_ENTRY) ++occupied;
+    }
+    stats.bucket_occupancy[occupied]++;
+
+    /// Follow the whole list, not only the part GetEntry reaches;
+    /// bounded in case a corrupted table has a cycle
+    const uint bucket_last_entry_idx = b * bucket_size + bucket_size - 1;
+    uint length = 0;
+    uint i = bucket_last_entry_idx;
+    while (entries_[i].offset != 0 && length < entry_count) {
+      i = (bucket_last_entry_idx + entries_[i].offset) % entry_count;
+      ++length;
+    }
+    if (length >= stats.chain_length.size()) {
+      stats.chain_length.resize(length + 1, 0);
+    }
+    stats.chain_length[length]++;
+    stats.linked_entry_count += length;
+  }
+
+  ulong probe_sum = 0;
+  uint found_count = 0;
+  for (uint i = 0; i < entry_count; ++i) {
+    if (entries_[i].ptr == FREE_ENTRY) continue;
+    ++stats.used_entry_count;
+
+    uint probe_count;
+    int found_idx = GetEntry(entries_[i].pos, probe_count);
+    if (found_idx < 0) {
+      ++stats.unreachable_count;
+    } else if (found_idx != (int)i) {
+      ++stats.duplicate_count;
+    } else {
+      probe_sum += probe_count;
+      ++found_count;
+    }
+  }
+  stats.load_factor = (float)stats.used_entry_count / entry_count;
+  stats.mean_probe_count = found_count > 0 ? (float)probe_sum / found_count : 0;
+  return stats;
+}
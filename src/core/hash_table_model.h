@@ -0,0 +1,79 @@
+//
+// Created by wei on 18-2-1.
+//
+// Host replica of the HashTable insertion and lookup policy:
+// buckets of bucket_size entries, overflow linked from the last entry
+// of a bucket within linked_list_size slots.
+// Single threaded, hence without the lock conflicts of the GPU,
+// and with a selectable hash function.
+
+#ifndef CORE_HASH_TABLE_MODEL_H
+#define CORE_HASH_TABLE_MODEL_H
+
+#include <vector>
+#include <helper_math.h>
+
+#include "core/common.h"
+#include "core/params.h"
+#include "core/hash_entry.h"
+#include "core/hash_function.h"
+
+struct HashTableStats {
+  uint  used_entry_count = 0;
+  float load_factor = 0;            /// used / entry_count
+  /// [k]: buckets with k of their entries occupied, by any chain
+  std::vector<uint> bucket_occupancy;
+  /// [k]: buckets with k entries linked from their last entry
+  std::vector<uint> chain_length;
+  uint  linked_entry_count = 0;     /// entries stored outside their bucket
+  uint  unreachable_count = 0;      /// stored, but GetEntry can't find them
+  uint  duplicate_count = 0;        /// stored more than once
+  float mean_probe_count = 0;       /// entries read per successful lookup
+};
+
+class HashTableModel {
+public:
+  enum AllocResult {
+    kFound,
+    kInserted,
+    kBucketOverflow,   /// bucket and linked list window full: given up
+    kHeapExhausted
+  };
+
+  HashTableModel(const HashParams &params, HashFunctionType type);
+  void Reset();
+
+  /// Same steps as HashTable::AllocEntry
+  AllocResult AllocEntry(const int3 &pos);
+  /// Same steps as HashTable::GetEntry
+  /// @return index of the entry, -1 if not found
+  /// @param probe_count entries read
+  int GetEntry(const int3 &pos, uint &probe_count) const;
+
+  /// Replace the entries, e.g. by the ones of a GPU table
+  void Load(const std::vector<HashEntry> &entries);
+  HashTableStats Analyze() const;
+
+  const HashParams& params() const {
+    return params_;
+  }
+
+private:
+  uint bucket(const int3 &pos) const {
+    return HashBucket(pos, params_.bucket_count, type_);
+  }
+  bool IsPosAllocated(const int3 &pos, const HashEntry &entry) const {
+    return pos.x == entry.pos.x
+        && pos.y == entry.pos.y
+        && pos.z == entry.pos.z
+        && entry.ptr != FREE_ENTRY;
+  }
+  void Fill(uint i, const int3 &pos, uint offset);
+
+  HashParams params_;
+  HashFunctionType type_;
+  std::vector<HashEntry> entries_;
+  uint allocated_count_;
+};
+
+#endif //CORE_HASH_TABLE_MODEL_H
@@ -0,0 +1,96 @@
+//
+// Created by wei on 18-2-1.
+//
+
+#include <device_launch_parameters.h>
+
+#include "util/timer.h"
+#include "core/hash_table_replay.h"
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void ReplayAllocEntriesKernel(
+    HashTable hash_table,
+    const int3 *positions,
+    uint count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx < count) {
+    hash_table.AllocEntry(positions[idx]);
+  }
+}
+
+__global__
+void ReplayGetEntriesKernel(
+    HashTable hash_table,
+    const int3 *positions,
+    uint count,
+    uint *found_count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx < count) {
+    HashEntry entry = hash_table.GetEntry(positions[idx]);
+    if (entry.ptr != FREE_ENTRY) {
+      atomicAdd(found_count, 1);
+    }
+  }
+}
+
+////////////////////
+/// Host code
+////////////////////
+double ReplayAllocEntries(
+    HashTable &hash_table,
+    const int3 *positions_gpu,
+    uint count
+) {
+  if (count == 0) return 0;
+  hash_table.ResetMutexes();
+
+  const uint threads_per_block = 64;
+  const dim3 grid_size((count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  Timer timer;
+  timer.Tick();
+  ReplayAllocEntriesKernel <<<grid_size, block_size>>>(
+      hash_table, positions_gpu, count);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  return timer.Tock();
+}
+
+double ReplayGetEntries(
+    HashTable &hash_table,
+    const int3 *positions_gpu,
+    uint count,
+    uint &found_count
+) {
+  found_count = 0;
+  if (count == 0) return 0;
+
+  uint *found_count_gpu;
+  checkCudaErrors(cudaMalloc(&found_count_gpu, sizeof(uint)));
+  checkCudaErrors(cudaMemset(found_count_gpu, 0, sizeof(uint)));
+
+  const uint threads_per_block = 64;
+  const dim3 grid_size((count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  Timer timer;
+  timer.Tick();
+  ReplayGetEntriesKernel <<<grid_size, block_size>>>(
+      hash_table, positions_gpu, count, found_count_gpu);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  double seconds = timer.Tock();
+
+  checkCudaErrors(cudaMemcpy(&found_count, found_count_gpu, sizeof(uint),
+                             cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaFree(found_count_gpu));
+  return seconds;
+}
@@ -0,0 +1,32 @@
+//
+// Created by wei on 18-2-1.
+//
+
+#ifndef CORE_HASH_TABLE_REPLAY_H
+#define CORE_HASH_TABLE_REPLAY_H
+
+#include "core/hash_table.h"
+
+// @function
+// Insert the @param count block positions of @param positions_gpu
+// into @param hash_table, one thread each, in a single launch
+// as AllocBlockArray does per frame: lock conflicts drop some of them
+// @return seconds
+double ReplayAllocEntries(
+    HashTable &hash_table,
+    const int3 *positions_gpu,
+    uint count
+);
+
+// @function
+// Look up the @param count block positions of @param positions_gpu
+// @param found_count positions allocated in @param hash_table
+// @return seconds
+double ReplayGetEntries(
+    HashTable &hash_table,
+    const int3 *positions_gpu,
+    uint count,
+    uint &found_count
+);
+
+#endif //CORE_HASH_TABLE_REPLAY_H
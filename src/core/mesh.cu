@@ -13,21 +13,19 @@
 /// Device code
 ////////////////////
 __global__
-void MeshResetVerticesKernel(uint* vertex_heap, Vertex* vertices, int max_vertex_count) {
+void MeshResetVerticesKernel(Vertex* vertices, int max_vertex_count) {
   const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
 
   if (idx < max_vertex_count) {
-    vertex_heap[idx] = max_vertex_count - idx - 1;
     vertices[idx].Clear();
   }
 }
 
 __global__
-void MeshResetTrianglesKernel(uint* triangle_heap, Triangle* triangles, int max_triangle_count) {
+void MeshResetTrianglesKernel(Triangle* triangles, int max_triangle_count) {
   const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
 
   if (idx < max_triangle_count) {
-    triangle_heap[idx] = max_triangle_count - idx - 1;
     triangles[idx].Clear();
   }
 }
@@ -42,15 +40,11 @@ void MeshResetTrianglesKernel(uint* triangle_heap, Triangle* triangles, int max_
 __host__
 void Mesh::Alloc(const MeshParams &mesh_params) {
   if (!is_allocated_on_gpu_) {
-    checkCudaErrors(cudaMalloc(&vertex_heap_,
-                               sizeof(uint) * mesh_params.max_vertex_count));
-    checkCudaErrors(cudaMalloc(&vertex_heap_counter_, sizeof(uint)));
+    vertex_heap_.Alloc(mesh_params.max_vertex_count);
     checkCudaErrors(cudaMalloc(&vertices,
                                sizeof(Vertex) * mesh_params.max_vertex_count));
 
-    checkCudaErrors(cudaMalloc(&triangle_heap_,
-                               sizeof(uint) * mesh_params.max_triangle_count));
-    checkCudaErrors(cudaMalloc(&triangle_heap_counter_, sizeof(uint)));
+    triangle_heap_.Alloc(mesh_params.max_triangle_count);
     checkCudaErrors(cudaMalloc(&triangles,
                                sizeof(Triangle) * mesh_params.max_triangle_count));
     is_allocated_on_gpu_ = true;
@@ -59,12 +53,10 @@ void Mesh::Alloc(const MeshParams &mesh_params) {
 
 void Mesh::Free() {
   if (is_allocated_on_gpu_) {
-    checkCudaErrors(cudaFree(vertex_heap_));
-    checkCudaErrors(cudaFree(vertex_heap_counter_));
+    vertex_heap_.Free();
     checkCudaErrors(cudaFree(vertices));
 
-    checkCudaErrors(cudaFree(triangle_heap_));
-    checkCudaErrors(cudaFree(triangle_heap_counter_));
+    triangle_heap_.Free();
     checkCudaErrors(cudaFree(triangles));
 
     is_allocated_on_gpu_ = false;
@@ -81,19 +73,7 @@ void Mesh::Resize(const MeshParams &mesh_params) {
 }
 
 void Mesh::Reset() {
-  uint val;
-
-  val = mesh_params_.max_vertex_count - 1;
-  checkCudaErrors(cudaMemcpy(vertex_heap_counter_,
-                             &val,
-                             sizeof(uint),
-                             cudaMemcpyHostToDevice));
-
-  val = mesh_params_.max_triangle_count - 1;
-  checkCudaErrors(cudaMemcpy(triangle_heap_counter_,
-                             &val,
-                             sizeof(uint),
-                             cudaMemcpyHostToDevice));
+  ResetLazily();
 
   {
     const int threads_per_block = 64;
@@ -101,7 +81,7 @@ void Mesh::Reset() {
                          / threads_per_block, 1);
     const dim3 block_size(threads_per_block, 1);
 
-    MeshResetVerticesKernel<<< grid_size, block_size >>> (vertex_heap_, vertices,
+    MeshResetVerticesKernel<<< grid_size, block_size >>> (vertices,
         mesh_params_.max_vertex_count);
     checkCudaErrors(cudaDeviceSynchronize());
     checkCudaErrors(cudaGetLastError());
@@ -113,25 +93,27 @@ void Mesh::Reset() {
                          / threads_per_block, 1);
     const dim3 block_size(threads_per_block, 1);
 
-    MeshResetTrianglesKernel<<<grid_size, block_size>>> (triangle_heap_, triangles,
+    MeshResetTrianglesKernel<<<grid_size, block_size>>> (triangles,
         mesh_params_.max_triangle_count);
     checkCudaErrors(cudaDeviceSynchronize());
     checkCudaErrors(cudaGetLastError());
   }
 }
 
-uint Mesh::vertex_heap_count() {
-  uint vertex_heap_count;
-  checkCudaErrors(cudaMemcpy(&vertex_heap_count,
-                             vertex_heap_counter_,
-                             sizeof(uint), cudaMemcpyDeviceToHost));
-  return vertex_heap_count;
+void Mesh::ResetLazily() {
+  vertex_heap_.Reset();
+  triangle_heap_.Reset();
+}
+
+void Mesh::ReleaseRetiredChunks() {
+  vertex_heap_.ReleaseRetired();
+  triangle_heap_.ReleaseRetired();
 }
 
-uint Mesh::triangle_heap_count() {
-  uint triangle_heap_count;
-  checkCudaErrors(cudaMemcpy(&triangle_heap_count,
-                             triangle_heap_counter_,
-                             sizeof(uint), cudaMemcpyDeviceToHost));
-  return triangle_heap_count;
-}
\ No newline at end of file
+uint Mesh::vertex_used_count() {
+  return vertex_heap_.used_count();
+}
+
+uint Mesh::triangle_used_count() {
+  return triangle_heap_.used_count();
+}
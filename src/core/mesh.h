@@ -9,10 +9,15 @@
 #include "core/params.h"
 #include "core/vertex.h"
 #include "core/triangle.h"
+#include "core/mesh_chunk.h"
+#include "core/chunk_heap.h"
 
 #include <helper_cuda.h>
 #include <helper_math.h>
 
+// Vertices and triangles are stored per Block:
+// each Block owns one contiguous vertex chunk and one triangle chunk,
+// triangles only refer to vertices in the chunk of the same Block.
 class Mesh {
 public:
   __host__ Mesh() = default;
@@ -22,6 +27,12 @@ public:
   __host__ void Resize(const MeshParams &mesh_params);
   __host__ void Free();
   __host__ void Reset();
+  // Only the chunk heaps: vertices and triangles are written
+  // when their chunk is handed out, and read only within chunks
+  __host__ void ResetLazily();
+
+  // Free the chunks retired during the last meshing pass
+  __host__ void ReleaseRetiredChunks();
 
   const MeshParams& params() {
     return mesh_params_;
@@ -33,65 +44,51 @@ public:
   __device__ __host__ Triangle& triangle(uint i) {
     return triangles[i];
   }
+  __device__ __host__ Vertex& vertex(const MeshChunk& chunk, int i) {
+    return vertices[chunk.ptr + i];
+  }
+  __device__ __host__ Triangle& triangle(const MeshChunk& chunk, int i) {
+    return triangles[chunk.ptr + i];
+  }
 
-  __host__ uint vertex_heap_count();
-  __host__ uint triangle_heap_count();
+  __host__ uint vertex_used_count();
+  __host__ uint triangle_used_count();
 
 private:
   bool is_allocated_on_gpu_ = false;
-  uint*     vertex_heap_;
-  uint*     vertex_heap_counter_;
+  ChunkHeap vertex_heap_;
   Vertex*   vertices;
 
-  uint*     triangle_heap_;
-  uint*     triangle_heap_counter_;
+  ChunkHeap triangle_heap_;
   Triangle* triangles;
 
 #ifdef __CUDACC__
 public:
+  /// Make @param chunk hold @param count vertices.
+  /// The old chunk is kept if its size is still reasonable,
+  /// otherwise it is retired and a new one is allocated.
   __device__
-  uint AllocVertex() {
-    uint addr = atomicSub(&vertex_heap_counter_[0], 1);
-    if (addr < MEMORY_LIMIT) {
-      printf("vertex heap: %d -> %d\n", addr, vertex_heap_[addr]);
-    }
-    return vertex_heap_[addr];
+  bool AllocVertexChunk(MeshChunk& chunk, int count) {
+    return AllocChunk(vertex_heap_, chunk, count);
   }
   __device__
-  void FreeVertex(uint ptr) {
-    uint addr = atomicAdd(&vertex_heap_counter_[0], 1);
-    vertex_heap_[addr + 1] = ptr;
-  }
-
-  __device__
-  uint AllocTriangle() {
-    uint addr = atomicSub(&triangle_heap_counter_[0], 1);
-    if (addr < MEMORY_LIMIT) {
-      printf("triangle heap: %d -> %d\n", addr, triangle_heap_[addr]);
+  void FreeVertexChunk(MeshChunk& chunk) {
+    if (chunk.ptr != FREE_PTR) {
+      vertex_heap_.FreeChunk(chunk.ptr, chunk.size_class);
     }
-    return triangle_heap_[addr];
-  }
-  __device__
-  void FreeTriangle(uint ptr) {
-    uint addr = atomicAdd(&triangle_heap_counter_[0], 1);
-    triangle_heap_[addr + 1] = ptr;
+    chunk.Clear();
   }
 
-  /// Release is NOT always a FREE operation
   __device__
-  void ReleaseTriangle(Triangle& triangle) {
-    int3 vertex_ptrs = triangle.vertex_ptrs;
-    atomicSub(&vertices[vertex_ptrs.x].ref_count, 1);
-    atomicSub(&vertices[vertex_ptrs.y].ref_count, 1);
-    atomicSub(&vertices[vertex_ptrs.z].ref_count, 1);
+  bool AllocTriangleChunk(MeshChunk& chunk, int count) {
+    return AllocChunk(triangle_heap_, chunk, count);
   }
-
   __device__
-  void AssignTriangle(Triangle& triangle, int3 vertex_ptrs) {
-    triangle.vertex_ptrs = vertex_ptrs;
-    atomicAdd(&vertices[vertex_ptrs.x].ref_count, 1);
-    atomicAdd(&vertices[vertex_ptrs.y].ref_count, 1);
-    atomicAdd(&vertices[vertex_ptrs.z].ref_count, 1);
+  void FreeTriangleChunk(MeshChunk& chunk) {
+    if (chunk.ptr != FREE_PTR) {
+      triangle_heap_.FreeChunk(chunk.ptr, chunk.size_class);
+    }
+    chunk.Clear();
   }
 
   __device__
@@ -105,6 +102,40 @@ public:
     vertices[vertex_ptrs.y].normal = n;
     vertices[vertex_ptrs.z].normal = n;
   }
+
+private:
+  __device__
+  bool AllocChunk(ChunkHeap& heap, MeshChunk& chunk, int count) {
+    int size_class = count > 0 ? ChunkHeap::SizeClass(count) : -1;
+
+    /// Keep chunks that are large enough but at most 2x too large
+    if (chunk.ptr != FREE_PTR
+        && size_class >= 0
+        && chunk.size_class >= size_class
+        && chunk.size_class <= size_class + 1) {
+      chunk.count = count;
+      return true;
+    }
+
+    if (chunk.ptr != FREE_PTR) {
+      heap.RetireChunk(chunk.ptr, chunk.size_class);
+      chunk.Clear();
+    }
+    if (count == 0) return true;
+    if (size_class < 0) {
+      printf("Mesh chunk too large: %d\n", count);
+      return false;
+    }
+
+    chunk.ptr = heap.AllocChunk(size_class);
+    if (chunk.ptr == FREE_PTR) {
+      chunk.Clear();
+      return false;
+    }
+    chunk.size_class = size_class;
+    chunk.count = count;
+    return true;
+  }
 #endif // __CUDACC__
   MeshParams mesh_params_;
 
@@ -0,0 +1,32 @@
+//
+// Created by wei on 18-1-15.
+//
+
+#ifndef CORE_MESH_CHUNK_H
+#define CORE_MESH_CHUNK_H
+
+#include "core/common.h"
+
+// A contiguous run of vertices or triangles owned by one Block.
+// @ptr is the offset of the first element in the Mesh pool,
+// @size_class gives the capacity (MESH_SLAB_SIZE << size_class),
+// @count is the number of elements currently in use.
+struct __ALIGN__(4) MeshChunk {
+  int ptr;
+  int size_class;
+  int count;
+
+  __host__ __device__
+  int capacity() const {
+    return ptr == FREE_PTR ? 0 : (MESH_SLAB_SIZE << size_class);
+  }
+
+  __host__ __device__
+  void Clear() {
+    ptr = FREE_PTR;
+    size_class = 0;
+    count = 0;
+  }
+};
+
+#endif // CORE_MESH_CHUNK_H
@@ -26,6 +26,18 @@ struct HashParams {
 struct MeshParams {
   uint max_vertex_count;
   uint max_triangle_count;
+
+  // Level of detail by distance to the camera (m), 0 to disable
+  float lod_distance_2x;        // 3.0, sample every 2 voxels beyond it
+  float lod_distance_4x;        // 5.0, sample every 4 voxels beyond it
+};
+
+/// Export-time simplification, see meshing/decimation.h
+struct DecimationParams {
+  float max_error;          // 0.005 (m), stop collapsing beyond it
+  float triangle_ratio;     // 0.1, stop when as few triangles remain
+  float partition_size;     // 0.32 (m), side length of a partition
+  int   thread_count;       // <= 0: all hardware threads
 };
 
 struct __ALIGN__(16) VolumeParams {
@@ -37,6 +49,13 @@ struct __ALIGN__(16) VolumeParams {
 
   uint  weight_sample;              // 10,  TODO(wei): change it dynamically!
   uint  weight_upper_bound;         // 255
+
+  /// Region of interest: nothing is allocated, integrated or meshed
+  /// outside this box, rotated about x, then y, then z
+  bool   enable_roi;                // false
+  float3 roi_center;                // (m)
+  float3 roi_half_extent;           // (m)
+  float3 roi_rotation;              // (deg)
 };
 
 struct RayCasterParams {
@@ -77,19 +96,36 @@ struct SensorParams {
 struct RuntimeParams {
   int  dataset_type;
   bool enable_bayesian_update;
+  bool enable_headless;
+  bool enable_pipeline;
 
   bool enable_navigation;
   bool enable_polygon_mode;
   bool enable_global_mesh;
   bool enable_sdf_gradient;
+  bool enable_surface_nets;
   bool enable_color;
 
   bool enable_bounding_box;
   bool enable_trajectory;
   bool enable_ray_casting;
+  bool enable_cpu_ray_casting;
+  int  host_page_mode;
+
+  bool enable_morton_placement;
+  int  defrag_interval;
+  int  export_interval;
+  int  publish_interval;
+  std::string shared_map_name;
+  float eviction_occupancy;
+  bool enable_eviction_spill;
+  bool enable_lazy_commit;
 
   bool enable_video_recording;
   bool enable_ply_saving;
+  bool enable_decimation;
+  float decimation_max_error;
+  float decimation_triangle_ratio;
 
   std::string filename_prefix;
   std::string time_profile;
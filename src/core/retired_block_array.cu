@@ -0,0 +1,80 @@
+//
+// Created by wei on 18-2-8.
+//
+
+#include "core/retired_block_array.h"
+#include "helper_cuda.h"
+
+#include <algorithm>
+
+////////////////////
+/// Host code
+////////////////////
+__host__
+RetiredBlockArray::RetiredBlockArray(uint capacity) {
+  Resize(capacity);
+}
+
+__host__
+void RetiredBlockArray::Alloc(uint capacity) {
+  if (! is_allocated_on_gpu_) {
+    capacity_ = capacity;
+    checkCudaErrors(cudaMalloc(&ptrs_, sizeof(uint) * capacity));
+    checkCudaErrors(cudaMalloc(&positions_, sizeof(int3) * capacity));
+    checkCudaErrors(cudaMalloc(&counter_, sizeof(uint)));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+__host__
+void RetiredBlockArray::Free() {
+  if (is_allocated_on_gpu_) {
+    checkCudaErrors(cudaFree(ptrs_));
+    checkCudaErrors(cudaFree(positions_));
+    checkCudaErrors(cudaFree(counter_));
+    capacity_ = 0;
+    ptrs_ = NULL;
+    positions_ = NULL;
+    counter_ = NULL;
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+__host__
+void RetiredBlockArray::Resize(uint capacity) {
+  if (is_allocated_on_gpu_) {
+    Free();
+  }
+  Alloc(capacity);
+  Reset();
+}
+
+__host__
+void RetiredBlockArray::Reset() {
+  checkCudaErrors(cudaMemset(counter_, 0, sizeof(uint)));
+}
+
+__host__
+uint RetiredBlockArray::count() {
+  uint count;
+  checkCudaErrors(cudaMemcpy(&count, counter_,
+                             sizeof(uint), cudaMemcpyDeviceToHost));
+  return count;
+}
+
+__host__
+void RetiredBlockArray::DownloadPositions(uint begin, uint end,
+                                          std::vector<int3> &positions) {
+  positions.resize(end - begin);
+  /// At most two runs: before and after the end of the ring
+  uint i = begin;
+  while (i < end) {
+    uint ring_begin = i % capacity_;
+    uint count = std::min(end - i, capacity_ - ring_begin);
+    checkCudaErrors(cudaMemcpy(positions.data() + (i - begin),
+                               positions_ + ring_begin,
+                               sizeof(int3) * count,
+                               cudaMemcpyDeviceToHost));
+    i += count;
+  }
+}
@@ -0,0 +1,60 @@
+//
+// Created by wei on 18-2-8.
+//
+// Blocks unlinked from the HashTable while readers may still reach them.
+// A ring of block indices and positions: recycling kernels append,
+// and the host returns
+// ranges of it to the heap once the readers of their epoch have left.
+// At most value_capacity blocks are ever retired and not yet freed,
+// so a ring of that size never overwrites itself.
+
+#ifndef CORE_RETIRED_BLOCK_ARRAY_H
+#define CORE_RETIRED_BLOCK_ARRAY_H
+
+#include <vector>
+#include "core/common.h"
+
+class RetiredBlockArray {
+public:
+  __host__ RetiredBlockArray() = default;
+  __host__ explicit RetiredBlockArray(uint capacity);
+
+  __host__ void Alloc(uint capacity);
+  __host__ void Resize(uint capacity);
+  __host__ void Free();
+  __host__ void Reset();
+
+  // Blocks retired since Reset, ever increasing: retired blocks
+  // [begin, end) are at ring positions begin % capacity, ...
+  __host__ uint count();
+  __host__ uint capacity() const {
+    return capacity_;
+  }
+  // Positions of the retired blocks [@param begin, @param end)
+  __host__ void DownloadPositions(uint begin, uint end,
+                                  std::vector<int3> &positions);
+
+#ifdef __CUDACC__
+  __device__ void Append(uint ptr, const int3 &pos) {
+    uint i = atomicAdd(&counter_[0], 1);
+    ptrs_[i % capacity_] = ptr;
+    positions_[i % capacity_] = pos;
+  }
+#endif
+  __host__ __device__ uint operator[] (uint i) const {
+    return ptrs_[i % capacity_];
+  }
+
+private:
+  bool  is_allocated_on_gpu_ = false;
+  // @param const element
+  uint  capacity_;
+  // @param array
+  uint* ptrs_;
+  // @param array
+  int3* positions_;
+  // @param read-write element
+  uint* counter_;
+};
+
+#endif //CORE_RETIRED_BLOCK_ARRAY_H
@@ -13,7 +13,6 @@ struct __ALIGN__(4) Vertex {
   float3 normal;
   float3 color;
   float  radius;
-  int    ref_count;
 
   __device__
   void Clear() {
@@ -21,7 +20,6 @@ struct __ALIGN__(4) Vertex {
     normal = make_float3(0.0);
     color = make_float3(0);
     radius = 0;
-    ref_count = 0;
   }
 };
 
@@ -0,0 +1,271 @@
+//
+// Created by wei on 18-2-9.
+//
+
+#include "core/voxel_snapshot.h"
+
+#include <algorithm>
+#include <helper_cuda.h>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+#include "util/timer.h"
+
+////////////////////
+/// Device code
+////////////////////
+/// One CUDA block per candidate: the candidates are distinct blocks
+__global__
+void PreserveBlocksKernel(
+    EntryArray    candidate_entries,
+    BlockArray    blocks,
+    VoxelSnapshot snapshot
+) {
+  const HashEntry &entry = candidate_entries[blockIdx.x];
+  __shared__ int copy_index;
+  if (threadIdx.x == 0) {
+    copy_index = snapshot.is_preserved(entry.ptr)
+                 ? -1 : (int)snapshot.NewCopy();
+  }
+  __syncthreads();
+  if (copy_index < 0) return;
+
+  snapshot.copy(copy_index)[threadIdx.x] = blocks[entry.ptr].voxels[threadIdx.x];
+  __threadfence_system();
+  __syncthreads();
+  if (threadIdx.x == 0) {
+    snapshot.set_preserved(entry.ptr, copy_index);
+  }
+}
+
+__global__
+void ExcludeAllocatedBlocksKernel(
+    HashTable     hash_table,
+    VoxelSnapshot snapshot,
+    uint          heap_begin,
+    uint          count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= count) return;
+  snapshot.set_preserved(hash_table.heap(heap_begin + idx),
+                         (int)VoxelSnapshot::kNoCopy);
+}
+
+/// One CUDA block per block of the snapshot. A block not copied yet
+/// may be copied, then written, while it is read: read the copy index
+/// again after the voxels, and take the copy if there is one by then
+__global__
+void GatherSnapshotKernel(
+    VoxelSnapshot snapshot,
+    BlockArray    blocks,
+    const uint   *ptrs,
+    Voxel        *voxels
+) {
+  const uint ptr = ptrs[blockIdx.x];
+  __shared__ int copy_index;
+  if (threadIdx.x == 0) {
+    copy_index = snapshot.copy_index(ptr);
+  }
+  __syncthreads();
+
+  Voxel voxel;
+  if (copy_index >= 0) {
+    voxel = snapshot.copy(copy_index)[threadIdx.x];
+  } else {
+    voxel = blocks[ptr].voxels[threadIdx.x];
+    __threadfence_system();
+    __syncthreads();
+    if (threadIdx.x == 0) {
+      copy_index = snapshot.copy_index(ptr);
+    }
+    __syncthreads();
+    if (copy_index >= 0) {
+      voxel = snapshot.copy(copy_index)[threadIdx.x];
+    }
+  }
+  voxels[blockIdx.x * BLOCK_SIZE + threadIdx.x] = voxel;
+}
+
+////////////////////
+/// Host code
+////////////////////
+__host__
+void VoxelSnapshot::Alloc(const HashParams &params) {
+  if (! is_allocated_on_gpu_) {
+    value_capacity_ = params.value_capacity;
+    entry_count_ = params.entry_count;
+    uint max_chunk_count = (value_capacity_ + kChunkBlockCount - 1)
+                           / kChunkBlockCount;
+
+    checkCudaErrors(cudaMalloc(&snapshot_ids_,
+                               sizeof(uint) * value_capacity_));
+    checkCudaErrors(cudaMemset(snapshot_ids_, 0,
+                               sizeof(uint) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&copy_indices_,
+                               sizeof(uint) * value_capacity_));
+    checkCudaErrors(cudaMalloc(&copy_counter_, sizeof(uint)));
+    checkCudaErrors(cudaMemset(copy_counter_, 0, sizeof(uint)));
+    checkCudaErrors(cudaMalloc(&chunks_, sizeof(Voxel*) * max_chunk_count));
+    host_chunks_ = new Voxel*[max_chunk_count];
+    chunk_count_ = 0;
+    checkCudaErrors(cudaMalloc(&entries_, sizeof(HashEntry) * entry_count_));
+
+    checkCudaErrors(cudaMalloc(&gather_ptrs_,
+                               sizeof(uint) * kGatherBlockCount));
+    checkCudaErrors(cudaMalloc(&gather_voxels_,
+                               sizeof(Voxel) * BLOCK_SIZE * kGatherBlockCount));
+    /// Not synchronized with the legacy default stream of the mapping
+    checkCudaErrors(cudaStreamCreateWithFlags(&stream_,
+                                              cudaStreamNonBlocking));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+__host__
+void VoxelSnapshot::Free() {
+  if (is_allocated_on_gpu_) {
+    checkCudaErrors(cudaStreamDestroy(stream_));
+    checkCudaErrors(cudaFree(snapshot_ids_));
+    checkCudaErrors(cudaFree(copy_indices_));
+    checkCudaErrors(cudaFree(copy_counter_));
+    for (uint i = 0; i < chunk_count_; ++i) {
+      checkCudaErrors(cudaFree(host_chunks_[i]));
+    }
+    checkCudaErrors(cudaFree(chunks_));
+    delete[] host_chunks_;
+    checkCudaErrors(cudaFree(entries_));
+    checkCudaErrors(cudaFree(gather_ptrs_));
+    checkCudaErrors(cudaFree(gather_voxels_));
+    snapshot_ids_ = NULL;
+    copy_indices_ = NULL;
+    copy_counter_ = NULL;
+    chunks_ = NULL;
+    host_chunks_ = NULL;
+    chunk_count_ = 0;
+    entries_ = NULL;
+    gather_ptrs_ = NULL;
+    gather_voxels_ = NULL;
+    is_taken_ = false;
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+__host__
+void VoxelSnapshot::Take(HashTable &hash_table) {
+  CHECK(! is_taken_) << "A snapshot is already taken";
+  /// Copies of the previous snapshots do not match any more
+  ++snapshot_id_;
+  checkCudaErrors(cudaMemset(copy_counter_, 0, sizeof(uint)));
+  /// Entries of older generations are copied too, and skipped on Download
+  generation_ = hash_table.generation();
+  checkCudaErrors(cudaMemcpy(entries_, hash_table.GetGPUPtr(),
+                             sizeof(HashEntry) * entry_count_,
+                             cudaMemcpyDeviceToDevice));
+  is_taken_ = true;
+}
+
+__host__
+void VoxelSnapshot::Release() {
+  is_taken_ = false;
+}
+
+__host__
+uint VoxelSnapshot::copy_count() {
+  uint count;
+  checkCudaErrors(cudaMemcpy(&count, copy_counter_,
+                             sizeof(uint), cudaMemcpyDeviceToHost));
+  return count;
+}
+
+/// Chunks are never moved: Download may be reading them
+__host__
+void VoxelSnapshot::Reserve(uint copy_count) {
+  copy_count = std::min(copy_count, value_capacity_);
+  while (chunk_count_ * kChunkBlockCount < copy_count) {
+    Voxel *chunk;
+    checkCudaErrors(cudaMalloc(&chunk, sizeof(Voxel) * BLOCK_SIZE
+                                       * kChunkBlockCount));
+    host_chunks_[chunk_count_] = chunk;
+    checkCudaErrors(cudaMemcpy(chunks_ + chunk_count_, &chunk,
+                               sizeof(Voxel*), cudaMemcpyHostToDevice));
+    ++chunk_count_;
+  }
+}
+
+__host__
+double VoxelSnapshot::Preserve(EntryArray &candidate_entries,
+                               BlockArray &blocks) {
+  Timer timer;
+  timer.Tick();
+  if (! is_taken_) return timer.Tock();
+
+  uint candidate_count = candidate_entries.count();
+  if (candidate_count == 0) return timer.Tock();
+  /// Each candidate is copied once at most
+  Reserve(copy_count() + candidate_count);
+
+  const dim3 grid_size(candidate_count, 1);
+  const dim3 block_size(BLOCK_SIZE, 1);
+  PreserveBlocksKernel<<<grid_size, block_size>>>(
+      candidate_entries, blocks, *this);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  return timer.Tock();
+}
+
+__host__
+void VoxelSnapshot::ExcludeAllocatedBlocks(HashTable &hash_table,
+                                           uint prev_allocated_count) {
+  if (! is_taken_) return;
+
+  uint allocated_count = hash_table.allocated_count();
+  if (allocated_count <= prev_allocated_count) return;
+  uint new_count = allocated_count - prev_allocated_count;
+
+  const uint threads_per_block = 64;
+  const dim3 grid_size((new_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+  ExcludeAllocatedBlocksKernel<<<grid_size, block_size>>>(
+      hash_table, *this,
+      hash_table.value_capacity - allocated_count, new_count);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+}
+
+__host__
+void VoxelSnapshot::Download(const BlockArray &blocks,
+                             std::vector<int3> &block_positions,
+                             std::vector<Voxel> &voxels) const {
+  std::vector<HashEntry> entries(entry_count_);
+  checkCudaErrors(cudaMemcpyAsync(entries.data(), entries_,
+                                  sizeof(HashEntry) * entry_count_,
+                                  cudaMemcpyDeviceToHost, stream_));
+  checkCudaErrors(cudaStreamSynchronize(stream_));
+
+  std::vector<uint> ptrs;
+  block_positions.clear();
+  for (const HashEntry &entry : entries) {
+    if (entry.ptr == FREE_ENTRY || entry.generation != generation_) continue;
+    block_positions.push_back(entry.pos);
+    ptrs.push_back((uint)entry.ptr);
+  }
+
+  voxels.resize((size_t)BLOCK_SIZE * ptrs.size());
+  for (size_t begin = 0; begin < ptrs.size(); begin += kGatherBlockCount) {
+    uint count = (uint)std::min(ptrs.size() - begin,
+                                (size_t)kGatherBlockCount);
+    checkCudaErrors(cudaMemcpyAsync(gather_ptrs_, ptrs.data() + begin,
+                                    sizeof(uint) * count,
+                                    cudaMemcpyHostToDevice, stream_));
+    const dim3 grid_size(count, 1);
+    const dim3 block_size(BLOCK_SIZE, 1);
+    GatherSnapshotKernel<<<grid_size, block_size, 0, stream_>>>(
+        *this, blocks, gather_ptrs_, gather_voxels_);
+    checkCudaErrors(cudaGetLastError());
+    checkCudaErrors(cudaMemcpyAsync(voxels.data() + BLOCK_SIZE * begin,
+                                    gather_voxels_,
+                                    sizeof(Voxel) * BLOCK_SIZE * count,
+                                    cudaMemcpyDeviceToHost, stream_));
+    checkCudaErrors(cudaStreamSynchronize(stream_));
+  }
+}
@@ -0,0 +1,119 @@
+//
+// Created by wei on 18-2-9.
+//
+// Copy-on-write snapshot of the voxels of the map, one at a time.
+// Take copies the hash entries only; the voxels of a block are copied
+// by Preserve right before the first kernel that writes them after Take.
+// Blocks allocated after Take are excluded, so that the copies are
+// bounded by the blocks of the snapshot.
+// Blocks of the snapshot must stay where they are: the owner pins a
+// MapView for as long as the snapshot is taken.
+// Download reads the snapshot from another thread, on its own stream:
+// copied blocks from the copies, the others from the live BlockArray.
+
+#ifndef CORE_VOXEL_SNAPSHOT_H
+#define CORE_VOXEL_SNAPSHOT_H
+
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "core/common.h"
+#include "core/voxel.h"
+#include "core/hash_entry.h"
+#include "core/hash_table.h"
+#include "core/block_array.h"
+#include "core/entry_array.h"
+
+class VoxelSnapshot {
+public:
+  __host__ VoxelSnapshot() = default;
+
+  __host__ void Alloc(const HashParams &params);
+  __host__ void Free();
+
+  /// Writer side, on the thread that maps
+  __host__ void Take(HashTable &hash_table);
+  // Drop the copies; the chunks are kept for the next snapshot
+  __host__ void Release();
+  __host__ bool is_taken() const {
+    return is_taken_;
+  }
+  // Before writing the voxels of @param candidate_entries
+  // @return seconds
+  __host__ double Preserve(EntryArray &candidate_entries, BlockArray &blocks);
+  // Exclude the blocks handed out by the heap since
+  // @param prev_allocated_count
+  __host__ void ExcludeAllocatedBlocks(HashTable &hash_table,
+                                       uint prev_allocated_count);
+  __host__ uint copy_count();
+
+  /// Reader side, on one other thread, with a copy made after Take
+  // @param blocks as pinned when the snapshot was taken
+  // @param voxels BLOCK_SIZE per block of @param block_positions
+  __host__ void Download(const BlockArray &blocks,
+                         std::vector<int3> &block_positions,
+                         std::vector<Voxel> &voxels) const;
+
+#ifdef __CUDACC__
+  /// -1 if not copied
+  __device__ int copy_index(uint ptr) const {
+    if (((volatile uint*)snapshot_ids_)[ptr] != snapshot_id_) return -1;
+    return (int)((volatile uint*)copy_indices_)[ptr];
+  }
+  __device__ bool is_preserved(uint ptr) const {
+    return snapshot_ids_[ptr] == snapshot_id_;
+  }
+  __device__ uint NewCopy() {
+    return atomicAdd(&copy_counter_[0], 1);
+  }
+  /// Index first, so that a reader seeing the id sees the index
+  __device__ void set_preserved(uint ptr, int copy_index) {
+    copy_indices_[ptr] = (uint)copy_index;
+    __threadfence_system();
+    snapshot_ids_[ptr] = snapshot_id_;
+  }
+  __device__ Voxel* copy(uint copy_index) const {
+    return chunks_[copy_index / kChunkBlockCount]
+           + (copy_index % kChunkBlockCount) * BLOCK_SIZE;
+  }
+#endif
+
+  /// Copies allocated at a time: 10 MB
+  static const uint kChunkBlockCount = 1024;
+  /// Blocks gathered at a time by Download
+  static const uint kGatherBlockCount = 1024;
+  /// In copy_indices_, for excluded blocks
+  static const uint kNoCopy = 0xffffffff;
+
+private:
+  // Room for @param copy_count copies
+  __host__ void Reserve(uint copy_count);
+
+  bool  is_allocated_on_gpu_ = false;
+  bool  is_taken_ = false;
+  uint  value_capacity_;
+  uint  entry_count_;
+  uint  snapshot_id_ = 0;
+  uint  generation_ = 0;    /// of the hash table when taken
+
+  // @param array, per slot: snapshot in which it was preserved
+  uint      *snapshot_ids_;
+  // @param array, per slot: its copy, if preserved
+  uint      *copy_indices_;
+  // @param read-write element
+  uint      *copy_counter_;
+  // @param array of kChunkBlockCount * BLOCK_SIZE voxels each
+  Voxel    **chunks_;
+  // The same pointers, on the host
+  Voxel    **host_chunks_;
+  uint       chunk_count_;
+  // @param array, the hash entries at Take
+  HashEntry *entries_;
+
+  /// Download
+  uint        *gather_ptrs_;
+  Voxel       *gather_voxels_;
+  cudaStream_t stream_;
+};
+
+#endif //CORE_VOXEL_SNAPSHOT_H
@@ -0,0 +1,227 @@
+//
+// Created by wei on 18-2-13.
+//
+
+#include "engine/block_evictor.h"
+
+#include <algorithm>
+#include <climits>
+#include <helper_cuda.h>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+
+#include "core/collect_block_array.h"
+#include "util/timer.h"
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void MarkObservedBlocksKernel(
+    EntryArray frustum_entries,
+    BlockArray blocks,
+    uint       processing_block_count,
+    int        frame
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+  blocks[frustum_entries[idx].ptr].last_observed_frame = frame;
+}
+
+__global__
+void GatherBlockFramesKernel(
+    EntryArray all_entries,
+    BlockArray blocks,
+    uint       processing_block_count,
+    int       *frames
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+  frames[idx] = blocks[all_entries[idx].ptr].last_observed_frame;
+}
+
+/// Condition: last_observed_frame < cutoff_frame, or == cutoff_frame while
+/// the tie budget lasts
+__global__
+void CollectOldestBlocksKernel(
+    EntryArray all_entries,
+    uint       processing_block_count,
+    const int *frames,
+    int        cutoff_frame,
+    int       *tie_budget,
+    EntryArray evicted_entries
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+
+  int frame = frames[idx];
+  bool is_evicted = frame < cutoff_frame
+                    || (frame == cutoff_frame && atomicSub(tie_budget, 1) > 0);
+  if (! is_evicted) return;
+
+  int addr = atomicAdd(&evicted_entries.counter(), 1);
+  evicted_entries[addr] = all_entries[idx];
+  evicted_entries.flag(addr) = 1;
+}
+
+/// One CUDA block per evicted block, from @param begin
+__global__
+void GatherEvictedBlocksKernel(
+    EntryArray evicted_entries,
+    uint       begin,
+    BlockArray blocks,
+    Block     *gather_blocks
+) {
+  const Block &block = blocks[evicted_entries[begin + blockIdx.x].ptr];
+  Block &gather_block = gather_blocks[blockIdx.x];
+  if (threadIdx.x == 0) {
+    gather_block.inner_surfel_count = block.inner_surfel_count;
+    gather_block.boundary_surfel_count = block.boundary_surfel_count;
+    gather_block.life_count_down = block.life_count_down;
+    gather_block.modified_frame = block.modified_frame;
+    gather_block.last_observed_frame = block.last_observed_frame;
+    gather_block.vertex_chunk = block.vertex_chunk;
+    gather_block.triangle_chunk = block.triangle_chunk;
+  }
+  gather_block.voxels[threadIdx.x] = block.voxels[threadIdx.x];
+  gather_block.mesh_units[threadIdx.x] = block.mesh_units[threadIdx.x];
+  gather_block.primal_dual_variables[threadIdx.x]
+      = block.primal_dual_variables[threadIdx.x];
+}
+
+////////////////////
+/// Host code
+////////////////////
+void BlockEvictor::Alloc(const HashParams &params) {
+  if (! is_allocated_on_gpu_) {
+    all_entries_.Resize(params.entry_count);
+    evicted_entries_.Resize(params.entry_count);
+    checkCudaErrors(cudaMalloc(&frames_, sizeof(int) * params.entry_count));
+    checkCudaErrors(cudaMalloc(&tie_budget_, sizeof(int)));
+    checkCudaErrors(cudaMalloc(&gather_blocks_,
+                               sizeof(Block) * kGatherBlockCount));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+void BlockEvictor::Free() {
+  if (is_allocated_on_gpu_) {
+    all_entries_.Free();
+    evicted_entries_.Free();
+    checkCudaErrors(cudaFree(frames_));
+    checkCudaErrors(cudaFree(tie_budget_));
+    checkCudaErrors(cudaFree(gather_blocks_));
+    frames_ = NULL;
+    tie_budget_ = NULL;
+    gather_blocks_ = NULL;
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+double BlockEvictor::MarkObserved(EntryArray &frustum_entries,
+                                  BlockArray &blocks,
+                                  int frame) {
+  Timer timer;
+  timer.Tick();
+  uint processing_block_count = frustum_entries.count();
+  if (processing_block_count == 0) return timer.Tock();
+
+  const uint threads_per_block = 64;
+  const dim3 grid_size((processing_block_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+  MarkObservedBlocksKernel<<<grid_size, block_size>>>(
+      frustum_entries, blocks, processing_block_count, frame);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  return timer.Tock();
+}
+
+/// The cut-off is the frame of the evict_count-th oldest block, found on
+/// the host; blocks of that frame are taken until the count is reached
+uint BlockEvictor::CollectOldestBlocks(HashTable &hash_table,
+                                       BlockArray &blocks,
+                                       uint evict_count,
+                                       int frame) {
+  evicted_entries_.reset_count();
+  if (evict_count == 0) return 0;
+
+  CollectAllBlocks(hash_table, all_entries_);
+  uint processing_block_count = all_entries_.count();
+  if (processing_block_count == 0) return 0;
+
+  const uint threads_per_block = 256;
+  const dim3 grid_size((processing_block_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+  GatherBlockFramesKernel<<<grid_size, block_size>>>(
+      all_entries_, blocks, processing_block_count, frames_);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  host_frames_.resize(processing_block_count);
+  checkCudaErrors(cudaMemcpy(host_frames_.data(), frames_,
+                             sizeof(int) * processing_block_count,
+                             cudaMemcpyDeviceToHost));
+  /// Observed in the current frame: in the frustum, never evicted
+  auto observed_end = std::partition(
+      host_frames_.begin(), host_frames_.end(),
+      [frame](int block_frame) { return block_frame < frame; });
+  uint candidate_count = (uint)(observed_end - host_frames_.begin());
+  if (candidate_count == 0) return 0;
+
+  int cutoff_frame = frame - 1;
+  int tie_budget = INT_MAX;
+  if (candidate_count > evict_count) {
+    std::nth_element(host_frames_.begin(),
+                     host_frames_.begin() + evict_count - 1,
+                     observed_end);
+    cutoff_frame = host_frames_[evict_count - 1];
+    uint older_count = (uint)std::count_if(
+        host_frames_.begin(), observed_end,
+        [cutoff_frame](int block_frame) {
+          return block_frame < cutoff_frame;
+        });
+    tie_budget = (int)(evict_count - older_count);
+  }
+  checkCudaErrors(cudaMemcpy(tie_budget_, &tie_budget, sizeof(int),
+                             cudaMemcpyHostToDevice));
+
+  CollectOldestBlocksKernel<<<grid_size, block_size>>>(
+      all_entries_, processing_block_count, frames_,
+      cutoff_frame, tie_budget_, evicted_entries_);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  return evicted_entries_.count();
+}
+
+double BlockEvictor::DownloadEvictedBlocks(BlockArray &blocks,
+                                           BlockMap &block_map) {
+  Timer timer;
+  timer.Tick();
+  uint evicted_count = evicted_entries_.count();
+  if (evicted_count == 0) return timer.Tock();
+
+  host_entries_.resize(evicted_count);
+  checkCudaErrors(cudaMemcpy(host_entries_.data(),
+                             evicted_entries_.GetGPUPtr(),
+                             sizeof(HashEntry) * evicted_count,
+                             cudaMemcpyDeviceToHost));
+  host_blocks_.resize(kGatherBlockCount);
+  for (uint begin = 0; begin < evicted_count; begin += kGatherBlockCount) {
+    uint gather_count = std::min(kGatherBlockCount, evicted_count - begin);
+    const dim3 grid_size(gather_count, 1);
+    const dim3 block_size(BLOCK_SIZE, 1);
+    GatherEvictedBlocksKernel<<<grid_size, block_size>>>(
+        evicted_entries_, begin, blocks, gather_blocks_);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+    checkCudaErrors(cudaMemcpy(host_blocks_.data(), gather_blocks_,
+                               sizeof(Block) * gather_count,
+                               cudaMemcpyDeviceToHost));
+    for (uint i = 0; i < gather_count; ++i) {
+      block_map.emplace(host_entries_[begin + i].pos, host_blocks_[i]);
+    }
+  }
+  return timer.Tock();
+}
@@ -0,0 +1,72 @@
+//
+// Created by wei on 18-2-13.
+//
+// Eviction under a memory budget, for runs longer than value_capacity
+// allows: the blocks observed least recently, out of the current frustum,
+// are picked to be recycled along with their mesh, and may be downloaded
+// first to be written to disk.
+// A block was last observed at its last_observed_frame, which MarkObserved
+// writes to the blocks collected in the frustum by each Mapping.
+
+#ifndef ENGINE_BLOCK_EVICTOR_H
+#define ENGINE_BLOCK_EVICTOR_H
+
+#include <vector>
+
+#include "core/common.h"
+#include "core/params.h"
+#include "core/hash_table.h"
+#include "core/block_array.h"
+#include "core/entry_array.h"
+#include "engine/logging_engine.h"
+
+class BlockEvictor {
+public:
+  BlockEvictor() = default;
+
+  void Alloc(const HashParams &params);
+  void Free();
+
+  // The blocks of @param frustum_entries were observed at @param frame
+  // @return seconds
+  double MarkObserved(EntryArray &frustum_entries,
+                      BlockArray &blocks,
+                      int frame);
+
+  // Collect into evicted_entries() the @param evict_count blocks of
+  // @param hash_table observed least recently, all before @param frame,
+  // flagged for RecycleGarbageBlockArray
+  // @return collected count, fewer if fewer are out of the frustum
+  uint CollectOldestBlocks(HashTable &hash_table,
+                           BlockArray &blocks,
+                           uint evict_count,
+                           int frame);
+  // Copy the blocks of evicted_entries() to @param block_map
+  // @return seconds
+  double DownloadEvictedBlocks(BlockArray &blocks, BlockMap &block_map);
+
+  EntryArray& evicted_entries() {
+    return evicted_entries_;
+  }
+
+  /// Blocks gathered at a time by DownloadEvictedBlocks
+  static const uint kGatherBlockCount = 128;
+
+private:
+  bool       is_allocated_on_gpu_ = false;
+
+  EntryArray all_entries_;
+  EntryArray evicted_entries_;
+  // @param array, last_observed_frame of all_entries_
+  int       *frames_;
+  // @param read-write element, blocks of the cut-off frame still to take
+  int       *tie_budget_;
+  std::vector<int> host_frames_;
+
+  // @param array, kGatherBlockCount
+  Block     *gather_blocks_;
+  std::vector<Block> host_blocks_;
+  std::vector<HashEntry> host_entries_;
+};
+
+#endif //ENGINE_BLOCK_EVICTOR_H
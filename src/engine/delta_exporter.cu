@@ -0,0 +1,320 @@
+//
+// Created by wei on 18-2-10.
+//
+
+#include "engine/delta_exporter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <helper_cuda.h>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+
+#include "core/collect_block_array.h"
+#include "util/timer.h"
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void StampBlocksKernel(
+    EntryArray candidate_entries,
+    BlockArray blocks,
+    uint       processing_block_count,
+    int        frame
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+  blocks[candidate_entries[idx].ptr].modified_frame = frame;
+}
+
+/// One CUDA block per changed block, from @param begin
+__global__
+void GatherChangedBlocksKernel(
+    EntryArray changed_entries,
+    uint       begin,
+    BlockArray blocks,
+    Voxel     *voxels
+) {
+  const HashEntry &entry = changed_entries[begin + blockIdx.x];
+  voxels[blockIdx.x * BLOCK_SIZE + threadIdx.x]
+      = blocks[entry.ptr].voxels[threadIdx.x];
+}
+
+__global__
+void CountChangedMeshKernel(
+    EntryArray changed_entries,
+    BlockArray blocks,
+    uint       processing_block_count,
+    int2      *element_counts
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+  const Block &block = blocks[changed_entries[idx].ptr];
+  element_counts[idx] = make_int2(block.vertex_chunk.count,
+                                  block.triangle_chunk.count);
+}
+
+/// One CUDA block per changed block: vertices as (pos, normal),
+/// triangles with indices local to the vertex chunk
+__global__
+void GatherChangedMeshKernel(
+    EntryArray changed_entries,
+    BlockArray blocks,
+    Mesh       mesh,
+    const int2 *element_offsets,
+    float3     *vertices,
+    ushort     *triangles
+) {
+  const Block &block = blocks[changed_entries[blockIdx.x].ptr];
+  const int2 offset = element_offsets[blockIdx.x];
+
+  for (int i = threadIdx.x; i < block.vertex_chunk.count; i += blockDim.x) {
+    const Vertex &vertex = mesh.vertex(block.vertex_chunk, i);
+    vertices[2 * (offset.x + i) + 0] = vertex.pos;
+    vertices[2 * (offset.x + i) + 1] = vertex.normal;
+  }
+  for (int i = threadIdx.x; i < block.triangle_chunk.count; i += blockDim.x) {
+    int3 vertex_ptrs = mesh.triangle(block.triangle_chunk, i).vertex_ptrs;
+    ushort *triangle = triangles + 3 * (offset.y + i);
+    triangle[0] = (ushort)(vertex_ptrs.x - block.vertex_chunk.ptr);
+    triangle[1] = (ushort)(vertex_ptrs.y - block.vertex_chunk.ptr);
+    triangle[2] = (ushort)(vertex_ptrs.z - block.vertex_chunk.ptr);
+  }
+}
+
+////////////////////
+/// Host code
+////////////////////
+template <typename T>
+void AppendBytes(std::vector<char> &bytes, const T *data, size_t count) {
+  size_t size = bytes.size();
+  bytes.resize(size + sizeof(T) * count);
+  memcpy(bytes.data() + size, data, sizeof(T) * count);
+}
+
+template <typename T>
+void AppendBytes(std::vector<char> &bytes, const T &value) {
+  AppendBytes(bytes, &value, 1);
+}
+
+void DeltaExporter::Alloc(const HashParams &params) {
+  if (! is_allocated_on_gpu_) {
+    changed_entries_.Resize(params.entry_count);
+    checkCudaErrors(cudaMalloc(&gather_voxels_,
+                               sizeof(Voxel) * BLOCK_SIZE * kGatherBlockCount));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+void DeltaExporter::Free() {
+  if (is_allocated_on_gpu_) {
+    changed_entries_.Free();
+    checkCudaErrors(cudaFree(gather_voxels_));
+    gather_voxels_ = NULL;
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+void DeltaExporter::Reset(int map_epoch) {
+  map_epoch_ = map_epoch;
+  deleted_frames_.clear();
+}
+
+double DeltaExporter::Stamp(EntryArray &candidate_entries,
+                            BlockArray &blocks,
+                            int frame) {
+  Timer timer;
+  timer.Tick();
+  uint processing_block_count = candidate_entries.count();
+  if (processing_block_count == 0) return timer.Tock();
+
+  const uint threads_per_block = 64;
+  const dim3 grid_size((processing_block_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+  StampBlocksKernel<<<grid_size, block_size>>>(
+      candidate_entries, blocks, processing_block_count, frame);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  return timer.Tock();
+}
+
+void DeltaExporter::RecordDeletions(const std::vector<int3> &block_positions,
+                                    int frame) {
+  for (const int3 &pos : block_positions) {
+    deleted_frames_[pos] = frame;
+  }
+}
+
+uint DeltaExporter::BeginDelta(HashTable &hash_table,
+                               BlockArray &blocks,
+                               const char *magic,
+                               int since_frame,
+                               int frame,
+                               std::vector<char> &delta) {
+  CollectBlocksModifiedSince(hash_table, blocks, since_frame,
+                             changed_entries_);
+  uint changed_count = changed_entries_.count();
+  host_entries_.resize(changed_count);
+  if (changed_count > 0) {
+    checkCudaErrors(cudaMemcpy(host_entries_.data(),
+                               changed_entries_.GetGPUPtr(),
+                               sizeof(HashEntry) * changed_count,
+                               cudaMemcpyDeviceToHost));
+  }
+
+  /// A full delta starts from an empty map: no deletions
+  std::vector<int3> deleted_positions;
+  if (since_frame >= 0) {
+    for (auto &&deleted_frame : deleted_frames_) {
+      if (deleted_frame.second > since_frame) {
+        deleted_positions.push_back(deleted_frame.first);
+      }
+    }
+  }
+
+  DeltaHeader header;
+  memcpy(header.magic, magic, 4);
+  header.version = kVersion;
+  header.map_epoch = map_epoch_;
+  header.since_frame = since_frame;
+  header.frame = frame;
+  header.deleted_count = (int)deleted_positions.size();
+  header.block_count = (int)changed_count;
+
+  delta.clear();
+  AppendBytes(delta, header);
+  AppendBytes(delta, deleted_positions.data(), deleted_positions.size());
+  return changed_count;
+}
+
+double DeltaExporter::ExportBlocks(HashTable &hash_table,
+                                   BlockArray &blocks,
+                                   int since_frame,
+                                   int frame,
+                                   std::vector<char> &delta) {
+  Timer timer;
+  timer.Tick();
+  uint changed_count = BeginDelta(hash_table, blocks, "VHBD",
+                                  since_frame, frame, delta);
+
+  host_voxels_.resize(BLOCK_SIZE * kGatherBlockCount);
+  for (uint begin = 0; begin < changed_count; begin += kGatherBlockCount) {
+    uint count = std::min(changed_count - begin, kGatherBlockCount);
+    const dim3 grid_size(count, 1);
+    const dim3 block_size(BLOCK_SIZE, 1);
+    GatherChangedBlocksKernel<<<grid_size, block_size>>>(
+        changed_entries_, begin, blocks, gather_voxels_);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+    checkCudaErrors(cudaMemcpy(host_voxels_.data(), gather_voxels_,
+                               sizeof(Voxel) * BLOCK_SIZE * count,
+                               cudaMemcpyDeviceToHost));
+
+    for (uint i = 0; i < count; ++i) {
+      const Voxel *voxels = host_voxels_.data() + i * BLOCK_SIZE;
+      uint64_t observed[BLOCK_SIZE / 64] = {0};
+      for (int j = 0; j < BLOCK_SIZE; ++j) {
+        if (voxels[j].inv_sigma2 > 0) {
+          observed[j / 64] |= (uint64_t)1 << (j % 64);
+        }
+      }
+      AppendBytes(delta, host_entries_[begin + i].pos);
+      AppendBytes(delta, observed, BLOCK_SIZE / 64);
+      for (int j = 0; j < BLOCK_SIZE; ++j) {
+        if (voxels[j].inv_sigma2 > 0) {
+          AppendBytes(delta, voxels[j].sdf);
+          AppendBytes(delta, voxels[j].inv_sigma2);
+          AppendBytes(delta, voxels[j].color);
+        }
+      }
+    }
+  }
+  return timer.Tock();
+}
+
+double DeltaExporter::ExportMesh(HashTable &hash_table,
+                                 BlockArray &blocks,
+                                 Mesh &mesh,
+                                 int since_frame,
+                                 int frame,
+                                 std::vector<char> &delta) {
+  Timer timer;
+  timer.Tick();
+  uint changed_count = BeginDelta(hash_table, blocks, "VHMD",
+                                  since_frame, frame, delta);
+  if (changed_count == 0) return timer.Tock();
+
+  /// Counts first, to lay the elements out contiguously
+  int2 *element_counts;
+  checkCudaErrors(cudaMalloc(&element_counts, sizeof(int2) * changed_count));
+  const uint threads_per_block = 64;
+  const dim3 count_grid_size((changed_count + threads_per_block - 1)
+                             / threads_per_block, 1);
+  const dim3 count_block_size(threads_per_block, 1);
+  CountChangedMeshKernel<<<count_grid_size, count_block_size>>>(
+      changed_entries_, blocks, changed_count, element_counts);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  std::vector<int2> counts(changed_count), offsets(changed_count);
+  checkCudaErrors(cudaMemcpy(counts.data(), element_counts,
+                             sizeof(int2) * changed_count,
+                             cudaMemcpyDeviceToHost));
+  int2 total = make_int2(0, 0);
+  for (uint i = 0; i < changed_count; ++i) {
+    offsets[i] = total;
+    total.x += counts[i].x;
+    total.y += counts[i].y;
+  }
+  /// Reuse the counts for the offsets
+  int2 *element_offsets = element_counts;
+  checkCudaErrors(cudaMemcpy(element_offsets, offsets.data(),
+                             sizeof(int2) * changed_count,
+                             cudaMemcpyHostToDevice));
+
+  float3 *vertices = NULL;
+  ushort *triangles = NULL;
+  if (total.x > 0) {
+    checkCudaErrors(cudaMalloc(&vertices, sizeof(float3) * 2 * total.x));
+  }
+  if (total.y > 0) {
+    checkCudaErrors(cudaMalloc(&triangles, sizeof(ushort) * 3 * total.y));
+  }
+  const dim3 grid_size(changed_count, 1);
+  const dim3 block_size(128, 1);
+  GatherChangedMeshKernel<<<grid_size, block_size>>>(
+      changed_entries_, blocks, mesh, element_offsets,
+      vertices, triangles);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  std::vector<float3> host_vertices(2 * total.x);
+  std::vector<ushort> host_triangles(3 * total.y);
+  if (total.x > 0) {
+    checkCudaErrors(cudaMemcpy(host_vertices.data(), vertices,
+                               sizeof(float3) * 2 * total.x,
+                               cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaFree(vertices));
+  }
+  if (total.y > 0) {
+    checkCudaErrors(cudaMemcpy(host_triangles.data(), triangles,
+                               sizeof(ushort) * 3 * total.y,
+                               cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaFree(triangles));
+  }
+  checkCudaErrors(cudaFree(element_counts));
+
+  for (uint i = 0; i < changed_count; ++i) {
+    AppendBytes(delta, host_entries_[i].pos);
+    AppendBytes(delta, counts[i].x);
+    AppendBytes(delta, counts[i].y);
+    AppendBytes(delta, host_vertices.data() + 2 * offsets[i].x,
+                2 * counts[i].x);
+    AppendBytes(delta, host_triangles.data() + 3 * offsets[i].y,
+                3 * counts[i].y);
+  }
+  return timer.Tock();
+}
@@ -0,0 +1,105 @@
+//
+// Created by wei on 18-2-10.
+//
+// Compact binary deltas of the map for remote clients: the blocks,
+// or their mesh, written after a given frame, and the blocks deleted
+// since. Blocks are stamped with the frame of their last write by Stamp,
+// deletions are logged by RecordDeletions; a client keeps the frame of
+// the last delta it applied and asks for the changes after it.
+//
+// Both formats start with a DeltaHeader, then deleted_count int3
+// positions of deleted blocks, to apply before the blocks that follow.
+// A block deleted, then allocated again is in both lists.
+// Blocks ("VHBD"), block_count times:
+//   int3 pos, uint64 observed[8]: bit i for voxel i if inv_sigma2 > 0,
+//   then for each observed voxel: float sdf, float inv_sigma2, uchar3 color.
+//   Voxels not observed are cleared.
+// Mesh ("VHMD"), block_count times:
+//   int3 pos, int vertex_count, int triangle_count,
+//   vertex_count x (float3 pos, float3 normal),
+//   triangle_count x ushort3 vertex indices, local to the block.
+//   The mesh of a block replaces the previous one.
+// Little endian, packed, no padding.
+
+#ifndef ENGINE_DELTA_EXPORTER_H
+#define ENGINE_DELTA_EXPORTER_H
+
+#include <map>
+#include <vector>
+
+#include "core/common.h"
+#include "core/params.h"
+#include "core/hash_table.h"
+#include "core/block_array.h"
+#include "core/entry_array.h"
+#include "core/mesh.h"
+#include "engine/logging_engine.h"
+
+struct DeltaHeader {
+  char magic[4];      // "VHBD" or "VHMD"
+  int  version;
+  // Changed by MainEngine::Reset: drop the map and apply a full delta
+  int  map_epoch;
+  int  since_frame;   // -1 for a full delta
+  int  frame;
+  int  deleted_count;
+  int  block_count;
+};
+
+class DeltaExporter {
+public:
+  DeltaExporter() = default;
+
+  void Alloc(const HashParams &params);
+  void Free();
+  // Forget the deletions, for a new map
+  void Reset(int map_epoch);
+
+  // The blocks of @param candidate_entries were written at @param frame
+  // @return seconds
+  double Stamp(EntryArray &candidate_entries,
+               BlockArray &blocks,
+               int frame);
+  void RecordDeletions(const std::vector<int3> &block_positions, int frame);
+
+  // Changes after @param since_frame, up to @param frame, into @param delta
+  // @return seconds
+  double ExportBlocks(HashTable &hash_table,
+                      BlockArray &blocks,
+                      int since_frame,
+                      int frame,
+                      std::vector<char> &delta);
+  double ExportMesh(HashTable &hash_table,
+                    BlockArray &blocks,
+                    Mesh &mesh,
+                    int since_frame,
+                    int frame,
+                    std::vector<char> &delta);
+
+  static const int kVersion = 1;
+  /// Blocks gathered at a time by ExportBlocks
+  static const uint kGatherBlockCount = 1024;
+
+private:
+  // Collect the changed blocks, write the header and the deletions
+  // @return changed block count
+  uint BeginDelta(HashTable &hash_table,
+                  BlockArray &blocks,
+                  const char *magic,
+                  int since_frame,
+                  int frame,
+                  std::vector<char> &delta);
+
+  bool       is_allocated_on_gpu_ = false;
+  int        map_epoch_ = 0;
+  // Position -> last frame it was deleted at
+  std::map<int3, int, Int3Sort> deleted_frames_;
+
+  EntryArray changed_entries_;
+  std::vector<HashEntry> host_entries_;
+  // @param array, kGatherBlockCount * BLOCK_SIZE
+  Voxel     *gather_voxels_;
+  std::vector<Voxel> host_voxels_;
+};
+
+#endif //ENGINE_DELTA_EXPORTER_H
@@ -0,0 +1,181 @@
+//
+// Created by wei on 18-1-28.
+//
+
+#include "engine/frame_pipeline.h"
+
+#include <thread>
+#include <glog/logging.h>
+
+#include "util/profiler.h"
+#include "util/timer.h"
+
+FramePipeline::FramePipeline(
+    MainEngine &main_engine,
+    RGBDDataProvider &data_provider,
+    Sensor &sensor,
+    int queue_size
+) : main_engine_(main_engine),
+    data_provider_(data_provider),
+    sensor_(sensor),
+    frame_queue_(queue_size),
+    video_queue_(queue_size) {}
+
+/// Decode frames ahead of the mapper
+void FramePipeline::LoadLoop(int run_frames) {
+  Timer timer;
+  for (int index = 0; run_frames <= 0 || index < run_frames; ++index) {
+    Frame frame;
+    frame.index = index;
+    timer.Tick();
+    bool is_available = data_provider_.ProvideData(frame.depth,
+                                                   frame.color,
+                                                   frame.wTc);
+    load_stats_.busy_seconds += timer.Tock();
+    if (! is_available) break;
+
+    load_stats_.frame_count++;
+    if (! frame_queue_.Push(std::move(frame))) break;
+  }
+  frame_queue_.Close();
+}
+
+/// The only stage that mutates the map
+void FramePipeline::MapLoop() {
+  Timer timer;
+  Frame frame;
+  while (frame_queue_.Pop(frame)) {
+    {
+      std::unique_lock<std::mutex> lock(map_mutex_);
+      map_cond_.wait(lock, [this] {
+        return is_stopped_ || viewed_frame_ == mapped_frame_;
+      });
+      if (is_stopped_) break;
+    }
+
+    timer.Tick();
+    PROFILE_SCOPE("map");
+    /// Deferred from the previous frame, which has now been viewed
+    if (map_stats_.frame_count > 0) {
+      main_engine_.Recycle();
+    }
+    /// Sensor buffers live on the GPU and are not double buffered,
+    /// so preprocessing stays in this stage
+    sensor_.Process(frame.depth, frame.color);
+    sensor_.set_transform(frame.wTc);
+    main_engine_.Mapping(sensor_);
+    main_engine_.Meshing();
+    double seconds = timer.Tock();
+    map_stats_.busy_seconds += seconds;
+    map_stats_.frame_count++;
+    LOG(INFO) << "Frame " << frame.index << " map time: " << seconds;
+
+    std::lock_guard<std::mutex> lock(map_mutex_);
+    mapped_frame_ = frame.index;
+    mapped_cTw_ = frame.wTc.getInverse();
+    map_cond_.notify_all();
+  }
+
+  std::lock_guard<std::mutex> lock(map_mutex_);
+  is_mapping_done_ = true;
+  map_cond_.notify_all();
+}
+
+/// Reads the map between two map stages, then draws while the next
+/// frame is being mapped
+void FramePipeline::ViewLoop() {
+  Timer timer;
+  while (true) {
+    float4x4 cTw;
+    {
+      std::unique_lock<std::mutex> lock(map_mutex_);
+      map_cond_.wait(lock, [this] {
+        return is_mapping_done_ || mapped_frame_ != viewed_frame_;
+      });
+      if (mapped_frame_ == viewed_frame_) break;
+      cTw = mapped_cTw_;
+    }
+
+    timer.Tick();
+    PROFILE_SCOPE("view");
+    main_engine_.PrepareVisualization(cTw);
+    {
+      std::lock_guard<std::mutex> lock(map_mutex_);
+      viewed_frame_ = mapped_frame_;
+      map_cond_.notify_all();
+    }
+
+    int ret = main_engine_.RenderVisualization();
+    cv::Mat capture;
+    if (main_engine_.CaptureVideoFrame(capture)) {
+      video_queue_.Push(capture);
+    }
+    view_stats_.busy_seconds += timer.Tock();
+    view_stats_.frame_count++;
+
+    if (ret) {
+      Stop();
+      break;
+    }
+  }
+}
+
+void FramePipeline::WriteLoop() {
+  Timer timer;
+  cv::Mat capture;
+  while (video_queue_.Pop(capture)) {
+    timer.Tick();
+    PROFILE_SCOPE("write");
+    main_engine_.WriteVideoFrame(capture);
+    write_stats_.busy_seconds += timer.Tock();
+    write_stats_.frame_count++;
+  }
+}
+
+void FramePipeline::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(map_mutex_);
+    is_stopped_ = true;
+    map_cond_.notify_all();
+  }
+  frame_queue_.Close();
+}
+
+int FramePipeline::Run(int run_frames) {
+  Timer timer;
+  timer.Tick();
+
+  std::thread load_thread(&FramePipeline::LoadLoop, this, run_frames);
+  std::thread map_thread(&FramePipeline::MapLoop, this);
+  std::thread write_thread(&FramePipeline::WriteLoop, this);
+
+  /// GL context belongs to this thread
+  ViewLoop();
+
+  load_thread.join();
+  map_thread.join();
+  video_queue_.Close();
+  write_thread.join();
+
+  /// Recycle of the last frame, as in the sequential loop
+  if (! is_stopped_ && map_stats_.frame_count > 0) {
+    main_engine_.Recycle();
+  }
+
+  Report(timer.Tock());
+  return map_stats_.frame_count;
+}
+
+void FramePipeline::Report(double wall_seconds) {
+  if (wall_seconds <= 0) return;
+  LOG(INFO) << "Pipeline: " << map_stats_.frame_count << " frames in "
+            << wall_seconds << " s, "
+            << map_stats_.frame_count / wall_seconds << " fps";
+  for (const StageStats *stats : {&load_stats_, &map_stats_,
+                                  &view_stats_, &write_stats_}) {
+    LOG(INFO) << "  " << stats->name << ": "
+              << stats->frame_count << " frames, "
+              << stats->busy_seconds << " s busy, "
+              << 100.0 * stats->busy_seconds / wall_seconds << "% occupancy";
+  }
+}
@@ -0,0 +1,83 @@
+//
+// Created by wei on 18-1-28.
+//
+// Pipelined frame loop: decoding of frame N+1, mapping of frame N
+// and rendering / video encoding of frame N-1 run on separate threads,
+// connected by bounded queues.
+// Map mutations (Mapping, Meshing, Recycle) stay on one thread and
+// interleave strictly with PrepareVisualization:
+//   map N -> prepare view N -> recycle N -> map N+1
+// GL calls stay on the calling thread, which owns the context.
+
+#ifndef ENGINE_FRAME_PIPELINE_H
+#define ENGINE_FRAME_PIPELINE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <matrix.h>
+
+#include "engine/main_engine.h"
+#include "sensor/rgbd_data_provider.h"
+#include "sensor/rgbd_sensor.h"
+#include "util/bounded_queue.h"
+
+class FramePipeline {
+public:
+  /// @param queue_size frames buffered between two stages
+  FramePipeline(MainEngine &main_engine,
+                RGBDDataProvider &data_provider,
+                Sensor &sensor,
+                int queue_size = 2);
+
+  /// Run until the data is exhausted, @param run_frames are mapped (if > 0),
+  /// or the visualizer asks to quit. Call from the GL thread.
+  /// @return number of mapped frames
+  int Run(int run_frames);
+
+private:
+  struct Frame {
+    int index;
+    cv::Mat depth;
+    cv::Mat color;
+    float4x4 wTc;
+  };
+
+  /// Busy time of a stage, for the occupancy report
+  struct StageStats {
+    explicit StageStats(const char *name) : name(name) {}
+    const char *name;
+    double busy_seconds = 0;
+    int frame_count = 0;
+  };
+
+  void LoadLoop(int run_frames);
+  void MapLoop();
+  void ViewLoop();
+  void WriteLoop();
+  void Stop();
+  void Report(double wall_seconds);
+
+  MainEngine       &main_engine_;
+  RGBDDataProvider &data_provider_;
+  Sensor           &sensor_;
+
+  BoundedQueue<Frame>   frame_queue_;
+  BoundedQueue<cv::Mat> video_queue_;
+
+  /// Handshake between the map and the view stages
+  std::mutex              map_mutex_;
+  std::condition_variable map_cond_;
+  int      mapped_frame_ = -1;
+  int      viewed_frame_ = -1;
+  float4x4 mapped_cTw_;
+  bool     is_mapping_done_ = false;
+  bool     is_stopped_ = false;
+
+  StageStats load_stats_{"load"};
+  StageStats map_stats_{"map"};
+  StageStats view_stats_{"view"};
+  StageStats write_stats_{"write"};
+};
+
+#endif //ENGINE_FRAME_PIPELINE_H
@@ -2,12 +2,16 @@
 // Created by wei on 17-10-24.
 //
 
+#include <algorithm>
 #include <iomanip>
+#include <vector>
 #include <io/mesh_writer.h>
 #include <glog/logging.h>
 #include <core/block.h>
 #include <core/hash_entry.h>
 #include "logging_engine.h"
+#include "util/profiler.h"
+#include "util/host_memory.h"
 
 void LoggingEngine::Init(std::string path) {
   base_path_ = path;
@@ -26,6 +30,9 @@ void LoggingEngine::Init(std::string path) {
   mesh_stats_file_.open(base_path_ + "/stats_mesh.txt");
 
   localization_err_file_.open(base_path_ + "/localization_error.txt");
+
+  /// Reserved bytes on the first line, then used bytes per frame
+  memory_usage_file_.open(base_path_ + "/memory_usage.txt");
 }
 
 LoggingEngine::~LoggingEngine() {
@@ -44,14 +51,56 @@ void LoggingEngine::ConfigVideoWriter(int width, int height) {
 }
 
 void LoggingEngine::WriteVideo(cv::Mat &mat) {
+  PROFILE_SCOPE("io/video");
   video_writer_ << mat;
 }
 
 void LoggingEngine::ConfigPlyWriter() {
   enable_ply_ = true;
 }
+void LoggingEngine::ConfigPlyDecimation(const DecimationParams &params) {
+  enable_decimation_ = true;
+  decimation_params_ = params;
+  decimation_scheduler_.reset(
+      new TaskScheduler(std::max(0, params.thread_count)));
+}
 void LoggingEngine::WritePly(CompactMesh &mesh) {
-  SavePly(mesh, base_path_ + "/mesh.ply");
+  PROFILE_SCOPE("io/ply");
+  if (enable_decimation_) {
+    SavePly(mesh, base_path_ + "/mesh.ply", decimation_params_,
+            *decimation_scheduler_);
+  } else {
+    SavePly(mesh, base_path_ + "/mesh.ply");
+  }
+}
+
+void LoggingEngine::WriteMemoryUsage(const MemoryTracker &memory_tracker,
+                                     int frame_idx) {
+  if (! memory_usage_file_.is_open()) return;
+  if (memory_usage_file_.tellp() == 0) {
+    memory_usage_file_ << "frame";
+    for (auto &usage : memory_tracker.usages()) {
+      memory_usage_file_ << " " << usage.name;
+    }
+    memory_usage_file_ << " total\nreserved";
+    for (auto &usage : memory_tracker.usages()) {
+      memory_usage_file_ << " " << usage.reserved_bytes;
+    }
+    memory_usage_file_ << " " << memory_tracker.total_reserved_bytes() << "\n";
+  }
+
+  memory_usage_file_ << frame_idx;
+  for (auto &usage : memory_tracker.usages()) {
+    memory_usage_file_ << " " << usage.used_bytes;
+  }
+  memory_usage_file_ << " " << memory_tracker.total_used_bytes() << "\n";
+}
+
+void LoggingEngine::WriteProfile() {
+#ifdef ENABLE_PROFILER
+  Profiler::Instance().WriteSummary(base_path_ + "/profile.txt");
+  Profiler::Instance().WriteChromeTrace(base_path_ + "/trace.json");
+#endif
 }
 
 void LoggingEngine::WriteLocalizationError(float error) {
@@ -211,7 +260,8 @@ BlockMap LoggingEngine::RecordBlockToMemory(
 ) {
 
   BlockMap block_map;
-  Block *block_cpu = new Block[block_num];
+  Block *block_cpu = (Block*)AllocHostPages(sizeof(Block) * block_num);
+  CHECK(block_cpu != NULL) << "Out of host memory for the blocks!";
   HashEntry *candidate_entry_cpu = new HashEntry[entry_num];
   cudaMemcpy(block_cpu, block_gpu,
              sizeof(Block) * block_num,
@@ -222,12 +272,35 @@ BlockMap LoggingEngine::RecordBlockToMemory(
 
   for (uint i = 0; i < entry_num; ++i) {
     int3 &pos = candidate_entry_cpu[i].pos;
-    //CHECK_LT(candidate_entry_cpu[i].ptr, entry_num);
+    /// Recycled since collected, or beyond the copied prefix
+    if (candidate_entry_cpu[i].ptr < 0
+        || (uint)candidate_entry_cpu[i].ptr >= block_num) continue;
     Block &block = block_cpu[candidate_entry_cpu[i].ptr];
     block_map.emplace(pos, block);
   }
 
-  delete[] block_cpu;
+  FreeHostPages(block_cpu, sizeof(Block) * block_num);
   delete[] candidate_entry_cpu;
   return block_map;
 }
+
+void LoggingEngine::WriteBlockPositions(
+    const HashEntry *candidate_entry_gpu, uint entry_num
+) {
+  std::ofstream file(base_path_ + "/block_positions.txt");
+  if (!file.is_open()) {
+    LOG(WARNING) << "can't open block position file.";
+    return;
+  }
+
+  std::vector<HashEntry> entries(entry_num);
+  cudaMemcpy(entries.data(), candidate_entry_gpu,
+             sizeof(HashEntry) * entry_num,
+             cudaMemcpyDeviceToHost);
+
+  file << "# x y z\n";
+  for (uint i = 0; i < entry_num; ++i) {
+    const int3 &pos = entries[i].pos;
+    file << pos.x << ' ' << pos.y << ' ' << pos.z << '\n';
+  }
+}
@@ -6,8 +6,16 @@
 #define ENGINE_LOGGING_ENGINE_H
 
 #include <fstream>
+#include <map>
+#include <memory>
 #include <string>
 #include <opencv2/opencv.hpp>
+#include "core/params.h"
+#include "core/block.h"
+#include "core/hash_entry.h"
+#include "visualization/compact_mesh.h"
+#include "engine/memory_tracker.h"
+#include "util/task_scheduler.h"
 
 class Int3Sort {
 public:
@@ -29,6 +37,7 @@ public:
 
   void ConfigVideoWriter(int width, int height);
   void ConfigPlyWriter();
+  void ConfigPlyDecimation(const DecimationParams& params);
   void WriteVideo(cv::Mat& mat);
   void WritePly(CompactMesh& mesh);
   void WriteLocalizationError(float error);
@@ -38,11 +47,17 @@ public:
                              int frame_idx);
   void WriteMeshingTimeStamp(float time, int frame_idx);
   void WriteMeshStats(int vtx_count, int tri_count);
+  // Used bytes per pool, one line per frame
+  void WriteMemoryUsage(const MemoryTracker& memory_tracker, int frame_idx);
+  // profile.txt and trace.json, when built with the profiler
+  void WriteProfile();
 
   BlockMap RecordBlockToMemory(
       const Block *block_gpu, uint block_num,
       const HashEntry *candidate_entry_gpu, uint entry_num
   );
+  // "x y z" per line, the input of the hash table benchmark
+  void WriteBlockPositions(const HashEntry *candidate_entry_gpu, uint entry_num);
   void WriteFormattedBlocks(const BlockMap &blocks, std::string filename);
   BlockMap ReadFormattedBlocks(std::string filename);
   void WriteRawBlocks(const BlockMap &blocks, std::string filename);
@@ -57,6 +72,10 @@ public:
 private:
   bool enable_video_ = false;
   bool enable_ply_ = false;
+  bool enable_decimation_ = false;
+  DecimationParams decimation_params_;
+  /// Kept across WritePly calls, with the chunk sizes it tuned
+  std::unique_ptr<TaskScheduler> decimation_scheduler_;
 
   std::string base_path_;
   std::string prefix_;
@@ -65,6 +84,7 @@ private:
   std::ofstream meshing_time_file_;
   std::ofstream mesh_stats_file_;
   std::ofstream localization_err_file_;
+  std::ofstream memory_usage_file_;
 };
 
 
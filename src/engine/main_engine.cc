@@ -2,6 +2,8 @@
 // Created by wei on 17-10-22.
 //
 
+#include <algorithm>
+#include <sstream>
 #include <mapping/update_bayesian.h>
 #include <optimize/primal_dual.h>
 #include "engine/main_engine.h"
@@ -12,6 +14,9 @@
 #include "mapping/update_simple.h"
 #include "mapping/recycle.h"
 #include "meshing/marching_cubes.h"
+#include "meshing/surface_nets.h"
+#include "meshing/mesh_stats.h"
+#include "util/profiler.h"
 #include "visualization/compress_mesh.h"
 #include "visualization/extract_bounding_box.h"
 
@@ -98,49 +103,99 @@ void MainEngine::Localizing(Sensor &sensor, int iters, float4x4& gt) {
 }
 
 void MainEngine::Mapping(Sensor &sensor) {
-  double alloc_time = AllocBlockArray(
-      hash_table_,
-      sensor,
-      geometry_helper_
-  );
-
-  double collect_time = CollectBlocksInFrustum(
-      hash_table_,
-      sensor,
-      geometry_helper_,
-      candidate_entries_
-  );
+  PROFILE_SCOPE("mapping");
+  if (snapshot_thread_.joinable() && is_snapshot_written_.load()) {
+    ReleaseSnapshot();
+  }
+  /// Whatever the readers that left held
+  epochs_.Collect();
+  camera_pos_ = make_float3(sensor.wTc().m14,
+                            sensor.wTc().m24,
+                            sensor.wTc().m34);
+
+  double alloc_time, collect_time;
+  {
+    PROFILE_SCOPE("alloc");
+    EntryChangeScope entry_change(entry_sequence_);
+    uint prev_allocated_count = hash_table_.allocated_count();
+    alloc_time = AllocBlockArray(
+        hash_table_,
+        sensor,
+        geometry_helper_
+    );
+    {
+      /// Slots handed out never exceed the peak allocated count;
+      /// one more for the first free slot, see BlockPlacement
+      PROFILE_SCOPE("commit");
+      CommitBlocks(hash_table_.allocated_count() + 1);
+    }
+    alloc_time += ClearAllocatedBlocks(
+        hash_table_, blocks_, prev_allocated_count);
+    /// Not in the snapshot: nothing to preserve
+    snapshot_.ExcludeAllocatedBlocks(hash_table_, prev_allocated_count);
+    if (enable_morton_placement_) {
+      PROFILE_SCOPE("place");
+      alloc_time += block_placement_.SortAllocatedBlocks(
+          hash_table_, prev_allocated_count);
+    }
+  }
+  {
+    PROFILE_SCOPE("collect");
+    collect_time = CollectBlocksInFrustum(
+        hash_table_,
+        sensor,
+        geometry_helper_,
+        candidate_entries_
+    );
+  }
+  if (snapshot_.is_taken()) {
+    PROFILE_SCOPE("preserve");
+    collect_time += snapshot_.Preserve(candidate_entries_, blocks_);
+  }
 
   double update_time = 0;
   if (!map_engine_.enable_bayesian_update()) {
     LOG(INFO) << "Simple update";
-    update_time = UpdateBlocksSimple(candidate_entries_,
-                                     blocks_,
-                                     sensor,
-                                     hash_table_,
-                                     geometry_helper_);
+    {
+      PROFILE_SCOPE("update");
+      update_time = UpdateBlocksSimple(candidate_entries_,
+                                       work_queue_,
+                                       blocks_,
+                                       sensor,
+                                       hash_table_,
+                                       geometry_helper_);
+    }
     log_engine_.WriteMappingTimeStamp(
         alloc_time,
         collect_time,
         update_time,
         integrated_frame_count_);
+    mapping_timings_.update = update_time;
   } else {
     LOG(INFO) << "Bayesian update";
-    float predict_seconds = PredictOutlierRatio(
-        candidate_entries_,
-        blocks_,
-        mesh_,
-        sensor,
-        hash_table_,
-        geometry_helper_
-    );
-    update_time = UpdateBlocksBayesian(
-        candidate_entries_,
-        blocks_,
-        sensor,
-        hash_table_,
-        geometry_helper_
-    );
+    float predict_seconds;
+    {
+      PROFILE_SCOPE("predict");
+      predict_seconds = PredictOutlierRatio(
+          candidate_entries_,
+          blocks_,
+          mesh_,
+          sensor,
+          hash_table_,
+          geometry_helper_
+      );
+    }
+    {
+      PROFILE_SCOPE("update");
+      update_time = UpdateBlocksBayesian(
+          candidate_entries_,
+          work_queue_,
+          blocks_,
+          sensor,
+          hash_table_,
+          geometry_helper_
+      );
+    }
 
     log_engine_.WriteMappingTimeStamp(
         alloc_time,
@@ -148,51 +203,299 @@ void MainEngine::Mapping(Sensor &sensor) {
         predict_seconds,
         update_time,
         integrated_frame_count_);
+    mapping_timings_.update = predict_seconds + update_time;
   }
 
+  mapping_timings_.alloc = alloc_time;
+  mapping_timings_.collect = collect_time;
   integrated_frame_count_ ++;
+  {
+    PROFILE_SCOPE("stamp");
+    delta_exporter_.Stamp(candidate_entries_, blocks_,
+                          integrated_frame_count_);
+    /// Still the blocks in the frustum: Visualize and Recycle may
+    /// collect others into candidate_entries_ later
+    block_evictor_.MarkObserved(candidate_entries_, blocks_,
+                                integrated_frame_count_);
+  }
 }
 
-void MainEngine::Meshing() {
-  float time = MarchingCubes(candidate_entries_,
-                             blocks_,
-                             mesh_,
-                             hash_table_,
-                             geometry_helper_,
-                             enable_sdf_gradient_);
+float MainEngine::ExtractMesh(bool enable_lod) {
+  if (enable_surface_nets_) {
+    return SurfaceNets(candidate_entries_,
+                       work_queue_,
+                       blocks_,
+                       mesh_,
+                       hash_table_,
+                       geometry_helper_,
+                       enable_sdf_gradient_);
+  }
+  return MarchingCubes(candidate_entries_,
+                       work_queue_,
+                       blocks_,
+                       mesh_,
+                       hash_table_,
+                       geometry_helper_,
+                       enable_sdf_gradient_,
+                       enable_lod,
+                       camera_pos_);
+}
+
+uint2 MainEngine::mesh_stats() {
+  return CountMeshElements(candidate_entries_, blocks_);
+}
+
+void MainEngine::Meshing(bool enable_lod) {
+  PROFILE_SCOPE("meshing");
+  float time;
+  {
+    PROFILE_SCOPE("extract");
+    time = ExtractMesh(enable_lod);
+  }
   CollectLowSurfelBlocks(candidate_entries_,
                          blocks_,
                          hash_table_,
                          geometry_helper_);
   if (integrated_frame_count_ % 10 == 0) {
-    RecycleGarbageBlockArray(candidate_entries_,
-                             blocks_,
-                             mesh_,
-                             hash_table_);
+    PROFILE_SCOPE("recycle");
+    RecycleGarbageBlocks(candidate_entries_);
   }
   log_engine_.WriteMeshingTimeStamp(time, integrated_frame_count_);
+
+  UpdateMemoryUsage();
+  log_engine_.WriteMemoryUsage(memory_tracker_, integrated_frame_count_);
+}
+
+const std::vector<MemoryUsage>& MainEngine::UpdateMemoryUsage() {
+  memory_tracker_.Update(hash_table_.allocated_count(),
+                         blocks_.committed_count(),
+                         candidate_entries_.count(),
+                         mesh_.vertex_used_count(),
+                         mesh_.triangle_used_count(),
+                         compact_mesh().vertex_count(),
+                         compact_mesh().triangle_count());
+  return memory_tracker_.usages();
 }
 
 void MainEngine::Recycle() {
+  PROFILE_SCOPE("recycle");
   // TODO(wei): change it via global parameters
   int kRecycleGap = 15;
   if (!map_engine_.enable_bayesian_update()
       && integrated_frame_count_ % kRecycleGap == kRecycleGap - 1) {
+    snapshot_.Preserve(candidate_entries_, blocks_);
     StarveOccupiedBlockArray(candidate_entries_, blocks_);
+    delta_exporter_.Stamp(candidate_entries_, blocks_,
+                          integrated_frame_count_);
 
     CollectGarbageBlockArray(candidate_entries_,
                              blocks_,
                              geometry_helper_);
     hash_table_.ResetMutexes();
-    RecycleGarbageBlockArray(candidate_entries_,
-                             blocks_,
-                             mesh_,
-                             hash_table_);
+    RecycleGarbageBlocks(candidate_entries_);
+  }
+
+  if (eviction_occupancy_ > 0) {
+    PROFILE_SCOPE("evict");
+    EvictBlocks();
+  }
+
+  if (defrag_interval_ > 0
+      && integrated_frame_count_ % defrag_interval_ == 0) {
+    Defragment();
+  }
+
+  if (export_interval_ > 0
+      && integrated_frame_count_ % export_interval_ == 0) {
+    std::stringstream ss;
+    ss << "snapshot_" << integrated_frame_count_;
+    if (! ExportSnapshot(ss.str())) {
+      LOG(INFO) << "Snapshot skipped: the previous export is running";
+    }
+  }
+
+  if (publish_interval_ > 0 && map_writer_.is_open()
+      && integrated_frame_count_ % publish_interval_ == 0) {
+    if (! PublishMap()) {
+      LOG(INFO) << "Publication skipped: readers hold the slot";
+    }
+  }
+}
+
+void MainEngine::RecycleGarbageBlocks(EntryArray &garbage_entries) {
+  uint begin = retired_blocks_.count();
+  uint end;
+  {
+    EntryChangeScope entry_change(entry_sequence_);
+    end = RetireGarbageBlockArray(garbage_entries,
+                                  hash_table_,
+                                  retired_blocks_);
+  }
+  if (end > begin) {
+    std::vector<int3> block_positions;
+    retired_blocks_.DownloadPositions(begin, end, block_positions);
+    delta_exporter_.RecordDeletions(block_positions, integrated_frame_count_);
+    epochs_.Defer([this, begin, end]() {
+      FreeRetiredBlocks(retired_blocks_, begin, end,
+                        blocks_, mesh_, hash_table_);
+      freed_retired_count_ = end;
+    });
+  }
+  /// At once when no MapView is pinned
+  epochs_.Collect();
+}
+
+/// Blocks retired, but held by MapViews, are not counted: they return
+/// to the heap later, and counting them would make room twice
+uint MainEngine::EvictBlocks() {
+  const float kEvictionMargin = 0.05f;
+  uint capacity = hash_params_.value_capacity;
+  uint pending_count = retired_blocks_.count() - freed_retired_count_;
+  uint live_count = hash_table_.allocated_count() - pending_count;
+  if (live_count <= (uint)(eviction_occupancy_ * capacity)) return 0;
+
+  float target_occupancy = std::max(0.0f,
+                                    eviction_occupancy_ - kEvictionMargin);
+  uint evict_count = live_count - (uint)(target_occupancy * capacity);
+  uint evicted_count = block_evictor_.CollectOldestBlocks(
+      hash_table_, blocks_, evict_count, integrated_frame_count_);
+  if (evicted_count < evict_count) {
+    LOG(WARNING) << "Only " << evicted_count << " of " << evict_count
+                 << " blocks to evict are out of the frustum";
+  }
+  if (evicted_count == 0) return 0;
+
+  if (enable_eviction_spill_) {
+    BlockMap block_map;
+    block_evictor_.DownloadEvictedBlocks(blocks_, block_map);
+    std::stringstream ss;
+    ss << "evicted_" << integrated_frame_count_;
+    log_engine_.WriteRawBlocks(block_map, ss.str());
+  }
+
+  hash_table_.ResetMutexes();
+  RecycleGarbageBlocks(block_evictor_.evicted_entries());
+  evicted_block_count_ += evicted_count;
+  LOG(INFO) << "Evicted " << evicted_count << " blocks at frame "
+            << integrated_frame_count_ << ", " << live_count - evicted_count
+            << " / " << capacity << " left; "
+            << evicted_block_count_ << " evicted in all";
+  return evicted_count;
+}
+
+void MainEngine::CommitBlocks(uint block_count) {
+  std::vector<void*> retired_buffers;
+  blocks_.Commit(block_count, &retired_buffers);
+  if (retired_buffers.empty()) return;
+
+  PublishMapHandles();
+  epochs_.Defer([retired_buffers]() {
+    for (void *buffer : retired_buffers) {
+      checkCudaErrors(cudaFree(buffer));
+    }
+  });
+  epochs_.Collect();
+}
+
+/// Before the Defer of what the previous handles point to,
+/// so that readers pinned after it get these
+void MainEngine::PublishMapHandles() {
+  MapHandles *handles = new MapHandles;
+  handles->hash_table = hash_table_;
+  handles->blocks = blocks_;
+  handles->geometry_helper = geometry_helper_;
+  const MapHandles *prev_handles = published_handles_.exchange(handles);
+  if (prev_handles != NULL) {
+    epochs_.Defer([prev_handles]() {
+      delete prev_handles;
+    });
   }
 }
 
+MapView MainEngine::PinMapView() {
+  return MapView(epochs_, published_handles_, entry_sequence_);
+}
+
+/// Blocks may move, and the heap is rebuilt from the allocated entries,
+/// only if nothing else reads them or owes them to the heap: no export
+/// thread, no MapView, and no retired block waiting for its free
+bool MainEngine::CanMoveBlocks() {
+  WaitForExport();
+  epochs_.Collect();
+  if (epochs_.pinned_reader_count() > 0) {
+    LOG(INFO) << "Blocks not moved: MapViews are pinned";
+    return false;
+  }
+  if (retired_blocks_.count() != freed_retired_count_) {
+    LOG(INFO) << "Blocks not moved: retired blocks are not freed yet";
+    return false;
+  }
+  return true;
+}
+
+double MainEngine::Defragment() {
+  PROFILE_SCOPE("defrag");
+  if (! CanMoveBlocks()) return 0;
+  /// Views may be pinned since
+  EntryChangeScope entry_change(entry_sequence_);
+  return block_placement_.Defragment(hash_table_,
+                                     blocks_,
+                                     candidate_entries_);
+}
+
+double MainEngine::Compact() {
+  PROFILE_SCOPE("compact");
+  if (! CanMoveBlocks()) return 0;
+  EntryChangeScope entry_change(entry_sequence_);
+  return block_placement_.Compact(hash_table_,
+                                  blocks_,
+                                  candidate_entries_);
+}
+
+double MainEngine::RayCast(RayCaster &ray_caster, const float4x4 &c_T_w) {
+  PROFILE_SCOPE("raycast");
+  Timer timer;
+  timer.Tick();
+  ray_caster.Cast(hash_table_, blocks_, ray_caster.data(),
+                  geometry_helper_, c_T_w);
+  return timer.Tock();
+}
+
+double MainEngine::DownloadBlocks(HostBlocks &host_blocks,
+                                  uint shard_count) {
+  Timer timer;
+  timer.Tick();
+  host_blocks.Download(candidate_entries_, blocks_, hash_table_,
+                       shard_count);
+  return timer.Tock();
+}
+
+double MainEngine::RayCast(CpuRayCaster &cpu_ray_caster,
+                           const HostBlocks &host_blocks,
+                           const float4x4 &c_T_w) {
+  PROFILE_SCOPE("cpu_raycast");
+  Timer timer;
+  timer.Tick();
+  cpu_ray_caster.Cast(host_blocks, geometry_helper_, c_T_w);
+  return timer.Tock();
+}
+
 // view: world -> camera
 int MainEngine::Visualize(float4x4 view, float4x4 view_gt) {
+  PrepareVisualization(view);
+#ifndef HEADLESS
+  if (enable_visualization_ && vis_engine_.enable_trajectory()) {
+    vis_engine_.trajectory().AddPose(view_gt.getInverse());
+  }
+#endif
+  return RenderVisualization();
+}
+
+void MainEngine::PrepareVisualization(float4x4 view) {
+#ifndef HEADLESS
+  if (! enable_visualization_) return;
+  PROFILE_SCOPE("visualize");
+
   if (vis_engine_.enable_interaction()) {
     vis_engine_.update_view_matrix();
   } else {
@@ -205,15 +508,19 @@ int MainEngine::Visualize(float4x4 view, float4x4 view_gt) {
   }
 
   if (vis_engine_.enable_global_mesh()) {
+    PROFILE_SCOPE("collect");
     CollectAllBlocks(hash_table_, candidate_entries_);
   } // else CollectBlocksInFrustum
 
   int3 timing;
-  CompressMesh(candidate_entries_,
-               blocks_,
-               mesh_,
-               vis_engine_.compact_mesh(),
-               timing);
+  {
+    PROFILE_SCOPE("compress");
+    CompressMesh(candidate_entries_,
+                 blocks_,
+                 mesh_,
+                 vis_engine_.compact_mesh(),
+                 timing);
+  }
 
   if (vis_engine_.enable_bounding_box()) {
     vis_engine_.bounding_box().Reset();
@@ -224,91 +531,236 @@ int MainEngine::Visualize(float4x4 view, float4x4 view_gt) {
   }
   if (vis_engine_.enable_trajectory()) {
     vis_engine_.trajectory().AddPose(view.getInverse());
-    vis_engine_.trajectory().AddPose(view_gt.getInverse());
   }
 
 
   if (vis_engine_.enable_ray_casting()) {
+    PROFILE_SCOPE("raycast");
     Timer timer;
     timer.Tick();
-    vis_engine_.RenderRayCaster(view,
-                                blocks_,
-                                hash_table_,
-                                geometry_helper_);
+    if (enable_cpu_ray_casting_) {
+      vis_engine_.RenderCpuRayCaster(view,
+                                     candidate_entries_,
+                                     blocks_,
+                                     hash_table_,
+                                     geometry_helper_);
+    } else {
+      vis_engine_.RenderRayCaster(view,
+                                  blocks_,
+                                  hash_table_,
+                                  geometry_helper_);
+    }
     LOG(INFO) << " Raycasting time: " << timer.Tock();
   }
 
+#endif
+}
+
+int MainEngine::RenderVisualization() {
+#ifdef HEADLESS
+  return 0;
+#else
+  if (! enable_visualization_) return 0;
+  PROFILE_SCOPE("render");
   return  vis_engine_.Render();
+#endif
 }
 
 int MainEngine::Visualize(float4x4 view) {
-  if (vis_engine_.enable_interaction()) {
-    vis_engine_.update_view_matrix();
-  } else {
-    glm::mat4 glm_view;
-    for (int i = 0; i < 4; ++i)
-      for (int j = 0; j < 4; ++j)
-        glm_view[i][j] = view.entries2[i][j];
-    glm_view = glm::transpose(glm_view);
-    vis_engine_.set_view_matrix(glm_view);
+  PrepareVisualization(view);
+  return RenderVisualization();
+}
+
+void MainEngine::Log() {
+  PROFILE_SCOPE("log");
+  cv::Mat capture;
+  if (CaptureVideoFrame(capture)) {
+    WriteVideoFrame(capture);
   }
+}
 
-  if (vis_engine_.enable_global_mesh()) {
-    CollectAllBlocks(hash_table_, candidate_entries_);
-  } // else CollectBlocksInFrustum
+bool MainEngine::CaptureVideoFrame(cv::Mat &capture) {
+#ifndef HEADLESS
+  if (enable_visualization_ && log_engine_.enable_video()) {
+    capture = vis_engine_.Capture();
+    return true;
+  }
+#endif
+  return false;
+}
 
-  int3 timing;
-  CompressMesh(candidate_entries_,
-               blocks_,
-               mesh_,
-               vis_engine_.compact_mesh(),
-               timing);
+void MainEngine::WriteVideoFrame(cv::Mat &capture) {
+  log_engine_.WriteVideo(capture);
+}
 
-  if (vis_engine_.enable_bounding_box()) {
-    vis_engine_.bounding_box().Reset();
+bool MainEngine::ExportSnapshot(std::string name) {
+  if (snapshot_thread_.joinable()) {
+    if (! is_snapshot_written_.load()) return false;
+    ReleaseSnapshot();
+  }
+  PROFILE_SCOPE("snapshot");
+  /// Blocks of the snapshot are neither freed nor moved until unpinned
+  snapshot_view_.reset(new MapView(PinMapView()));
+  snapshot_.Take(hash_table_);
+  is_snapshot_written_.store(false);
+  snapshot_thread_ = std::thread(&MainEngine::WriteSnapshot, this,
+                                 snapshot_, name);
+  return true;
+}
 
-    ExtractBoundingBox(candidate_entries_,
-                       vis_engine_.bounding_box(),
-                       geometry_helper_);
+void MainEngine::WriteSnapshot(VoxelSnapshot snapshot, std::string name) {
+  Timer timer;
+  timer.Tick();
+  std::vector<int3> block_positions;
+  std::vector<Voxel> voxels;
+  snapshot.Download(snapshot_view_->handles().blocks,
+                    block_positions, voxels);
+
+  BlockMap block_map;
+  for (size_t i = 0; i < block_positions.size(); ++i) {
+    Block &block = block_map[block_positions[i]];
+    block.Clear();
+    std::copy(voxels.begin() + i * BLOCK_SIZE,
+              voxels.begin() + (i + 1) * BLOCK_SIZE,
+              block.voxels);
   }
-  if (vis_engine_.enable_trajectory()) {
-    vis_engine_.trajectory().AddPose(view.getInverse());
+  log_engine_.WriteRawBlocks(block_map, name);
+  LOG(INFO) << "Snapshot " << name << ": " << block_map.size()
+            << " blocks written in " << timer.Tock() << "s";
+  is_snapshot_written_.store(true);
+}
+
+void MainEngine::WaitForExport() {
+  if (snapshot_thread_.joinable()) {
+    ReleaseSnapshot();
   }
+}
 
+void MainEngine::ReleaseSnapshot() {
+  snapshot_thread_.join();
+  LOG(INFO) << "Snapshot blocks copied on write: " << snapshot_.copy_count();
+  snapshot_.Release();
+  snapshot_view_.reset();
+}
 
-  if (vis_engine_.enable_ray_casting()) {
-    Timer timer;
-    timer.Tick();
-    vis_engine_.RenderRayCaster(view,
-                                blocks_,
-                                hash_table_,
-                                geometry_helper_);
-    LOG(INFO) << " Raycasting time: " << timer.Tock();
-  }
+int MainEngine::ExportChangedBlocks(int since_frame,
+                                    std::vector<char> &delta) {
+  PROFILE_SCOPE("delta");
+  double seconds = delta_exporter_.ExportBlocks(
+      hash_table_, blocks_, since_frame, integrated_frame_count_, delta);
+  LOG(INFO) << "Block delta since " << since_frame << ": "
+            << delta.size() << " bytes in " << seconds << "s";
+  return integrated_frame_count_;
+}
 
-  return  vis_engine_.Render();
+int MainEngine::ExportChangedMesh(int since_frame,
+                                  std::vector<char> &delta) {
+  PROFILE_SCOPE("delta");
+  double seconds = delta_exporter_.ExportMesh(
+      hash_table_, blocks_, mesh_, since_frame, integrated_frame_count_,
+      delta);
+  LOG(INFO) << "Mesh delta since " << since_frame << ": "
+            << delta.size() << " bytes in " << seconds << "s";
+  return integrated_frame_count_;
 }
 
-void MainEngine::Log() {
-  if (log_engine_.enable_video()) {
-    cv::Mat capture = vis_engine_.Capture();
-    log_engine_.WriteVideo(capture);
+bool MainEngine::ConfigMapPublisher(std::string name) {
+  if (! map_writer_.Open(name,
+                         mesh_params_.max_vertex_count,
+                         mesh_params_.max_triangle_count,
+                         hash_params_.entry_count)) {
+    return false;
+  }
+  if (block_ranges_ == NULL) {
+    checkCudaErrors(cudaMalloc(&block_ranges_, sizeof(MeshBlockRange)
+                                               * hash_params_.entry_count));
+    publish_entries_.Resize(hash_params_.entry_count);
+    publish_mesh_.Resize(mesh_params_);
+  }
+  /// Pageable memory would be staged by the driver
+  is_map_segment_pinned_ = cudaHostRegister(map_writer_.segment(),
+                                            map_writer_.segment_bytes(),
+                                            cudaHostRegisterDefault)
+                           == cudaSuccess;
+  if (! is_map_segment_pinned_) {
+    cudaGetLastError();
+    LOG(WARNING) << "Shared map not pinned: copies are staged";
   }
+  return true;
 }
 
-void MainEngine::FinalLog() {
-  CollectAllBlocks(hash_table_, candidate_entries_);
-  Meshing();
+bool MainEngine::PublishMap() {
+  PROFILE_SCOPE("publish");
+  const SharedMapArrays *arrays = map_writer_.BeginWrite();
+  if (arrays == NULL) return false;
+
+  /// Arrays of its own: the view stage reads compact_mesh() and
+  /// candidate_entries_ meanwhile in the FramePipeline
+  CollectAllBlocks(hash_table_, publish_entries_);
   int3 timing;
+  CompressMesh(publish_entries_,
+               blocks_,
+               mesh_,
+               publish_mesh_, timing,
+               block_ranges_);
+
+  uint vertex_count = publish_mesh_.vertex_count();
+  uint triangle_count = publish_mesh_.triangle_count();
+  uint block_count = publish_entries_.count();
+  checkCudaErrors(cudaMemcpy(arrays->vertices, publish_mesh_.vertices(),
+                             sizeof(float3) * vertex_count,
+                             cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaMemcpy(arrays->normals, publish_mesh_.normals(),
+                             sizeof(float3) * vertex_count,
+                             cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaMemcpy(arrays->colors, publish_mesh_.colors(),
+                             sizeof(float3) * vertex_count,
+                             cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaMemcpy(arrays->triangles, publish_mesh_.triangles(),
+                             sizeof(int3) * triangle_count,
+                             cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaMemcpy(arrays->blocks, block_ranges_,
+                             sizeof(MeshBlockRange) * block_count,
+                             cudaMemcpyDeviceToHost));
+  map_writer_.EndWrite(integrated_frame_count_,
+                       vertex_count, triangle_count, block_count);
+  return true;
+}
+
+void MainEngine::CompressGlobalMesh() {
+  {
+    PROFILE_SCOPE("collect");
+    CollectAllBlocks(hash_table_, candidate_entries_);
+  }
+  Meshing(false);
+  int3 timing;
+  PROFILE_SCOPE("compress");
   CompressMesh(candidate_entries_,
                blocks_,
                mesh_,
-               vis_engine_.compact_mesh(), timing);
+               compact_mesh(), timing);
+}
+
+void MainEngine::SaveGlobalMesh() {
   if (log_engine_.enable_ply()) {
-    log_engine_.WritePly(vis_engine_.compact_mesh());
+    log_engine_.WritePly(compact_mesh());
   }
-  log_engine_.WriteMeshStats(vis_engine_.compact_mesh().vertex_count(),
-                             vis_engine_.compact_mesh().triangle_count());
+  log_engine_.WriteMeshStats(compact_mesh().vertex_count(),
+                             compact_mesh().triangle_count());
+}
+
+void MainEngine::FinalLog() {
+  WaitForExport();
+  {
+    PROFILE_SCOPE("final");
+    CompressGlobalMesh();
+    SaveGlobalMesh();
+  }
+  /// All the blocks are collected by CompressGlobalMesh
+  log_engine_.WriteBlockPositions(candidate_entries_.GetGPUPtr(),
+                                  candidate_entries_.count());
+  LOG(INFO) << "GPU memory:\n" << memory_tracker_.Summary();
+  log_engine_.WriteProfile();
 }
 
 /// Life cycle
@@ -317,7 +769,8 @@ MainEngine::MainEngine(
     const VolumeParams &volume_params,
     const MeshParams &mesh_params,
     const SensorParams &sensor_params,
-    const RayCasterParams &ray_caster_params
+    const RayCasterParams &ray_caster_params,
+    bool enable_lazy_commit
 ) {
 
   hash_params_ = hash_params;
@@ -326,32 +779,94 @@ MainEngine::MainEngine(
   sensor_params_ = sensor_params;
   ray_caster_params_ = ray_caster_params;
 
+  memory_tracker_.Init(hash_params, mesh_params, sensor_params);
+  LOG(INFO) << "Predicted GPU memory:\n" << memory_tracker_.Summary();
+
   hash_table_.Resize(hash_params);
   candidate_entries_.Resize(hash_params.entry_count);
-  blocks_.Resize(hash_params.value_capacity);
+  /// Lazily: blocks are committed in Mapping as the heap hands them out
+  blocks_.Resize(hash_params.value_capacity,
+                 enable_lazy_commit ? 0 : hash_params.value_capacity);
+  block_placement_.Alloc(hash_params);
+  work_queue_.Alloc(hash_params);
+  block_evictor_.Alloc(hash_params);
 
   mesh_.Resize(mesh_params);
+  compact_mesh().Resize(mesh_params);
 
   geometry_helper_.Init(volume_params);
+
+  retired_blocks_.Resize(hash_params.value_capacity);
+  published_handles_.store(NULL);
+  entry_sequence_.store(0);
+  PublishMapHandles();
+
+  snapshot_.Alloc(hash_params);
+  is_snapshot_written_.store(false);
+
+  delta_exporter_.Alloc(hash_params);
 }
 
 MainEngine::~MainEngine() {
+  WaitForExport();
+  snapshot_.Free();
+  delta_exporter_.Free();
+  if (is_map_segment_pinned_) {
+    checkCudaErrors(cudaHostUnregister(map_writer_.segment()));
+  }
+  map_writer_.Close();
+  if (block_ranges_ != NULL) {
+    checkCudaErrors(cudaFree(block_ranges_));
+    publish_entries_.Free();
+    publish_mesh_.Free();
+  }
+  epochs_.CollectAll();
+  delete published_handles_.load();
+  retired_blocks_.Free();
+
   hash_table_.Free();
   blocks_.Free();
+  block_placement_.Free();
+  work_queue_.Free();
+  block_evictor_.Free();
   mesh_.Free();
+#ifdef HEADLESS
+  compact_mesh_.Free();
+#endif
 
   candidate_entries_.Free();
 }
 
 /// Reset
-void MainEngine::Reset() {
+void MainEngine::Reset(bool clear_all) {
   integrated_frame_count_ = 0;
 
+  WaitForExport();
+  CHECK(epochs_.pinned_reader_count() == 0)
+      << "Reset while MapViews are pinned";
+  /// Retired blocks go back to the heap before the heap is reset
+  epochs_.CollectAll();
+  retired_blocks_.Reset();
+  freed_retired_count_ = 0;
+  evicted_block_count_ = 0;
   hash_table_.Reset();
-  blocks_.Reset();
-  mesh_.Reset();
+  if (clear_all) {
+    blocks_.Reset();
+    mesh_.Reset();
+  } else {
+    blocks_.ResetLazily();
+    mesh_.ResetLazily();
+  }
 
   candidate_entries_.Reset();
+#ifndef HEADLESS
+  /// Modified frames start over: the host copy would match them
+  vis_engine_.host_blocks().Clear();
+#endif
+  /// A new block generation
+  PublishMapHandles();
+  /// Clients of the deltas start over
+  delta_exporter_.Reset(++map_epoch_);
 }
 
 void MainEngine::ConfigMappingEngine(
@@ -362,6 +877,7 @@ void MainEngine::ConfigMappingEngine(
                    enable_bayesian_update);
 }
 
+#ifndef HEADLESS
 void MainEngine::ConfigVisualizingEngine(
     gl::Light &light,
     bool enable_navigation,
@@ -372,6 +888,7 @@ void MainEngine::ConfigVisualizingEngine(
     bool enable_ray_caster,
     bool enable_color
 ) {
+  enable_visualization_ = true;
   vis_engine_.Init("VisEngine", 640, 480);
   vis_engine_.set_interaction_mode(enable_navigation);
   vis_engine_.set_light(light);
@@ -380,7 +897,6 @@ void MainEngine::ConfigVisualizingEngine(
                               enable_global_mesh,
                               enable_polygon_mode,
                               enable_color);
-  vis_engine_.compact_mesh().Resize(mesh_params_);
 
   if (enable_bounding_box || enable_trajectory) {
     vis_engine_.BuildHelperProgram();
@@ -397,6 +913,7 @@ void MainEngine::ConfigVisualizingEngine(
     vis_engine_.BuildRayCaster(ray_caster_params_);
   }
 }
+#endif
 
 void MainEngine::ConfigLoggingEngine(
     std::string path,
@@ -412,10 +929,35 @@ void MainEngine::ConfigLoggingEngine(
   }
 }
 
+void MainEngine::ConfigMeshDecimation(
+    float max_error,
+    float triangle_ratio
+) {
+  DecimationParams decimation_params;
+  decimation_params.max_error = max_error;
+  decimation_params.triangle_ratio = triangle_ratio;
+  /// 4 x 4 x 4 blocks per partition
+  decimation_params.partition_size =
+      4 * BLOCK_SIDE_LENGTH * volume_params_.voxel_size;
+  decimation_params.thread_count = 0;
+  log_engine_.ConfigPlyDecimation(decimation_params);
+}
+
 void MainEngine::RecordBlocks(std::string prefix) {
   //CollectAllBlocks(hash_table_, candidate_entries_);
+  /// Compacted, the live blocks fill [0, allocated count): copy only those.
+  /// Otherwise they may lie anywhere in the committed pool
+  uint block_count;
+  if (CanMoveBlocks()) {
+    Compact();
+    block_count = hash_table_.allocated_count();
+  } else {
+    block_count = blocks_.committed_count();
+    LOG(WARNING) << "Blocks not compacted, recording all "
+                 << block_count << " committed ones";
+  }
   BlockMap block_map = log_engine_.RecordBlockToMemory(
-      blocks_.GetGPUPtr(), hash_params_.value_capacity,
+      blocks_.GetGPUPtr(), block_count,
       candidate_entries_.GetGPUPtr(), candidate_entries_.count());
 
   std::stringstream ss("");
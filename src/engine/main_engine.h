@@ -6,30 +6,68 @@
 #ifndef ENGINE_MAIN_ENGINE_H
 #define ENGINE_MAIN_ENGINE_H
 
+#include <atomic>
+#include <memory>
+#include <thread>
+
 #include "core/hash_table.h"
 #include "core/block_array.h"
 #include "core/entry_array.h"
 #include "core/mesh.h"
+#include "core/block_placement.h"
+#include "core/block_work_queue.h"
+#include "core/retired_block_array.h"
+#include "core/voxel_snapshot.h"
 
+#ifndef HEADLESS
 #include "engine/visualizing_engine.h"
+#endif
 #include "engine/logging_engine.h"
+#include "engine/memory_tracker.h"
+#include "engine/map_view.h"
+#include "engine/delta_exporter.h"
+#include "engine/block_evictor.h"
+#include "io/shared_map.h"
 #include "visualization/compact_mesh.h"
 #include "visualization/bounding_box.h"
+#include "visualization/ray_caster.h"
+#include "visualization/cpu_ray_caster.h"
 #include "sensor/rgbd_sensor.h"
 #include "mapping_engine.h"
 
+// Seconds spent in the steps of the last Mapping
+struct MappingTimings {
+  double alloc = 0;
+  double collect = 0;
+  double update = 0;   // including the outlier prediction
+};
+
 class MainEngine {
 public:
   // configure main data
+  // @param enable_lazy_commit commits the blocks as the heap hands them
+  // out: a faster start, but each growth holds and copies the old and the
+  // new arrays at once, which the eager commit of value_capacity never needs.
+  // The mesh pools are committed at start either way
   MainEngine(
       const HashParams& hash_params,
       const VolumeParams& volume_params,
       const MeshParams& mesh_params,
       const SensorParams& sensor_params,
-      const RayCasterParams& ray_caster_params
+      const RayCasterParams& ray_caster_params,
+      bool enable_lazy_commit = false
   );
   ~MainEngine();
-  void Reset();
+  // Hash entries and heap slots start a new generation, O(1);
+  // blocks and mesh elements are cleared lazily, when handed out again;
+  // @param clear_all clears the blocks and the mesh now, O(value_capacity)
+  // Fails while MapViews are pinned
+  void Reset(bool clear_all = false);
+
+  // From any thread, while Mapping, Meshing and Recycle go on:
+  // the blocks found through the view stay valid until it is destroyed.
+  // Defragment and Compact move blocks, and must not run meanwhile
+  MapView PinMapView();
 
   // configure engines
   void ConfigMappingEngine(
@@ -37,6 +75,9 @@ public:
   );
 
   void ConfigLocalizingEngine();
+#ifndef HEADLESS
+  // Without it, or in a HEADLESS build, no GL context is created
+  // and Visualize does nothing
   void ConfigVisualizingEngine(
       gl::Light& light,
       bool enable_navigation,
@@ -47,50 +88,228 @@ public:
       bool enable_ray_caster,
       bool enable_color
   );
+#endif
 
   void ConfigLoggingEngine(
       std::string path,
       bool enable_video,
       bool enable_ply
   );
+  // Simplify the exported mesh
+  void ConfigMeshDecimation(
+      float max_error,
+      float triangle_ratio
+  );
 
   void Localizing(Sensor &sensor, int iters, float4x4& gt);
   void Mapping(Sensor &sensor);
-  void Meshing();
+  void Meshing(bool enable_lod = true);
+  // Mesh the candidate blocks only, without recycling;
+  // LOD by distance applies to marching cubes
+  float ExtractMesh(bool enable_lod = true);
   void Recycle();
+  // Defragment and Compact wait for a running export, then move nothing
+  // and return 0 while MapViews are pinned or retired blocks are not
+  // freed yet
+  // Move all blocks to the front of the BlockArray in Morton order
+  double Defragment();
+  // Move the fewest blocks to fill the front of the BlockArray
+  double Compact();
   int Visualize(float4x4 view);
   int Visualize(float4x4 view, float4x4 view_gt);
+  // Visualize in two steps: the first reads the map on the GPU,
+  // the second only draws, and may overlap with the next Mapping
+  void PrepareVisualization(float4x4 view);
+  int RenderVisualization();
 
   void Log();
+  // Log in two steps, so that encoding may run on another thread
+  bool CaptureVideoFrame(cv::Mat& capture);
+  void WriteVideoFrame(cv::Mat& capture);
+  // Compact when blocks may move, then copy the allocated prefix only
   void RecordBlocks(std::string prefix = "");
+  // Ray cast the map from @param c_T_w, without visualization
+  // @return seconds
+  double RayCast(RayCaster& ray_caster, const float4x4& c_T_w);
+  // The CPU path: copy the candidate blocks new or modified since the
+  // last download to @param host_blocks, then ray cast them
+  // @return seconds
+  double DownloadBlocks(HostBlocks& host_blocks, uint shard_count = 1);
+  double RayCast(CpuRayCaster& cpu_ray_caster,
+                 const HostBlocks& host_blocks,
+                 const float4x4& c_T_w);
+  // Snapshot the voxels, copying none of them yet, and write them as
+  // raw blocks @param name on a background thread while mapping goes on.
+  // Blocks are copied on their first write after the snapshot
+  // @return false if the previous export is still running
+  bool ExportSnapshot(std::string name);
+  void WaitForExport();
+  // Binary deltas of the blocks, or of their mesh, written after
+  // @param since_frame, and of the blocks deleted since; -1 for all.
+  // Between frames, after Recycle. See DeltaExporter for the formats
+  // @return the frame to ask the next delta since
+  int ExportChangedBlocks(int since_frame, std::vector<char> &delta);
+  int ExportChangedMesh(int since_frame, std::vector<char> &delta);
+  // Publish the mesh to the shared memory segment @param name, see
+  // io/shared_map.h. The segment is pinned for the copies from the GPU,
+  // which commits its memory
+  bool ConfigMapPublisher(std::string name);
+  // Mesh all the blocks into a CompactMesh of its own, not the one of
+  // the visualizer, and copy it to the segment
+  // @return false if skipped, readers holding the slot
+  bool PublishMap();
+  // Mesh all the blocks into the CompactMesh, then save it
+  void CompressGlobalMesh();
+  void SaveGlobalMesh();
   void FinalLog();
 
   const int& frame_count() {
     return integrated_frame_count_;
   }
+  const MappingTimings& mapping_timings() {
+    return mapping_timings_;
+  }
   bool& enable_sdf_gradient() {
     return enable_sdf_gradient_;
   }
+  bool& enable_surface_nets() {
+    return enable_surface_nets_;
+  }
+  // New blocks take heap slots in the Morton order of their positions
+  bool& enable_morton_placement() {
+    return enable_morton_placement_;
+  }
+  // Defragment every defrag_interval frames in Recycle, 0 to disable
+  int& defrag_interval() {
+    return defrag_interval_;
+  }
+  // Export a snapshot every export_interval frames in Recycle, 0 to disable
+  int& export_interval() {
+    return export_interval_;
+  }
+  // Publish the mesh every publish_interval frames in Recycle, 0 to disable
+  int& publish_interval() {
+    return publish_interval_;
+  }
+  // In Recycle, once more than eviction_occupancy of value_capacity is
+  // allocated, evict the blocks observed least recently, out of the
+  // frustum, down to a margin below it; 0 to disable
+  float& eviction_occupancy() {
+    return eviction_occupancy_;
+  }
+  // Write the evicted blocks to Blocks/evicted_<frame>.block first,
+  // in the format of RecordBlocks
+  bool& enable_eviction_spill() {
+    return enable_eviction_spill_;
+  }
+  // Blocks evicted since Reset
+  long evicted_block_count() {
+    return evicted_block_count_;
+  }
+  // Ray cast the candidate blocks on the CPU instead of the GPU
+  bool& enable_cpu_ray_casting() {
+    return enable_cpu_ray_casting_;
+  }
+  // (vertex_count, triangle_count) held by the candidate blocks
+  uint2 mesh_stats();
+  // Blocks in the map
+  uint block_count() {
+    return hash_table_.allocated_count();
+  }
+  // Reserved / used / peak bytes of the GPU pools, read from the counters
+  const std::vector<MemoryUsage>& UpdateMemoryUsage();
 
 private:
   // Engines
   MappingEngine     map_engine_;
+#ifndef HEADLESS
   VisualizingEngine vis_engine_;
+#else
+  CompactMesh       compact_mesh_;
+#endif
   LoggingEngine     log_engine_;
+  MemoryTracker     memory_tracker_;
+
+  // Owned by the visualizer when there is one
+  CompactMesh& compact_mesh() {
+#ifndef HEADLESS
+    return vis_engine_.compact_mesh();
+#else
+    return compact_mesh_;
+#endif
+  }
 
   // Core
   HashTable        hash_table_;
   BlockArray       blocks_;
   EntryArray       candidate_entries_;
+  BlockPlacement   block_placement_;
+  // Candidate blocks handed to the update and meshing kernels
+  BlockWorkQueue   work_queue_;
 
   // Meshing
   Mesh             mesh_;
 
+  // Readers
+  // Unlink the blocks flagged in @param garbage_entries, and free them
+  // once no MapView reaches them
+  void RecycleGarbageBlocks(EntryArray &garbage_entries);
+  // Grow the BlockArray, freeing the previous one once no MapView reads it
+  void CommitBlocks(uint block_count);
+  // Whether Defragment and Compact may move blocks now
+  bool CanMoveBlocks();
+  void PublishMapHandles();
+  EpochManager                    epochs_;
+  RetiredBlockArray               retired_blocks_;
+  // Retired blocks [0, freed_retired_count_) are back in the heap
+  uint                            freed_retired_count_ = 0;
+  std::atomic<const MapHandles*>  published_handles_;
+  // Odd while kernels change the HashEntries, see MapView
+  std::atomic<uint64_t>           entry_sequence_;
+
+  // Snapshots
+  // Background thread: download the snapshot and write it
+  void WriteSnapshot(VoxelSnapshot snapshot, std::string name);
+  // Drop the copies and the pin of a finished export
+  void ReleaseSnapshot();
+  VoxelSnapshot                   snapshot_;
+  std::unique_ptr<MapView>        snapshot_view_;
+  std::thread                     snapshot_thread_;
+  std::atomic<bool>               is_snapshot_written_;
+
+  // Deltas
+  DeltaExporter                   delta_exporter_;
+  int                             map_epoch_ = 0;
+
+  // Eviction
+  // @return evicted count
+  uint EvictBlocks();
+  BlockEvictor                    block_evictor_;
+  float                           eviction_occupancy_ = 0;
+  bool                            enable_eviction_spill_ = false;
+  long                            evicted_block_count_ = 0;
+
+  // Publication
+  SharedMapWriter                 map_writer_;
+  MeshBlockRange                 *block_ranges_ = NULL;
+  EntryArray                      publish_entries_;
+  CompactMesh                     publish_mesh_;
+  bool                            is_map_segment_pinned_ = false;
+
   // Geometry
   GeometryHelper  geometry_helper_;
 
   int             integrated_frame_count_ = 0;
+  MappingTimings  mapping_timings_;
+  float3          camera_pos_ = {0, 0, 0};  // for level of detail
   bool            enable_sdf_gradient_;
+  bool            enable_surface_nets_ = false;
+  bool            enable_cpu_ray_casting_ = false;
+  bool            enable_morton_placement_ = false;
+  int             defrag_interval_ = 0;
+  int             export_interval_ = 0;
+  int             publish_interval_ = 0;
+  bool            enable_visualization_ = false;
 
   HashParams hash_params_;
   VolumeParams volume_params_;
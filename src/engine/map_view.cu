@@ -0,0 +1,151 @@
+//
+// Created by wei on 18-2-8.
+//
+
+#include "engine/map_view.h"
+
+#include <algorithm>
+#include <thread>
+#include <helper_cuda.h>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+#include "geometry/voxel_query.h"
+#include "util/timer.h"
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void QueryVoxelsKernel(
+    HashTable      hash_table,
+    BlockArray     blocks,
+    GeometryHelper geometry_helper,
+    const float3  *world_points,
+    Voxel         *voxels,
+    uint           point_count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= point_count) return;
+
+  /// GetVoxelValue, but an entry read while it was written may hold any
+  /// ptr: the result is dropped then, the read must not fault
+  int3 voxel_pos = geometry_helper.WorldToVoxeli(world_points[idx]);
+  int3 block_pos = geometry_helper.VoxelToBlock(voxel_pos);
+  uint3 offset = geometry_helper.VoxelToOffset(block_pos, voxel_pos);
+  HashEntry entry = hash_table.GetEntry(block_pos);
+  Voxel voxel;
+  if (entry.ptr == FREE_ENTRY || entry.ptr < 0
+      || (uint)entry.ptr >= blocks.committed_count()) {
+    voxel.Clear();
+  } else {
+    voxel = blocks[entry.ptr].voxels[geometry_helper.VectorizeOffset(offset)];
+  }
+  voxels[idx] = voxel;
+}
+
+////////////////////
+/// Host code
+////////////////////
+MapView::MapView(EpochManager &epochs,
+                 const std::atomic<const MapHandles*> &published_handles,
+                 const std::atomic<uint64_t> &entry_sequence)
+    : epochs_(&epochs),
+      published_handles_(&published_handles),
+      entry_sequence_(&entry_sequence) {
+  reader_idx_ = epochs_->Pin();
+  /// After the pin: handles replaced from now on are freed after us,
+  /// so that their address is not reused while we compare with it
+  if (reader_idx_ >= 0) {
+    pinned_handles_ = published_handles.load();
+    handles_ = *pinned_handles_;
+  }
+}
+
+MapView::MapView(MapView &&view)
+    : epochs_(view.epochs_),
+      reader_idx_(view.reader_idx_),
+      handles_(view.handles_),
+      published_handles_(view.published_handles_),
+      pinned_handles_(view.pinned_handles_),
+      entry_sequence_(view.entry_sequence_) {
+  view.reader_idx_ = -1;
+}
+
+MapView::~MapView() {
+  epochs_->Unpin(reader_idx_);
+}
+
+void VoxelQuery::Alloc(uint capacity) {
+  if (! is_allocated_on_gpu_) {
+    capacity_ = capacity;
+    checkCudaErrors(cudaMalloc(&world_points_, sizeof(float3) * capacity));
+    checkCudaErrors(cudaMalloc(&voxels_, sizeof(Voxel) * capacity));
+    /// Not synchronized with the legacy default stream of the mapping
+    checkCudaErrors(cudaStreamCreateWithFlags(&stream_,
+                                              cudaStreamNonBlocking));
+    is_allocated_on_gpu_ = true;
+  }
+}
+
+void VoxelQuery::Free() {
+  if (is_allocated_on_gpu_) {
+    checkCudaErrors(cudaStreamDestroy(stream_));
+    checkCudaErrors(cudaFree(world_points_));
+    checkCudaErrors(cudaFree(voxels_));
+    world_points_ = NULL;
+    voxels_ = NULL;
+    is_allocated_on_gpu_ = false;
+  }
+}
+
+double VoxelQuery::Run(const MapView &view,
+                       const std::vector<float3> &world_points,
+                       std::vector<Voxel> &voxels) {
+  Timer timer;
+  timer.Tick();
+  voxels.resize(world_points.size());
+  if (! view.is_pinned()) {
+    LOG(WARNING) << "Querying an unpinned MapView";
+    return timer.Tock();
+  }
+
+  const MapHandles &handles = view.handles();
+  const uint threads_per_block = 256;
+  for (size_t begin = 0; begin < world_points.size(); begin += capacity_) {
+    uint count = (uint)std::min(world_points.size() - begin,
+                                (size_t)capacity_);
+    checkCudaErrors(cudaMemcpyAsync(world_points_,
+                                    world_points.data() + begin,
+                                    sizeof(float3) * count,
+                                    cudaMemcpyHostToDevice, stream_));
+
+    const dim3 grid_size((count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    /// A seqlock on the entries: the writer never waits for us
+    for (;;) {
+      uint64_t sequence = view.entry_sequence();
+      if (sequence % 2 == 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (! view.is_current()) {
+        LOG(WARNING) << "Querying an outdated MapView: pin a new one";
+        voxels.clear();
+        return timer.Tock();
+      }
+      QueryVoxelsKernel<<<grid_size, block_size, 0, stream_>>>(
+          handles.hash_table, handles.blocks, handles.geometry_helper,
+          world_points_, voxels_, count);
+      checkCudaErrors(cudaGetLastError());
+      checkCudaErrors(cudaMemcpyAsync(voxels.data() + begin, voxels_,
+                                      sizeof(Voxel) * count,
+                                      cudaMemcpyDeviceToHost, stream_));
+      /// The view must outlive the kernel
+      checkCudaErrors(cudaStreamSynchronize(stream_));
+      if (view.entry_sequence() == sequence) break;
+      ++retry_count_;
+    }
+  }
+  return timer.Tock();
+}
@@ -0,0 +1,134 @@
+//
+// Created by wei on 18-2-8.
+//
+// Reading the map from other threads while MainEngine keeps mapping.
+// A MapView pins the current epoch: every block it finds through its
+// HashTable stays that block, at that place, until the view is destroyed,
+// since recycled blocks and outgrown BlockArrays are freed only after.
+//
+// What a view guarantees:
+// - HashEntries are read whole, from one state of the table: MainEngine
+//   makes the entry sequence odd while kernels allocate, free or move
+//   entries, and VoxelQuery runs a lookup again if the sequence was odd
+//   or changed meanwhile.
+// - Blocks are never read out of the BlockArray of the view: once the
+//   BlockArray grows (lazy commit), the view is outdated, and queries
+//   through it return nothing. Pin a new one.
+// What it does not:
+// - Voxels are integrated in place, with no sequence: the fields of a
+//   voxel read during an integration may come from two frames, and a
+//   value read twice may differ by the frames integrated in between.
+//   For a frozen copy, export a VoxelSnapshot.
+// - Blocks allocated after the pin may or may not be found.
+// MainEngine::Reset must not run while views are pinned.
+
+#ifndef ENGINE_MAP_VIEW_H
+#define ENGINE_MAP_VIEW_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "core/hash_table.h"
+#include "core/block_array.h"
+#include "geometry/geometry_helper.h"
+#include "util/epoch_manager.h"
+
+// What a reader needs to query the map on the GPU, published by
+// MainEngine whenever one of them changes, and freed by epoch
+struct MapHandles {
+  HashTable      hash_table;
+  BlockArray     blocks;
+  GeometryHelper geometry_helper;
+};
+
+class MapView {
+public:
+  MapView(EpochManager &epochs,
+          const std::atomic<const MapHandles*> &published_handles,
+          const std::atomic<uint64_t> &entry_sequence);
+  MapView(MapView &&view);
+  ~MapView();
+  MapView(const MapView&) = delete;
+  MapView& operator=(const MapView&) = delete;
+
+  // False if all the reader slots were taken: nothing to read
+  bool is_pinned() const {
+    return reader_idx_ >= 0;
+  }
+  const MapHandles& handles() const {
+    return handles_;
+  }
+  // Odd while HashEntries are changed: lookups run between two equal
+  // even values read the entries of one state
+  uint64_t entry_sequence() const {
+    return entry_sequence_->load();
+  }
+  // False once MainEngine published other handles: entries may then
+  // point beyond the BlockArray of this view
+  bool is_current() const {
+    return published_handles_->load() == pinned_handles_;
+  }
+
+private:
+  EpochManager *epochs_;
+  int           reader_idx_;
+  MapHandles    handles_;
+  const std::atomic<const MapHandles*> *published_handles_;
+  const MapHandles                     *pinned_handles_ = NULL;
+  const std::atomic<uint64_t>          *entry_sequence_;
+};
+
+// Makes @param entry_sequence odd for its scope, on the writer thread
+class EntryChangeScope {
+public:
+  explicit EntryChangeScope(std::atomic<uint64_t> &entry_sequence)
+      : entry_sequence_(entry_sequence) {
+    entry_sequence_.fetch_add(1);
+  }
+  /// The kernels changing the entries are synchronized before
+  ~EntryChangeScope() {
+    entry_sequence_.fetch_add(1);
+  }
+  EntryChangeScope(const EntryChangeScope&) = delete;
+  EntryChangeScope& operator=(const EntryChangeScope&) = delete;
+
+private:
+  std::atomic<uint64_t> &entry_sequence_;
+};
+
+// Voxel lookups of one reader thread, on a CUDA stream of its own
+// that does not wait for the kernels of MainEngine
+class VoxelQuery {
+public:
+  VoxelQuery() = default;
+  // @param capacity points per kernel launch
+  void Alloc(uint capacity);
+  void Free();
+
+  // Voxels at @param world_points; inv_sigma2 is 0 where unobserved.
+  // Retried while the entries change, see above; @param voxels is
+  // empty if the view is outdated
+  // @return seconds
+  double Run(const MapView &view,
+             const std::vector<float3> &world_points,
+             std::vector<Voxel> &voxels);
+
+  // Lookups run again since Alloc, the entries having changed meanwhile
+  uint retry_count() const {
+    return retry_count_;
+  }
+
+private:
+  bool         is_allocated_on_gpu_ = false;
+  uint         capacity_;
+  uint         retry_count_ = 0;
+  // @param array
+  float3      *world_points_;
+  // @param array
+  Voxel       *voxels_;
+  cudaStream_t stream_;
+};
+
+#endif //ENGINE_MAP_VIEW_H
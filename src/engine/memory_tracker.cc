@@ -0,0 +1,156 @@
+//
+// Created by wei on 18-1-30.
+//
+
+#include "engine/memory_tracker.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "core/block.h"
+#include "core/hash_entry.h"
+#include "core/vertex.h"
+#include "core/triangle.h"
+#include "core/chunk_heap.h"
+
+namespace {
+const double kMB = 1024.0 * 1024.0;
+
+/// Per element, as in the Alloc of each pool
+const size_t kBlockBytes = sizeof(Block) + sizeof(uint);   // block + generation
+const size_t kHeapSlotBytes = 3 * sizeof(uint)  // heap + generation + ring
+                              + sizeof(int3);
+const size_t kCandidateBytes = 2 * sizeof(HashEntry)  // + BlockWorkQueue
+                               + sizeof(uchar);
+const size_t kCompactVertexBytes = 3 * sizeof(float3);     // pos, normal, color
+const size_t kCompactTriangleBytes = sizeof(int3);
+/// depth_buffer, color_buffer, depth_data, inlier_ratio,
+/// filtered_depth_data, color_data, normal_data,
+/// and the depth, color and normal texture arrays
+const size_t kSensorPixelBytes = sizeof(short) + sizeof(uchar4)
+                                 + 3 * sizeof(float) + 2 * sizeof(float4)
+                                 + sizeof(float) + 2 * sizeof(float4);
+}
+
+void MemoryTracker::Init(
+    const HashParams &hash_params,
+    const MeshParams &mesh_params,
+    const SensorParams &sensor_params
+) {
+  usages_.assign(kPoolCount, MemoryUsage());
+  usages_[kHashEntries].name = "hash_entries";
+  usages_[kHashEntries].reserved_bytes =
+      sizeof(HashEntry) * hash_params.entry_count
+      + sizeof(int) * hash_params.bucket_count
+      + sizeof(uint);
+
+  usages_[kBlockPool].name = "block_pool";
+  usages_[kBlockPool].reserved_bytes =
+      (kBlockBytes + kHeapSlotBytes) * hash_params.value_capacity;
+  value_capacity_ = hash_params.value_capacity;
+
+  usages_[kCandidateEntries].name = "candidate_entries";
+  usages_[kCandidateEntries].reserved_bytes =
+      kCandidateBytes * hash_params.entry_count + 4 * sizeof(int);
+
+  usages_[kVertexHeap].name = "vertex_heap";
+  usages_[kVertexHeap].reserved_bytes =
+      sizeof(Vertex) * mesh_params.max_vertex_count
+      + ChunkHeap::MetaBytes(mesh_params.max_vertex_count);
+
+  usages_[kTriangleHeap].name = "triangle_heap";
+  usages_[kTriangleHeap].reserved_bytes =
+      sizeof(Triangle) * mesh_params.max_triangle_count
+      + ChunkHeap::MetaBytes(mesh_params.max_triangle_count);
+
+  usages_[kCompactMesh].name = "compact_mesh";
+  usages_[kCompactMesh].reserved_bytes =
+      kCompactVertexBytes * mesh_params.max_vertex_count
+      + kCompactTriangleBytes * mesh_params.max_triangle_count
+      + 2 * sizeof(uint);
+
+  /// Fixed size: always fully used
+  usages_[kSensor].name = "sensor";
+  usages_[kSensor].reserved_bytes =
+      kSensorPixelBytes * sensor_params.width * sensor_params.height;
+  set_used(kSensor, usages_[kSensor].reserved_bytes);
+
+  /// All but the block pool are committed at once
+  for (auto &usage : usages_) usage.committed_bytes = usage.reserved_bytes;
+}
+
+void MemoryTracker::set_used(Pool pool, size_t used_bytes) {
+  MemoryUsage &usage = usages_[pool];
+  usage.used_bytes = used_bytes;
+  usage.peak_bytes = std::max(usage.peak_bytes, used_bytes);
+}
+
+void MemoryTracker::Update(
+    uint block_count,
+    uint committed_block_count,
+    uint candidate_count,
+    uint vertex_count,
+    uint triangle_count,
+    uint compact_vertex_count,
+    uint compact_triangle_count
+) {
+  /// One entry per allocated block
+  set_used(kHashEntries, sizeof(HashEntry) * block_count);
+  set_used(kBlockPool, (kBlockBytes + kHeapSlotBytes) * block_count);
+  usages_[kBlockPool].committed_bytes =
+      kBlockBytes * committed_block_count + kHeapSlotBytes * value_capacity_;
+  set_used(kCandidateEntries, kCandidateBytes * candidate_count);
+  set_used(kVertexHeap, sizeof(Vertex) * vertex_count);
+  set_used(kTriangleHeap, sizeof(Triangle) * triangle_count);
+  set_used(kCompactMesh,
+           kCompactVertexBytes * compact_vertex_count
+           + kCompactTriangleBytes * compact_triangle_count);
+}
+
+size_t MemoryTracker::total_reserved_bytes() const {
+  size_t bytes = 0;
+  for (auto &usage : usages_) bytes += usage.reserved_bytes;
+  return bytes;
+}
+
+size_t MemoryTracker::total_committed_bytes() const {
+  size_t bytes = 0;
+  for (auto &usage : usages_) bytes += usage.committed_bytes;
+  return bytes;
+}
+
+size_t MemoryTracker::total_used_bytes() const {
+  size_t bytes = 0;
+  for (auto &usage : usages_) bytes += usage.used_bytes;
+  return bytes;
+}
+
+std::string MemoryTracker::Summary() const {
+  std::stringstream ss;
+  ss << std::left << std::setw(20) << "pool" << std::right
+     << std::setw(12) << "reserved"
+     << std::setw(12) << "committed"
+     << std::setw(12) << "used"
+     << std::setw(12) << "peak"
+     << std::setw(8) << "peak%" << "  (MB)\n";
+  ss << std::fixed << std::setprecision(2);
+  size_t total_peak = 0;
+  for (auto &usage : usages_) {
+    total_peak += usage.peak_bytes;
+    ss << std::left << std::setw(20) << usage.name << std::right
+       << std::setw(12) << usage.reserved_bytes / kMB
+       << std::setw(12) << usage.committed_bytes / kMB
+       << std::setw(12) << usage.used_bytes / kMB
+       << std::setw(12) << usage.peak_bytes / kMB
+       << std::setw(8) << (usage.reserved_bytes > 0
+                           ? 100.0 * usage.peak_bytes / usage.reserved_bytes
+                           : 0.0) << "\n";
+  }
+  ss << std::left << std::setw(20) << "total" << std::right
+     << std::setw(12) << total_reserved_bytes() / kMB
+     << std::setw(12) << total_committed_bytes() / kMB
+     << std::setw(12) << total_used_bytes() / kMB
+     << std::setw(12) << total_peak / kMB << "\n";
+  return ss.str();
+}
@@ -0,0 +1,68 @@
+//
+// Created by wei on 18-1-30.
+//
+// GPU memory of the preallocated pools: bytes reserved from the params,
+// bytes used from the current element counts, and high-water marks.
+
+#ifndef ENGINE_MEMORY_TRACKER_H
+#define ENGINE_MEMORY_TRACKER_H
+
+#include <string>
+#include <vector>
+#include "core/params.h"
+
+struct MemoryUsage {
+  std::string name;
+  size_t reserved_bytes = 0;
+  size_t committed_bytes = 0;  /// allocated on the GPU, <= reserved_bytes
+  size_t used_bytes = 0;
+  size_t peak_bytes = 0;   /// high-water mark of used_bytes
+};
+
+class MemoryTracker {
+public:
+  MemoryTracker() = default;
+
+  /// Reserved bytes follow the Alloc of every pool,
+  /// so they are known before any allocation: the prediction
+  void Init(const HashParams &hash_params,
+            const MeshParams &mesh_params,
+            const SensorParams &sensor_params);
+
+  void Update(uint block_count,
+              uint committed_block_count,
+              uint candidate_count,
+              uint vertex_count,
+              uint triangle_count,
+              uint compact_vertex_count,
+              uint compact_triangle_count);
+
+  const std::vector<MemoryUsage>& usages() const {
+    return usages_;
+  }
+  size_t total_reserved_bytes() const;
+  size_t total_committed_bytes() const;
+  size_t total_used_bytes() const;
+
+  /// One line per pool: reserved, committed, used, peak
+  /// and used / reserved
+  std::string Summary() const;
+
+private:
+  enum Pool {
+    kHashEntries,
+    kBlockPool,
+    kCandidateEntries,
+    kVertexHeap,
+    kTriangleHeap,
+    kCompactMesh,
+    kSensor,
+    kPoolCount
+  };
+  void set_used(Pool pool, size_t used_bytes);
+
+  std::vector<MemoryUsage> usages_;
+  uint value_capacity_ = 0;
+};
+
+#endif //ENGINE_MEMORY_TRACKER_H
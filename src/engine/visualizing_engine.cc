@@ -15,6 +15,7 @@ VisualizingEngine::VisualizingEngine(std::string window_name,
 
 VisualizingEngine::~VisualizingEngine() {
   ray_caster_.Free();
+  cpu_ray_caster_.Free();
   compact_mesh_.Free();
   bounding_box_.Free();
   trajectory_.Free();
@@ -272,4 +273,19 @@ void VisualizingEngine::RenderRayCaster(
                    view);
   cv::imshow("RayCasting", ray_caster_.surface_image());
   cv::waitKey(1);
-}
\ No newline at end of file
+}
+
+void VisualizingEngine::RenderCpuRayCaster(
+    float4x4 view,
+    EntryArray &candidate_entries,
+    BlockArray &blocks,
+    HashTable &hash_table,
+    GeometryHelper &geometry_helper
+) {
+  cpu_ray_caster_.Alloc(ray_caster_.ray_caster_params());
+  /// Kept between frames: only the blocks modified since are copied
+  host_blocks_.Download(candidate_entries, blocks, hash_table);
+  cpu_ray_caster_.Cast(host_blocks_, geometry_helper, view);
+  cv::imshow("RayCasting", cpu_ray_caster_.surface_image());
+  cv::waitKey(1);
+}
@@ -10,6 +10,8 @@
 #include "glwrapper.h"
 #include "visualization/compact_mesh.h"
 #include "visualization/ray_caster.h"
+#include "visualization/cpu_ray_caster.h"
+#include "visualization/host_blocks.h"
 #include "visualization/bounding_box.h"
 
 // TODO: setup a factory
@@ -64,6 +66,16 @@ public:
       HashTable& hash_table,
       GeometryHelper& geometry_helper
   ) ;
+  // @method
+  // download @param candidate_entries to the host and cast there,
+  // skipping empty blocks
+  void RenderCpuRayCaster(
+      float4x4 view,
+      EntryArray& candidate_entries,
+      BlockArray& blocks,
+      HashTable& hash_table,
+      GeometryHelper& geometry_helper
+  );
 
   bool enable_interaction() {
     return enable_interaction_;
@@ -92,6 +104,9 @@ public:
   Trajectory& trajectory() {
     return trajectory_;
   }
+  HostBlocks& host_blocks() {
+    return host_blocks_;
+  }
 
 private:
   bool enable_interaction_ = false;
@@ -124,6 +139,8 @@ private:
 
   // Raycaster
   RayCaster   ray_caster_;
+  CpuRayCaster cpu_ray_caster_;
+  HostBlocks  host_blocks_;
   CompactMesh compact_mesh_;
   BoundingBox bounding_box_;
   Trajectory  trajectory_;
@@ -40,6 +40,12 @@ struct GeometryHelper {
   float sdf_upper_bound;
   float weight_sample;
 
+  /// Region of interest, an oriented box
+  bool   enable_roi;
+  float3 roi_center;
+  float3 roi_half_extent;
+  float3 roi_axes[3];    // unit, in world coordinates
+
   GeometryHelper() = default;
   void Init(const VolumeParams &params) {
     voxel_size = params.voxel_size;
@@ -47,6 +53,22 @@ struct GeometryHelper {
     truncation_distance = params.truncation_distance;
     sdf_upper_bound = params.sdf_upper_bound;
     weight_sample = params.weight_sample;
+
+    enable_roi = params.enable_roi;
+    roi_center = params.roi_center;
+    roi_half_extent = params.roi_half_extent;
+    /// Columns of Rz * Ry * Rx
+    float3 r = params.roi_rotation * (float)(M_PI / 180.0);
+    float cx = cosf(r.x), sx = sinf(r.x);
+    float cy = cosf(r.y), sy = sinf(r.y);
+    float cz = cosf(r.z), sz = sinf(r.z);
+    roi_axes[0] = make_float3(cy * cz, cy * sz, -sy);
+    roi_axes[1] = make_float3(sx * sy * cz - cx * sz,
+                              sx * sy * sz + cx * cz,
+                              sx * cy);
+    roi_axes[2] = make_float3(cx * sy * cz + sx * sz,
+                              cx * sy * sz - sx * cz,
+                              cx * cy);
   }
   GeometryHelper(const VolumeParams &params) {
     Init(params);
@@ -214,6 +236,67 @@ struct GeometryHelper {
                        + voxel_size * 0.5f * (BLOCK_SIDE_LENGTH - 1.0f);
     return IsPointInCameraFrustum(c_T_w, world_pos, sensor_params);
   }
+
+/// Region of interest tests, all true without one
+  __host__ __device__
+  inline
+  bool IsPointInRoi(const float3 world_pos) {
+    if (! enable_roi) return true;
+    float3 d = world_pos - roi_center;
+    return fabsf(dot(d, roi_axes[0])) <= roi_half_extent.x
+           && fabsf(dot(d, roi_axes[1])) <= roi_half_extent.y
+           && fabsf(dot(d, roi_axes[2])) <= roi_half_extent.z;
+  }
+
+  /// Conservative: the box of the block, projected on the axes of the ROI
+  __host__ __device__
+  inline
+  bool IsBlockInRoi(const int3 block_pos) {
+    if (! enable_roi) return true;
+    float half_side = voxel_size * 0.5f * (BLOCK_SIDE_LENGTH - 1.0f);
+    float3 d = VoxelToWorld(BlockToVoxel(block_pos))
+               + half_side - roi_center;
+    float3 half_extent = roi_half_extent;
+    for (int i = 0; i < 3; ++i) {
+      float3 a = roi_axes[i];
+      float radius = half_side * (fabsf(a.x) + fabsf(a.y) + fabsf(a.z));
+      float extent = i == 0 ? half_extent.x
+                   : (i == 1 ? half_extent.y : half_extent.z);
+      if (fabsf(dot(d, a)) > extent + radius) return false;
+    }
+    return true;
+  }
+
+  /// Clip the segment @param world_pos_near -> @param world_pos_far
+  /// to the ROI, slab by slab
+  /// @return false if it misses the ROI
+  __host__ __device__
+  inline
+  bool ClipSegmentToRoi(float3 &world_pos_near, float3 &world_pos_far) {
+    if (! enable_roi) return true;
+    float3 d = world_pos_near - roi_center;
+    float3 dir = world_pos_far - world_pos_near;
+    float3 half_extent = roi_half_extent;
+    float t_near = 0, t_far = 1;
+    for (int i = 0; i < 3; ++i) {
+      float p = dot(d, roi_axes[i]);
+      float v = dot(dir, roi_axes[i]);
+      float extent = i == 0 ? half_extent.x
+                   : (i == 1 ? half_extent.y : half_extent.z);
+      if (v == 0.0f) {
+        if (fabsf(p) > extent) return false;
+        continue;
+      }
+      float t0 = (-extent - p) / v, t1 = (extent - p) / v;
+      t_near = fmaxf(t_near, fminf(t0, t1));
+      t_far = fminf(t_far, fmaxf(t0, t1));
+    }
+    if (t_near > t_far) return false;
+    float3 origin = world_pos_near;
+    world_pos_near = origin + t_near * dir;
+    world_pos_far = origin + t_far * dir;
+    return true;
+  }
 };
 
 #endif //VH_GEOMETRY_UTIL_H
@@ -16,18 +16,35 @@ void LoadRuntimeParams(std::string path, RuntimeParams& params) {
   params.dataset_type  = (int)fs["dataset_type"];
 
   params.enable_bayesian_update = (int)fs["enable_bayesian_update"];
+  params.enable_headless     = (int)fs["enable_headless"];
+  params.enable_pipeline     = (int)fs["enable_pipeline"];
   params.enable_navigation   = (int)fs["enable_navigation"];
   params.enable_polygon_mode = (int)fs["enable_polygon_mode"];
   params.enable_global_mesh = (int)fs["enable_global_mesh"];
   params.enable_sdf_gradient = (int)fs["enable_sdf_gradient"];
+  params.enable_surface_nets = (int)fs["enable_surface_nets"];
   params.enable_color   = (int)fs["enable_color"];
 
   params.enable_bounding_box  = (int)fs["enable_bounding_box"];
   params.enable_trajectory  = (int)fs["enable_trajectory"];
   params.enable_ray_casting   = (int)fs["enable_ray_casting"];
+  params.enable_cpu_ray_casting = (int)fs["enable_cpu_ray_casting"];
+  params.host_page_mode         = (int)fs["host_page_mode"];
+
+  params.enable_morton_placement = (int)fs["enable_morton_placement"];
+  params.defrag_interval         = (int)fs["defrag_interval"];
+  params.export_interval         = (int)fs["export_interval"];
+  params.publish_interval        = (int)fs["publish_interval"];
+  params.shared_map_name   = (std::string)fs["shared_map_name"];
+  params.eviction_occupancy      = (float)fs["eviction_occupancy"];
+  params.enable_eviction_spill   = (int)fs["enable_eviction_spill"];
+  params.enable_lazy_commit      = (int)fs["enable_lazy_commit"];
 
   params.enable_video_recording  = (int)fs["enable_video_recording"];
   params.enable_ply_saving     = (int)fs["enable_ply_saving"];
+  params.enable_decimation     = (int)fs["enable_decimation"];
+  params.decimation_max_error  = (float)fs["decimation_max_error"];
+  params.decimation_triangle_ratio = (float)fs["decimation_triangle_ratio"];
   params.filename_prefix = (std::string)fs["filename_prefix"];
   params.time_profile    = (std::string)fs["time_profile"];
   params.memo_profile    = (std::string)fs["memo_profile"];
@@ -48,6 +65,8 @@ void LoadMeshParams(std::string path, MeshParams &params) {
   cv::FileStorage fs(path, cv::FileStorage::READ);
   params.max_vertex_count   = (int)fs["max_vertex_count"];
   params.max_triangle_count = (int)fs["max_triangle_count"];
+  params.lod_distance_2x    = (float)fs["lod_distance_2x"];
+  params.lod_distance_4x    = (float)fs["lod_distance_4x"];
 }
 
 void LoadVolumeParams(std::string path, VolumeParams& params) {
@@ -58,6 +77,26 @@ void LoadVolumeParams(std::string path, VolumeParams& params) {
   params.truncation_distance       = (float)fs["truncation_distance"];
   params.weight_sample             = (int)fs["weight_sample"];
   params.weight_upper_bound        = (int)fs["weight_upper_bound"];
+
+  /// Optional: everywhere if not given
+  cv::FileNode roi = fs["roi"];
+  params.enable_roi = false;
+  params.roi_center = make_float3(0, 0, 0);
+  params.roi_half_extent = make_float3(0, 0, 0);
+  params.roi_rotation = make_float3(0, 0, 0);
+  if (! roi.empty()) {
+    params.enable_roi = (int)roi["enable"];
+    cv::FileNode center = roi["center"];
+    cv::FileNode half_extent = roi["half_extent"];
+    cv::FileNode rotation = roi["rotation"];
+    params.roi_center = make_float3(
+        (float)center[0], (float)center[1], (float)center[2]);
+    params.roi_half_extent = make_float3(
+        (float)half_extent[0], (float)half_extent[1], (float)half_extent[2]);
+    params.roi_rotation = rotation.empty() ? make_float3(0, 0, 0)
+        : make_float3((float)rotation[0], (float)rotation[1],
+                      (float)rotation[2]);
+  }
 }
 
 void LoadSensorParams(std::string path, SensorParams& params) {
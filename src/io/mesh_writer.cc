@@ -72,7 +72,7 @@ void SaveObj(CompactMesh& compact_mesh, std::string path) {
 }
 
 
-void SavePly(CompactMesh& compact_mesh, std::string path) {
+void DownloadMesh(CompactMesh& compact_mesh, HostMesh& mesh) {
   LOG(INFO) << "Copying data from GPU";
 
   uint compact_vertex_count = compact_mesh.vertex_count();
@@ -80,22 +80,46 @@ void SavePly(CompactMesh& compact_mesh, std::string path) {
   LOG(INFO) << "Vertices: " << compact_vertex_count;
   LOG(INFO) << "Triangles: " << compact_triangle_count;
 
-  float3* vertices = new float3[compact_vertex_count];
-  float3* normals  = new float3[compact_vertex_count];
-  float3* colors = new float3[compact_vertex_count];
-  int3* triangles  = new int3  [compact_triangle_count];
-  checkCudaErrors(cudaMemcpy(vertices, compact_mesh.vertices(),
+  mesh.vertices.resize(compact_vertex_count);
+  mesh.normals.resize(compact_vertex_count);
+  mesh.colors.resize(compact_vertex_count);
+  mesh.triangles.resize(compact_triangle_count);
+  checkCudaErrors(cudaMemcpy(mesh.vertices.data(), compact_mesh.vertices(),
                              sizeof(float3) * compact_vertex_count,
                              cudaMemcpyDeviceToHost));
-  checkCudaErrors(cudaMemcpy(normals, compact_mesh.normals(),
+  checkCudaErrors(cudaMemcpy(mesh.normals.data(), compact_mesh.normals(),
                              sizeof(float3) * compact_vertex_count,
                              cudaMemcpyDeviceToHost));
-  checkCudaErrors(cudaMemcpy(colors, compact_mesh.colors(),
+  checkCudaErrors(cudaMemcpy(mesh.colors.data(), compact_mesh.colors(),
                              sizeof(float3) * compact_vertex_count,
                              cudaMemcpyDeviceToHost));
-  checkCudaErrors(cudaMemcpy(triangles, compact_mesh.triangles(),
+  checkCudaErrors(cudaMemcpy(mesh.triangles.data(), compact_mesh.triangles(),
                              sizeof(int3) * compact_triangle_count,
                              cudaMemcpyDeviceToHost));
+}
+
+void SavePly(CompactMesh& compact_mesh, std::string path) {
+  HostMesh mesh;
+  DownloadMesh(compact_mesh, mesh);
+  SavePly(mesh, path);
+}
+
+void SavePly(CompactMesh& compact_mesh, std::string path,
+             const DecimationParams& decimation_params,
+             TaskScheduler& scheduler) {
+  HostMesh mesh;
+  DownloadMesh(compact_mesh, mesh);
+  DecimateMesh(mesh, decimation_params, scheduler);
+  SavePly(mesh, path);
+}
+
+void SavePly(const HostMesh& mesh, std::string path) {
+  const std::vector<float3>& vertices = mesh.vertices;
+  const std::vector<float3>& normals = mesh.normals;
+  const std::vector<float3>& colors = mesh.colors;
+  const std::vector<int3>& triangles = mesh.triangles;
+  uint compact_vertex_count = (uint)vertices.size();
+  uint compact_triangle_count = (uint)triangles.size();
 
   std::ofstream out(path);
   std::stringstream ss;
@@ -140,11 +164,4 @@ void SavePly(CompactMesh& compact_mesh, std::string path) {
     ss << "3 " << idx.x << " " << idx.y << " " << idx.z << "\n";
     out << ss.str();
   }
-
-  LOG(INFO) << "Finishing vertices";
-  delete[] vertices;
-  LOG(INFO) << "Finishing normals";
-  delete[] normals;
-  LOG(INFO) << "Finishing triangles";
-  delete[] triangles;
 }
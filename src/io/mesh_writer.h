@@ -7,9 +7,18 @@
 
 #include <string>
 #include "core/common.h"
+#include "core/params.h"
 #include "visualization/compact_mesh.h"
+#include "meshing/decimation.h"
+
+void DownloadMesh(CompactMesh& compact_mesh, HostMesh& mesh);
 
 void SaveObj(CompactMesh& compact_mesh, std::string path);
 void SavePly(CompactMesh& compact_mesh, std::string path);
+/// Decimate on @param scheduler before writing, see meshing/decimation.h
+void SavePly(CompactMesh& compact_mesh, std::string path,
+             const DecimationParams& decimation_params,
+             TaskScheduler& scheduler);
+void SavePly(const HostMesh& mesh, std::string path);
 
 #endif //MESH_HASHING_MESH_WRITER_H
@@ -0,0 +1,258 @@
+//
+// Created by wei on 18-2-11.
+//
+
+#include "io/shared_map.h"
+
+#include <chrono>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+
+namespace {
+const uint32_t kSharedMapMagic = 0x50414d56;   // "VMAP"
+const uint32_t kSharedMapLayoutVersion = 1;
+const size_t kPageBytes = 4096;
+/// A reader losing the race that many times in a row gives up
+const int kMaxAcquireTries = 16;
+
+size_t RoundUpToPage(size_t bytes) {
+  return (bytes + kPageBytes - 1) / kPageBytes * kPageBytes;
+}
+
+size_t SlotBytes(uint max_vertex_count,
+                 uint max_triangle_count,
+                 uint max_block_count) {
+  return RoundUpToPage(3 * sizeof(float3) * (size_t)max_vertex_count
+                       + sizeof(int3) * (size_t)max_triangle_count
+                       + sizeof(MeshBlockRange) * (size_t)max_block_count);
+}
+
+void LocateArrays(void *segment, const SharedMapHeader &header,
+                  SharedMapArrays arrays[2]) {
+  for (int i = 0; i < 2; ++i) {
+    char *slot = (char*)segment + RoundUpToPage(sizeof(SharedMapHeader))
+                 + i * header.slot_bytes;
+    arrays[i].vertices = (float3*)slot;
+    arrays[i].normals = arrays[i].vertices + header.max_vertex_count;
+    arrays[i].colors = arrays[i].normals + header.max_vertex_count;
+    arrays[i].triangles = (int3*)(arrays[i].colors + header.max_vertex_count);
+    arrays[i].blocks = (MeshBlockRange*)(arrays[i].triangles
+                                         + header.max_triangle_count);
+  }
+}
+}
+
+int64_t SharedMapClock() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////
+/// SharedMapWriter
+////////////////////
+SharedMapWriter::~SharedMapWriter() {
+  Close();
+}
+
+bool SharedMapWriter::Open(std::string name,
+                           uint max_vertex_count,
+                           uint max_triangle_count,
+                           uint max_block_count) {
+  Close();
+  size_t slot_bytes = SlotBytes(max_vertex_count,
+                                max_triangle_count,
+                                max_block_count);
+  size_t segment_bytes = RoundUpToPage(sizeof(SharedMapHeader))
+                         + 2 * slot_bytes;
+
+  /// Readers of a previous segment keep it until they unmap it
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    LOG(WARNING) << "Can't create shared memory " << name;
+    return false;
+  }
+  if (ftruncate(fd, segment_bytes) != 0) {
+    LOG(WARNING) << "Can't size shared memory " << name
+                 << " to " << segment_bytes << " bytes";
+    close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  void *segment = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED) {
+    LOG(WARNING) << "Can't map shared memory " << name;
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  SharedMapHeader *header = new (segment) SharedMapHeader;
+  header->layout_version = kSharedMapLayoutVersion;
+  header->max_vertex_count = max_vertex_count;
+  header->max_triangle_count = max_triangle_count;
+  header->max_block_count = max_block_count;
+  header->slot_bytes = slot_bytes;
+  header->latest_version.store(0);
+  for (SharedMapSlot &slot : header->slots) {
+    slot.sequence.store(0);
+    slot.reader_count.store(0);
+    slot.frame = -1;
+    slot.vertex_count = slot.triangle_count = slot.block_count = 0;
+    slot.publish_ns = 0;
+  }
+  /// Last: readers check it before anything else
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = kSharedMapMagic;
+
+  name_ = name;
+  segment_ = segment;
+  segment_bytes_ = segment_bytes;
+  header_ = header;
+  LocateArrays(segment_, *header_, arrays_);
+  writing_slot_ = -1;
+  skipped_in_row_ = skipped_count_ = 0;
+  LOG(INFO) << "Shared map " << name << ": " << segment_bytes
+            << " bytes reserved";
+  return true;
+}
+
+void SharedMapWriter::Close() {
+  if (header_ == NULL) return;
+  munmap(segment_, segment_bytes_);
+  shm_unlink(name_.c_str());
+  segment_ = NULL;
+  segment_bytes_ = 0;
+  header_ = NULL;
+}
+
+/// The sequence is made odd before the readers are counted, and a reader
+/// counts itself before checking the sequence: one of them sees the other
+const SharedMapArrays* SharedMapWriter::BeginWrite() {
+  CHECK(writing_slot_ < 0) << "A version is being written";
+  uint64_t version = header_->latest_version.load() + 1;
+  int slot_idx = (int)(version % 2);
+  SharedMapSlot &slot = header_->slots[slot_idx];
+
+  uint64_t prev_sequence = slot.sequence.load();
+  slot.sequence.store(2 * version - 1);
+  if (slot.reader_count.load() > 0
+      && skipped_in_row_ < kMaxSkippedPublications) {
+    slot.sequence.store(prev_sequence);
+    ++skipped_in_row_;
+    ++skipped_count_;
+    return NULL;
+  }
+  skipped_in_row_ = 0;
+  writing_slot_ = slot_idx;
+  return &arrays_[slot_idx];
+}
+
+void SharedMapWriter::EndWrite(int frame,
+                               uint vertex_count,
+                               uint triangle_count,
+                               uint block_count) {
+  CHECK(writing_slot_ >= 0) << "No version is being written";
+  uint64_t version = header_->latest_version.load() + 1;
+  SharedMapSlot &slot = header_->slots[writing_slot_];
+  slot.frame = frame;
+  slot.vertex_count = vertex_count;
+  slot.triangle_count = triangle_count;
+  slot.block_count = block_count;
+  slot.publish_ns = SharedMapClock();
+  slot.sequence.store(2 * version);
+  header_->latest_version.store(version);
+  writing_slot_ = -1;
+}
+
+////////////////////
+/// SharedMapReader
+////////////////////
+SharedMapReader::~SharedMapReader() {
+  Close();
+}
+
+bool SharedMapReader::Open(std::string name) {
+  Close();
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SharedMapHeader)) {
+    close(fd);
+    return false;
+  }
+  /// Read-write: pinning writes the reader count
+  void *segment = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED) return false;
+
+  SharedMapHeader *header = (SharedMapHeader*)segment;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header->magic != kSharedMapMagic
+      || header->layout_version != kSharedMapLayoutVersion) {
+    LOG(WARNING) << "Shared map " << name << " is not ready, or of "
+                 << "another layout";
+    munmap(segment, st.st_size);
+    return false;
+  }
+
+  segment_ = segment;
+  segment_bytes_ = st.st_size;
+  header_ = header;
+  LocateArrays(segment_, *header_, arrays_);
+  pinned_slot_ = -1;
+  return true;
+}
+
+void SharedMapReader::Close() {
+  if (header_ == NULL) return;
+  if (pinned_slot_ >= 0) Release();
+  munmap(segment_, segment_bytes_);
+  segment_ = NULL;
+  segment_bytes_ = 0;
+  header_ = NULL;
+}
+
+bool SharedMapReader::Acquire(uint64_t last_version, SharedMeshFrame &frame) {
+  CHECK(pinned_slot_ < 0) << "A version is pinned";
+  for (int i = 0; i < kMaxAcquireTries; ++i) {
+    uint64_t version = header_->latest_version.load();
+    if (version == 0 || version == last_version) return false;
+
+    int slot_idx = (int)(version % 2);
+    SharedMapSlot &slot = header_->slots[slot_idx];
+    slot.reader_count.fetch_add(1);
+    if (slot.sequence.load() != 2 * version) {
+      /// Being written again already
+      slot.reader_count.fetch_sub(1);
+      continue;
+    }
+
+    pinned_slot_ = slot_idx;
+    pinned_sequence_ = 2 * version;
+    frame.version = version;
+    frame.frame = slot.frame;
+    frame.vertex_count = slot.vertex_count;
+    frame.triangle_count = slot.triangle_count;
+    frame.block_count = slot.block_count;
+    frame.publish_ns = slot.publish_ns;
+    frame.arrays = arrays_[slot_idx];
+    return true;
+  }
+  return false;
+}
+
+bool SharedMapReader::Release() {
+  CHECK(pinned_slot_ >= 0) << "No version is pinned";
+  SharedMapSlot &slot = header_->slots[pinned_slot_];
+  bool is_intact = slot.sequence.load() == pinned_sequence_;
+  slot.reader_count.fetch_sub(1);
+  pinned_slot_ = -1;
+  return is_intact;
+}
@@ -0,0 +1,154 @@
+//
+// Created by wei on 18-2-11.
+//
+// The latest mesh, published in POSIX shared memory for the processes
+// of the same host: a SharedMapReader maps the arrays where the writer
+// wrote them, without copies or files.
+// Two slots, written in turns: a version is written to the slot not
+// holding the latest one, then becomes the latest. Each slot has a
+// sequence, odd while it is written and 2 * version once written, so
+// that a reader can tell whether what it read was overwritten meanwhile.
+// Readers pin the slot they read; the writer skips a publication rather
+// than overwrite a pinned slot, kMaxSkippedPublications times in a row
+// at most, since a reader that died pinned would block it for good.
+//
+// Segment layout: SharedMapHeader, padded to a page, then two slots of
+//   float3 vertices[max_vertex_count], normals[...], colors[...],
+//   int3 triangles[max_triangle_count],
+//   MeshBlockRange blocks[max_block_count]
+// Triangles index the vertices of their slot, as in CompactMesh.
+// Only the pages written take memory in /dev/shm, unless pinned.
+
+#ifndef IO_SHARED_MAP_H
+#define IO_SHARED_MAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "core/common.h"
+#include "visualization/compact_mesh.h"
+
+struct SharedMapSlot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<int>      reader_count;
+  int      frame;
+  uint     vertex_count;
+  uint     triangle_count;
+  uint     block_count;
+  // Steady clock, the same for all processes of the host
+  int64_t  publish_ns;
+};
+
+struct SharedMapHeader {
+  uint32_t magic;
+  uint32_t layout_version;
+  uint32_t max_vertex_count;
+  uint32_t max_triangle_count;
+  uint32_t max_block_count;
+  uint64_t slot_bytes;
+  // 0 until the first publication
+  std::atomic<uint64_t> latest_version;
+  SharedMapSlot slots[2];
+};
+
+// Where the arrays of a slot are, in the mapping of a process
+struct SharedMapArrays {
+  float3         *vertices;
+  float3         *normals;
+  float3         *colors;
+  int3           *triangles;
+  MeshBlockRange *blocks;
+};
+
+// A published version, read in place
+struct SharedMeshFrame {
+  uint64_t version;
+  int      frame;
+  uint     vertex_count;
+  uint     triangle_count;
+  uint     block_count;
+  int64_t  publish_ns;
+  SharedMapArrays arrays;
+};
+
+class SharedMapWriter {
+public:
+  SharedMapWriter() = default;
+  ~SharedMapWriter();
+
+  // Create the segment @param name ("/name"), replacing an older one
+  bool Open(std::string name,
+            uint max_vertex_count,
+            uint max_triangle_count,
+            uint max_block_count);
+  // Unlink the segment: readers keep what they mapped
+  void Close();
+  bool is_open() const {
+    return header_ != NULL;
+  }
+
+  // The slot to write the next version to, or NULL to skip this one
+  const SharedMapArrays* BeginWrite();
+  // Make what was written the latest version
+  void EndWrite(int frame,
+                uint vertex_count,
+                uint triangle_count,
+                uint block_count);
+
+  // To pin it for DMA
+  void* segment() {
+    return segment_;
+  }
+  size_t segment_bytes() const {
+    return segment_bytes_;
+  }
+  const SharedMapHeader* header() const {
+    return header_;
+  }
+  uint skipped_count() const {
+    return skipped_count_;
+  }
+
+  static const uint kMaxSkippedPublications = 8;
+
+private:
+  std::string      name_;
+  void            *segment_ = NULL;
+  size_t           segment_bytes_ = 0;
+  SharedMapHeader *header_ = NULL;
+  SharedMapArrays  arrays_[2];
+  int              writing_slot_ = -1;
+  uint             skipped_in_row_ = 0;
+  uint             skipped_count_ = 0;
+};
+
+class SharedMapReader {
+public:
+  SharedMapReader() = default;
+  ~SharedMapReader();
+
+  // Map the segment @param name; false if no writer created it
+  bool Open(std::string name);
+  void Close();
+
+  // Pin the latest version if newer than @param last_version
+  // @return false if there is none; Release before the next Acquire
+  bool Acquire(uint64_t last_version, SharedMeshFrame &frame);
+  // @return false if the version was overwritten while pinned:
+  // what was read from it is not to be trusted
+  bool Release();
+
+private:
+  void            *segment_ = NULL;
+  size_t           segment_bytes_ = 0;
+  SharedMapHeader *header_ = NULL;
+  SharedMapArrays  arrays_[2];
+  int              pinned_slot_ = -1;
+  uint64_t         pinned_sequence_ = 0;
+};
+
+// Steady clock in ns, as in SharedMapSlot::publish_ns
+int64_t SharedMapClock();
+
+#endif //IO_SHARED_MAP_H
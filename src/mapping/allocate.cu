@@ -40,6 +40,9 @@ void AllocBlockArrayKernel(HashTable   hash_table,
   /// 2. Set range where blocks are allocated
   float3 world_pos_near  = w_T_c * camera_pos_near;
   float3 world_pos_far   = w_T_c * camera_pos_far;
+  /// Only the part of the ray in the region of interest
+  if (! geometry_helper.ClipSegmentToRoi(world_pos_near, world_pos_far))
+    return;
   float3 world_ray_dir = normalize(world_pos_far - world_pos_near);
 
   int3 block_pos_near = geometry_helper.WorldToBlock(world_pos_near);
@@ -98,6 +101,27 @@ void AllocBlockArrayKernel(HashTable   hash_table,
   }
 }
 
+/// One CUDA block per heap slot handed out
+__global__
+void ClearAllocatedBlocksKernel(
+    HashTable  hash_table,
+    BlockArray blocks,
+    uint       heap_begin
+) {
+  const uint ptr = hash_table.heap(heap_begin + blockIdx.x);
+  bool is_stale = blocks.is_stale(ptr);
+  /// Everyone reads the generation before thread 0 updates it
+  __syncthreads();
+  if (! is_stale) return;
+
+  Block &block = blocks[ptr];
+  block.ClearVoxel(threadIdx.x);
+  if (threadIdx.x == 0) {
+    block.ClearHeader();
+    blocks.set_fresh(ptr);
+  }
+}
+
 double AllocBlockArray(
     HashTable& hash_table,
     Sensor& sensor,
@@ -123,3 +147,27 @@ double AllocBlockArray(
   checkCudaErrors(cudaGetLastError());
   return timer.Tock();
 }
+
+double ClearAllocatedBlocks(
+    HashTable& hash_table,
+    BlockArray& blocks,
+    uint prev_allocated_count
+) {
+  Timer timer;
+  timer.Tick();
+
+  uint allocated_count = hash_table.allocated_count();
+  if (allocated_count <= prev_allocated_count) return timer.Tock();
+  uint new_count = allocated_count - prev_allocated_count;
+
+  /// The heap counter went down from value_capacity - 1 - prev_allocated_count:
+  /// the slots handed out are right above it
+  const dim3 grid_size(new_count, 1);
+  const dim3 block_size(BLOCK_SIZE, 1);
+  ClearAllocatedBlocksKernel<<<grid_size, block_size>>>(
+      hash_table, blocks,
+      hash_table.value_capacity - allocated_count);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  return timer.Tock();
+}
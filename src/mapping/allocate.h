@@ -6,6 +6,7 @@
 #define MESH_HASHING_ALLOCATE_H
 
 #include "core/hash_table.h"
+#include "core/block_array.h"
 #include "geometry/geometry_helper.h"
 #include "sensor/rgbd_sensor.h"
 
@@ -19,4 +20,14 @@ double AllocBlockArray(
     GeometryHelper& geometry_helper
 );
 
+// @function
+// Clear the stale blocks of @param blocks among those handed out
+// by @param hash_table since @param prev_allocated_count,
+// completing a lazy reset
+double ClearAllocatedBlocks(
+    HashTable& hash_table,
+    BlockArray& blocks,
+    uint prev_allocated_count
+);
+
 #endif //MESH_HASHING_ALLOCATE_H
@@ -10,6 +10,7 @@
 #include "core/common.h"
 #include "core/entry_array.h"
 #include "core/block_array.h"
+#include "core/retired_block_array.h"
 #include "helper_math.h"
 
 __global__
@@ -113,71 +114,71 @@ void CollectLowSurfelBlocksKernel(
   }
 }
 
-/// !!! Their mesh not recycled
+/// Mesh of a block lives in its own chunks: free them along with the block
+__device__
+void FreeBlock(
+    uint       ptr,
+    BlockArray &blocks,
+    Mesh       &mesh
+) {
+  Block& block = blocks[ptr];
+  mesh.FreeVertexChunk(block.vertex_chunk);
+  mesh.FreeTriangleChunk(block.triangle_chunk);
+  block.Clear();
+}
+
 __global__
-void RecycleGarbageTrianglesKernel(
+void RecycleGarbageBlocksKernel(
     EntryArray candidate_entries,
     BlockArray blocks,
     Mesh       mesh,
-    HashTable  hash_table
+    HashTable  hash_table,
+    uint       processing_block_count
 ) {
-  const uint idx = blockIdx.x;
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
   if (candidate_entries.flag(idx) == 0) return;
 
   const HashEntry& entry = candidate_entries[idx];
-  const uint local_idx = threadIdx.x;  //inside an SDF block
-  Voxel &voxel = blocks[entry.ptr].voxels[local_idx];
-  MeshUnit &mesh_unit = blocks[entry.ptr].mesh_units[local_idx];
-
-  for (int i = 0; i < N_TRIANGLE; ++i) {
-    int triangle_ptr = mesh_unit.triangle_ptrs[i];
-    if (triangle_ptr == FREE_PTR) continue;
-
-    // Clear ref_count of its pointed vertices
-    mesh.ReleaseTriangle(mesh.triangle(triangle_ptr));
-    mesh.triangle(triangle_ptr).Clear();
-    mesh.FreeTriangle(triangle_ptr);
-    mesh_unit.triangle_ptrs[i] = FREE_PTR;
+  if (hash_table.FreeEntry(entry.pos)) {
+    FreeBlock(entry.ptr, blocks, mesh);
   }
 }
 
+/// Unlink only: the block, its mesh and its heap slot stay as they are
 __global__
-void RecycleGarbageVerticesKernel(
+void RetireGarbageBlocksKernel(
     EntryArray candidate_entries,
-    BlockArray       blocks,
-    Mesh             mesh,
-    HashTable        hash_table
+    HashTable  hash_table,
+    RetiredBlockArray retired_blocks,
+    uint       processing_block_count
 ) {
-  if (candidate_entries.flag(blockIdx.x) == 0) return;
-  const HashEntry &entry = candidate_entries[blockIdx.x];
-  const uint local_idx = threadIdx.x;
-
-  MeshUnit &cube = blocks[entry.ptr].mesh_units[local_idx];
-
-  __shared__ int valid_vertex_count;
-  if (threadIdx.x == 0) valid_vertex_count = 0;
-  __syncthreads();
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+  if (candidate_entries.flag(idx) == 0) return;
 
-#pragma unroll 1
-  for (int i = 0; i < 3; ++i) {
-    if (cube.vertex_ptrs[i] != FREE_PTR) {
-      if (mesh.vertex(cube.vertex_ptrs[i]).ref_count <= 0) {
-        mesh.vertex(cube.vertex_ptrs[i]).Clear();
-        mesh.FreeVertex(cube.vertex_ptrs[i]);
-        cube.vertex_ptrs[i] = FREE_PTR;
-      }
-      else {
-        atomicAdd(&valid_vertex_count, 1);
-      }
-    }
+  const HashEntry& entry = candidate_entries[idx];
+  uint ptr;
+  if (hash_table.FreeEntry(entry.pos, &ptr)) {
+    retired_blocks.Append(ptr, entry.pos);
   }
+}
 
-  __syncthreads();
-  if (threadIdx.x == 0 && valid_vertex_count == 0) {
-    if (hash_table.FreeEntry(entry.pos)) {
-      blocks[entry.ptr].Clear();
-    }
-  }
+__global__
+void FreeRetiredBlocksKernel(
+    RetiredBlockArray retired_blocks,
+    BlockArray blocks,
+    Mesh       mesh,
+    HashTable  hash_table,
+    uint       begin,
+    uint       count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= count) return;
+
+  uint ptr = retired_blocks[begin + idx];
+  FreeBlock(ptr, blocks, mesh);
+  hash_table.FreeSlot(ptr);
 }
 
 void StarveOccupiedBlockArray(
@@ -253,23 +254,61 @@ void RecycleGarbageBlockArray(
     Mesh&      mesh,
     HashTable& hash_table
 ) {
-  const uint threads_per_block = BLOCK_SIZE;
-
   uint processing_block_count = candidate_entries.count();
   if (processing_block_count <= 0)
     return;
 
-  const dim3 grid_size(processing_block_count, 1);
+  const int threads_per_block = 64;
+  const dim3 grid_size((processing_block_count + threads_per_block - 1)
+                       / threads_per_block, 1);
   const dim3 block_size(threads_per_block, 1);
 
-  RecycleGarbageTrianglesKernel <<<grid_size, block_size >>>(
-      candidate_entries, blocks, mesh, hash_table);
+  RecycleGarbageBlocksKernel <<<grid_size, block_size >>>(
+      candidate_entries, blocks, mesh, hash_table, processing_block_count);
   checkCudaErrors(cudaDeviceSynchronize());
   checkCudaErrors(cudaGetLastError());
+}
+
+uint RetireGarbageBlockArray(
+    EntryArray &candidate_entries,
+    HashTable& hash_table,
+    RetiredBlockArray& retired_blocks
+) {
+  uint processing_block_count = candidate_entries.count();
+  if (processing_block_count <= 0)
+    return retired_blocks.count();
 
-  RecycleGarbageVerticesKernel <<<grid_size, block_size >>>(
-      candidate_entries, blocks, mesh, hash_table);
+  const int threads_per_block = 64;
+  const dim3 grid_size((processing_block_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  RetireGarbageBlocksKernel <<<grid_size, block_size >>>(
+      candidate_entries, hash_table, retired_blocks, processing_block_count);
   checkCudaErrors(cudaDeviceSynchronize());
   checkCudaErrors(cudaGetLastError());
+  return retired_blocks.count();
 }
 
+void FreeRetiredBlocks(
+    RetiredBlockArray& retired_blocks,
+    uint begin,
+    uint end,
+    BlockArray& blocks,
+    Mesh&      mesh,
+    HashTable& hash_table
+) {
+  if (begin >= end)
+    return;
+  uint count = end - begin;
+
+  const int threads_per_block = 64;
+  const dim3 grid_size((count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  FreeRetiredBlocksKernel <<<grid_size, block_size >>>(
+      retired_blocks, blocks, mesh, hash_table, begin, count);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+}
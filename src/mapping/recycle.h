@@ -10,6 +10,7 @@
 #include "core/mesh.h"
 #include "core/entry_array.h"
 #include "core/block_array.h"
+#include "core/retired_block_array.h"
 #include "geometry/geometry_helper.h"
 
 // @function
@@ -49,4 +50,28 @@ void RecycleGarbageBlockArray(
     HashTable& hash_table
 );
 
+// @function
+// As RecycleGarbageBlockArray, but for readers still on the map:
+// the entries are freed in @param hash_table, and their blocks
+// appended to @param retired_blocks, untouched
+// @return retired_blocks.count() after the appends
+uint RetireGarbageBlockArray(
+    EntryArray &candidate_entries,
+    HashTable& hash_table,
+    RetiredBlockArray& retired_blocks
+);
+
+// @function
+// Clear the retired blocks [@param begin, @param end) of
+// @param retired_blocks, free their chunks in @param mesh
+// and return them to the heap of @param hash_table
+void FreeRetiredBlocks(
+    RetiredBlockArray& retired_blocks,
+    uint begin,
+    uint end,
+    BlockArray& blocks,
+    Mesh&      mesh,
+    HashTable& hash_table
+);
+
 #endif //MESH_HASHING_RECYCLE_H
@@ -75,8 +75,9 @@ void PredictOutlierRatioKernel(
                                              sensor_params.cx, sensor_params.cy);
 
   for (int i = 0; i < N_VERTEX; ++i) {
-    if (this_mesh_unit.vertex_ptrs[i] > 0) {
-      Vertex& vtx = mesh.vertex(this_mesh_unit.vertex_ptrs[i]);
+    if (this_mesh_unit.vertex_ptrs[i] >= 0) {
+      Vertex& vtx = mesh.vertex(blocks[entry.ptr].vertex_chunk,
+                                this_mesh_unit.vertex_ptrs[i]);
       float3 n = vtx.normal; // in world coordinate system
       float3 x = vtx.pos;
       float  r = vtx.radius;
@@ -100,19 +101,16 @@ void PredictOutlierRatioKernel(
   }
 }
 
-__global__
-void UpdateBlocksBayesianKernel(
-    EntryArray candidate_entries,
-    BlockArray blocks,
-    SensorData sensor_data,
-    SensorParams sensor_params,
-    float4x4 cTw,
-    HashTable hash_table,
-    GeometryHelper geometry_helper) {
-
-  //TODO check if we should load this in shared memory (entries)
+/// One thread per voxel of the block of @param entry
+__device__
+void UpdateBlockBayesian(
+    const HashEntry &entry,
+    BlockArray &blocks,
+    SensorData &sensor_data,
+    SensorParams &sensor_params,
+    float4x4 &cTw,
+    GeometryHelper &geometry_helper) {
   /// 1. Select voxel
-  const HashEntry &entry = candidate_entries[blockIdx.x];
   int3 voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
   uint local_idx = threadIdx.x;  //inside of an SDF block
   int3 voxel_pos = voxel_base_pos + make_int3(geometry_helper.DevectorizeIndex(local_idx));
@@ -120,6 +118,8 @@ void UpdateBlocksBayesianKernel(
   Voxel &this_voxel = blocks[entry.ptr].voxels[local_idx];
   /// 2. Project to camera
   float3 world_pos = geometry_helper.VoxelToWorld(voxel_pos);
+  if (! geometry_helper.IsPointInRoi(world_pos))
+    return;
   float3 camera_pos = cTw * world_pos;
   uint2 image_pos = make_uint2(
       geometry_helper.CameraProjectToImagei(camera_pos,
@@ -184,6 +184,23 @@ void UpdateBlocksBayesianKernel(
   }
 }
 
+/// Persistent CUDA blocks, as UpdateBlocksSimpleKernel
+__global__
+void UpdateBlocksBayesianKernel(
+    BlockWorkQueue work_queue,
+    BlockArray blocks,
+    SensorData sensor_data,
+    SensorParams sensor_params,
+    float4x4 cTw,
+    GeometryHelper geometry_helper) {
+  for (uint i = work_queue.Pop(); i < work_queue.count();
+       i = work_queue.Pop()) {
+    UpdateBlockBayesian(work_queue[i], blocks,
+                        sensor_data, sensor_params, cTw,
+                        geometry_helper);
+  }
+}
+
 ////////////////////
 /// Device code
 ////////////////////
@@ -245,8 +262,9 @@ void BuildSensorDataEquationKernel(
   float3 b = make_float3(0);
 
   for (int i = 0; i < N_VERTEX; ++i) {
-    if (mesh_unit.vertex_ptrs[i] > 0) {
-      Vertex vtx = mesh.vertex(mesh_unit.vertex_ptrs[i]);
+    if (mesh_unit.vertex_ptrs[i] >= 0) {
+      Vertex vtx = mesh.vertex(blocks[entry.ptr].vertex_chunk,
+                               mesh_unit.vertex_ptrs[i]);
       float3 v = vtx.pos;
       float3 n = vtx.normal;
       float3x3 nnT = float3x3(n.x * n.x, n.x * n.y, n.x * n.z,
@@ -297,6 +315,7 @@ float PredictOutlierRatio(
 
 float UpdateBlocksBayesian(
   EntryArray &candidate_entries,
+  BlockWorkQueue &work_queue,
   BlockArray &blocks,
   Sensor &sensor,
   HashTable &hash_table,
@@ -310,15 +329,16 @@ float UpdateBlocksBayesian(
 
   Timer timer;
   timer.Tick();
-  const dim3 grid_size(candidate_entry_count, 1);
+  work_queue.Fill(candidate_entries, blocks);
+  const dim3 grid_size(work_queue.PersistentGridSize(
+      (const void *)UpdateBlocksBayesianKernel, threads_per_block), 1);
   const dim3 block_size(threads_per_block, 1);
   UpdateBlocksBayesianKernel << < grid_size, block_size >> > (
-      candidate_entries,
+      work_queue,
           blocks,
           sensor.data(),
           sensor.sensor_params(),
           sensor.cTw(),
-          hash_table,
           geometry_helper);
   checkCudaErrors(cudaDeviceSynchronize());
   checkCudaErrors(cudaGetLastError());
@@ -8,6 +8,7 @@
 #include "core/hash_table.h"
 #include "core/block_array.h"
 #include "core/entry_array.h"
+#include "core/block_work_queue.h"
 #include "core/mesh.h"
 #include "sensor/rgbd_sensor.h"
 #include "geometry/geometry_helper.h"
@@ -30,8 +31,10 @@ void BuildSensorDataEquation(
     SensorLinearEquations &linear_equations
 );
 
+/// @param work_queue refilled with @param candidate_entries
 float UpdateBlocksBayesian(
     EntryArray &candidate_entries,
+    BlockWorkQueue &work_queue,
     BlockArray &blocks,
     Sensor &sensor,
     HashTable &hash_table,
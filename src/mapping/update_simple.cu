@@ -10,20 +10,17 @@
 ////////////////////
 /// Device code
 ////////////////////
-__global__
-void UpdateBlocksSimpleKernel(
-    EntryArray candidate_entries,
-    BlockArray blocks,
-    SensorData sensor_data,
-    SensorParams sensor_params,
-    float4x4 cTw,
-    HashTable hash_table,
-    GeometryHelper geometry_helper
+/// One thread per voxel of the block of @param entry
+__device__
+void UpdateBlockSimple(
+    const HashEntry &entry,
+    BlockArray &blocks,
+    SensorData &sensor_data,
+    SensorParams &sensor_params,
+    float4x4 &cTw,
+    GeometryHelper &geometry_helper
 ) {
-
-  //TODO check if we should load this in shared memory (entries)
   /// 1. Select voxel
-  const HashEntry &entry = candidate_entries[blockIdx.x];
   int3 voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
   uint local_idx = threadIdx.x;  //inside of an SDF block
   int3 voxel_pos = voxel_base_pos + make_int3(geometry_helper.DevectorizeIndex(local_idx));
@@ -31,6 +28,8 @@ void UpdateBlocksSimpleKernel(
   Voxel &this_voxel = blocks[entry.ptr].voxels[local_idx];
   /// 2. Project to camera
   float3 world_pos = geometry_helper.VoxelToWorld(voxel_pos);
+  if (! geometry_helper.IsPointInRoi(world_pos))
+    return;
   float3 camera_pos = cTw * world_pos;
   uint2 image_pos = make_uint2(
       geometry_helper.CameraProjectToImagei(camera_pos,
@@ -76,8 +75,28 @@ void UpdateBlocksSimpleKernel(
   this_voxel.Update(delta);
 }
 
+/// Persistent CUDA blocks, each updating blocks popped from
+/// @param work_queue until it is drained
+__global__
+void UpdateBlocksSimpleKernel(
+    BlockWorkQueue work_queue,
+    BlockArray blocks,
+    SensorData sensor_data,
+    SensorParams sensor_params,
+    float4x4 cTw,
+    GeometryHelper geometry_helper
+) {
+  for (uint i = work_queue.Pop(); i < work_queue.count();
+       i = work_queue.Pop()) {
+    UpdateBlockSimple(work_queue[i], blocks,
+                      sensor_data, sensor_params, cTw,
+                      geometry_helper);
+  }
+}
+
 double UpdateBlocksSimple(
     EntryArray &candidate_entries,
+    BlockWorkQueue &work_queue,
     BlockArray &blocks,
     Sensor &sensor,
     HashTable &hash_table,
@@ -92,15 +111,16 @@ double UpdateBlocksSimple(
   if (candidate_entry_count <= 0)
     return timer.Tock();
 
-  const dim3 grid_size(candidate_entry_count, 1);
+  work_queue.Fill(candidate_entries, blocks);
+  const dim3 grid_size(work_queue.PersistentGridSize(
+      (const void *)UpdateBlocksSimpleKernel, threads_per_block), 1);
   const dim3 block_size(threads_per_block, 1);
   UpdateBlocksSimpleKernel << < grid_size, block_size >> > (
-      candidate_entries,
+      work_queue,
           blocks,
           sensor.data(),
           sensor.sensor_params(),
           sensor.cTw(),
-          hash_table,
           geometry_helper);
   checkCudaErrors(cudaDeviceSynchronize());
   checkCudaErrors(cudaGetLastError());
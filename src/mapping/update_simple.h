@@ -8,6 +8,7 @@
 #include "core/hash_table.h"
 #include "core/block_array.h"
 #include "core/entry_array.h"
+#include "core/block_work_queue.h"
 #include "core/mesh.h"
 #include "sensor/rgbd_sensor.h"
 #include "geometry/geometry_helper.h"
@@ -17,9 +18,11 @@
 // change the value of @param blocks
 // according to the existing @param mesh
 //                 and input @param sensor data
-// with the help of hash_table and geometry_helper
+// with the help of hash_table and geometry_helper,
+// through @param work_queue refilled with them
 double UpdateBlocksSimple(
     EntryArray& candidate_entries,
+    BlockWorkQueue& work_queue,
     BlockArray& blocks,
     Sensor& sensor,
     HashTable& hash_table,
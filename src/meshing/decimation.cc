@@ -0,0 +1,393 @@
+//
+// Created by wei on 18-1-24.
+//
+
+#include "meshing/decimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <glog/logging.h>
+#include <helper_math.h>
+
+#include "core/hash_function.h"
+#include "util/timer.h"
+#include "util/task_scheduler.h"
+
+namespace {
+/// Plane quadric, upper triangle of the symmetric 4x4 matrix
+struct Quadric {
+  double a[10];
+
+  Quadric() {
+    std::fill(a, a + 10, 0.0);
+  }
+  Quadric(double nx, double ny, double nz, double d) {
+    a[0] = nx * nx; a[1] = nx * ny; a[2] = nx * nz; a[3] = nx * d;
+    a[4] = ny * ny; a[5] = ny * nz; a[6] = ny * d;
+    a[7] = nz * nz; a[8] = nz * d;
+    a[9] = d * d;
+  }
+
+  Quadric& operator += (const Quadric& q) {
+    for (int i = 0; i < 10; ++i) a[i] += q.a[i];
+    return *this;
+  }
+  Quadric operator + (const Quadric& q) const {
+    Quadric r = *this;
+    r += q;
+    return r;
+  }
+
+  /// Sum of squared distances to the planes
+  double Error(const float3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+         + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+         + a[7] * z * z + 2 * a[8] * z
+         + a[9];
+  }
+};
+
+/// Vertices duplicated on block faces are bitwise identical
+struct VertexKey {
+  uint x, y, z;
+  bool operator == (const VertexKey& k) const {
+    return x == k.x && y == k.y && z == k.z;
+  }
+};
+
+struct VertexKeyHash {
+  size_t operator() (const VertexKey& k) const {
+    return ((size_t)k.x * 73856093) ^ ((size_t)k.y * 19349663)
+           ^ ((size_t)k.z * 83492791);
+  }
+};
+
+inline VertexKey MakeVertexKey(const float3& p) {
+  /// + 0.0f turns -0 into +0
+  float x = p.x + 0.0f, y = p.y + 0.0f, z = p.z + 0.0f;
+  VertexKey key;
+  std::memcpy(&key.x, &x, sizeof(uint));
+  std::memcpy(&key.y, &y, sizeof(uint));
+  std::memcpy(&key.z, &z, sizeof(uint));
+  return key;
+}
+
+inline uint64_t EdgeKey(int u, int v) {
+  if (u > v) std::swap(u, v);
+  return ((uint64_t)(uint)u << 32) | (uint)v;
+}
+
+inline int& Corner(int3& t, int i) {
+  return i == 0 ? t.x : (i == 1 ? t.y : t.z);
+}
+
+inline bool Contains(const int3& t, int v) {
+  return t.x == v || t.y == v || t.z == v;
+}
+
+/// Merge vertices duplicated by neighboring blocks,
+/// drop triangles degenerated by merging
+void WeldVertices(HostMesh& mesh) {
+  std::unordered_map<VertexKey, int, VertexKeyHash> welded_vertices;
+  welded_vertices.reserve(mesh.vertices.size());
+
+  std::vector<int> remapper(mesh.vertices.size());
+  HostMesh welded;
+  for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+    VertexKey key = MakeVertexKey(mesh.vertices[i]);
+    auto iter = welded_vertices.find(key);
+    if (iter != welded_vertices.end()) {
+      remapper[i] = iter->second;
+      continue;
+    }
+    int ptr = (int)welded.vertices.size();
+    welded_vertices.emplace(key, ptr);
+    remapper[i] = ptr;
+    welded.vertices.push_back(mesh.vertices[i]);
+    welded.normals.push_back(mesh.normals[i]);
+    welded.colors.push_back(mesh.colors[i]);
+  }
+
+  welded.triangles.reserve(mesh.triangles.size());
+  for (const int3& t : mesh.triangles) {
+    int3 r = make_int3(remapper[t.x], remapper[t.y], remapper[t.z]);
+    if (r.x == r.y || r.y == r.z || r.z == r.x) continue;
+    welded.triangles.push_back(r);
+  }
+  mesh = std::move(welded);
+}
+
+struct Collapse {
+  double cost;
+  int    from, to;
+  uint   from_stamp, to_stamp;
+  bool operator > (const Collapse& c) const {
+    return cost > c.cost;
+  }
+};
+
+/// Greedy half-edge collapses: vertices are only removed, never moved,
+/// so partitions don't write any shared data.
+/// @return surviving triangles, with global vertex indices
+std::vector<int3> SimplifyPartition(
+    const HostMesh& mesh,
+    const std::vector<int>& triangle_ids,
+    const std::vector<uchar>& is_shared,
+    const DecimationParams& params
+) {
+  /// 1. Local indexing
+  std::unordered_map<int, int> to_local;
+  std::vector<int> to_global;
+  std::vector<int3> triangles(triangle_ids.size());
+  for (size_t i = 0; i < triangle_ids.size(); ++i) {
+    int3 t = mesh.triangles[triangle_ids[i]];
+    for (int k = 0; k < 3; ++k) {
+      int& v = Corner(t, k);
+      auto iter = to_local.find(v);
+      if (iter == to_local.end()) {
+        iter = to_local.emplace(v, (int)to_global.size()).first;
+        to_global.push_back(v);
+      }
+      v = iter->second;
+    }
+    triangles[i] = t;
+  }
+
+  const int vertex_count = (int)to_global.size();
+  const int triangle_count = (int)triangles.size();
+  std::vector<float3>  pos(vertex_count);
+  std::vector<uchar>   is_locked(vertex_count);
+  std::vector<uchar>   is_vertex_removed(vertex_count, 0);
+  std::vector<uint>    stamps(vertex_count, 0);
+  std::vector<Quadric> quadrics(vertex_count);
+  std::vector<std::vector<int>> vertex_triangles(vertex_count);
+  std::vector<uchar>   is_triangle_removed(triangle_count, 0);
+  for (int v = 0; v < vertex_count; ++v) {
+    pos[v] = mesh.vertices[to_global[v]];
+    is_locked[v] = is_shared[to_global[v]];
+  }
+
+  /// 2. Quadrics, adjacency, and border locking
+  std::unordered_map<uint64_t, int> edge_use_count;
+  for (int i = 0; i < triangle_count; ++i) {
+    const int3& t = triangles[i];
+    float3 n = cross(pos[t.y] - pos[t.x], pos[t.z] - pos[t.x]);
+    float l = length(n);
+    if (l > 0) {
+      n /= l;
+      Quadric q(n.x, n.y, n.z, -dot(n, pos[t.x]));
+      quadrics[t.x] += q;
+      quadrics[t.y] += q;
+      quadrics[t.z] += q;
+    }
+    vertex_triangles[t.x].push_back(i);
+    vertex_triangles[t.y].push_back(i);
+    vertex_triangles[t.z].push_back(i);
+    edge_use_count[EdgeKey(t.x, t.y)]++;
+    edge_use_count[EdgeKey(t.y, t.z)]++;
+    edge_use_count[EdgeKey(t.z, t.x)]++;
+  }
+  /// Open borders and non-manifold edges keep their shape
+  for (const auto& edge : edge_use_count) {
+    if (edge.second != 2) {
+      is_locked[(int)(edge.first >> 32)] = 1;
+      is_locked[(int)(edge.first & 0xffffffff)] = 1;
+    }
+  }
+
+  /// 3. Collapse the cheapest edges first
+  std::priority_queue<Collapse, std::vector<Collapse>,
+                      std::greater<Collapse> > candidates;
+  auto push_edge = [&](int u, int v) {
+    Quadric q = quadrics[u] + quadrics[v];
+    if (! is_locked[u]) {
+      candidates.push({q.Error(pos[v]), u, v, stamps[u], stamps[v]});
+    }
+    if (! is_locked[v]) {
+      candidates.push({q.Error(pos[u]), v, u, stamps[v], stamps[u]});
+    }
+  };
+  for (const auto& edge : edge_use_count) {
+    push_edge((int)(edge.first >> 32), (int)(edge.first & 0xffffffff));
+  }
+
+  auto collect_neighbors = [&](int v, std::vector<int>& neighbors) {
+    neighbors.clear();
+    for (int i : vertex_triangles[v]) {
+      if (is_triangle_removed[i]) continue;
+      const int3& t = triangles[i];
+      if (t.x != v) neighbors.push_back(t.x);
+      if (t.y != v) neighbors.push_back(t.y);
+      if (t.z != v) neighbors.push_back(t.z);
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()),
+                    neighbors.end());
+  };
+
+  const float kMinNormalCosine = 0.5f;
+  std::vector<int> from_neighbors, to_neighbors, common_neighbors;
+  auto is_collapsible = [&](int from, int to) {
+    /// Link condition: only the wing vertices of the edge are shared
+    collect_neighbors(from, from_neighbors);
+    collect_neighbors(to, to_neighbors);
+    common_neighbors.clear();
+    std::set_intersection(from_neighbors.begin(), from_neighbors.end(),
+                          to_neighbors.begin(), to_neighbors.end(),
+                          std::back_inserter(common_neighbors));
+    int wing_count = 0;
+    for (int i : vertex_triangles[from]) {
+      if (! is_triangle_removed[i] && Contains(triangles[i], to))
+        ++wing_count;
+    }
+    if (wing_count == 0 || (int)common_neighbors.size() != wing_count)
+      return false;
+
+    /// No flipped or degenerated triangles
+    for (int i : vertex_triangles[from]) {
+      if (is_triangle_removed[i] || Contains(triangles[i], to)) continue;
+      const int3& t = triangles[i];
+      float3 p[3] = {pos[t.x], pos[t.y], pos[t.z]};
+      float3 n0 = cross(p[1] - p[0], p[2] - p[0]);
+      for (int k = 0; k < 3; ++k) {
+        if (Corner(triangles[i], k) == from) p[k] = pos[to];
+      }
+      float3 n1 = cross(p[1] - p[0], p[2] - p[0]);
+      float l0 = length(n0), l1 = length(n1);
+      if (l1 <= 1e-12f) return false;
+      if (l0 > 0 && dot(n0, n1) < kMinNormalCosine * l0 * l1) return false;
+    }
+    return true;
+  };
+
+  const double kMaxCost = (double)params.max_error * params.max_error;
+  const int target_triangle_count =
+      (int)std::ceil(triangle_count * params.triangle_ratio);
+  int live_triangle_count = triangle_count;
+  while (! candidates.empty() && live_triangle_count > target_triangle_count) {
+    Collapse c = candidates.top();
+    candidates.pop();
+    if (c.cost > kMaxCost) break;
+    if (is_vertex_removed[c.from] || is_vertex_removed[c.to]) continue;
+    if (c.from_stamp != stamps[c.from] || c.to_stamp != stamps[c.to])
+      continue;
+    if (! is_collapsible(c.from, c.to)) continue;
+
+    std::vector<int>& to_triangles = vertex_triangles[c.to];
+    for (int i : vertex_triangles[c.from]) {
+      if (is_triangle_removed[i]) continue;
+      if (Contains(triangles[i], c.to)) {
+        is_triangle_removed[i] = 1;
+        --live_triangle_count;
+        continue;
+      }
+      for (int k = 0; k < 3; ++k) {
+        if (Corner(triangles[i], k) == c.from) Corner(triangles[i], k) = c.to;
+      }
+      to_triangles.push_back(i);
+    }
+    to_triangles.erase(
+        std::remove_if(to_triangles.begin(), to_triangles.end(),
+                       [&](int i) { return is_triangle_removed[i] != 0; }),
+        to_triangles.end());
+    vertex_triangles[c.from].clear();
+
+    quadrics[c.to] += quadrics[c.from];
+    is_vertex_removed[c.from] = 1;
+    ++stamps[c.to];
+
+    collect_neighbors(c.to, to_neighbors);
+    for (int v : to_neighbors) {
+      push_edge(c.to, v);
+    }
+  }
+
+  /// 4. Back to global indices
+  std::vector<int3> result;
+  result.reserve(live_triangle_count);
+  for (int i = 0; i < triangle_count; ++i) {
+    if (is_triangle_removed[i]) continue;
+    const int3& t = triangles[i];
+    result.push_back(make_int3(to_global[t.x], to_global[t.y], to_global[t.z]));
+  }
+  return result;
+}
+}
+
+uint DecimateMesh(HostMesh& mesh, const DecimationParams& params,
+                  TaskScheduler& scheduler) {
+  Timer timer;
+  timer.Tick();
+  size_t input_triangle_count = mesh.triangles.size();
+
+  WeldVertices(mesh);
+
+  /// Partition triangles by their centroids
+  std::unordered_map<int3, int, Int3Hash, Int3Equal> partition_indices;
+  std::vector<std::vector<int> > partitions;
+  std::vector<int> vertex_partition(mesh.vertices.size(), -1);
+  std::vector<uchar> is_shared(mesh.vertices.size(), 0);
+  const float kInvPartitionSize = 1.0f / params.partition_size;
+  for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+    const int3& t = mesh.triangles[i];
+    float3 c = (mesh.vertices[t.x] + mesh.vertices[t.y] + mesh.vertices[t.z])
+               * (kInvPartitionSize / 3.0f);
+    int3 cell = make_int3((int)std::floor(c.x),
+                          (int)std::floor(c.y),
+                          (int)std::floor(c.z));
+    auto iter = partition_indices.find(cell);
+    if (iter == partition_indices.end()) {
+      iter = partition_indices.emplace(cell, (int)partitions.size()).first;
+      partitions.emplace_back();
+    }
+    int p = iter->second;
+    partitions[p].push_back((int)i);
+
+    const int vertex_ptrs[3] = {t.x, t.y, t.z};
+    for (int v : vertex_ptrs) {
+      if (vertex_partition[v] == -1) vertex_partition[v] = p;
+      else if (vertex_partition[v] != p) is_shared[v] = 1;
+    }
+  }
+
+  /// Simplify partitions in parallel
+  std::vector<std::vector<int3> > results(partitions.size());
+  /// Partitions differ in size: stolen in chunks by idle workers
+  scheduler.ParallelFor("decimation", (uint)partitions.size(),
+                        [&](uint begin, uint end) {
+    for (uint p = begin; p < end; ++p) {
+      results[p] = SimplifyPartition(mesh, partitions[p], is_shared, params);
+    }
+  });
+
+  /// Gather triangles and drop unreferenced vertices
+  std::vector<int> remapper(mesh.vertices.size(), -1);
+  HostMesh decimated;
+  for (const auto& result : results) {
+    for (int3 t : result) {
+      for (int k = 0; k < 3; ++k) {
+        int& v = Corner(t, k);
+        if (remapper[v] == -1) {
+          remapper[v] = (int)decimated.vertices.size();
+          decimated.vertices.push_back(mesh.vertices[v]);
+          decimated.normals.push_back(mesh.normals[v]);
+          decimated.colors.push_back(mesh.colors[v]);
+        }
+        v = remapper[v];
+      }
+      decimated.triangles.push_back(t);
+    }
+  }
+  mesh = std::move(decimated);
+
+  LOG(INFO) << "Decimation: " << input_triangle_count << " -> "
+            << mesh.triangles.size() << " triangles, "
+            << partitions.size() << " partitions on "
+            << scheduler.worker_count() << " threads, "
+            << timer.Tock() << "s";
+  return (uint)mesh.triangles.size();
+}
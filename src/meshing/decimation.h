@@ -0,0 +1,34 @@
+//
+// Created by wei on 18-1-24.
+//
+// Quadric error decimation of an exported mesh, on the CPU.
+// The mesh is cut into cubic partitions of several blocks;
+// vertices shared by partitions or on open borders are locked,
+// so that partitions are simplified independently on many threads
+// and still stitch together exactly.
+
+#ifndef MESHING_DECIMATION_H
+#define MESHING_DECIMATION_H
+
+#include <vector>
+#include "core/common.h"
+#include "core/params.h"
+
+class TaskScheduler;
+
+/// Mesh on the host, the layout of CompactMesh
+struct HostMesh {
+  std::vector<float3> vertices;
+  std::vector<float3> normals;
+  std::vector<float3> colors;
+  std::vector<int3>   triangles;
+};
+
+/// Simplify @param mesh in place, partitions on the workers of
+/// @param scheduler, kept alive by the caller so that its chunk sizes
+/// stay tuned across calls
+/// @return triangle count after decimation
+uint DecimateMesh(HostMesh& mesh, const DecimationParams& params,
+                  TaskScheduler& scheduler);
+
+#endif //MESHING_DECIMATION_H
@@ -1,7 +1,6 @@
 #include <device_launch_parameters.h>
 #include "meshing/marching_cubes.h"
-#include "geometry/spatial_query.h"
-#include "visualization/color_util.h"
+#include "meshing/mesh_util.h"
 //#define REDUCTION
 
 ////////////////////
@@ -12,77 +11,69 @@
 /// Device code
 ////////////////////
 
-/// Marching Cubes
+/// Marching Cubes: vertices lie on edges owned by the cubes in [0, 8]^3;
+/// with a LOD @param stride, cubes sit at multiples of the stride
 __device__
-float3 VertexIntersection(const float3 &p1, const float3 p2,
-                          const float &v1, const float &v2,
-                          const float &isolevel) {
-  if (fabs(v1 - isolevel) < 0.008) return p1;
-  if (fabs(v2 - isolevel) < 0.008) return p2;
-  float mu = (isolevel - v1) / (v2 - v1);
-
-  float3 p = make_float3(p1.x + mu * (p2.x - p1.x),
-                         p1.y + mu * (p2.y - p1.y),
-                         p1.z + mu * (p2.z - p1.z));
-  return p;
+inline uint EdgeOwnerSlot(const uint3 offset, int edge, int stride) {
+  uint4 edge_owner_cube_offset = kEdgeOwnerCubeOffset[edge];
+  uint3 owner_offset = offset
+                       + (uint)stride * make_uint3(edge_owner_cube_offset.x,
+                                                   edge_owner_cube_offset.y,
+                                                   edge_owner_cube_offset.z);
+  return VectorizeHaloOffset(owner_offset) * N_VERTEX + edge_owner_cube_offset.w;
 }
 
+/// Rebuild the whole mesh of a block into its own chunks:
+/// 0. pick the stride of the block and of its 26 neighbors by distance
+/// 1. classify cubes, assign local vertex indices through shared memory
+/// 2. fit the vertex and triangle chunks to the counts
+/// 3. cache voxel attributes of the block, write vertices
+/// 4. write triangles
 __device__
-inline int AllocateVertexWithMutex(
-    MeshUnit &mesh_unit,
-    uint  &vertex_idx,
-    const float3 &vertex_pos,
-    Mesh &mesh,
+void ExtractBlockMesh(
+    const HashEntry &entry,
     BlockArray &blocks,
-    const HashTable &hash_table,
+    Mesh &mesh,
+    HashTable &hash_table,
     GeometryHelper &geometry_helper,
-    bool enable_sdf_gradient
+    bool enable_sdf_gradient,
+    float3 camera_pos,
+    float2 lod_distances
 ) {
-  int ptr = mesh_unit.vertex_ptrs[vertex_idx];
-  if (ptr == FREE_PTR) {
-    int lock = atomicExch(&mesh_unit.vertex_mutexes[vertex_idx], LOCK_ENTRY);
-    if (lock != LOCK_ENTRY) {
-      ptr = mesh.AllocVertex();
-    } /// Ensure that it is only allocated once
-  }
-
-  if (ptr >= 0) {
-    Voxel voxel_query;
-    bool valid = GetSpatialValue(vertex_pos, blocks, hash_table,
-                                 geometry_helper, &voxel_query);
-    mesh_unit.vertex_ptrs[vertex_idx] = ptr;
-    mesh.vertex(ptr).pos = vertex_pos;
-    mesh.vertex(ptr).radius = sqrtf(1.0f / voxel_query.inv_sigma2);
+  Block& block = blocks[entry.ptr];
 
-    float3 grad;
-    valid = GetSpatialSDFGradient(
-        vertex_pos,
-        blocks, hash_table,
-        geometry_helper,
-        &grad
-    );
-    float l = length(grad);
-    mesh.vertex(ptr).normal = l > 0 && valid ? grad / l : make_float3(0);
+  __shared__ int  local_vertex_ptrs[kHaloSize * N_VERTEX];
+  __shared__ int  vertex_count;
+  __shared__ int  triangle_count;
+  __shared__ bool is_chunk_allocated;
+  __shared__ int  neighbor_strides[27];
+  __shared__ VoxelAttributeCache attribute_cache;
 
-    float rho = voxel_query.a/(voxel_query.a + voxel_query.b);
-    //printf("%f %f\n", voxel_query.a, voxel_query.b);
-    mesh.vertex(ptr).color = ValToRGB(rho, 0.4f, 1.0f);
-    //mesh.vertex(ptr).color = ValToRGB(voxel_query.inv_sigma2/10000.0f, 0, 1.0f);
+  for (int i = threadIdx.x; i < kHaloSize * N_VERTEX; i += blockDim.x) {
+    local_vertex_ptrs[i] = FREE_PTR;
   }
-  return ptr;
-}
+  if (threadIdx.x == 0) {
+    vertex_count = 0;
+    triangle_count = 0;
+    block.boundary_surfel_count = 0;
+    block.inner_surfel_count = 0;
+  }
+  if (threadIdx.x < 27) {
+    int3 block_offset = make_int3(threadIdx.x % 3,
+                                  (threadIdx.x / 3) % 3,
+                                  threadIdx.x / 9) - make_int3(1);
+    neighbor_strides[threadIdx.x] = LodStride(entry.pos + block_offset,
+                                              camera_pos, lod_distances,
+                                              geometry_helper);
+  }
+  __syncthreads();
 
-__global__
-void SurfelExtractionKernel(
-    EntryArray candidate_entries,
-    BlockArray blocks,
-    Mesh mesh,
-    HashTable hash_table,
-    GeometryHelper geometry_helper,
-    bool enable_sdf_gradient
-) {
-  const HashEntry &entry = candidate_entries[blockIdx.x];
-  Block& block = blocks[entry.ptr];
+  /// Seams with coarser neighbors across faces, edges or corners
+  const int stride = neighbor_strides[NeighborIndex(make_int3(0))];
+  bool is_seam = false;
+  for (int i = 0; i < 27; ++i) {
+    is_seam = is_seam || (neighbor_strides[i] > stride);
+  }
 
   int3   voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
   uint3  offset = geometry_helper.DevectorizeIndex(threadIdx.x);
@@ -90,233 +81,164 @@ void SurfelExtractionKernel(
   float3 world_pos = geometry_helper.VoxelToWorld(voxel_pos);
 
   MeshUnit &this_mesh_unit = block.mesh_units[threadIdx.x];
-  Voxel& this_voxel = block.voxels[threadIdx.x];
+
   //////////
-  /// 1. Read the scalar values, see mc_tables.h
-  const int kVertexCount = 8;
-  const float kVoxelSize = geometry_helper.voxel_size;
-  const float kThreshold = 0.20f;
+  /// 1. Classify the cube, the first visitor of an edge owns its vertex
+  const int kEdgeCount = 12;
   const float kIsoLevel = 0;
+  float  d[8];
+  float3 p[8];
 
-  float  d[kVertexCount];
-  float3 p[kVertexCount];
-
-  short cube_index = 0;
+  /// Only cubes at multiples of the stride are sampled
+  bool is_sampled = (offset.x % stride == 0
+                     && offset.y % stride == 0
+                     && offset.z % stride == 0);
   this_mesh_unit.prev_cube_idx = this_mesh_unit.curr_cube_idx;
-  this_mesh_unit.curr_cube_idx = 0;
-
-  // inlier ratio
-//  if (this_voxel.inv_sigma2 < 5.0f) return;
-//  float rho = this_voxel.a / (this_voxel.a + this_voxel.b);
-//  if (rho < 0.2f || this_voxel.inv_sigma2 < squaref(0.33f / kVoxelSize))
-//    return;
-
-  /// Check 8 corners of a cube: are they valid?
-  Voxel voxel_query;
-  for (int i = 0; i < kVertexCount; ++i) {
-    if (! GetVoxelValue(entry, voxel_pos + kVtxOffset[i],
-                        blocks, hash_table,
-                        geometry_helper, &voxel_query)) {
-      return;
-    }
-
-    d[i] = voxel_query.sdf;
-    if (fabs(d[i]) > kThreshold) return;
-
-    float rho = voxel_query.a / (voxel_query.a + voxel_query.b);
-    if (rho < 0.1f || voxel_query.inv_sigma2 < squaref(1.0f / kVoxelSize))
-      return;
-//    if (voxel_query.inv_sigma2 < 50.0f) return;
-    if (d[i] < kIsoLevel) cube_index |= (1 << i);
-    p[i] = world_pos + kVoxelSize * make_float3(kVtxOffset[i]);
-  }
-
+  short cube_index = ! is_sampled ? 0 :
+                     ReadCube(entry, voxel_pos, world_pos,
+                              blocks, hash_table, geometry_helper,
+                              d, p,
+                              stride, is_seam ? neighbor_strides : nullptr);
   this_mesh_unit.curr_cube_idx = cube_index;
-  if (cube_index == 0 || cube_index == 255) return;
+  bool is_surface = (cube_index != 0 && cube_index != 255);
 
-  const int kEdgeCount = 12;
+  int pending_edges[kEdgeCount];
+  int pending_ptrs[kEdgeCount];
+  int pending_count = 0;
+  int local_triangle_ptr = 0;
+  if (is_surface) {
 #pragma unroll 1
-  for (int i = 0; i < kEdgeCount; ++i) {
-    if (kCubeEdges[cube_index] & (1 << i)) {
-      int2 edge_endpoint_vertices = kEdgeEndpointVertices[i];
-      uint4 edge_cube_owner_offset = kEdgeOwnerCubeOffset[i];
-
-      // Special noise-bit interpolation here: extrapolation
-      float3 vertex_pos = VertexIntersection(
-          p[edge_endpoint_vertices.x],
-          p[edge_endpoint_vertices.y],
-          d[edge_endpoint_vertices.x],
-          d[edge_endpoint_vertices.y],
-          kIsoLevel);
-
-      MeshUnit &mesh_unit = GetMeshUnitRef(
-          entry,
-          voxel_pos + make_int3(edge_cube_owner_offset.x,
-                                edge_cube_owner_offset.y,
-                                edge_cube_owner_offset.z),
-          blocks, hash_table,
-          geometry_helper);
+    for (int i = 0; i < kEdgeCount; ++i) {
+      if (kCubeEdges[cube_index] & (1 << i)) {
+        uint slot = EdgeOwnerSlot(offset, i, stride);
+        int lock = atomicCAS(&local_vertex_ptrs[slot], FREE_PTR, LOCK_ENTRY);
+        if (lock == FREE_PTR) {
+          int ptr = atomicAdd(&vertex_count, 1);
+          local_vertex_ptrs[slot] = ptr;
+          pending_edges[pending_count] = i;
+          pending_ptrs[pending_count] = ptr;
+          ++pending_count;
+        }
+      }
+    }
 
-      AllocateVertexWithMutex(
-          mesh_unit,
-          edge_cube_owner_offset.w,
-          vertex_pos,
-          mesh,
-          blocks,
-          hash_table, geometry_helper,
-          enable_sdf_gradient);
+    int local_triangle_count = 0;
+    for (int t = 0; kTriangleVertexEdge[cube_index][t] != -1; t += 3) {
+      ++local_triangle_count;
     }
+    local_triangle_ptr = atomicAdd(&triangle_count, local_triangle_count);
   }
-}
-
-__device__
-inline bool IsInner(uint3 offset) {
-  return (offset.x >= 1 && offset.y >= 1 && offset.z >= 1
-          && offset.x < BLOCK_SIDE_LENGTH - 1
-          && offset.y < BLOCK_SIDE_LENGTH - 1
-          && offset.z < BLOCK_SIDE_LENGTH - 1);
-}
+  __syncthreads();
 
-__global__
-void TriangleExtractionKernel(
-    EntryArray candidate_entries,
-    BlockArray blocks,
-    Mesh mesh,
-    HashTable hash_table,
-    GeometryHelper geometry_helper,
-    bool enable_sdf_gradient
-) {
-  const HashEntry &entry = candidate_entries[blockIdx.x];
-  Block& block = blocks[entry.ptr];
+  //////////
+  /// 2. Fit the chunks; on failure the block is left without mesh
   if (threadIdx.x == 0) {
-    block.boundary_surfel_count = 0;
-    block.inner_surfel_count = 0;
+    is_chunk_allocated =
+        mesh.AllocVertexChunk(block.vertex_chunk, vertex_count)
+        && mesh.AllocTriangleChunk(block.triangle_chunk, triangle_count);
+    if (! is_chunk_allocated) {
+      mesh.AllocVertexChunk(block.vertex_chunk, 0);
+      mesh.AllocTriangleChunk(block.triangle_chunk, 0);
+    }
   }
   __syncthreads();
 
-  int3   voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
-  uint3  offset = geometry_helper.DevectorizeIndex(threadIdx.x);
-  int3   voxel_pos = voxel_base_pos + make_int3(offset);
-  float3 world_pos = geometry_helper.VoxelToWorld(voxel_pos);
+  //////////
+  /// 3. Write vertices; cubes inside the block remember their own.
+  ///    A coarse vertex stands for stride^2 surfels of the full resolution.
+  ///    Normals and radii come from voxel attributes cached once per block
+  if (is_chunk_allocated && vertex_count > 0) {
+    FillVoxelAttributeCache(attribute_cache, entry,
+                            blocks, hash_table, geometry_helper);
+  }
 
-  MeshUnit &this_mesh_unit = block.mesh_units[threadIdx.x];
+  uint this_slot = VectorizeHaloOffset(offset) * N_VERTEX;
   bool is_inner = IsInner(offset);
-  for (int i = 0; i < 3; ++i) {
-    if (this_mesh_unit.vertex_ptrs[i] >= 0) {
+  for (int i = 0; i < N_VERTEX; ++i) {
+    int ptr = is_chunk_allocated ? local_vertex_ptrs[this_slot + i] : FREE_PTR;
+    this_mesh_unit.vertex_ptrs[i] = ptr;
+    if (ptr >= 0) {
       if (is_inner) {
-        atomicAdd(&block.inner_surfel_count, 1);
+        atomicAdd(&block.inner_surfel_count, stride * stride);
       } else {
-        atomicAdd(&block.boundary_surfel_count, 1);
+        atomicAdd(&block.boundary_surfel_count, stride * stride);
       }
     }
   }
-  /// Cube type unchanged: NO need to update triangles
-//  if (this_cube.curr_cube_idx == this_cube.prev_cube_idx) {
-//    blocks[entry.ptr].voxels[local_idx].stats.duration += 1.0f;
-//    return;
-//  }
-//  blocks[entry.ptr].voxels[local_idx].stats.duration = 0;
 
-  if (this_mesh_unit.curr_cube_idx == 0
-      || this_mesh_unit.curr_cube_idx == 255) {
-    return;
+  if (is_chunk_allocated) {
+#pragma unroll 1
+    for (int i = 0; i < pending_count; ++i) {
+      int2 edge_endpoint_vertices = kEdgeEndpointVertices[pending_edges[i]];
+      // Special noise-bit interpolation here: extrapolation
+      float3 vertex_pos = VertexIntersection(
+          p[edge_endpoint_vertices.x],
+          p[edge_endpoint_vertices.y],
+          d[edge_endpoint_vertices.x],
+          d[edge_endpoint_vertices.y],
+          kIsoLevel);
+      if (is_seam) {
+        vertex_pos = SnapSeamVertex(
+            vertex_pos,
+            voxel_pos + stride * kVtxOffset[edge_endpoint_vertices.x],
+            voxel_pos + stride * kVtxOffset[edge_endpoint_vertices.y],
+            entry, stride, neighbor_strides,
+            blocks, hash_table, geometry_helper);
+      }
+      WriteVertex(mesh.vertex(block.vertex_chunk, pending_ptrs[i]),
+                  vertex_pos, voxel_base_pos,
+                  attribute_cache, geometry_helper,
+                  enable_sdf_gradient);
+    }
   }
+  __syncthreads();
 
   //////////
-  /// 2. Determine vertices (ptr allocated via (shared) edges
-  /// If the program reach here, the voxels holding edges must exist
-  /// This operation is in 2-pass
-  /// pass2: Assign
-  const int kEdgeCount = 12;
-  int vertex_ptrs[kEdgeCount];
+  /// 4. Assign triangles, referring to vertices in the same chunk
+  if (! is_chunk_allocated || ! is_surface) return;
 
+  int vertex_ptrs[kEdgeCount];
 #pragma unroll 1
   for (int i = 0; i < kEdgeCount; ++i) {
-    if (kCubeEdges[this_mesh_unit.curr_cube_idx] & (1 << i)) {
-      uint4 edge_owner_cube_offset = kEdgeOwnerCubeOffset[i];
-
-      MeshUnit &mesh_unit  = GetMeshUnitRef(
-          entry,
-          voxel_pos + make_int3(edge_owner_cube_offset.x,
-                                edge_owner_cube_offset.y,
-                                edge_owner_cube_offset.z),
-          blocks,
-          hash_table,
-          geometry_helper);
-
-      vertex_ptrs[i] = mesh_unit.GetVertex(edge_owner_cube_offset.w);
-      mesh_unit.ResetMutexes();
+    if (kCubeEdges[cube_index] & (1 << i)) {
+      vertex_ptrs[i] = block.vertex_chunk.ptr
+                       + local_vertex_ptrs[EdgeOwnerSlot(offset, i, stride)];
     }
   }
 
-  //////////
-  /// 3. Assign triangles
-  int i = 0;
   for (int t = 0;
-       kTriangleVertexEdge[this_mesh_unit.curr_cube_idx][t] != -1;
-       t += 3, ++i) {
-    int triangle_ptr = this_mesh_unit.triangle_ptrs[i];
-    if (triangle_ptr == FREE_PTR) {
-      triangle_ptr = mesh.AllocTriangle();
-    } else {
-      mesh.ReleaseTriangle(mesh.triangle(triangle_ptr));
-    }
-    this_mesh_unit.triangle_ptrs[i] = triangle_ptr;
-
-    mesh.AssignTriangle(
-        mesh.triangle(triangle_ptr),
-        make_int3(vertex_ptrs[kTriangleVertexEdge[this_mesh_unit.curr_cube_idx][t + 0]],
-                  vertex_ptrs[kTriangleVertexEdge[this_mesh_unit.curr_cube_idx][t + 1]],
-                  vertex_ptrs[kTriangleVertexEdge[this_mesh_unit.curr_cube_idx][t + 2]]));
+       kTriangleVertexEdge[cube_index][t] != -1;
+       t += 3, ++local_triangle_ptr) {
+    Triangle& triangle = mesh.triangle(block.triangle_chunk,
+                                       local_triangle_ptr);
+    triangle.vertex_ptrs = make_int3(
+        vertex_ptrs[kTriangleVertexEdge[cube_index][t + 0]],
+        vertex_ptrs[kTriangleVertexEdge[cube_index][t + 1]],
+        vertex_ptrs[kTriangleVertexEdge[cube_index][t + 2]]);
     if (!enable_sdf_gradient) {
-      mesh.ComputeTriangleNormal(mesh.triangle(triangle_ptr));
+      mesh.ComputeTriangleNormal(triangle);
     }
   }
 }
 
-/// Garbage collection (ref count)
-__global__
-void RecycleTrianglesKernel(
-    EntryArray candidate_entries,
-    BlockArray blocks,
-    Mesh mesh) {
-  const HashEntry &entry = candidate_entries[blockIdx.x];
-  MeshUnit &mesh_unit = blocks[entry.ptr].mesh_units[threadIdx.x];
-
-  int i = 0;
-  for (int t = 0;
-       kTriangleVertexEdge[mesh_unit.curr_cube_idx][t] != -1;
-       t += 3, ++i);
-
-  for (; i < N_TRIANGLE; ++i) {
-    int triangle_ptr = mesh_unit.triangle_ptrs[i];
-    if (triangle_ptr == FREE_PTR) continue;
-
-    // Clear ref_count of its pointed vertices
-    mesh.ReleaseTriangle(mesh.triangle(triangle_ptr));
-    mesh.triangle(triangle_ptr).Clear();
-    mesh.FreeTriangle(triangle_ptr);
-    mesh_unit.triangle_ptrs[i] = FREE_PTR;
-  }
-}
-
+/// Persistent CUDA blocks, each extracting blocks popped from
+/// @param work_queue until it is drained
 __global__
-void RecycleVerticesKernel(
-    EntryArray candidate_entries,
+void MeshExtractionKernel(
+    BlockWorkQueue work_queue,
     BlockArray blocks,
-    Mesh mesh
+    Mesh mesh,
+    HashTable hash_table,
+    GeometryHelper geometry_helper,
+    bool enable_sdf_gradient,
+    float3 camera_pos,
+    float2 lod_distances
 ) {
-  const HashEntry &entry = candidate_entries[blockIdx.x];
-  MeshUnit &mesh_unit = blocks[entry.ptr].mesh_units[threadIdx.x];
-
-#pragma unroll 1
-  for (int i = 0; i < 3; ++i) {
-    if (mesh_unit.vertex_ptrs[i] != FREE_PTR &&
-        mesh.vertex(mesh_unit.vertex_ptrs[i]).ref_count == 0) {
-      mesh.vertex(mesh_unit.vertex_ptrs[i]).Clear();
-      mesh.FreeVertex(mesh_unit.vertex_ptrs[i]);
-      mesh_unit.vertex_ptrs[i] = FREE_PTR;
-    }
+  for (uint i = work_queue.Pop(); i < work_queue.count();
+       i = work_queue.Pop()) {
+    ExtractBlockMesh(work_queue[i], blocks, mesh,
+                     hash_table, geometry_helper,
+                     enable_sdf_gradient, camera_pos, lod_distances);
   }
 }
 
@@ -325,58 +247,61 @@ void RecycleVerticesKernel(
 ////////////////////
 float MarchingCubes(
     EntryArray &candidate_entries,
+    BlockWorkQueue &work_queue,
     BlockArray &blocks,
     Mesh &mesh,
     HashTable &hash_table,
     GeometryHelper &geometry_helper,
-    bool enable_sdf_gradient
+    bool enable_sdf_gradient,
+    bool enable_lod,
+    float3 camera_pos
 ) {
   uint occupied_block_count = candidate_entries.count();
   LOG(INFO) << "Marching cubes block count: " << occupied_block_count;
   if (occupied_block_count == 0)
     return -1;
 
+  Timer timer;
+  timer.Tick();
+  work_queue.Fill(candidate_entries, blocks);
+  double queue_seconds = timer.Tock();
+  LOG(INFO) << "Surface blocks queued first: " << work_queue.surface_count();
+
   const uint threads_per_block = BLOCK_SIZE;
-  const dim3 grid_size(occupied_block_count, 1);
+  const dim3 grid_size(work_queue.PersistentGridSize(
+      (const void *)MeshExtractionKernel, threads_per_block), 1);
   const dim3 block_size(threads_per_block, 1);
 
-  /// Use divide and conquer to avoid read-write conflict
-  Timer timer;
-  timer.Tick();
-  SurfelExtractionKernel << < grid_size, block_size >> > (
-      candidate_entries,
-          blocks,
-          mesh,
-          hash_table,
-          geometry_helper,
-          enable_sdf_gradient);
-  checkCudaErrors(cudaDeviceSynchronize());
-  checkCudaErrors(cudaGetLastError());
-  double pass1_seconds = timer.Tock();
-  LOG(INFO) << "Pass1 duration: " << pass1_seconds;
+  /// Without LOD every block is sampled at full resolution
+  float2 lod_distances = enable_lod
+                         ? make_float2(mesh.params().lod_distance_2x,
+                                       mesh.params().lod_distance_4x)
+                         : make_float2(0, 0);
 
   timer.Tick();
-  TriangleExtractionKernel << < grid_size, block_size >> > (
-      candidate_entries,
+  MeshExtractionKernel << < grid_size, block_size >> > (
+      work_queue,
           blocks,
           mesh,
           hash_table,
           geometry_helper,
-          enable_sdf_gradient);
+          enable_sdf_gradient,
+          camera_pos,
+          lod_distances);
   checkCudaErrors(cudaDeviceSynchronize());
   checkCudaErrors(cudaGetLastError());
-  double pass2_seconds = timer.Tock();
-  LOG(INFO) << "Pass2 duration: " << pass2_seconds;
+  double extraction_seconds = queue_seconds + timer.Tock();
+  LOG(INFO) << "Extraction duration: " << extraction_seconds;
 
-  RecycleTrianglesKernel << < grid_size, block_size >> > (
-      candidate_entries, blocks, mesh);
-  checkCudaErrors(cudaDeviceSynchronize());
-  checkCudaErrors(cudaGetLastError());
+  /// Chunks outgrown or emptied in this pass go back to the heap
+  timer.Tick();
+  mesh.ReleaseRetiredChunks();
+  double release_seconds = timer.Tock();
+  LOG(INFO) << "Release duration: " << release_seconds;
 
-  RecycleVerticesKernel << < grid_size, block_size >> > (
-      candidate_entries, blocks, mesh);
-  checkCudaErrors(cudaDeviceSynchronize());
-  checkCudaErrors(cudaGetLastError());
+  return (float)(extraction_seconds + release_seconds);
+}
 
-  return (float)(pass1_seconds + pass2_seconds);
+MesherOccupancy MarchingCubesOccupancy() {
+  return GetMesherOccupancy((const void *)MeshExtractionKernel);
 }
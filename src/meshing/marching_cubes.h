@@ -14,12 +14,21 @@
 #include "util/timer.h"
 #include "engine/main_engine.h"
 #include "core/collect_block_array.h"
+#include "core/block_work_queue.h"
+#include "meshing/mesh_stats.h"
 
+/// @param work_queue refilled with @param candidate_entries
 float MarchingCubes(
     EntryArray& candidate_entries,
+    BlockWorkQueue& work_queue,
     BlockArray& blocks,
     Mesh& mesh,
     HashTable& hash_table,
     GeometryHelper& geometry_helper,
-    bool enable_sdf_gradient);
+    bool enable_sdf_gradient,
+    bool enable_lod,
+    float3 camera_pos);
+
+/// Resources of the kernel of MarchingCubes
+MesherOccupancy MarchingCubesOccupancy();
 #endif //MESH_HASHING_MARCHING_CUBES_H
@@ -0,0 +1,82 @@
+//
+// Created by wei on 18-1-20.
+//
+
+#include "meshing/mesh_stats.h"
+
+#include <helper_cuda.h>
+#include <device_launch_parameters.h>
+
+////////////////////
+/// Device code
+////////////////////
+__global__
+void CountMeshElementsKernel(
+    EntryArray candidate_entries,
+    BlockArray blocks,
+    uint       processing_block_count,
+    uint2     *element_count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= processing_block_count) return;
+
+  const HashEntry& entry = candidate_entries[idx];
+  const Block& block = blocks[entry.ptr];
+  if (block.vertex_chunk.count > 0)
+    atomicAdd(&element_count->x, (uint)block.vertex_chunk.count);
+  if (block.triangle_chunk.count > 0)
+    atomicAdd(&element_count->y, (uint)block.triangle_chunk.count);
+}
+
+////////////////////
+/// Host code
+////////////////////
+uint2 CountMeshElements(
+    EntryArray& candidate_entries,
+    BlockArray& blocks
+) {
+  uint2 element_count = make_uint2(0, 0);
+  uint processing_block_count = candidate_entries.count();
+  if (processing_block_count <= 0)
+    return element_count;
+
+  uint2* element_count_gpu;
+  checkCudaErrors(cudaMalloc(&element_count_gpu, sizeof(uint2)));
+  checkCudaErrors(cudaMemset(element_count_gpu, 0, sizeof(uint2)));
+
+  const int threads_per_block = 64;
+  const dim3 grid_size((processing_block_count + threads_per_block - 1)
+                       / threads_per_block, 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  CountMeshElementsKernel<<<grid_size, block_size>>>(
+      candidate_entries,
+          blocks,
+          processing_block_count,
+          element_count_gpu);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+
+  checkCudaErrors(cudaMemcpy(&element_count, element_count_gpu,
+                             sizeof(uint2), cudaMemcpyDeviceToHost));
+  checkCudaErrors(cudaFree(element_count_gpu));
+  return element_count;
+}
+
+MesherOccupancy GetMesherOccupancy(const void *kernel) {
+  MesherOccupancy occupancy;
+  cudaFuncAttributes attributes;
+  checkCudaErrors(cudaFuncGetAttributes(&attributes, kernel));
+  occupancy.shared_bytes = attributes.sharedSizeBytes;
+  occupancy.register_count = attributes.numRegs;
+  checkCudaErrors(cudaOccupancyMaxActiveBlocksPerMultiprocessor(
+      &occupancy.blocks_per_sm, kernel, BLOCK_SIZE, 0));
+
+  int device;
+  cudaDeviceProp properties;
+  checkCudaErrors(cudaGetDevice(&device));
+  checkCudaErrors(cudaGetDeviceProperties(&properties, device));
+  occupancy.occupancy = (float)(occupancy.blocks_per_sm * BLOCK_SIZE)
+                        / properties.maxThreadsPerMultiProcessor;
+  return occupancy;
+}
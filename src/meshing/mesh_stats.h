@@ -0,0 +1,29 @@
+//
+// Created by wei on 18-1-20.
+//
+
+#ifndef MESHING_MESH_STATS_H
+#define MESHING_MESH_STATS_H
+
+#include "core/entry_array.h"
+#include "core/block_array.h"
+
+/// Vertices and triangles held by the chunks of the candidate blocks
+/// @return (vertex_count, triangle_count)
+uint2 CountMeshElements(
+    EntryArray& candidate_entries,
+    BlockArray& blocks);
+
+/// What a mesh extraction kernel costs a multiprocessor, one CUDA block
+/// of BLOCK_SIZE threads per block of the map
+struct MesherOccupancy {
+  size_t shared_bytes = 0;   // static shared memory per CUDA block
+  int    register_count = 0; // per thread
+  int    blocks_per_sm = 0;  // resident CUDA blocks per multiprocessor
+  float  occupancy = 0;      // resident over maximum threads
+};
+
+/// @param kernel a __global__ function launched with BLOCK_SIZE threads
+MesherOccupancy GetMesherOccupancy(const void *kernel);
+
+#endif //MESHING_MESH_STATS_H
@@ -0,0 +1,510 @@
+//
+// Created by wei on 18-1-20.
+//
+// Device helpers shared by the meshing methods, include in .cu only
+
+#ifndef MESHING_MESH_UTIL_H
+#define MESHING_MESH_UTIL_H
+
+#include "core/common.h"
+#include "core/entry_array.h"
+#include "core/block_array.h"
+#include "core/hash_table.h"
+#include "core/mesh.h"
+#include "geometry/geometry_helper.h"
+#include "geometry/spatial_query.h"
+#include "meshing/mc_tables.h"
+#include "visualization/color_util.h"
+
+////////////////////
+/// Device code
+////////////////////
+/// Marching Cubes
+__device__
+inline float3 VertexIntersection(const float3 &p1, const float3 p2,
+                                 const float &v1, const float &v2,
+                                 const float &isolevel) {
+  if (fabs(v1 - isolevel) < 0.008) return p1;
+  if (fabs(v2 - isolevel) < 0.008) return p2;
+  float mu = (isolevel - v1) / (v2 - v1);
+
+  float3 p = make_float3(p1.x + mu * (p2.x - p1.x),
+                         p1.y + mu * (p2.y - p1.y),
+                         p1.z + mu * (p2.z - p1.z));
+  return p;
+}
+
+/// Cubes touched when meshing a block span one extra layer (9^3).
+/// Vertices in the extra layer belong to neighbor blocks as well,
+/// they are duplicated so that the chunk of each block is self-contained.
+static const int kHaloSideLength = BLOCK_SIDE_LENGTH + 1;
+static const int kHaloSize = kHaloSideLength * kHaloSideLength * kHaloSideLength;
+
+__device__
+inline uint VectorizeHaloOffset(const uint3 offset) {
+  return (offset.z * kHaloSideLength + offset.y) * kHaloSideLength + offset.x;
+}
+
+__device__
+inline uint3 DevectorizeHaloOffset(const uint idx) {
+  uint x = idx % kHaloSideLength;
+  uint y = (idx / kHaloSideLength) % kHaloSideLength;
+  uint z = idx / (kHaloSideLength * kHaloSideLength);
+  return make_uint3(x, y, z);
+}
+
+/// Level of detail: sampling stride of a block in voxels,
+/// growing with the distance of its center to the camera.
+/// Non-positive distances disable the level.
+__device__
+inline int LodStride(
+    const int3 block_pos,
+    const float3 camera_pos,
+    const float2 lod_distances,
+    GeometryHelper &geometry_helper
+) {
+  float3 block_center = geometry_helper.VoxelToWorld(
+      geometry_helper.BlockToVoxel(block_pos))
+      + make_float3(0.5f * BLOCK_SIDE_LENGTH * geometry_helper.voxel_size);
+  float dist = length(block_center - camera_pos);
+  if (lod_distances.y > 0 && dist > lod_distances.y) return 4;
+  if (lod_distances.x > 0 && dist > lod_distances.x) return 2;
+  return 1;
+}
+
+/// A block and its 26 neighbors, as block_ptrs of VoxelAttributeCache
+/// @param block_offset in [-1, 1]^3
+__device__
+inline int NeighborIndex(const int3 block_offset) {
+  return (block_offset.z + 1) * 9 + (block_offset.y + 1) * 3
+         + (block_offset.x + 1);
+}
+
+/// Stride of the coarsest block sharing the corner: the block itself,
+/// and the neighbors across the faces, edges and corners it lies on
+/// @param offset           corner offset in [0, 8]^3
+/// @param neighbor_strides strides of the block and its 26 neighbors
+__device__
+inline int SeamStride(const int3 offset, const int *neighbor_strides) {
+  int3 lower = make_int3(offset.x == 0 ? -1 : 0,
+                         offset.y == 0 ? -1 : 0,
+                         offset.z == 0 ? -1 : 0);
+  int3 upper = make_int3(offset.x == BLOCK_SIDE_LENGTH ? 1 : 0,
+                         offset.y == BLOCK_SIDE_LENGTH ? 1 : 0,
+                         offset.z == BLOCK_SIDE_LENGTH ? 1 : 0);
+  int stride = 1;
+  for (int z = lower.z; z <= upper.z; ++z) {
+    for (int y = lower.y; y <= upper.y; ++y) {
+      for (int x = lower.x; x <= upper.x; ++x) {
+        stride = max(stride,
+                     neighbor_strides[NeighborIndex(make_int3(x, y, z))]);
+      }
+    }
+  }
+  return stride;
+}
+
+__device__
+inline int FloorDiv(int a, int b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/// Voxel attributes around a block, filled once per block so that
+/// vertices interpolate them instead of querying the hash table:
+/// samples cover [-1, 8]^3, the sdf one more layer for central differences.
+/// Gradients are not stored: differences of the cached sdf are as cheap
+/// as reading them, and the cache stays at about 15 KB of shared memory.
+/// With the vertex slots of a mesher, two CUDA blocks of 512 threads still
+/// fit in the 64 KB of a multiprocessor, see MesherOccupancy.
+static const int kCacheSideLength = BLOCK_SIDE_LENGTH + 2;
+static const int kCacheSize = kCacheSideLength * kCacheSideLength * kCacheSideLength;
+static const int kCacheSDFSideLength = BLOCK_SIDE_LENGTH + 4;
+static const int kCacheSDFSize = kCacheSDFSideLength * kCacheSDFSideLength * kCacheSDFSideLength;
+
+struct VoxelAttributeCache {
+  int    block_ptrs[27];                  // the block and its 26 neighbors
+  float  sdf[kCacheSDFSize];              // [-2, 9]^3, PINF if missing
+  float2 radius_rho[kCacheSize];          // x: radius, y: inlier ratio
+};
+
+__device__
+inline uint VectorizeCacheOffset(const int3 offset) {
+  int3 o = offset + make_int3(1);
+  return (o.z * kCacheSideLength + o.y) * kCacheSideLength + o.x;
+}
+
+__device__
+inline uint VectorizeCacheSDFOffset(const int3 offset) {
+  int3 o = offset + make_int3(2);
+  return (o.z * kCacheSDFSideLength + o.y) * kCacheSDFSideLength + o.x;
+}
+
+/// Fill @param cache with the block of @param entry, called by all threads
+__device__
+inline void FillVoxelAttributeCache(
+    VoxelAttributeCache &cache,
+    const HashEntry &entry,
+    BlockArray &blocks,
+    const HashTable &hash_table,
+    GeometryHelper &geometry_helper
+) {
+  if (threadIdx.x < 27) {
+    int3 block_offset = make_int3(threadIdx.x % 3,
+                                  (threadIdx.x / 3) % 3,
+                                  threadIdx.x / 9) - make_int3(1);
+    cache.block_ptrs[threadIdx.x] =
+        hash_table.GetEntry(entry.pos + block_offset).ptr;
+  }
+  __syncthreads();
+
+  const int kSDFStride = kCacheSDFSideLength;
+  for (int i = threadIdx.x; i < kCacheSDFSize; i += blockDim.x) {
+    int3 offset = make_int3(i % kSDFStride,
+                            (i / kSDFStride) % kSDFStride,
+                            i / (kSDFStride * kSDFStride)) - make_int3(2);
+    int3 block_offset = make_int3(FloorDiv(offset.x, BLOCK_SIDE_LENGTH),
+                                  FloorDiv(offset.y, BLOCK_SIDE_LENGTH),
+                                  FloorDiv(offset.z, BLOCK_SIDE_LENGTH));
+    int ptr = cache.block_ptrs[NeighborIndex(block_offset)];
+    bool valid = (ptr >= 0);
+    Voxel voxel;
+    if (valid) {
+      uint3 local_offset = make_uint3(offset - BLOCK_SIDE_LENGTH * block_offset);
+      voxel = blocks[ptr].voxels[geometry_helper.VectorizeOffset(local_offset)];
+    }
+    cache.sdf[i] = valid ? voxel.sdf : PINF;
+
+    if (offset.x >= -1 && offset.y >= -1 && offset.z >= -1
+        && offset.x <= BLOCK_SIDE_LENGTH
+        && offset.y <= BLOCK_SIDE_LENGTH
+        && offset.z <= BLOCK_SIDE_LENGTH) {
+      cache.radius_rho[VectorizeCacheOffset(offset)] = valid
+          ? make_float2(sqrtf(1.0f / voxel.inv_sigma2),
+                        voxel.a / (voxel.a + voxel.b))
+          : make_float2(0, 0);
+    }
+  }
+  __syncthreads();
+}
+
+/// Central differences of the cached sdf at @param offset in [-1, 8]^3,
+/// zero where a neighbor is missing
+__device__
+inline float3 CachedSDFGradient(
+    const VoxelAttributeCache &cache,
+    const int3 offset,
+    const float voxel_size
+) {
+  const int3 kAxes[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  float grad[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    float sdfn = cache.sdf[VectorizeCacheSDFOffset(offset - kAxes[axis])];
+    float sdfp = cache.sdf[VectorizeCacheSDFOffset(offset + kAxes[axis])];
+    if (sdfn == PINF || sdfp == PINF) return make_float3(0);
+    grad[axis] = (sdfp - sdfn) * 0.5f / voxel_size;
+  }
+  return make_float3(grad[0], grad[1], grad[2]);
+}
+
+/// Trilinear interpolation of the cached attributes, and of the sdf
+/// gradient with @param enable_sdf_gradient.
+/// Invalid gradients are zero and end up as zero normals
+__device__
+inline void WriteVertex(
+    Vertex &vertex,
+    const float3 &vertex_pos,
+    const int3 voxel_base_pos,
+    const VoxelAttributeCache &cache,
+    GeometryHelper &geometry_helper,
+    bool enable_sdf_gradient
+) {
+  float3 local_pos = geometry_helper.WorldToVoxelf(vertex_pos)
+                     - make_float3(voxel_base_pos);
+  int3 base = make_int3(floorf(local_pos.x),
+                        floorf(local_pos.y),
+                        floorf(local_pos.z));
+  base = clamp(base, make_int3(-1), make_int3(BLOCK_SIDE_LENGTH - 1));
+  float3 r = clamp(local_pos - make_float3(base),
+                   make_float3(0.0f), make_float3(1.0f));
+
+  float3 grad = make_float3(0);
+  float radius = 0, rho = 0;
+  for (int i = 0; i < 8; ++i) {
+    int3 mask = make_int3((i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1);
+    float w = (mask.x ? r.x : 1 - r.x)
+              * (mask.y ? r.y : 1 - r.y)
+              * (mask.z ? r.z : 1 - r.z);
+    if (w == 0) continue;
+    float2 radius_rho = cache.radius_rho[VectorizeCacheOffset(base + mask)];
+    radius += w * radius_rho.x;
+    rho += w * radius_rho.y;
+    if (enable_sdf_gradient) {
+      grad += w * CachedSDFGradient(cache, base + mask,
+                                    geometry_helper.voxel_size);
+    }
+  }
+
+  vertex.pos = vertex_pos;
+  vertex.radius = radius;
+  float l = length(grad);
+  vertex.normal = l > 0 ? grad / l : make_float3(0);
+  vertex.color = ValToRGB(rho, 0.4f, 1.0f);
+}
+
+/// Trilinear interpolation of the sdf on the lattice of @param stride.
+/// On block faces the lattice points are voxels of the face itself.
+__device__
+inline bool GetLatticeSDF(
+    const HashEntry &entry,
+    const int3 voxel_pos,
+    const int stride,
+    BlockArray &blocks,
+    const HashTable &hash_table,
+    GeometryHelper &geometry_helper,
+    float *sdf
+) {
+  int3 base = make_int3(FloorDiv(voxel_pos.x, stride),
+                        FloorDiv(voxel_pos.y, stride),
+                        FloorDiv(voxel_pos.z, stride)) * stride;
+  float3 r = make_float3(voxel_pos - base) / (float)stride;
+
+  Voxel voxel_query;
+  *sdf = 0;
+  for (int i = 0; i < 8; ++i) {
+    int3 mask = make_int3((i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1);
+    float w = (mask.x ? r.x : 1 - r.x)
+              * (mask.y ? r.y : 1 - r.y)
+              * (mask.z ? r.z : 1 - r.z);
+    if (w == 0) continue;
+    if (! GetVoxelValue(entry, base + stride * mask,
+                        blocks, hash_table,
+                        geometry_helper, &voxel_query)) {
+      return false;
+    }
+    *sdf += w * voxel_query.sdf;
+  }
+  return true;
+}
+
+/// The sdf at a corner on a LOD seam, as every block sharing the corner
+/// sees it: interpolated on the lattice of the coarsest of them, from
+/// lattice points that are in turn interpolated on the lattice of the
+/// coarsest block sharing them. Strides are 1, 2 or 4, so lattice points
+/// of the second level are on the lattice of 4 and read as they are.
+__device__
+inline bool GetSeamSDF(
+    const HashEntry &entry,
+    const int3 voxel_pos,
+    const int *neighbor_strides,
+    BlockArray &blocks,
+    const HashTable &hash_table,
+    GeometryHelper &geometry_helper,
+    float *sdf
+) {
+  const int3 voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
+  int stride = SeamStride(voxel_pos - voxel_base_pos, neighbor_strides);
+  int3 base = make_int3(FloorDiv(voxel_pos.x, stride),
+                        FloorDiv(voxel_pos.y, stride),
+                        FloorDiv(voxel_pos.z, stride)) * stride;
+  float3 r = make_float3(voxel_pos - base) / (float)stride;
+
+  *sdf = 0;
+  for (int i = 0; i < 8; ++i) {
+    int3 mask = make_int3((i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1);
+    float w = (mask.x ? r.x : 1 - r.x)
+              * (mask.y ? r.y : 1 - r.y)
+              * (mask.z ? r.z : 1 - r.z);
+    if (w == 0) continue;
+    int3 lattice_pos = base + stride * mask;
+    int lattice_stride = SeamStride(lattice_pos - voxel_base_pos,
+                                    neighbor_strides);
+    float lattice_sdf;
+    if (! GetLatticeSDF(entry, lattice_pos, lattice_stride,
+                        blocks, hash_table, geometry_helper, &lattice_sdf)) {
+      return false;
+    }
+    *sdf += w * lattice_sdf;
+  }
+  return true;
+}
+
+/// Read the scalar values of the 8 corners, see mc_tables.h
+/// @param stride           cube side length in voxels
+/// @param neighbor_strides strides of the block and its 26 neighbors for
+///                         LOD seams, nullptr when they are all the same
+/// @return cube index, 0 if any corner is invalid
+__device__
+inline short ReadCube(
+    const HashEntry &entry,
+    const int3 voxel_pos,
+    const float3 world_pos,
+    BlockArray &blocks,
+    const HashTable &hash_table,
+    GeometryHelper &geometry_helper,
+    float *d,
+    float3 *p,
+    const int stride = 1,
+    const int *neighbor_strides = nullptr
+) {
+  const int kVertexCount = 8;
+  const float kVoxelSize = geometry_helper.voxel_size;
+  const float kThreshold = 0.20f;
+  const float kIsoLevel = 0;
+
+  // inlier ratio
+//  if (this_voxel.inv_sigma2 < 5.0f) return;
+//  float rho = this_voxel.a / (this_voxel.a + this_voxel.b);
+//  if (rho < 0.2f || this_voxel.inv_sigma2 < squaref(0.33f / kVoxelSize))
+//    return;
+
+  /// Check 8 corners of a cube: are they valid?
+  short cube_index = 0;
+  Voxel voxel_query;
+  const int3 voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
+  for (int i = 0; i < kVertexCount; ++i) {
+    int3 corner_pos = voxel_pos + stride * kVtxOffset[i];
+    if (! GetVoxelValue(entry, corner_pos,
+                        blocks, hash_table,
+                        geometry_helper, &voxel_query)) {
+      return 0;
+    }
+
+    d[i] = voxel_query.sdf;
+    if (neighbor_strides != nullptr
+        && SeamStride(corner_pos - voxel_base_pos, neighbor_strides) > stride
+        && ! GetSeamSDF(entry, corner_pos, neighbor_strides,
+                        blocks, hash_table, geometry_helper, &d[i])) {
+      return 0;
+    }
+    if (fabs(d[i]) > kThreshold) return 0;
+
+    float rho = voxel_query.a / (voxel_query.a + voxel_query.b);
+    if (rho < 0.1f || voxel_query.inv_sigma2 < squaref(1.0f / kVoxelSize))
+      return 0;
+//    if (voxel_query.inv_sigma2 < 50.0f) return;
+    if (d[i] < kIsoLevel) cube_index |= (1 << i);
+    p[i] = world_pos + (kVoxelSize * stride) * make_float3(kVtxOffset[i]);
+  }
+  return cube_index;
+}
+
+__device__
+inline float3 ProjectToSegment(const float3 &p,
+                               const float3 &a, const float3 &b) {
+  float3 ab = b - a;
+  float l2 = dot(ab, ab);
+  if (l2 == 0) return a;
+  float t = fminf(fmaxf(dot(p - a, ab) / l2, 0.0f), 1.0f);
+  return a + t * ab;
+}
+
+/// T-junctions of LOD seams: a vertex on a block face shared with a coarser
+/// block, inside a cell of the coarse lattice on that face, is moved onto
+/// the contour the coarse block has in the cell, so that the fine triangles
+/// end on the coarse edge instead of leaving a sliver open.
+/// Vertices on coarse lattice lines already coincide with coarse ones.
+/// In a saddle cell the nearer of the two coarse contours is taken.
+/// @param edge_begin, edge_end voxel positions of the edge of the vertex
+/// @return the vertex, moved if needed
+__device__
+inline float3 SnapSeamVertex(
+    const float3 &vertex_pos,
+    const int3 edge_begin,
+    const int3 edge_end,
+    const HashEntry &entry,
+    const int stride,
+    const int *neighbor_strides,
+    BlockArray &blocks,
+    const HashTable &hash_table,
+    GeometryHelper &geometry_helper
+) {
+  const float kIsoLevel = 0;
+  const int3 voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
+  const int3 o1 = edge_begin - voxel_base_pos;
+  const int3 o2 = edge_end - voxel_base_pos;
+  const int b[3] = {o1.x, o1.y, o1.z};
+  const int e[3] = {o2.x, o2.y, o2.z};
+
+  /// On a block edge the field is linear between coarse lattice points
+  int face_axis = -1, face_count = 0;
+  for (int a = 0; a < 3; ++a) {
+    if (b[a] == e[a] && (b[a] == 0 || b[a] == BLOCK_SIDE_LENGTH)) {
+      face_axis = a;
+      ++face_count;
+    }
+  }
+  if (face_count != 1) return vertex_pos;
+
+  int neighbor[3] = {0, 0, 0};
+  neighbor[face_axis] = (b[face_axis] == 0) ? -1 : 1;
+  int face_stride = max(stride, neighbor_strides[NeighborIndex(
+      make_int3(neighbor[0], neighbor[1], neighbor[2]))]);
+  if (face_stride <= stride) return vertex_pos;
+
+  /// u along the edge, w across it, both in the face
+  int u = -1, w = -1;
+  for (int a = 0; a < 3; ++a) {
+    if (a == face_axis) continue;
+    if (b[a] != e[a]) u = a;
+    else w = a;
+  }
+  if (b[w] % face_stride == 0) return vertex_pos;
+
+  /// The coarse cell around the edge, corners in order around it
+  const int kCellCorners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+  int cell_u = (min(b[u], e[u]) / face_stride) * face_stride;
+  int cell_w = (b[w] / face_stride) * face_stride;
+  float  d[4];
+  float3 p[4];
+  for (int k = 0; k < 4; ++k) {
+    int c[3];
+    c[face_axis] = b[face_axis];
+    c[u] = cell_u + face_stride * kCellCorners[k][0];
+    c[w] = cell_w + face_stride * kCellCorners[k][1];
+    int3 corner_pos = voxel_base_pos + make_int3(c[0], c[1], c[2]);
+    if (! GetSeamSDF(entry, corner_pos, neighbor_strides,
+                     blocks, hash_table, geometry_helper, &d[k])) {
+      return vertex_pos;
+    }
+    p[k] = geometry_helper.VoxelToWorld(corner_pos);
+  }
+
+  float3 crossings[4];
+  int crossing_count = 0;
+  for (int k = 0; k < 4; ++k) {
+    int l = (k + 1) % 4;
+    if ((d[k] < kIsoLevel) != (d[l] < kIsoLevel)) {
+      crossings[crossing_count++] = VertexIntersection(p[k], p[l],
+                                                       d[k], d[l],
+                                                       kIsoLevel);
+    }
+  }
+  if (crossing_count == 2) {
+    return ProjectToSegment(vertex_pos, crossings[0], crossings[1]);
+  }
+  if (crossing_count != 4) return vertex_pos;
+
+  /// Saddle: contours join crossings of adjacent cell edges
+  float3 snapped_pos = vertex_pos;
+  float min_dist = PINF;
+  for (int k = 0; k < 4; ++k) {
+    float3 q = ProjectToSegment(vertex_pos,
+                                crossings[k], crossings[(k + 1) % 4]);
+    float dist = length(q - vertex_pos);
+    if (dist < min_dist) {
+      min_dist = dist;
+      snapped_pos = q;
+    }
+  }
+  return snapped_pos;
+}
+
+__device__
+inline bool IsInner(uint3 offset) {
+  return (offset.x >= 1 && offset.y >= 1 && offset.z >= 1
+          && offset.x < BLOCK_SIDE_LENGTH - 1
+          && offset.y < BLOCK_SIDE_LENGTH - 1
+          && offset.z < BLOCK_SIDE_LENGTH - 1);
+}
+
+#endif //MESHING_MESH_UTIL_H
@@ -0,0 +1,306 @@
+//
+// Created by wei on 18-1-20.
+//
+
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+#include "meshing/surface_nets.h"
+#include "meshing/mesh_util.h"
+
+////////////////////
+/// Device code
+////////////////////
+
+/// Corners of a cube adjacent to its origin along x, y, z, see kVtxOffset
+__device__
+const static int2 kAxisEdgeVertices[3] = {
+    {7, 6}, {7, 3}, {7, 4}
+};
+
+/// The 4 cubes sharing the voxel edge along an axis,
+/// counter-clockwise around the axis
+__device__
+const static int3 kQuadCubeOffset[3][4] = {
+    {{0, 0, 0}, {0, -1, 0}, {0, -1, -1}, {0, 0, -1}},
+    {{0, 0, 0}, {0, 0, -1}, {-1, 0, -1}, {-1, 0, 0}},
+    {{0, 0, 0}, {-1, 0, 0}, {-1, -1, 0}, {0, -1, 0}}
+};
+
+/// Cubes in [-1, 8)^3 are stored at [0, 9)^3
+__device__
+inline uint QuadCubeSlot(const uint3 offset, int axis, int i) {
+  int3 cube_offset = make_int3(offset) + make_int3(1) + kQuadCubeOffset[axis][i];
+  return VectorizeHaloOffset(make_uint3(cube_offset));
+}
+
+/// Rebuild the whole mesh of a block into its own chunks:
+/// 1. classify cubes, including the layer of lower neighbors
+/// 2. each voxel checks its 3 edges, cubes around a crossing edge
+///    get a vertex, the edge gets a quad
+/// 3. fit the vertex and triangle chunks to the counts
+/// 4. cache voxel attributes of the block, write vertices at the mean
+///    of the edge intersections of their cubes
+/// 5. write triangles
+__device__
+void ExtractBlockSurfaceNet(
+    const HashEntry &entry,
+    BlockArray &blocks,
+    Mesh &mesh,
+    HashTable &hash_table,
+    GeometryHelper &geometry_helper,
+    bool enable_sdf_gradient
+) {
+  Block& block = blocks[entry.ptr];
+
+  __shared__ short cube_indices[kHaloSize];
+  __shared__ int   local_vertex_ptrs[kHaloSize];
+  __shared__ int   vertex_count;
+  __shared__ int   triangle_count;
+  __shared__ bool  is_chunk_allocated;
+  __shared__ VoxelAttributeCache attribute_cache;
+
+  for (int i = threadIdx.x; i < kHaloSize; i += blockDim.x) {
+    local_vertex_ptrs[i] = FREE_PTR;
+  }
+  if (threadIdx.x == 0) {
+    vertex_count = 0;
+    triangle_count = 0;
+    block.boundary_surfel_count = 0;
+    block.inner_surfel_count = 0;
+  }
+
+  const int3 voxel_base_pos = geometry_helper.BlockToVoxel(entry.pos);
+  const float kIsoLevel = 0;
+  float  d[8];
+  float3 p[8];
+
+  //////////
+  /// 1. Classify cubes
+  for (int i = threadIdx.x; i < kHaloSize; i += blockDim.x) {
+    int3 cube_pos = voxel_base_pos
+                    + make_int3(DevectorizeHaloOffset(i)) - make_int3(1);
+    cube_indices[i] = ReadCube(entry, cube_pos,
+                               geometry_helper.VoxelToWorld(cube_pos),
+                               blocks, hash_table, geometry_helper,
+                               d, p);
+  }
+  __syncthreads();
+
+  uint3 offset = geometry_helper.DevectorizeIndex(threadIdx.x);
+  uint  this_slot = VectorizeHaloOffset(offset + make_uint3(1));
+  short cube_index = cube_indices[this_slot];
+
+  MeshUnit &this_mesh_unit = block.mesh_units[threadIdx.x];
+  this_mesh_unit.prev_cube_idx = this_mesh_unit.curr_cube_idx;
+  this_mesh_unit.curr_cube_idx = cube_index;
+
+  //////////
+  /// 2. Edges starting from this voxel, the first visitor of a cube
+  ///    owns its vertex
+  const int kAxisCount = 3;
+  const int kQuadCubeCount = 4;
+  int pending_slots[kAxisCount * kQuadCubeCount];
+  int pending_ptrs[kAxisCount * kQuadCubeCount];
+  int pending_count = 0;
+  bool is_crossing[kAxisCount];
+  bool is_flipped[kAxisCount];
+  int  quad_count = 0;
+  int  local_triangle_ptr = 0;
+
+#pragma unroll 1
+  for (int axis = 0; axis < kAxisCount; ++axis) {
+    bool inside0 = (cube_index & (1 << kAxisEdgeVertices[axis].x)) != 0;
+    bool inside1 = (cube_index & (1 << kAxisEdgeVertices[axis].y)) != 0;
+    is_crossing[axis] = (cube_index != 0 && inside0 != inside1);
+    is_flipped[axis] = inside0;
+    for (int i = 1; i < kQuadCubeCount && is_crossing[axis]; ++i) {
+      is_crossing[axis] = (cube_indices[QuadCubeSlot(offset, axis, i)] != 0);
+    }
+    if (! is_crossing[axis]) continue;
+
+    ++quad_count;
+    for (int i = 0; i < kQuadCubeCount; ++i) {
+      uint slot = QuadCubeSlot(offset, axis, i);
+      int lock = atomicCAS(&local_vertex_ptrs[slot], FREE_PTR, LOCK_ENTRY);
+      if (lock == FREE_PTR) {
+        int ptr = atomicAdd(&vertex_count, 1);
+        local_vertex_ptrs[slot] = ptr;
+        pending_slots[pending_count] = slot;
+        pending_ptrs[pending_count] = ptr;
+        ++pending_count;
+      }
+    }
+  }
+  if (quad_count > 0) {
+    local_triangle_ptr = atomicAdd(&triangle_count, 2 * quad_count);
+  }
+  __syncthreads();
+
+  //////////
+  /// 3. Fit the chunks; on failure the block is left without mesh
+  if (threadIdx.x == 0) {
+    is_chunk_allocated =
+        mesh.AllocVertexChunk(block.vertex_chunk, vertex_count)
+        && mesh.AllocTriangleChunk(block.triangle_chunk, triangle_count);
+    if (! is_chunk_allocated) {
+      mesh.AllocVertexChunk(block.vertex_chunk, 0);
+      mesh.AllocTriangleChunk(block.triangle_chunk, 0);
+    }
+  }
+  __syncthreads();
+
+  //////////
+  /// 4. Write vertices; a cube inside the block remembers its own
+  int this_ptr = is_chunk_allocated ? local_vertex_ptrs[this_slot] : FREE_PTR;
+  this_mesh_unit.vertex_ptrs[0] = this_ptr;
+  this_mesh_unit.vertex_ptrs[1] = FREE_PTR;
+  this_mesh_unit.vertex_ptrs[2] = FREE_PTR;
+  if (this_ptr >= 0) {
+    if (IsInner(offset)) {
+      atomicAdd(&block.inner_surfel_count, 1);
+    } else {
+      atomicAdd(&block.boundary_surfel_count, 1);
+    }
+  }
+
+  if (is_chunk_allocated && vertex_count > 0) {
+    FillVoxelAttributeCache(attribute_cache, entry,
+                            blocks, hash_table, geometry_helper);
+  }
+
+  if (is_chunk_allocated) {
+#pragma unroll 1
+    for (int i = 0; i < pending_count; ++i) {
+      int3 cube_pos = voxel_base_pos
+                      + make_int3(DevectorizeHaloOffset(pending_slots[i]))
+                      - make_int3(1);
+      short pending_cube_index = ReadCube(
+          entry, cube_pos, geometry_helper.VoxelToWorld(cube_pos),
+          blocks, hash_table, geometry_helper,
+          d, p);
+
+      float3 vertex_pos = make_float3(0);
+      int intersection_count = 0;
+      for (int e = 0; e < 12; ++e) {
+        if (kCubeEdges[pending_cube_index] & (1 << e)) {
+          int2 edge_endpoint_vertices = kEdgeEndpointVertices[e];
+          vertex_pos += VertexIntersection(
+              p[edge_endpoint_vertices.x],
+              p[edge_endpoint_vertices.y],
+              d[edge_endpoint_vertices.x],
+              d[edge_endpoint_vertices.y],
+              kIsoLevel);
+          ++intersection_count;
+        }
+      }
+      vertex_pos /= fmaxf(1.0f, (float)intersection_count);
+      WriteVertex(mesh.vertex(block.vertex_chunk, pending_ptrs[i]),
+                  vertex_pos, voxel_base_pos,
+                  attribute_cache, geometry_helper,
+                  enable_sdf_gradient);
+    }
+  }
+  __syncthreads();
+
+  //////////
+  /// 5. Split quads into triangles, facing the positive sdf side
+  if (! is_chunk_allocated || quad_count == 0) return;
+
+#pragma unroll 1
+  for (int axis = 0; axis < kAxisCount; ++axis) {
+    if (! is_crossing[axis]) continue;
+
+    int q[kQuadCubeCount];
+    for (int i = 0; i < kQuadCubeCount; ++i) {
+      q[i] = block.vertex_chunk.ptr
+             + local_vertex_ptrs[QuadCubeSlot(offset, axis, i)];
+    }
+
+    Triangle& triangle0 = mesh.triangle(block.triangle_chunk,
+                                        local_triangle_ptr++);
+    Triangle& triangle1 = mesh.triangle(block.triangle_chunk,
+                                        local_triangle_ptr++);
+    if (is_flipped[axis]) {
+      triangle0.vertex_ptrs = make_int3(q[0], q[2], q[1]);
+      triangle1.vertex_ptrs = make_int3(q[0], q[3], q[2]);
+    } else {
+      triangle0.vertex_ptrs = make_int3(q[0], q[1], q[2]);
+      triangle1.vertex_ptrs = make_int3(q[0], q[2], q[3]);
+    }
+    if (!enable_sdf_gradient) {
+      mesh.ComputeTriangleNormal(triangle0);
+      mesh.ComputeTriangleNormal(triangle1);
+    }
+  }
+}
+
+/// Persistent CUDA blocks, as MeshExtractionKernel
+__global__
+void SurfaceNetsKernel(
+    BlockWorkQueue work_queue,
+    BlockArray blocks,
+    Mesh mesh,
+    HashTable hash_table,
+    GeometryHelper geometry_helper,
+    bool enable_sdf_gradient
+) {
+  for (uint i = work_queue.Pop(); i < work_queue.count();
+       i = work_queue.Pop()) {
+    ExtractBlockSurfaceNet(work_queue[i], blocks, mesh,
+                           hash_table, geometry_helper,
+                           enable_sdf_gradient);
+  }
+}
+
+////////////////////
+/// Host code
+////////////////////
+float SurfaceNets(
+    EntryArray &candidate_entries,
+    BlockWorkQueue &work_queue,
+    BlockArray &blocks,
+    Mesh &mesh,
+    HashTable &hash_table,
+    GeometryHelper &geometry_helper,
+    bool enable_sdf_gradient
+) {
+  uint occupied_block_count = candidate_entries.count();
+  LOG(INFO) << "Surface nets block count: " << occupied_block_count;
+  if (occupied_block_count == 0)
+    return -1;
+
+  Timer timer;
+  timer.Tick();
+  work_queue.Fill(candidate_entries, blocks);
+  double queue_seconds = timer.Tock();
+  LOG(INFO) << "Surface blocks queued first: " << work_queue.surface_count();
+
+  const uint threads_per_block = BLOCK_SIZE;
+  const dim3 grid_size(work_queue.PersistentGridSize(
+      (const void *)SurfaceNetsKernel, threads_per_block), 1);
+  const dim3 block_size(threads_per_block, 1);
+
+  timer.Tick();
+  SurfaceNetsKernel << < grid_size, block_size >> > (
+      work_queue,
+          blocks,
+          mesh,
+          hash_table,
+          geometry_helper,
+          enable_sdf_gradient);
+  checkCudaErrors(cudaDeviceSynchronize());
+  checkCudaErrors(cudaGetLastError());
+  double extraction_seconds = queue_seconds + timer.Tock();
+  LOG(INFO) << "Extraction duration: " << extraction_seconds;
+
+  timer.Tick();
+  mesh.ReleaseRetiredChunks();
+  double release_seconds = timer.Tock();
+  LOG(INFO) << "Release duration: " << release_seconds;
+
+  return (float)(extraction_seconds + release_seconds);
+}
+
+MesherOccupancy SurfaceNetsOccupancy() {
+  return GetMesherOccupancy((const void *)SurfaceNetsKernel);
+}
@@ -0,0 +1,33 @@
+//
+// Created by wei on 18-1-20.
+//
+
+#ifndef MESHING_SURFACE_NETS_H
+#define MESHING_SURFACE_NETS_H
+
+#include "util/timer.h"
+#include "core/entry_array.h"
+#include "core/block_array.h"
+#include "core/block_work_queue.h"
+#include "core/hash_table.h"
+#include "core/mesh.h"
+#include "geometry/geometry_helper.h"
+#include "meshing/mesh_stats.h"
+
+/// Surface Nets: one vertex per surface cube,
+/// one quad (2 triangles) per sign-changing voxel edge.
+/// Writes the same per-block chunks as MarchingCubes.
+/// @param work_queue refilled with @param candidate_entries
+float SurfaceNets(
+    EntryArray& candidate_entries,
+    BlockWorkQueue& work_queue,
+    BlockArray& blocks,
+    Mesh& mesh,
+    HashTable& hash_table,
+    GeometryHelper& geometry_helper,
+    bool enable_sdf_gradient);
+
+/// Resources of the kernel of SurfaceNets
+MesherOccupancy SurfaceNetsOccupancy();
+
+#endif //MESHING_SURFACE_NETS_H
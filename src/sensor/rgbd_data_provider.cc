@@ -4,6 +4,7 @@
 
 #include "rgbd_data_provider.h"
 #include <glog/logging.h>
+#include "util/profiler.h"
 
 const std::string kConfigPaths[] = {
     "../config/ICL.yml",
@@ -61,6 +62,7 @@ bool RGBDDataProvider::ProvideData(
     cv::Mat &depth,
     cv::Mat &color
 ) {
+  PROFILE_SCOPE("io/load");
   if (frame_id > depth_image_list.size()) {
     LOG(ERROR) << "All images provided!";
     return false;
@@ -79,6 +81,7 @@ bool RGBDDataProvider::ProvideData(
 bool RGBDDataProvider::ProvideData(cv::Mat &depth,
                               cv::Mat &color,
                               float4x4 &wTc) {
+  PROFILE_SCOPE("io/load");
   if (frame_id >= depth_image_list.size()) {
     LOG(ERROR) << "All images provided!";
     return false;
@@ -9,6 +9,7 @@
 #include <driver_types.h>
 #include <extern/cuda/helper_cuda.h>
 #include "sensor/preprocess.h"
+#include "util/profiler.h"
 
 
 /// Member functions: (CPU code)
@@ -116,6 +117,7 @@ void Sensor::BindCUDATexture() {
 }
 
 int Sensor::Process(cv::Mat &depth, cv::Mat &color) {
+  PROFILE_SCOPE("preprocess");
   // TODO(wei): deal with distortion
   /// Disable all filters at current
   ConvertDepthFormat(depth, data_.depth_buffer, data_.depth_data, params_);
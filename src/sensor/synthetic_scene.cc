@@ -0,0 +1,294 @@
+//
+// Created by wei on 18-1-31.
+//
+
+#include "sensor/synthetic_scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glog/logging.h>
+
+namespace {
+const float kPi = 3.14159265f;
+/// Checker size on every surface, so that color is not uniform
+const float kCheckerSize = 0.25f;
+
+/// Camera: x right, y down, z forward; the world uses the same axes
+float4x4 LookAt(const float3 &eye, const float3 &target) {
+  float3 forward = normalize(target - eye);
+  float3 right = normalize(cross(make_float3(0, 1, 0), forward));
+  float3 down = cross(forward, right);
+
+  float4x4 wTc;
+  wTc.setIdentity();
+  wTc.m11 = right.x; wTc.m12 = down.x; wTc.m13 = forward.x; wTc.m14 = eye.x;
+  wTc.m21 = right.y; wTc.m22 = down.y; wTc.m23 = forward.y; wTc.m24 = eye.y;
+  wTc.m31 = right.z; wTc.m32 = down.z; wTc.m33 = forward.z; wTc.m34 = eye.z;
+  return wTc;
+}
+
+/// Slab test, @return entry and exit distances
+bool IntersectBox(const float3 &lo, const float3 &hi,
+                  const float3 &origin, const float3 &dir,
+                  float &t_near, float &t_far) {
+  float o[3] = {origin.x, origin.y, origin.z};
+  float d[3] = {dir.x, dir.y, dir.z};
+  float l[3] = {lo.x, lo.y, lo.z};
+  float h[3] = {hi.x, hi.y, hi.z};
+
+  t_near = -INFINITY;
+  t_far = INFINITY;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (d[axis] == 0) {
+      if (o[axis] < l[axis] || o[axis] > h[axis]) return false;
+      continue;
+    }
+    float t0 = (l[axis] - o[axis]) / d[axis];
+    float t1 = (h[axis] - o[axis]) / d[axis];
+    t_near = fmaxf(t_near, fminf(t0, t1));
+    t_far = fminf(t_far, fmaxf(t0, t1));
+  }
+  return t_near <= t_far;
+}
+}
+
+SyntheticScene::SyntheticScene(
+    SyntheticSceneType type,
+    float scale,
+    int frame_count,
+    const SensorParams &sensor_params
+) : type_(type),
+    scale_(scale),
+    frame_count_(frame_count),
+    sensor_params_(sensor_params) {
+  const float s = scale;
+  /// Floor at y = 1, 1 m below the eyes
+  switch (type) {
+    case ROOM:
+      AddBoxInterior(make_float3(-2 * s, -1.5f, -2 * s),
+                     make_float3(2 * s, 1.0f, 2 * s),
+                     make_uchar3(200, 190, 170));
+      for (int i = 0; i < 4; ++i) {
+        float x = (i & 1 ? 1 : -1) * 1.2f * s;
+        float z = (i & 2 ? 1 : -1) * 1.2f * s;
+        AddBox(make_float3(x - 0.4f, 0.25f, z - 0.3f),
+               make_float3(x + 0.4f, 1.0f, z + 0.3f),
+               make_uchar3(120, 80, 40));
+        AddSphere(make_float3(x, 0.0f, z), 0.25f,
+                  make_uchar3(40, 120, 200));
+      }
+      break;
+
+    case SPHERES: {
+      int n = (int)(3 * s);
+      float spacing = 1.0f;
+      AddBox(make_float3(-10 * s, 1.0f, -10 * s),
+             make_float3(10 * s, 1.2f, 10 * s),
+             make_uchar3(150, 150, 150));
+      for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+          float x = (i - 0.5f * (n - 1)) * spacing;
+          float z = (j - 0.5f * (n - 1)) * spacing;
+          AddSphere(make_float3(x, 0.7f, z), 0.3f,
+                    make_uchar3(60 + 40 * (i % 4), 200 - 40 * (j % 4), 120));
+        }
+      }
+      break;
+    }
+
+    case CORRIDOR: {
+      float length = 10 * s;
+      AddBoxInterior(make_float3(-1.0f, -1.5f, -1.0f),
+                     make_float3(1.0f, 1.0f, length),
+                     make_uchar3(180, 200, 180));
+      for (float z = 1.0f; z < length; z += 2.0f) {
+        AddBox(make_float3(-1.0f, -1.5f, z),
+               make_float3(-0.8f, 1.0f, z + 0.2f),
+               make_uchar3(90, 90, 120));
+        AddBox(make_float3(0.8f, -1.5f, z + 1.0f),
+               make_float3(1.0f, 1.0f, z + 1.2f),
+               make_uchar3(90, 90, 120));
+      }
+      break;
+    }
+  }
+}
+
+const char* SyntheticScene::name(SyntheticSceneType type) {
+  switch (type) {
+    case ROOM:     return "room";
+    case SPHERES:  return "spheres";
+    case CORRIDOR: return "corridor";
+  }
+  return "unknown";
+}
+
+void SyntheticScene::AddBoxInterior(float3 lo, float3 hi, uchar3 color) {
+  Primitive primitive;
+  primitive.type = Primitive::kBoxInterior;
+  primitive.lo = lo;
+  primitive.hi = hi;
+  primitive.color = color;
+  primitives_.push_back(primitive);
+}
+
+void SyntheticScene::AddBox(float3 lo, float3 hi, uchar3 color) {
+  Primitive primitive;
+  primitive.type = Primitive::kBox;
+  primitive.lo = lo;
+  primitive.hi = hi;
+  primitive.color = color;
+  primitives_.push_back(primitive);
+}
+
+void SyntheticScene::AddSphere(float3 center, float radius, uchar3 color) {
+  Primitive primitive;
+  primitive.type = Primitive::kSphere;
+  primitive.center = center;
+  primitive.radius = radius;
+  primitive.color = color;
+  primitives_.push_back(primitive);
+}
+
+float4x4 SyntheticScene::Pose(float tau) {
+  const float s = scale_;
+  switch (type_) {
+    case ROOM: {
+      /// Turn around once while drifting on a small circle
+      float theta = 2 * kPi * tau;
+      float3 eye = make_float3(0.5f * s * cosf(theta), 0.0f,
+                               0.5f * s * sinf(theta));
+      float phi = 1.5f * theta;
+      return LookAt(eye, eye + make_float3(cosf(phi), 0.2f, sinf(phi)));
+    }
+    case SPHERES: {
+      float theta = 2 * kPi * tau;
+      float radius = 1.5f * s + 1.5f;
+      float3 eye = make_float3(radius * cosf(theta), -0.5f,
+                               radius * sinf(theta));
+      return LookAt(eye, make_float3(0.0f, 0.5f, 0.0f));
+    }
+    case CORRIDOR: {
+      /// Walk forward, swaying and looking left and right
+      float z = tau * (10 * s - 3.0f);
+      float3 eye = make_float3(0.3f * sinf(4 * kPi * tau), 0.0f, z);
+      float yaw = 0.4f * sinf(6 * kPi * tau);
+      return LookAt(eye, eye + make_float3(sinf(yaw), 0.1f, cosf(yaw)));
+    }
+  }
+  float4x4 wTc;
+  wTc.setIdentity();
+  return wTc;
+}
+
+bool SyntheticScene::Intersect(
+    const float3 &origin,
+    const float3 &dir,
+    float &t,
+    uchar3 &color
+) {
+  t = INFINITY;
+  for (const Primitive &primitive : primitives_) {
+    float t_hit = INFINITY;
+    switch (primitive.type) {
+      case Primitive::kBoxInterior: {
+        float t_near, t_far;
+        if (IntersectBox(primitive.lo, primitive.hi, origin, dir,
+                         t_near, t_far) && t_near <= 0 && t_far > 0) {
+          t_hit = t_far;
+        }
+        break;
+      }
+      case Primitive::kBox: {
+        float t_near, t_far;
+        if (IntersectBox(primitive.lo, primitive.hi, origin, dir,
+                         t_near, t_far) && t_near > 0) {
+          t_hit = t_near;
+        }
+        break;
+      }
+      case Primitive::kSphere: {
+        float3 oc = origin - primitive.center;
+        float a = dot(dir, dir);
+        float b = dot(oc, dir);
+        float c = dot(oc, oc) - primitive.radius * primitive.radius;
+        float discriminant = b * b - a * c;
+        if (discriminant >= 0) {
+          float t_near = (-b - sqrtf(discriminant)) / a;
+          if (t_near > 0) t_hit = t_near;
+        }
+        break;
+      }
+    }
+    if (t_hit < t) {
+      t = t_hit;
+      color = primitive.color;
+    }
+  }
+  if (t == INFINITY) return false;
+
+  /// Cells are shifted by half, so that the planes of the scene,
+  /// at multiples of kCheckerSize, do not lie on cell borders
+  float3 pos = origin + t * dir;
+  int checker = (int)floorf(pos.x / kCheckerSize + 0.5f)
+                + (int)floorf(pos.y / kCheckerSize + 0.5f)
+                + (int)floorf(pos.z / kCheckerSize + 0.5f);
+  if (checker & 1) {
+    /// Keep channels non-zero, zero marks invalid color in the sensor
+    color = make_uchar3(std::max(1, color.x * 3 / 5),
+                        std::max(1, color.y * 3 / 5),
+                        std::max(1, color.z * 3 / 5));
+  }
+  return true;
+}
+
+void SyntheticScene::Render(
+    const float4x4 &wTc,
+    cv::Mat &depth,
+    cv::Mat &color
+) {
+  const SensorParams &params = sensor_params_;
+  depth = cv::Mat(params.height, params.width, CV_16UC1);
+  color = cv::Mat(params.height, params.width, CV_8UC4);
+
+  float3 origin = make_float3(wTc.m14, wTc.m24, wTc.m34);
+  for (int y = 0; y < (int)params.height; ++y) {
+    for (int x = 0; x < (int)params.width; ++x) {
+      /// z = 1 in the camera, so that t is the depth
+      float4 camera_dir = make_float4((x - params.cx) / params.fx,
+                                      (y - params.cy) / params.fy,
+                                      1.0f, 0.0f);
+      float4 world_dir = wTc * camera_dir;
+
+      float t;
+      uchar3 c;
+      ushort depth_value = 0;
+      cv::Vec4b color_value(0, 0, 0, 255);
+      if (Intersect(origin,
+                    make_float3(world_dir.x, world_dir.y, world_dir.z),
+                    t, c)) {
+        /// short on the GPU
+        depth_value = (ushort)std::min(t / params.range_factor + 0.5f,
+                                       32767.0f);
+        color_value = cv::Vec4b(c.z, c.y, c.x, 255);  // BGRA
+      }
+      depth.at<ushort>(y, x) = depth_value;
+      color.at<cv::Vec4b>(y, x) = color_value;
+    }
+  }
+}
+
+bool SyntheticScene::ProvideData(
+    cv::Mat &depth,
+    cv::Mat &color,
+    float4x4 &wTc
+) {
+  if (frame_id_ >= frame_count_) {
+    LOG(INFO) << "All synthetic frames provided!";
+    return false;
+  }
+  wTc = Pose((float)frame_id_ / frame_count_);
+  Render(wTc, depth, color);
+  ++frame_id_;
+  return true;
+}
@@ -0,0 +1,69 @@
+//
+// Created by wei on 18-1-31.
+//
+// Dataset-free RGB-D source: depth and color of an analytic scene,
+// ray traced along a scripted trajectory.
+// Same ProvideData interface as RGBDDataProvider.
+
+#ifndef SENSOR_SYNTHETIC_SCENE_H
+#define SENSOR_SYNTHETIC_SCENE_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <helper_math.h>
+#include <matrix.h>
+
+#include "core/params.h"
+
+enum SyntheticSceneType {
+  ROOM = 0,      /// box room with furniture, camera turning around inside
+  SPHERES = 1,   /// grid of spheres on a floor, camera orbiting outside
+  CORRIDOR = 2   /// long corridor with pillars, camera walking through
+};
+
+class SyntheticScene {
+public:
+  /// @param scale grows the scene, hence the map, linearly
+  /// @param frame_count length of the trajectory
+  SyntheticScene(SyntheticSceneType type,
+                 float scale,
+                 int frame_count,
+                 const SensorParams &sensor_params);
+
+  bool ProvideData(cv::Mat &depth, cv::Mat &color, float4x4 &wTc);
+
+  static const char* name(SyntheticSceneType type);
+
+private:
+  struct Primitive {
+    enum Type {
+      kBoxInterior,  /// seen from inside: walls, floor and ceiling
+      kBox,
+      kSphere
+    } type;
+    float3 lo, hi;       /// boxes
+    float3 center;       /// spheres
+    float  radius;
+    uchar3 color;
+  };
+
+  void AddBoxInterior(float3 lo, float3 hi, uchar3 color);
+  void AddBox(float3 lo, float3 hi, uchar3 color);
+  void AddSphere(float3 center, float radius, uchar3 color);
+
+  /// @param tau in [0, 1) along the trajectory
+  float4x4 Pose(float tau);
+  /// @param dir need not be normalized, @param t is in its units
+  bool Intersect(const float3 &origin, const float3 &dir,
+                 float &t, uchar3 &color);
+  void Render(const float4x4 &wTc, cv::Mat &depth, cv::Mat &color);
+
+  SyntheticSceneType type_;
+  float scale_;
+  int   frame_count_;
+  int   frame_id_ = 0;
+  SensorParams sensor_params_;
+  std::vector<Primitive> primitives_;
+};
+
+#endif //SENSOR_SYNTHETIC_SCENE_H
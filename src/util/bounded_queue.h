@@ -0,0 +1,62 @@
+//
+// Created by wei on 18-1-28.
+//
+// Blocking FIFO of fixed capacity connecting two pipeline stages
+
+#ifndef UTIL_BOUNDED_QUEUE_H
+#define UTIL_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+  /// Block while full
+  /// @return false if the queue is closed
+  bool Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {
+      return is_closed_ || items_.size() < capacity_;
+    });
+    if (is_closed_) return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /// Block while empty
+  /// @return false if the queue is closed and drained
+  bool Pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] {
+      return is_closed_ || ! items_.empty();
+    });
+    if (items_.empty()) return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /// Wake up all the waiting stages; remaining items can still be popped
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool is_closed_ = false;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+#endif //UTIL_BOUNDED_QUEUE_H
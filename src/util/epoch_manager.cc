@@ -0,0 +1,85 @@
+//
+// Created by wei on 18-2-8.
+//
+
+#include "util/epoch_manager.h"
+
+#include <algorithm>
+#include <limits>
+#include <glog/logging.h>
+
+EpochManager::EpochManager() : epoch_(1) {
+  for (auto &reader_epoch : reader_epochs_) {
+    reader_epoch.store(kUnpinned);
+  }
+}
+
+int EpochManager::Pin() {
+  for (int i = 0; i < kMaxReaders; ++i) {
+    unsigned long expected = kUnpinned;
+    unsigned long epoch = epoch_.load();
+    if (! reader_epochs_[i].compare_exchange_strong(expected, epoch)) {
+      continue;
+    }
+    /// A Defer may have advanced the epoch and a Collect missed the slot
+    /// in between: publish again until the epoch holds still
+    unsigned long current_epoch;
+    while ((current_epoch = epoch_.load()) != epoch) {
+      epoch = current_epoch;
+      reader_epochs_[i].store(epoch);
+    }
+    return i;
+  }
+  LOG(WARNING) << "All " << kMaxReaders << " reader slots are pinned";
+  return -1;
+}
+
+void EpochManager::Unpin(int reader_idx) {
+  if (reader_idx < 0) return;
+  reader_epochs_[reader_idx].store(kUnpinned);
+}
+
+void EpochManager::Defer(std::function<void()> release) {
+  /// Readers pinning from now on get a later epoch
+  unsigned long epoch = epoch_.fetch_add(1);
+  deferred_.emplace_back(epoch, std::move(release));
+}
+
+int EpochManager::Collect() {
+  unsigned long min_epoch = MinPinnedEpoch();
+  int release_count = 0;
+  while (! deferred_.empty() && deferred_.front().first < min_epoch) {
+    deferred_.front().second();
+    deferred_.pop_front();
+    ++release_count;
+  }
+  return release_count;
+}
+
+void EpochManager::CollectAll() {
+  int pinned_count = pinned_reader_count();
+  if (pinned_count > 0) {
+    LOG(WARNING) << "Releasing with " << pinned_count << " readers pinned";
+  }
+  while (! deferred_.empty()) {
+    deferred_.front().second();
+    deferred_.pop_front();
+  }
+}
+
+int EpochManager::pinned_reader_count() const {
+  int count = 0;
+  for (const auto &reader_epoch : reader_epochs_) {
+    if (reader_epoch.load() != kUnpinned) ++count;
+  }
+  return count;
+}
+
+unsigned long EpochManager::MinPinnedEpoch() const {
+  unsigned long min_epoch = std::numeric_limits<unsigned long>::max();
+  for (const auto &reader_epoch : reader_epochs_) {
+    unsigned long epoch = reader_epoch.load();
+    if (epoch != kUnpinned) min_epoch = std::min(min_epoch, epoch);
+  }
+  return min_epoch;
+}
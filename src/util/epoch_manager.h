@@ -0,0 +1,64 @@
+//
+// Created by wei on 18-2-8.
+//
+// Epoch-based reclamation between one writer and concurrent readers.
+// A reader pins the current epoch while it reads; whatever the writer
+// unlinks is deferred with the epoch it was unlinked in, and released
+// once no reader pinned at that epoch or before is left.
+// Readers never wait, and the writer never waits for readers:
+// releases are only postponed to a later Collect.
+
+#ifndef UTIL_EPOCH_MANAGER_H
+#define UTIL_EPOCH_MANAGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <utility>
+
+class EpochManager {
+public:
+  /// Readers pinned at once, at most
+  static const int kMaxReaders = 64;
+
+  EpochManager();
+  EpochManager(const EpochManager&) = delete;
+  EpochManager& operator=(const EpochManager&) = delete;
+
+  /// Reader side, from any thread
+  /// @return a reader slot for Unpin, -1 if all are taken
+  int Pin();
+  void Unpin(int reader_idx);
+
+  /// Writer side, from one thread
+  /// Run @param release once every reader pinned now has left,
+  /// at the latest in the Collect after that
+  void Defer(std::function<void()> release);
+  /// Run the releases no reader can reach any more
+  /// @return how many ran
+  int Collect();
+  /// Run every release, readers or not: only when none is left
+  void CollectAll();
+
+  int pinned_reader_count() const;
+  size_t deferred_count() const {
+    return deferred_.size();
+  }
+  unsigned long epoch() const {
+    return epoch_.load();
+  }
+
+private:
+  /// 0 when the slot is free
+  static const unsigned long kUnpinned = 0;
+
+  unsigned long MinPinnedEpoch() const;
+
+  std::atomic<unsigned long> epoch_;
+  std::atomic<unsigned long> reader_epochs_[kMaxReaders];
+  /// (epoch unlinked in, release), in epoch order
+  std::deque<std::pair<unsigned long, std::function<void()> > > deferred_;
+};
+
+#endif //UTIL_EPOCH_MANAGER_H
@@ -0,0 +1,113 @@
+//
+// Created by wei on 18-2-5.
+//
+
+#include "util/host_memory.h"
+
+#include <sys/mman.h>
+#include <cstdint>
+#include <glog/logging.h>
+
+namespace {
+const size_t kPageBytes = 4096;
+const size_t kHugePageBytes = 2 * 1024 * 1024;
+
+HostPageMode g_host_page_mode = HOST_PAGES_DEFAULT;
+
+size_t RoundUp(size_t bytes, size_t alignment) {
+  return (bytes + alignment - 1) / alignment * alignment;
+}
+
+/// Huge pages only pay off for arrays of several of them;
+/// smaller ones keep 4 KB pages whatever the mode
+size_t MappedBytes(size_t bytes) {
+  if (bytes == 0) bytes = 1;
+  return bytes >= kHugePageBytes
+         ? RoundUp(bytes, kHugePageBytes)
+         : RoundUp(bytes, kPageBytes);
+}
+
+void* MapAnonymous(size_t bytes, int extra_flags) {
+  void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/// Transparent huge pages only back 2 MB aligned ranges:
+/// over-map, then trim the head and the tail
+void* MapAligned(size_t bytes) {
+  char *ptr = (char*)MapAnonymous(bytes + kHugePageBytes, 0);
+  if (ptr == NULL) return NULL;
+  char *aligned = (char*)RoundUp((uintptr_t)ptr, kHugePageBytes);
+  size_t head = aligned - ptr;
+  if (head > 0) munmap(ptr, head);
+  size_t tail = kHugePageBytes - head;
+  if (tail > 0) munmap(aligned + bytes, tail);
+  return aligned;
+}
+
+void WarnFallback(const char *what) {
+  static bool is_warned = false;
+  if (is_warned) return;
+  LOG(WARNING) << what << " unavailable, falling back";
+  is_warned = true;
+}
+}
+
+void SetHostPageMode(HostPageMode mode) {
+  g_host_page_mode = mode;
+  LOG(INFO) << "Host pages: " << HostPageModeName(mode);
+}
+
+HostPageMode host_page_mode() {
+  return g_host_page_mode;
+}
+
+const char* HostPageModeName(HostPageMode mode) {
+  switch (mode) {
+    case HOST_PAGES_DEFAULT:          return "default";
+    case HOST_PAGES_TRANSPARENT_HUGE: return "transparent_huge";
+    case HOST_PAGES_EXPLICIT_HUGE:    return "explicit_huge";
+  }
+  return "unknown";
+}
+
+void* AllocHostPages(size_t bytes, HostPageMode *mode_used) {
+  size_t mapped_bytes = MappedBytes(bytes);
+  HostPageMode mode = g_host_page_mode;
+  if (mapped_bytes % kHugePageBytes != 0) mode = HOST_PAGES_DEFAULT;
+
+  void *ptr = NULL;
+  if (mode == HOST_PAGES_EXPLICIT_HUGE) {
+#ifdef MAP_HUGETLB
+    ptr = MapAnonymous(mapped_bytes, MAP_HUGETLB);
+#endif
+    if (ptr == NULL) {
+      WarnFallback("MAP_HUGETLB (see /proc/sys/vm/nr_hugepages)");
+      mode = HOST_PAGES_TRANSPARENT_HUGE;
+    }
+  }
+
+  if (mode == HOST_PAGES_TRANSPARENT_HUGE) {
+    ptr = MapAligned(mapped_bytes);
+    if (ptr == NULL) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (madvise(ptr, mapped_bytes, MADV_HUGEPAGE) != 0) {
+      WarnFallback("MADV_HUGEPAGE (see /sys/kernel/mm/transparent_hugepage)");
+      mode = HOST_PAGES_DEFAULT;
+    }
+#else
+    mode = HOST_PAGES_DEFAULT;
+#endif
+  } else if (mode == HOST_PAGES_DEFAULT) {
+    ptr = MapAnonymous(mapped_bytes, 0);
+  }
+
+  if (mode_used != NULL) *mode_used = mode;
+  return ptr;
+}
+
+void FreeHostPages(void *ptr, size_t bytes) {
+  if (ptr == NULL) return;
+  munmap(ptr, MappedBytes(bytes));
+}
@@ -0,0 +1,61 @@
+//
+// Created by wei on 18-2-5.
+//
+// Host memory for the large arrays of the CPU path, indexed by block:
+// with 4 KB pages, random block accesses miss the TLB most of the time.
+// Pages are mapped with MAP_HUGETLB (explicit 2 MB pages, reserved in
+// /proc/sys/vm/nr_hugepages) or advised with MADV_HUGEPAGE (transparent),
+// falling back to the next mode when the system refuses.
+
+#ifndef UTIL_HOST_MEMORY_H
+#define UTIL_HOST_MEMORY_H
+
+#include <cstddef>
+#include <new>
+
+enum HostPageMode {
+  HOST_PAGES_DEFAULT = 0,           /// 4 KB pages, as the system decides
+  HOST_PAGES_TRANSPARENT_HUGE = 1,  /// madvise(MADV_HUGEPAGE)
+  HOST_PAGES_EXPLICIT_HUGE = 2      /// mmap(MAP_HUGETLB)
+};
+
+/// Process-wide, for every following AllocHostPages
+void SetHostPageMode(HostPageMode mode);
+HostPageMode host_page_mode();
+const char* HostPageModeName(HostPageMode mode);
+
+/// Page-aligned and uninitialized; @return NULL if out of memory
+/// @param mode_used if not NULL, the mode actually obtained
+void* AllocHostPages(size_t bytes, HostPageMode *mode_used = NULL);
+/// @param bytes as given to AllocHostPages
+void FreeHostPages(void *ptr, size_t bytes);
+
+/// For std::vector and the like
+template <typename T>
+struct HostPageAllocator {
+  typedef T value_type;
+
+  HostPageAllocator() = default;
+  template <typename U>
+  HostPageAllocator(const HostPageAllocator<U> &) {}
+
+  T* allocate(size_t n) {
+    void *ptr = AllocHostPages(n * sizeof(T));
+    if (ptr == NULL) throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+  void deallocate(T *ptr, size_t n) {
+    FreeHostPages(ptr, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const HostPageAllocator<T> &, const HostPageAllocator<U> &) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const HostPageAllocator<T> &, const HostPageAllocator<U> &) {
+  return false;
+}
+
+#endif //UTIL_HOST_MEMORY_H
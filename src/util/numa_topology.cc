@@ -0,0 +1,77 @@
+//
+// Created by wei on 18-2-6.
+//
+
+#include "util/numa_topology.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <glog/logging.h>
+
+namespace {
+/// "0-3,8-11" -> 0 1 2 3 8 9 10 11
+std::vector<int> ParseCpuList(const std::string &cpu_list) {
+  std::vector<int> cpus;
+  std::stringstream ss(cpu_list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty()) continue;
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos
+               ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+}
+
+const NumaTopology& NumaTopology::Instance() {
+  static NumaTopology topology;
+  return topology;
+}
+
+NumaTopology::NumaTopology() {
+  for (int node = 0; ; ++node) {
+    std::ifstream file("/sys/devices/system/node/node"
+                       + std::to_string(node) + "/cpulist");
+    if (! file.is_open()) break;
+    std::string cpu_list;
+    std::getline(file, cpu_list);
+    std::vector<int> cpus = ParseCpuList(cpu_list);
+    /// Memory-only nodes run no threads
+    if (! cpus.empty()) node_cpus_.push_back(cpus);
+  }
+
+  if (node_cpus_.empty()) {
+    int cpu_count = (int)std::max(1u, std::thread::hardware_concurrency());
+    node_cpus_.emplace_back();
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+      node_cpus_[0].push_back(cpu);
+    }
+  }
+  LOG(INFO) << "NUMA nodes: " << node_cpus_.size();
+}
+
+int NumaTopology::cpu_count(int node_count) const {
+  int count = 0;
+  for (int node = 0; node < std::min(node_count, this->node_count()); ++node) {
+    count += (int)node_cpus_[node].size();
+  }
+  return count;
+}
+
+bool NumaTopology::PinThreadToNode(int node) const {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus(node)) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                &cpu_set) == 0;
+}
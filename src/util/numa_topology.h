@@ -0,0 +1,36 @@
+//
+// Created by wei on 18-2-6.
+//
+// NUMA nodes and their CPUs, read from /sys/devices/system/node.
+// Memory is placed on the node of the thread that first touches it,
+// so a thread pinned to a node fills the arrays it will read most.
+// Without the sysfs entries, one node holds every hardware thread.
+
+#ifndef UTIL_NUMA_TOPOLOGY_H
+#define UTIL_NUMA_TOPOLOGY_H
+
+#include <vector>
+
+class NumaTopology {
+public:
+  static const NumaTopology& Instance();
+
+  int node_count() const {
+    return (int)node_cpus_.size();
+  }
+  const std::vector<int>& cpus(int node) const {
+    return node_cpus_[node % node_count()];
+  }
+  int cpu_count(int node_count) const;
+
+  /// Pin the calling thread to the CPUs of @param node
+  /// @return false if the system refused
+  bool PinThreadToNode(int node) const;
+
+private:
+  NumaTopology();
+
+  std::vector<std::vector<int> > node_cpus_;
+};
+
+#endif //UTIL_NUMA_TOPOLOGY_H
@@ -0,0 +1,175 @@
+//
+// Created by wei on 18-1-29.
+//
+
+#include "util/profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <glog/logging.h>
+
+Profiler& Profiler::Instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler() {
+  start_ = std::chrono::steady_clock::now();
+}
+
+long long Profiler::now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_).count();
+}
+
+/// Registered once per thread; buffers outlive their threads
+Profiler::ThreadBuffer& Profiler::thread_buffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.emplace_back(new ThreadBuffer);
+    buffer = buffers_.back().get();
+    buffer->tid = (int)buffers_.size() - 1;
+  }
+  return *buffer;
+}
+
+void Profiler::BeginZone(const char *name) {
+  ThreadBuffer &buffer = thread_buffer();
+  std::string full_name = buffer.stack.empty()
+                          ? std::string(name)
+                          : buffer.stack.back().first + "/" + name;
+  buffer.stack.emplace_back(std::move(full_name), now_us());
+}
+
+void Profiler::EndZone() {
+  ThreadBuffer &buffer = thread_buffer();
+  if (buffer.stack.empty()) return;
+  long long end_us = now_us();
+  Event event;
+  event.name = std::move(buffer.stack.back().first);
+  event.start_us = buffer.stack.back().second;
+  event.duration_us = end_us - event.start_us;
+  buffer.stack.pop_back();
+  buffer.events.push_back(std::move(event));
+}
+
+void Profiler::RecordWorker(const std::string &loop, int worker_idx,
+                            long long busy_us, long long idle_us,
+                            long chunk_count, long steal_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  WorkerTotals &totals = worker_totals_[std::make_pair(loop, worker_idx)];
+  totals.busy_us += busy_us;
+  totals.idle_us += idle_us;
+  totals.chunk_count += chunk_count;
+  totals.steal_count += steal_count;
+}
+
+void Profiler::WriteSummary(const std::string &path) {
+  std::map<std::string, std::vector<long long>> durations;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &buffer : buffers_) {
+      for (auto &event : buffer->events) {
+        durations[event.name].push_back(event.duration_us);
+      }
+    }
+  }
+  if (durations.empty()) return;
+
+  std::ofstream out(path);
+  if (! out.is_open()) {
+    LOG(ERROR) << "Can't open profile summary " << path;
+  }
+  std::stringstream ss;
+  ss << std::left << std::setw(40) << "zone" << std::right
+     << std::setw(8) << "count"
+     << std::setw(10) << "mean"
+     << std::setw(10) << "p50"
+     << std::setw(10) << "p95"
+     << std::setw(10) << "p99" << "  (ms)\n";
+  ss << std::fixed << std::setprecision(3);
+  for (auto &zone : durations) {
+    std::vector<long long> &d = zone.second;
+    std::sort(d.begin(), d.end());
+    /// Nearest rank
+    auto percentile = [&d](double p) {
+      size_t rank = (size_t)std::ceil(p * d.size());
+      return d[std::max<size_t>(rank, 1) - 1] * 1e-3;
+    };
+    double sum = 0;
+    for (long long t : d) sum += t;
+
+    ss << std::left << std::setw(40) << zone.first << std::right
+       << std::setw(8) << d.size()
+       << std::setw(10) << sum * 1e-3 / d.size()
+       << std::setw(10) << percentile(0.50)
+       << std::setw(10) << percentile(0.95)
+       << std::setw(10) << percentile(0.99) << "\n";
+  }
+
+  std::map<std::pair<std::string, int>, WorkerTotals> worker_totals;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    worker_totals = worker_totals_;
+  }
+  if (! worker_totals.empty()) {
+    ss << "\n" << std::left << std::setw(40) << "loop/worker" << std::right
+       << std::setw(10) << "busy"
+       << std::setw(10) << "idle"
+       << std::setw(8) << "busy%"
+       << std::setw(8) << "chunks"
+       << std::setw(8) << "steals" << "  (ms)\n";
+    for (auto &worker : worker_totals) {
+      const WorkerTotals &t = worker.second;
+      long long total_us = t.busy_us + t.idle_us;
+      ss << std::left << std::setw(40)
+         << worker.first.first + "/" + std::to_string(worker.first.second)
+         << std::right
+         << std::setw(10) << t.busy_us * 1e-3
+         << std::setw(10) << t.idle_us * 1e-3
+         << std::setw(8) << (total_us > 0 ? 100.0 * t.busy_us / total_us : 0)
+         << std::setw(8) << t.chunk_count
+         << std::setw(8) << t.steal_count << "\n";
+    }
+  }
+  LOG(INFO) << "Profile:\n" << ss.str();
+  if (out.is_open()) {
+    out << ss.str();
+  }
+}
+
+void Profiler::WriteChromeTrace(const std::string &path) {
+  std::ofstream out(path);
+  if (! out.is_open()) {
+    LOG(ERROR) << "Can't open trace file " << path;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << "{\"traceEvents\":[\n";
+  bool is_first = true;
+  for (auto &buffer : buffers_) {
+    for (auto &event : buffer->events) {
+      /// Only the leaf name; the nesting is shown by the timeline
+      size_t slash = event.name.rfind('/');
+      std::string leaf = slash == std::string::npos
+                         ? event.name : event.name.substr(slash + 1);
+      out << (is_first ? "" : ",\n")
+          << "{\"name\":\"" << leaf << "\","
+          << "\"cat\":\"" << event.name << "\","
+          << "\"ph\":\"X\","
+          << "\"ts\":" << event.start_us << ","
+          << "\"dur\":" << event.duration_us << ","
+          << "\"pid\":0,"
+          << "\"tid\":" << buffer->tid << "}";
+      is_first = false;
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  LOG(INFO) << "Trace written to " << path;
+}
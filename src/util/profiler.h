@@ -0,0 +1,89 @@
+//
+// Created by wei on 18-1-29.
+//
+// Scoped zones timed by steady_clock, compiled out unless ENABLE_PROFILER.
+// Zones nest: PROFILE_SCOPE("update") inside PROFILE_SCOPE("mapping")
+// is recorded as "mapping/update". Each thread records into its own buffer;
+// write the results only while no zone is being recorded.
+
+#ifndef UTIL_PROFILER_H
+#define UTIL_PROFILER_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+  ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+class Profiler {
+public:
+  static Profiler& Instance();
+
+  void BeginZone(const char *name);
+  void EndZone();
+
+  /// One loop run by a TaskScheduler worker
+  void RecordWorker(const std::string &loop, int worker_idx,
+                    long long busy_us, long long idle_us,
+                    long chunk_count, long steal_count);
+
+  /// p50 / p95 / p99 of every zone, and the busy / idle time of every
+  /// worker, to LOG(INFO) and @param path
+  void WriteSummary(const std::string &path);
+  /// chrome://tracing or Perfetto
+  void WriteChromeTrace(const std::string &path);
+
+private:
+  struct Event {
+    std::string name;
+    long long   start_us;
+    long long   duration_us;
+  };
+  struct ThreadBuffer {
+    int tid;
+    std::vector<Event> events;
+    /// Open zones: full name and start
+    std::vector<std::pair<std::string, long long>> stack;
+  };
+
+  Profiler();
+  ThreadBuffer& thread_buffer();
+  long long now_us();
+
+  struct WorkerTotals {
+    long long busy_us = 0;
+    long long idle_us = 0;
+    long chunk_count = 0;
+    long steal_count = 0;
+  };
+
+  std::chrono::steady_clock::time_point start_;
+  std::mutex mutex_;  // guards the buffer list and the worker totals
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  /// By loop name and worker
+  std::map<std::pair<std::string, int>, WorkerTotals> worker_totals_;
+};
+
+class ProfileZone {
+public:
+  explicit ProfileZone(const char *name) {
+    Profiler::Instance().BeginZone(name);
+  }
+  ~ProfileZone() {
+    Profiler::Instance().EndZone();
+  }
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#endif //UTIL_PROFILER_H
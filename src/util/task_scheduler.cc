@@ -0,0 +1,241 @@
+//
+// Created by wei on 18-2-7.
+//
+
+#include "util/task_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "util/numa_topology.h"
+#include "util/profiler.h"
+
+namespace {
+const long long kTargetChunkUs = 200;
+/// Chunks a worker starts with, at least, before any tuning
+const uint kInitialChunksPerWorker = 8;
+/// Chunks a worker starts with, at least, after tuning: room to steal
+const uint kMinChunksPerWorker = 4;
+
+long long NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+TaskScheduler::TaskScheduler(int worker_count, int node_count)
+    : node_count_(node_count) {
+  if (worker_count <= 0) {
+    worker_count = (int)std::max(1u, std::thread::hardware_concurrency());
+  }
+  stats_.resize(worker_count);
+  loop_stats_.resize(worker_count);
+  for (int i = 0; i < worker_count; ++i) {
+    queues_.emplace_back(new WorkerQueue);
+  }
+  for (int i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(&TaskScheduler::WorkerLoop, this, i);
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopping_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+uint TaskScheduler::chunk_size(const std::string &name) const {
+  auto iter = chunk_sizes_.find(name);
+  return iter == chunk_sizes_.end() ? 0 : iter->second;
+}
+
+void TaskScheduler::ParallelFor(
+    const char *name, uint count,
+    const std::function<void(uint, uint)> &task
+) {
+  /// Contiguous shares
+  const uint worker_count = (uint)workers_.size();
+  std::vector<std::vector<Chunk> > shares(worker_count);
+  for (uint i = 0; i < worker_count; ++i) {
+    shares[i].emplace_back(
+        (uint)((unsigned long long)count * i / worker_count),
+        (uint)((unsigned long long)count * (i + 1) / worker_count));
+  }
+  Run(name, count, shares, task);
+}
+
+void TaskScheduler::ParallelFor(
+    const char *name, const std::vector<uint> &node_begins,
+    const std::function<void(uint, uint)> &task
+) {
+  if (node_begins.size() < 2) return;
+  const uint count = node_begins.back();
+  if (node_count_ <= 0) {
+    ParallelFor(name, count, task);
+    return;
+  }
+
+  /// The range of node n is shared by the workers pinned to it,
+  /// n, n + node_count_, ...; by worker n % worker_count if there is none
+  const int worker_count = (int)workers_.size();
+  std::vector<std::vector<Chunk> > shares(worker_count);
+  for (int n = 0; n + 1 < (int)node_begins.size(); ++n) {
+    std::vector<int> node_workers;
+    for (int i = n % node_count_; i < worker_count; i += node_count_) {
+      node_workers.push_back(i);
+    }
+    if (node_workers.empty()) node_workers.push_back(n % worker_count);
+
+    const unsigned long long begin = node_begins[n];
+    const unsigned long long size = node_begins[n + 1] - node_begins[n];
+    const size_t share_count = node_workers.size();
+    for (size_t k = 0; k < share_count; ++k) {
+      shares[node_workers[k]].emplace_back(
+          (uint)(begin + size * k / share_count),
+          (uint)(begin + size * (k + 1) / share_count));
+    }
+  }
+  Run(name, count, shares, task);
+}
+
+void TaskScheduler::Run(
+    const char *name, uint count,
+    const std::vector<std::vector<Chunk> > &shares,
+    const std::function<void(uint, uint)> &task
+) {
+  if (count == 0) return;
+  const uint worker_count = (uint)workers_.size();
+
+  uint chunk = chunk_size(name);
+  if (chunk == 0) {
+    chunk = std::max(1u, count / (worker_count * kInitialChunksPerWorker));
+  }
+
+  /// Shares cut into chunks in order
+  for (uint i = 0; i < worker_count; ++i) {
+    WorkerQueue &queue = *queues_[i];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (const Chunk &share : shares[i]) {
+      for (uint b = share.first; b < share.second; b += chunk) {
+        queue.chunks.emplace_back(b, std::min(b + chunk, share.second));
+      }
+    }
+  }
+  std::fill(loop_stats_.begin(), loop_stats_.end(), WorkerStats());
+
+  long long start_us = NowUs();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    running_worker_count_ = (int)worker_count;
+    ++generation_;
+    start_cv_.notify_all();
+    done_cv_.wait(lock, [this]() { return running_worker_count_ == 0; });
+    task_ = nullptr;
+  }
+  long long loop_us = NowUs() - start_us;
+
+  long long busy_us = 0;
+  for (uint i = 0; i < worker_count; ++i) {
+    WorkerStats &loop_stats = loop_stats_[i];
+    loop_stats.idle_us = std::max(0ll, loop_us - loop_stats.busy_us);
+    busy_us += loop_stats.busy_us;
+
+    WorkerStats &stats = stats_[i];
+    stats.busy_us += loop_stats.busy_us;
+    stats.idle_us += loop_stats.idle_us;
+    stats.chunk_count += loop_stats.chunk_count;
+    stats.steal_count += loop_stats.steal_count;
+#ifdef ENABLE_PROFILER
+    Profiler::Instance().RecordWorker(name, i,
+                                      loop_stats.busy_us, loop_stats.idle_us,
+                                      loop_stats.chunk_count,
+                                      loop_stats.steal_count);
+#endif
+  }
+
+  /// Chunks of about kTargetChunkUs next time, keeping enough to steal
+  double item_us = std::max(1ll, busy_us) / (double)count;
+  uint tuned_chunk = (uint)std::max(1.0, kTargetChunkUs / item_us);
+  uint max_chunk = std::max(1u, count / (worker_count * kMinChunksPerWorker));
+  chunk_sizes_[name] = std::min(tuned_chunk, max_chunk);
+}
+
+void TaskScheduler::WorkerLoop(int worker_idx) {
+  if (node_count_ > 0) {
+    NumaTopology::Instance().PinThreadToNode(worker_idx % node_count_);
+  }
+
+  long seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock, [this, seen_generation]() {
+        return is_stopping_ || generation_ != seen_generation;
+      });
+      if (is_stopping_) return;
+      seen_generation = generation_;
+    }
+
+    RunChunks(worker_idx);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_worker_count_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+/// No chunk is added during a loop: once every queue is empty,
+/// the worker is done with it
+void TaskScheduler::RunChunks(int worker_idx) {
+  WorkerStats &stats = loop_stats_[worker_idx];
+  Chunk chunk;
+  while (true) {
+    if (! PopOwn(worker_idx, chunk)) {
+      if (! Steal(worker_idx, chunk)) return;
+      ++stats.steal_count;
+    }
+    long long start_us = NowUs();
+    (*task_)(chunk.first, chunk.second);
+    stats.busy_us += NowUs() - start_us;
+    ++stats.chunk_count;
+  }
+}
+
+/// From the front: in order over the own share
+bool TaskScheduler::PopOwn(int worker_idx, Chunk &chunk) {
+  WorkerQueue &queue = *queues_[worker_idx];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.chunks.empty()) return false;
+  chunk = queue.chunks.front();
+  queue.chunks.pop_front();
+  return true;
+}
+
+/// From the back: the part of the share its owner reaches last.
+/// Pinned, from the workers of the same node first: their data is local
+bool TaskScheduler::Steal(int worker_idx, Chunk &chunk) {
+  const int worker_count = (int)queues_.size();
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int k = 1; k < worker_count; ++k) {
+      int victim_idx = (worker_idx + k) % worker_count;
+      bool is_same_node = node_count_ <= 0
+                          || victim_idx % node_count_
+                             == worker_idx % node_count_;
+      if (is_same_node != (pass == 0)) continue;
+      WorkerQueue &queue = *queues_[victim_idx];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.chunks.empty()) continue;
+      chunk = queue.chunks.back();
+      queue.chunks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,102 @@
+//
+// Created by wei on 18-2-7.
+//
+// Parallel loops over items of very different costs, on persistent workers.
+// A loop is cut into chunks; each worker starts on its own contiguous share
+// and, when done, steals chunks from the far end of the others.
+// The chunk size of every loop, by name, is tuned from its last run so
+// that a chunk takes about kTargetChunkUs: small enough to balance,
+// large enough to amortize the deque locks.
+
+#ifndef UTIL_TASK_SCHEDULER_H
+#define UTIL_TASK_SCHEDULER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "core/common.h"
+
+class TaskScheduler {
+public:
+  struct WorkerStats {
+    long long busy_us = 0;   /// running chunks
+    long long idle_us = 0;   /// inside a loop, but out of chunks
+    long chunk_count = 0;
+    long steal_count = 0;
+  };
+
+  /// @param worker_count 0 to use all hardware threads
+  /// @param node_count if > 0, worker i is pinned to NUMA node i % node_count
+  explicit TaskScheduler(int worker_count = 0, int node_count = 0);
+  ~TaskScheduler();
+  TaskScheduler(const TaskScheduler&) = delete;
+  TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+  /// Run @param task on [begin, end) ranges covering [0, @param count),
+  /// and return when all are done. Not reentrant.
+  /// @param name identifies the loop for chunk tuning and the profiler
+  void ParallelFor(const char *name, uint count,
+                   const std::function<void(uint, uint)> &task);
+  /// As above, over [0, @param node_begins.back()), where items
+  /// [node_begins[n], node_begins[n + 1]) start on the workers pinned to
+  /// node n: the data of node n. Idle workers steal on their node first.
+  /// Without pinning, the same as the loop over all the items.
+  void ParallelFor(const char *name, const std::vector<uint> &node_begins,
+                   const std::function<void(uint, uint)> &task);
+
+  int worker_count() const {
+    return (int)workers_.size();
+  }
+  /// 0 if the workers are not pinned
+  int node_count() const {
+    return node_count_;
+  }
+  /// Summed over every loop run
+  const std::vector<WorkerStats>& stats() const {
+    return stats_;
+  }
+  uint chunk_size(const std::string &name) const;
+
+private:
+  typedef std::pair<uint, uint> Chunk;
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Chunk> chunks;
+  };
+
+  /// Worker i starts on the ranges of @param shares[i]
+  void Run(const char *name, uint count,
+           const std::vector<std::vector<Chunk> > &shares,
+           const std::function<void(uint, uint)> &task);
+  void WorkerLoop(int worker_idx);
+  void RunChunks(int worker_idx);
+  bool PopOwn(int worker_idx, Chunk &chunk);
+  bool Steal(int worker_idx, Chunk &chunk);
+
+  int node_count_;
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<WorkerQueue> > queues_;
+
+  /// The current loop
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(uint, uint)> *task_ = nullptr;
+  long generation_ = 0;
+  int  running_worker_count_ = 0;
+  bool is_stopping_ = false;
+
+  /// Per worker, for the current loop then summed
+  std::vector<WorkerStats> loop_stats_;
+  std::vector<WorkerStats> stats_;
+  std::map<std::string, uint> chunk_sizes_;
+};
+
+#endif //UTIL_TASK_SCHEDULER_H
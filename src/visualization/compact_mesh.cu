@@ -15,13 +15,8 @@
 
 void CompactMesh::Alloc(const MeshParams &mesh_params) {
   if (! is_allocated_on_gpu_) {
-    checkCudaErrors(cudaMalloc(&vertex_remapper_,
-                               sizeof(int) * mesh_params.max_vertex_count));
-
     checkCudaErrors(cudaMalloc(&vertex_counter_,
                                sizeof(uint)));
-    checkCudaErrors(cudaMalloc(&vertices_ref_count_,
-                               sizeof(int) * mesh_params.max_vertex_count));
     checkCudaErrors(cudaMalloc(&vertices_,
                                sizeof(float3) * mesh_params.max_vertex_count));
     checkCudaErrors(cudaMalloc(&normals_,
@@ -31,8 +26,6 @@ void CompactMesh::Alloc(const MeshParams &mesh_params) {
 
     checkCudaErrors(cudaMalloc(&triangle_counter_,
                                sizeof(uint)));
-    checkCudaErrors(cudaMalloc(&triangles_ref_count_,
-                               sizeof(int) * mesh_params.max_triangle_count));
     checkCudaErrors(cudaMalloc(&triangles_,
                                sizeof(int3) * mesh_params.max_triangle_count));
     is_allocated_on_gpu_ = true;
@@ -41,16 +34,12 @@ void CompactMesh::Alloc(const MeshParams &mesh_params) {
 
 void CompactMesh::Free() {
   if (is_allocated_on_gpu_) {
-    checkCudaErrors(cudaFree(vertex_remapper_));
-
     checkCudaErrors(cudaFree(vertex_counter_));
-    checkCudaErrors(cudaFree(vertices_ref_count_));
     checkCudaErrors(cudaFree(vertices_));
     checkCudaErrors(cudaFree(normals_));
     checkCudaErrors(cudaFree(colors_));
 
     checkCudaErrors(cudaFree(triangle_counter_));
-    checkCudaErrors(cudaFree(triangles_ref_count_));
     checkCudaErrors(cudaFree(triangles_));
   }
 }
@@ -66,14 +55,8 @@ void CompactMesh::Resize(const MeshParams &mesh_params) {
 
 /// Reset
 void CompactMesh::Reset() {
-  checkCudaErrors(cudaMemset(vertex_remapper_, 0xff,
-                             sizeof(int) * mesh_params_.max_vertex_count));
-  checkCudaErrors(cudaMemset(vertices_ref_count_, 0,
-                             sizeof(int) * mesh_params_.max_vertex_count));
   checkCudaErrors(cudaMemset(vertex_counter_,
                              0, sizeof(uint)));
-  checkCudaErrors(cudaMemset(triangles_ref_count_, 0,
-                             sizeof(int) * mesh_params_.max_triangle_count));
   checkCudaErrors(cudaMemset(triangle_counter_,
                              0, sizeof(uint)));
 }
@@ -10,6 +10,16 @@
 #include "core/vertex.h"
 #include "core/triangle.h"
 
+// The elements of one block in a CompactMesh, contiguous:
+// empty if the block had no triangles
+struct MeshBlockRange {
+  int3 pos;
+  uint vertex_begin;
+  uint vertex_count;
+  uint triangle_begin;
+  uint triangle_count;
+};
+
 class CompactMesh {
 public:
   CompactMesh() = default;
@@ -23,10 +33,6 @@ public:
   uint vertex_count();
   uint triangle_count();
 
-  __device__ __host__
-  int* vertex_remapper() {
-    return vertex_remapper_;
-  }
   __device__ __host__
   float3* vertices() {
     return vertices_;
@@ -44,14 +50,6 @@ public:
     return triangles_;
   }
   __device__ __host__
-  int* triangles_ref_count() {
-    return triangles_ref_count_;
-  }
-  __device__ __host__
-  int* vertices_ref_count() {
-    return vertices_ref_count_;
-  }
-  __device__ __host__
   uint* triangle_counter() {
     return triangle_counter_;
   }
@@ -62,17 +60,14 @@ public:
 
 private:
   bool  is_allocated_on_gpu_ = false;
-  int*      vertex_remapper_;
 
   // They are decoupled so as to be separately assigned to the rendering pipeline
   float3*   vertices_;
   float3*   normals_;
   float3*   colors_;
-  int*      vertices_ref_count_;
   uint*     vertex_counter_;
 
   int3*     triangles_;
-  int*      triangles_ref_count_;
   uint*     triangle_counter_;
   MeshParams     mesh_params_;
 };
@@ -11,8 +11,10 @@
 #include "core/mesh.h"
 #include "visualization/compact_mesh.h"
 
+// @param block_ranges if not NULL, one per candidate, on the GPU
 void CompressMesh(EntryArray& candidate_entries, BlockArray& blocks,
                   Mesh& mesh,
-                  CompactMesh & compact_mesh, int3& stats);
+                  CompactMesh & compact_mesh, int3& stats,
+                  MeshBlockRange *block_ranges = NULL);
 
 #endif //MESH_HASHING_COMPRESS_MESH_H
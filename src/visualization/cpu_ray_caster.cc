@@ -0,0 +1,331 @@
+//
+// Created by wei on 18-1-27.
+//
+
+#include "visualization/cpu_ray_caster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <glog/logging.h>
+
+#include "util/timer.h"
+#include "visualization/color_util.h"
+
+namespace {
+/// See LinearIntersection and BisectionIntersection on the GPU
+float LinearIntersection(float t_near, float t_far,
+                         float sdf_near, float sdf_far) {
+  return t_near + (sdf_near / (sdf_near - sdf_far)) * (t_far - t_near);
+}
+
+bool BisectionIntersection(
+    const float3 &world_cam_pos,
+    const float3 &world_cam_dir,
+    float sdf_near, float t_near,
+    float sdf_far, float t_far,
+    const HostBlocks &blocks,
+    GeometryHelper &geometry_helper,
+    float &t, uchar3 &color) {
+  float l = t_near, r = t_far, m = (l + r) * 0.5f;
+  float l_sdf = sdf_near, r_sdf = sdf_far;
+
+  const uint kIterations = 3;
+  Voxel voxel_query;
+  for (uint i = 0; i < kIterations; i++) {
+    m = LinearIntersection(l, r, l_sdf, r_sdf);
+    if (! blocks.GetSpatialValue(world_cam_pos + m * world_cam_dir,
+                                 geometry_helper, &voxel_query))
+      return false;
+    float m_sdf = voxel_query.sdf;
+    if (l_sdf * m_sdf > 0.0) {
+      l = m;
+      l_sdf = m_sdf;
+    } else {
+      r = m;
+      r_sdf = m_sdf;
+    }
+  }
+  t = m;
+  color = voxel_query.color;
+  return true;
+}
+
+/// Leave the cell of @param block_pos, in world units along the ray
+float BlockExitDistance(const int3 &block_pos,
+                        const float3 &origin, const float3 &dir,
+                        float block_side_length) {
+  float3 lower = make_float3(block_pos) * block_side_length;
+  float o[3] = {origin.x, origin.y, origin.z};
+  float d[3] = {dir.x, dir.y, dir.z};
+  float l[3] = {lower.x, lower.y, lower.z};
+
+  float t_exit = INFINITY;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (d[axis] == 0) continue;
+    float bound = d[axis] > 0 ? l[axis] + block_side_length : l[axis];
+    t_exit = fminf(t_exit, (bound - o[axis]) / d[axis]);
+  }
+  return t_exit;
+}
+
+/// MINF of the GPU ray caster
+const cv::Vec4f kInvalidPixel(-INFINITY, -INFINITY, -INFINITY, -INFINITY);
+}
+
+void CpuRayCaster::Alloc(const RayCasterParams &params, int thread_count,
+                         int node_count) {
+  if (! is_allocated_) {
+    ray_caster_params_ = params;
+    scheduler_.reset(new TaskScheduler(thread_count, node_count));
+    tiles_per_row_ = (params.width + kTileWidth - 1) / kTileWidth;
+    tile_shards_.assign(params.height * tiles_per_row_, -1);
+
+    depth_image_ = cv::Mat(params.height, params.width, CV_32FC4);
+    vertex_image_ = cv::Mat(params.height, params.width, CV_32FC4);
+    normal_image_ = cv::Mat(params.height, params.width, CV_32FC4);
+    color_image_ = cv::Mat(params.height, params.width, CV_32FC4);
+    surface_image_ = cv::Mat(params.height, params.width, CV_32FC4);
+
+    is_allocated_ = true;
+  }
+}
+
+void CpuRayCaster::Free() {
+  if (is_allocated_) {
+    depth_image_.release();
+    vertex_image_.release();
+    normal_image_.release();
+    color_image_.release();
+    surface_image_.release();
+    scheduler_.reset();
+    is_allocated_ = false;
+  }
+}
+
+void CpuRayCaster::CastTile(
+    uint tile,
+    const HostBlocks &blocks,
+    GeometryHelper &geometry_helper,
+    const float4x4 &c_T_w,
+    const float4x4 &w_T_c
+) {
+  const RayCasterParams &params = ray_caster_params_;
+  const float kBlockSideLength = BLOCK_SIDE_LENGTH * geometry_helper.voxel_size;
+  const float kStep = params.raycast_step;
+  const int y = (int)(tile / tiles_per_row_);
+  const int x_begin = (int)((tile % tiles_per_row_) * kTileWidth);
+  const int x_end = std::min(x_begin + (int)kTileWidth, (int)params.width);
+
+  long sample_count = 0;
+  long skipped_block_count = 0;
+  std::vector<int> shard_hit_counts(blocks.shard_count(), 0);
+  float3 world_cam_pos = w_T_c * make_float3(0.0f);
+  for (int x = x_begin; x < x_end; ++x) {
+    depth_image_.at<cv::Vec4f>(y, x) = kInvalidPixel;
+    vertex_image_.at<cv::Vec4f>(y, x) = kInvalidPixel;
+    normal_image_.at<cv::Vec4f>(y, x) = kInvalidPixel;
+    color_image_.at<cv::Vec4f>(y, x) = cv::Vec4f(1, 1, 1, 1);
+    surface_image_.at<cv::Vec4f>(y, x) = cv::Vec4f(0, 0, 0, 0);
+
+    /// 1. Determine ray direction
+    float3 camera_ray_dir = normalize(
+        geometry_helper.ImageReprojectToCamera(x, y, 1.0f,
+                                               params.fx, params.fy,
+                                               params.cx, params.cy));
+    float t_min = params.min_raycast_depth / camera_ray_dir.z;
+    float t_max = params.max_raycast_depth / camera_ray_dir.z;
+
+    float4 world_ray_dir_homo = w_T_c * make_float4(camera_ray_dir, 0.0f);
+    float3 world_ray_dir = normalize(make_float3(world_ray_dir_homo.x,
+                                                 world_ray_dir_homo.y,
+                                                 world_ray_dir_homo.z));
+
+    RayCasterSample prev_sample;
+    prev_sample.sdf = 0.0f;
+    prev_sample.t = 0.0f;
+    prev_sample.weight = 0;
+
+    /// 2. Walk the block cells, samples stay at t_min + k * step
+    ///    as in the dense GPU march
+    bool is_found = false;
+    Voxel voxel_query;
+    float t = t_min;
+    while (t < t_max && ! is_found) {
+      float3 world_sample_pos = world_cam_pos + t * world_ray_dir;
+      float3 voxel_posf = geometry_helper.WorldToVoxelf(world_sample_pos);
+      int3 block_pos = geometry_helper.VoxelToBlock(
+          make_int3(floorf(voxel_posf.x),
+                    floorf(voxel_posf.y),
+                    floorf(voxel_posf.z)));
+      float t_exit = BlockExitDistance(block_pos,
+                                       world_cam_pos, world_ray_dir,
+                                       kBlockSideLength);
+      float t_next = t_min + ceilf((t_exit - t_min) / kStep) * kStep;
+      if (t_next <= t) t_next = t + kStep;
+
+      int block_idx = blocks.Find(block_pos);
+      /// Unallocated: every sample would be invalid
+      if (block_idx < 0) {
+        ++skipped_block_count;
+        t = t_next;
+        continue;
+      }
+      /// No zero crossing inside: only the last sample matters,
+      /// as the previous one of the next cell
+      if (! blocks.is_surface(block_idx)) {
+        ++skipped_block_count;
+        float t_last = t_next - kStep;
+        if (t_last >= t
+            && blocks.GetSpatialValue(world_cam_pos + t_last * world_ray_dir,
+                                      geometry_helper, &voxel_query)) {
+          ++sample_count;
+          prev_sample.sdf = voxel_query.sdf;
+          prev_sample.t = t_last;
+          prev_sample.weight = 1;
+        }
+        t = t_next;
+        continue;
+      }
+
+      for (; t < t_next && t < t_max && ! is_found; t += kStep) {
+        world_sample_pos = world_cam_pos + t * world_ray_dir;
+        ++sample_count;
+        if (! blocks.GetSpatialValue(world_sample_pos,
+                                     geometry_helper, &voxel_query)) {
+          continue;
+        }
+
+        /// Zero crossing exist
+        if (prev_sample.weight > 0
+            && prev_sample.sdf > 0.0f && voxel_query.sdf < 0.0f) {
+          float interpolated_t;
+          uchar3 interpolated_color;
+          bool is_isosurface_found = BisectionIntersection(
+              world_cam_pos, world_ray_dir,
+              prev_sample.sdf, prev_sample.t,
+              voxel_query.sdf, t,
+              blocks, geometry_helper,
+              interpolated_t, interpolated_color);
+
+          float3 world_pos_isosurface =
+              world_cam_pos + interpolated_t * world_ray_dir;
+
+          if (is_isosurface_found
+              && fabsf(prev_sample.sdf - voxel_query.sdf)
+                 < params.sample_sdf_threshold
+              && fabsf(voxel_query.sdf) < params.sdf_threshold) {
+            float depth = interpolated_t * camera_ray_dir.z;
+
+            float3 rgb = ValToRGB(depth, 0.3, 5.0);
+            depth_image_.at<cv::Vec4f>(y, x)
+                = cv::Vec4f(rgb.x, rgb.y, rgb.z, 1.0f);
+            float3 vertex = geometry_helper.ImageReprojectToCamera(
+                x, y, depth, params.fx, params.fy, params.cx, params.cy);
+            vertex_image_.at<cv::Vec4f>(y, x)
+                = cv::Vec4f(vertex.x, vertex.y, vertex.z, 1.0f);
+            color_image_.at<cv::Vec4f>(y, x)
+                = cv::Vec4f(interpolated_color.x / 255.f,
+                            interpolated_color.y / 255.f,
+                            interpolated_color.z / 255.f, 1.0f);
+
+            if (params.enable_gradients) {
+              float3 grad;
+              bool valid = blocks.GetSpatialSDFGradient(
+                  world_pos_isosurface, geometry_helper, &grad);
+              float l = length(grad);
+              float3 normal = l > 0 && valid ? grad / l : make_float3(0);
+              normal = -normal;
+              float4 n = c_T_w * make_float4(normal, 0.0f);
+              normal_image_.at<cv::Vec4f>(y, x)
+                  = cv::Vec4f(n.x, n.y, n.z, 1.0f);
+
+              /// Same shading as the GPU ray caster
+              float3 light_pos = make_float3(0, -2, -3);
+              float3 n3 = normalize(normal);
+              float3 l3 = normalize(light_pos - world_pos_isosurface);
+              float distance = length(light_pos - world_pos_isosurface);
+              float3 c3 = make_float3(0.62f, 0.72f, 0.88) * dot(-n3, l3)
+                          * 20.0f / (distance * distance);
+              surface_image_.at<cv::Vec4f>(y, x)
+                  = cv::Vec4f(c3.x, c3.y, c3.z, 1.0f);
+            }
+            ++shard_hit_counts[blocks.ShardOf(block_pos)];
+            is_found = true;
+          }
+        }
+
+        /// No zero crossing || not good
+        prev_sample.sdf = voxel_query.sdf;
+        prev_sample.t = t;
+        prev_sample.weight = 1;
+      }
+    }
+  }
+
+  /// Where the tile goes next time; kept if the rays hit nothing
+  auto max_hit = std::max_element(shard_hit_counts.begin(),
+                                  shard_hit_counts.end());
+  if (max_hit != shard_hit_counts.end() && *max_hit > 0) {
+    tile_shards_[tile] = (int)(max_hit - shard_hit_counts.begin());
+  }
+
+  sample_count_ += sample_count;
+  skipped_block_count_ += skipped_block_count;
+}
+
+void CpuRayCaster::Cast(
+    const HostBlocks &blocks,
+    GeometryHelper &geometry_helper,
+    const float4x4 &c_T_w
+) {
+  const float4x4 w_T_c = c_T_w.getInverse();
+  const uint tile_count = (uint)tile_shards_.size();
+  const int node_count = scheduler_->node_count();
+
+  Timer timer;
+  timer.Tick();
+  sample_count_ = 0;
+  skipped_block_count_ = 0;
+  placed_tile_count_ = 0;
+  if (enable_tile_placement_ && node_count > 1 && blocks.shard_count() > 1) {
+    /// Tiles by the node of their shard, in raster order within a node.
+    /// Tiles that hit nothing yet are spread over the nodes in bands
+    std::vector<std::vector<uint> > node_tiles(node_count);
+    for (uint tile = 0; tile < tile_count; ++tile) {
+      int shard = tile_shards_[tile];
+      if (shard >= 0) ++placed_tile_count_;
+      int node = shard >= 0
+                 ? shard % node_count
+                 : (int)((unsigned long long)tile * node_count / tile_count);
+      node_tiles[node].push_back(tile);
+    }
+    tile_order_.clear();
+    node_begins_.assign(1, 0);
+    for (const std::vector<uint> &tiles : node_tiles) {
+      tile_order_.insert(tile_order_.end(), tiles.begin(), tiles.end());
+      node_begins_.push_back((uint)tile_order_.size());
+    }
+    scheduler_->ParallelFor("cpu_raycast", node_begins_,
+                            [&](uint begin, uint end) {
+      for (uint i = begin; i < end; ++i) {
+        CastTile(tile_order_[i], blocks, geometry_helper, c_T_w, w_T_c);
+      }
+    });
+  } else {
+    scheduler_->ParallelFor("cpu_raycast", tile_count,
+                            [&](uint begin, uint end) {
+      for (uint tile = begin; tile < end; ++tile) {
+        CastTile(tile, blocks, geometry_helper, c_T_w, w_T_c);
+      }
+    });
+  }
+
+  LOG(INFO) << "CPU ray casting: " << timer.Tock() << " s, "
+            << scheduler_->worker_count() << " threads, "
+            << sample_count_ << " samples, "
+            << skipped_block_count_ << " blocks skipped, "
+            << placed_tile_count_ << " / " << tile_count
+            << " tiles on the node of their shard";
+}
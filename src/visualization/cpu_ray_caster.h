@@ -0,0 +1,103 @@
+//
+// Created by wei on 18-1-27.
+//
+// Ray caster on the CPU: rays traverse the block grid (DDA),
+// cross unallocated or surface-free blocks in one step,
+// and only sample densely inside blocks that may hold a zero crossing.
+// Tiles of a row are distributed over the workers of a TaskScheduler:
+// tiles over empty space end early, tiles over surfaces sample a lot.
+// With workers pinned to NUMA nodes and a sharded HostBlocks, a tile goes
+// to the node of the shard its rays hit most in the last Cast, where the
+// dense sampling around the surface reads local memory.
+
+#ifndef VISUALIZATION_CPU_RAY_CASTER_H
+#define VISUALIZATION_CPU_RAY_CASTER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <matrix.h>
+
+#include "core/common.h"
+#include "core/params.h"
+#include "geometry/geometry_helper.h"
+#include "visualization/host_blocks.h"
+#include "visualization/ray_caster.h"
+#include "util/task_scheduler.h"
+
+class CpuRayCaster {
+public:
+  CpuRayCaster() = default;
+  /// @param thread_count 0 to use all hardware threads
+  /// @param node_count if > 0, thread i is pinned to NUMA node
+  /// i % node_count, spreading the threads over the first nodes;
+  /// shard i of HostBlocks is on node i % node_count
+  void Alloc(const RayCasterParams &params, int thread_count = 0,
+             int node_count = 0);
+  void Free();
+
+  /// Fill the same images as RayCaster::Cast, plus the camera-space vertices
+  void Cast(const HostBlocks &blocks,
+            GeometryHelper &geometry_helper,
+            const float4x4 &c_T_w);
+
+  const cv::Mat& depth_image() {
+    return depth_image_;
+  }
+  const cv::Mat& vertex_image() {
+    return vertex_image_;
+  }
+  const cv::Mat& normal_image() {
+    return normal_image_;
+  }
+  const cv::Mat& color_image() {
+    return color_image_;
+  }
+  const cv::Mat& surface_image() {
+    return surface_image_;
+  }
+  const RayCasterParams& ray_caster_params() const {
+    return ray_caster_params_;
+  }
+  /// Tiles to the node of their shard, when pinned and sharded
+  bool& enable_tile_placement() {
+    return enable_tile_placement_;
+  }
+
+private:
+  /// Pixels of a row cast by one task
+  static const uint kTileWidth = 32;
+
+  void CastTile(uint tile,
+                const HostBlocks &blocks,
+                GeometryHelper &geometry_helper,
+                const float4x4 &c_T_w,
+                const float4x4 &w_T_c);
+
+  bool is_allocated_ = false;
+  std::unique_ptr<TaskScheduler> scheduler_;
+  RayCasterParams ray_caster_params_;
+  bool enable_tile_placement_ = true;
+  uint tiles_per_row_;
+
+  /// Per tile, the shard hit most in the last Cast, -1 if none
+  std::vector<int>  tile_shards_;
+  /// Tiles grouped by node, and where the group of each node begins
+  std::vector<uint> tile_order_;
+  std::vector<uint> node_begins_;
+
+  cv::Mat depth_image_;
+  cv::Mat vertex_image_;
+  cv::Mat normal_image_;
+  cv::Mat color_image_;
+  cv::Mat surface_image_;
+
+  /// Statistics of the last Cast
+  std::atomic<long> sample_count_{0};
+  std::atomic<long> skipped_block_count_{0};
+  /// Tiles sent to the node of their shard, the others to any
+  long placed_tile_count_ = 0;
+};
+
+#endif //VISUALIZATION_CPU_RAY_CASTER_H
@@ -0,0 +1,294 @@
+//
+// Created by wei on 18-1-27.
+//
+
+#include "visualization/host_blocks.h"
+
+#include <helper_cuda.h>
+#include <device_launch_parameters.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include "util/timer.h"
+#include "util/numa_topology.h"
+
+////////////////////
+/// Device code
+////////////////////
+/// modified_frame of a candidate recycled after the collection
+const int kRecycledFrame = -2;
+
+/// One thread per candidate block
+__global__
+void GatherBlockFramesKernel(
+    EntryArray candidate_entries,
+    BlockArray blocks,
+    HashTable  hash_table,
+    int       *modified_frames,
+    uint       count
+) {
+  const uint idx = blockIdx.x * blockDim.x + threadIdx.x;
+  if (idx >= count) return;
+
+  const HashEntry &entry = candidate_entries[idx];
+  modified_frames[idx] = (hash_table.GetEntry(entry.pos).ptr == entry.ptr)
+                         ? blocks[entry.ptr].modified_frame
+                         : kRecycledFrame;
+}
+
+/// One thread per voxel of a candidate block to copy
+__global__
+void GatherBlockVoxelsKernel(
+    EntryArray  candidate_entries,
+    BlockArray  blocks,
+    const uint *download_indices,
+    Voxel      *voxels
+) {
+  const HashEntry &entry = candidate_entries[download_indices[blockIdx.x]];
+  voxels[blockIdx.x * BLOCK_SIZE + threadIdx.x]
+      = blocks[entry.ptr].voxels[threadIdx.x];
+}
+
+////////////////////
+/// Host code
+////////////////////
+uint HostBlocks::block_count() const {
+  uint count = 0;
+  for (const Shard &shard : shards_) {
+    count += (uint)shard.block_indices.size();
+  }
+  return count;
+}
+
+void HostBlocks::Clear() {
+  /// Drop the storage too: the page mode may have changed
+  shards_.clear();
+}
+
+uint HostBlocks::Download(
+    EntryArray &candidate_entries,
+    BlockArray &blocks,
+    HashTable &hash_table,
+    uint shard_count
+) {
+  shard_count = std::max(shard_count, 1u);
+  if (shards_.size() != shard_count) {
+    Clear();
+    shards_.resize(shard_count);
+  }
+  ++download_id_;
+
+  Timer timer;
+  timer.Tick();
+  uint candidate_count = candidate_entries.count();
+  std::vector<HashEntry> entries(candidate_count);
+  std::vector<int> modified_frames(candidate_count);
+  if (candidate_count > 0) {
+    int *modified_frames_gpu;
+    checkCudaErrors(cudaMalloc(&modified_frames_gpu,
+                               sizeof(int) * candidate_count));
+    const uint threads_per_block = 256;
+    const dim3 grid_size((candidate_count + threads_per_block - 1)
+                         / threads_per_block, 1);
+    const dim3 block_size(threads_per_block, 1);
+    GatherBlockFramesKernel <<< grid_size, block_size >>> (
+        candidate_entries,
+            blocks,
+            hash_table,
+            modified_frames_gpu,
+            candidate_count);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+
+    checkCudaErrors(cudaMemcpy(entries.data(), candidate_entries.GetGPUPtr(),
+                               sizeof(HashEntry) * candidate_count,
+                               cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaMemcpy(modified_frames.data(), modified_frames_gpu,
+                               sizeof(int) * candidate_count,
+                               cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaFree(modified_frames_gpu));
+  }
+
+  /// Copy the blocks new or modified since they were copied
+  std::vector<uint> download_indices;
+  for (uint i = 0; i < candidate_count; ++i) {
+    if (modified_frames[i] == kRecycledFrame) continue;
+    Shard &shard = shards_[ShardOf(entries[i].pos)];
+    auto iter = shard.block_indices.find(entries[i].pos);
+    if (iter != shard.block_indices.end()) {
+      shard.download_ids[iter->second] = download_id_;
+      if (shard.modified_frames[iter->second] == modified_frames[i]) continue;
+    }
+    download_indices.push_back(i);
+  }
+
+  uint download_count = (uint)download_indices.size();
+  std::vector<Voxel> voxels(BLOCK_SIZE * download_count);
+  if (download_count > 0) {
+    uint  *download_indices_gpu;
+    Voxel *voxels_gpu;
+    checkCudaErrors(cudaMalloc(&download_indices_gpu,
+                               sizeof(uint) * download_count));
+    checkCudaErrors(cudaMalloc(&voxels_gpu,
+                               sizeof(Voxel) * BLOCK_SIZE * download_count));
+    checkCudaErrors(cudaMemcpy(download_indices_gpu, download_indices.data(),
+                               sizeof(uint) * download_count,
+                               cudaMemcpyHostToDevice));
+
+    const dim3 grid_size(download_count, 1);
+    const dim3 block_size(BLOCK_SIZE, 1);
+    GatherBlockVoxelsKernel <<< grid_size, block_size >>> (
+        candidate_entries,
+            blocks,
+            download_indices_gpu,
+            voxels_gpu);
+    checkCudaErrors(cudaDeviceSynchronize());
+    checkCudaErrors(cudaGetLastError());
+
+    checkCudaErrors(cudaMemcpy(voxels.data(), voxels_gpu,
+                               sizeof(Voxel) * BLOCK_SIZE * download_count,
+                               cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaFree(download_indices_gpu));
+    checkCudaErrors(cudaFree(voxels_gpu));
+  }
+
+  if (shards_.size() == 1) {
+    FillShard(0, entries, modified_frames, download_indices, voxels);
+  } else {
+    std::vector<std::thread> threads;
+    for (uint i = 0; i < shards_.size(); ++i) {
+      threads.emplace_back(&HostBlocks::FillShard, this, i,
+                           std::cref(entries), std::cref(modified_frames),
+                           std::cref(download_indices), std::cref(voxels));
+    }
+    for (auto &thread : threads) thread.join();
+  }
+
+  /// A changed block changes the surfaces of its lower neighbors too
+  std::vector<PositionSet> relinked_positions(shards_.size());
+  for (const Shard &shard : shards_) {
+    for (const int3 &pos : shard.changed_positions) {
+      for (int n = 0; n < 8; ++n) {
+        int3 neighbor_pos = pos - make_int3((n & 4) > 0,
+                                            (n & 2) > 0,
+                                            (n & 1) > 0);
+        relinked_positions[ShardOf(neighbor_pos)].insert(neighbor_pos);
+      }
+    }
+  }
+  if (shards_.size() == 1) {
+    FindSurfaces(0, relinked_positions[0]);
+  } else {
+    std::vector<std::thread> threads;
+    for (uint i = 0; i < shards_.size(); ++i) {
+      threads.emplace_back(&HostBlocks::FindSurfaces, this, i,
+                           std::cref(relinked_positions[i]));
+    }
+    for (auto &thread : threads) thread.join();
+  }
+
+  LOG(INFO) << "Downloaded " << download_count << " of " << block_count()
+            << " blocks into " << shards_.size() << " shards in "
+            << timer.Tock() << " s";
+  return download_count;
+}
+
+void HostBlocks::FillShard(
+    uint shard_idx,
+    const std::vector<HashEntry> &entries,
+    const std::vector<int> &modified_frames,
+    const std::vector<uint> &download_indices,
+    const std::vector<Voxel> &voxels
+) {
+  /// Each shard is written, hence placed, by a thread on its node
+  if (shards_.size() > 1) {
+    NumaTopology::Instance().PinThreadToNode(shard_idx);
+  }
+
+  /// 1. Drop the blocks no longer among the candidates, or recycled
+  Shard &shard = shards_[shard_idx];
+  shard.changed_positions.clear();
+  for (uint slot = 0; slot < shard.block_positions.size(); ++slot) {
+    if (! shard.is_used[slot] || shard.download_ids[slot] == download_id_) {
+      continue;
+    }
+    shard.block_indices.erase(shard.block_positions[slot]);
+    shard.is_used[slot] = 0;
+    shard.is_surface[slot] = 0;
+    shard.free_slots.push_back((int)slot);
+    shard.changed_positions.push_back(shard.block_positions[slot]);
+  }
+
+  /// 2. Copy the downloaded blocks, recording their sdf range
+  for (uint d = 0; d < download_indices.size(); ++d) {
+    const HashEntry &entry = entries[download_indices[d]];
+    if (ShardOf(entry.pos) != shard_idx) continue;
+
+    int slot;
+    auto iter = shard.block_indices.find(entry.pos);
+    if (iter != shard.block_indices.end()) {
+      slot = iter->second;
+    } else if (! shard.free_slots.empty()) {
+      slot = shard.free_slots.back();
+      shard.free_slots.pop_back();
+    } else {
+      slot = (int)shard.block_positions.size();
+      shard.block_positions.emplace_back();
+      shard.voxels.resize(shard.voxels.size() + BLOCK_SIZE);
+      shard.sdf_ranges.emplace_back();
+      shard.is_surface.push_back(0);
+      shard.upper_neighbors.resize(
+          shard.upper_neighbors.size() + kUpperNeighborCount, -1);
+      shard.modified_frames.push_back(0);
+      shard.download_ids.push_back(0);
+      shard.is_used.push_back(0);
+    }
+    shard.block_indices[entry.pos] = slot;
+    shard.block_positions[slot] = entry.pos;
+    shard.modified_frames[slot] = modified_frames[download_indices[d]];
+    shard.download_ids[slot] = download_id_;
+    shard.is_used[slot] = 1;
+
+    float2 sdf_range = make_float2(0, 0);
+    for (uint j = 0; j < BLOCK_SIZE; ++j) {
+      const Voxel &voxel = voxels[d * BLOCK_SIZE + j];
+      shard.voxels[slot * BLOCK_SIZE + j] = voxel;
+      sdf_range.x = fminf(sdf_range.x, voxel.sdf);
+      sdf_range.y = fmaxf(sdf_range.y, voxel.sdf);
+    }
+    shard.sdf_ranges[slot] = sdf_range;
+    shard.changed_positions.push_back(entry.pos);
+  }
+}
+
+void HostBlocks::FindSurfaces(uint shard_idx, const PositionSet &positions) {
+  if (shards_.size() > 1) {
+    NumaTopology::Instance().PinThreadToNode(shard_idx);
+  }
+
+  /// A sample in the cell of a block interpolates voxels
+  /// of the block and of its upper neighbors
+  Shard &shard = shards_[shard_idx];
+  for (const int3 &pos : positions) {
+    auto iter = shard.block_indices.find(pos);
+    if (iter == shard.block_indices.end()) continue;
+    int i = iter->second;
+
+    float2 sdf_range = shard.sdf_ranges[i];
+    for (int n = 1; n < 8; ++n) {
+      int3 neighbor_pos = pos + make_int3((n & 4) > 0,
+                                          (n & 2) > 0,
+                                          (n & 1) > 0);
+      int neighbor_idx = Find(neighbor_pos);
+      shard.upper_neighbors[i * kUpperNeighborCount + n - 1] = neighbor_idx;
+      if (neighbor_idx < 0) continue;
+      const Shard &neighbor_shard = shards_[neighbor_idx % shards_.size()];
+      float2 neighbor_range =
+          neighbor_shard.sdf_ranges[neighbor_idx / shards_.size()];
+      sdf_range.x = fminf(sdf_range.x, neighbor_range.x);
+      sdf_range.y = fmaxf(sdf_range.y, neighbor_range.y);
+    }
+    shard.is_surface[i] = (sdf_range.x < 0 && sdf_range.y > 0);
+  }
+}
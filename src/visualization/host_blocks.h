@@ -0,0 +1,228 @@
+//
+// Created by wei on 18-1-27.
+//
+// Voxels of a set of blocks copied to the host for CPU queries,
+// mirroring geometry/spatial_query.h.
+// Kept between downloads: only the blocks whose modified_frame changed
+// are copied again, and the slots of blocks gone are reused.
+// Blocks may be split into shards by coarse region (16^3 blocks),
+// shard i on NUMA node i, each filled by a thread pinned to its node.
+// Queries route by position, so neighbors may lie in any shard; the
+// upper neighbors of a block, read by interpolation, are kept with it,
+// so that crossing into another shard reads its voxels, not its index.
+
+#ifndef VISUALIZATION_HOST_BLOCKS_H
+#define VISUALIZATION_HOST_BLOCKS_H
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <helper_math.h>
+
+#include "core/common.h"
+#include "core/voxel.h"
+#include "core/entry_array.h"
+#include "core/block_array.h"
+#include "core/hash_table.h"
+#include "geometry/geometry_helper.h"
+#include "core/hash_function.h"
+#include "util/host_memory.h"
+
+class HostBlocks {
+public:
+  HostBlocks() = default;
+
+  /// Hold the voxels of @param candidate_entries on the host,
+  /// skipping entries already freed in @param hash_table: blocks new
+  /// or modified since the last download are copied, blocks no longer
+  /// among the candidates dropped, and the others kept as they are
+  /// @param shard_count shards, on NUMA nodes 0, 1, ... in turn;
+  /// a new count drops every block first
+  /// @return blocks copied
+  uint Download(EntryArray &candidate_entries,
+                BlockArray &blocks,
+                HashTable &hash_table,
+                uint shard_count = 1);
+  /// Drop every block, e.g. once the modified frames start over
+  void Clear();
+
+  uint block_count() const;
+  uint shard_count() const {
+    return (uint)shards_.size();
+  }
+  /// Blocks of a region are in the same shard
+  uint ShardOf(const int3 &block_pos) const {
+    int3 region_pos = make_int3(block_pos.x >> kRegionShift,
+                                block_pos.y >> kRegionShift,
+                                block_pos.z >> kRegionShift);
+    return TeschnerHash(region_pos, shard_count());
+  }
+  /// @return index of the block, -1 if it is not allocated.
+  /// Index i is slot i / shard_count of shard i % shard_count
+  int Find(const int3 &block_pos) const {
+    if (shards_.empty()) return -1;
+    uint shard_idx = ShardOf(block_pos);
+    const Shard &shard = shards_[shard_idx];
+    auto iter = shard.block_indices.find(block_pos);
+    return iter == shard.block_indices.end()
+           ? -1 : iter->second * (int)shards_.size() + (int)shard_idx;
+  }
+  /// @return index of the upper neighbor @param n of @param block_idx,
+  /// offset by ((n & 4) > 0, (n & 2) > 0, (n & 1) > 0), -1 if it is not
+  /// allocated; n = 0 is the block itself
+  int UpperNeighbor(int block_idx, int n) const {
+    if (n == 0) return block_idx;
+    const Shard &shard = shards_[block_idx % shards_.size()];
+    return shard.upper_neighbors[(block_idx / shards_.size())
+                                 * kUpperNeighborCount + n - 1];
+  }
+  const Voxel& voxel(int block_idx, uint local_idx) const {
+    const Shard &shard = shards_[block_idx % shards_.size()];
+    return shard.voxels[(block_idx / shards_.size()) * BLOCK_SIZE
+                        + local_idx];
+  }
+  /// Whether a zero crossing may be sampled in the cell of the block:
+  /// the sdf of the block and its 7 upper neighbors changes sign
+  bool is_surface(int block_idx) const {
+    const Shard &shard = shards_[block_idx % shards_.size()];
+    return shard.is_surface[block_idx / shards_.size()] != 0;
+  }
+
+  bool GetVoxelValue(const int3 &voxel_pos,
+                     GeometryHelper &geometry_helper,
+                     Voxel *voxel) const {
+    int3 block_pos = geometry_helper.VoxelToBlock(voxel_pos);
+    int block_idx = Find(block_pos);
+    if (block_idx < 0) return false;
+    uint3 offset = geometry_helper.VoxelToOffset(block_pos, voxel_pos);
+    *voxel = this->voxel(block_idx, geometry_helper.VectorizeOffset(offset));
+    return true;
+  }
+
+  /// Trilinear interpolation, see GetSpatialValue on the GPU
+  bool GetSpatialValue(const float3 &pos,
+                       GeometryHelper &geometry_helper,
+                       Voxel *voxel) const {
+    float3 voxel_posf = geometry_helper.WorldToVoxelf(pos);
+    int3 corner_pos = make_int3(floorf(voxel_posf.x),
+                                floorf(voxel_posf.y),
+                                floorf(voxel_posf.z));
+    float3 ratio = voxel_posf - make_float3(corner_pos);
+
+    /// Corners lie in the block of the first one or in its upper
+    /// neighbors: one lookup, then the neighbor table
+    int3 block_pos = geometry_helper.VoxelToBlock(corner_pos);
+    uint3 offset = geometry_helper.VoxelToOffset(block_pos, corner_pos);
+    int block_idx = Find(block_pos);
+    if (block_idx < 0) return false;
+
+    float sdf = 0, a = 0, b = 0, radius = 0;
+    float3 colorf = make_float3(0.0f);
+    Voxel voxel_query;
+    for (int i = 0; i < 8; ++i) {
+      int3 mask = make_int3((i & 4) > 0, (i & 2) > 0, (i & 1) > 0);
+      uint3 corner_offset = offset + make_uint3(mask);
+      int n = 0;
+      if (corner_offset.x == BLOCK_SIDE_LENGTH) {
+        corner_offset.x = 0;
+        n |= 4;
+      }
+      if (corner_offset.y == BLOCK_SIDE_LENGTH) {
+        corner_offset.y = 0;
+        n |= 2;
+      }
+      if (corner_offset.z == BLOCK_SIDE_LENGTH) {
+        corner_offset.z = 0;
+        n |= 1;
+      }
+      int corner_block_idx = UpperNeighbor(block_idx, n);
+      if (corner_block_idx < 0) return false;
+      voxel_query = this->voxel(
+          corner_block_idx, geometry_helper.VectorizeOffset(corner_offset));
+      float w = (mask.x ? ratio.x : 1 - ratio.x)
+                * (mask.y ? ratio.y : 1 - ratio.y)
+                * (mask.z ? ratio.z : 1 - ratio.z);
+      sdf += w * voxel_query.sdf;
+      colorf += w * make_float3(voxel_query.color.x,
+                                voxel_query.color.y,
+                                voxel_query.color.z);
+      a += w * voxel_query.a;
+      b += w * voxel_query.b;
+      radius += w * sqrtf(1.0f / voxel_query.inv_sigma2);
+    }
+
+    voxel->sdf = sdf;
+    voxel->color = make_uchar3(colorf.x, colorf.y, colorf.z);
+    voxel->a = a;
+    voxel->b = b;
+    voxel->inv_sigma2 = 1.0f / squaref(radius);
+    return true;
+  }
+
+  /// Central differences, see GetSpatialSDFGradient on the GPU
+  bool GetSpatialSDFGradient(const float3 &pos,
+                             GeometryHelper &geometry_helper,
+                             float3 *grad) const {
+    const float3 grad_masks[3] = {{0.5, 0, 0}, {0, 0.5, 0}, {0, 0, 0.5}};
+    const float3 offset = make_float3(geometry_helper.voxel_size);
+
+    float sdfp[3], sdfn[3];
+    Voxel voxel_query;
+    for (int i = 0; i < 3; ++i) {
+      float3 dpos = grad_masks[i] * offset;
+      if (! GetSpatialValue(pos - dpos, geometry_helper, &voxel_query))
+        return false;
+      sdfn[i] = voxel_query.sdf;
+      if (! GetSpatialValue(pos + dpos, geometry_helper, &voxel_query))
+        return false;
+      sdfp[i] = voxel_query.sdf;
+    }
+
+    *grad = make_float3(sdfp[0] - sdfn[0],
+                        sdfp[1] - sdfn[1],
+                        sdfp[2] - sdfn[2]) / offset;
+    return true;
+  }
+
+private:
+  static const int kRegionShift = 4;
+  static const int kUpperNeighborCount = 7;
+
+  typedef std::unordered_set<int3, Int3Hash, Int3Equal> PositionSet;
+
+  /// Per slot, except block_indices; free slots are in free_slots
+  struct Shard {
+    std::vector<int3>  block_positions;
+    /// Read at random by block: on huge pages if SetHostPageMode says so
+    std::vector<Voxel, HostPageAllocator<Voxel> > voxels;
+    std::vector<float2> sdf_ranges;
+    std::vector<uchar> is_surface;
+    /// kUpperNeighborCount per block, see UpperNeighbor
+    std::vector<int>   upper_neighbors;
+    /// modified_frame of the block when copied
+    std::vector<int>   modified_frames;
+    /// Last download the block was among the candidates in
+    std::vector<uint>  download_ids;
+    std::vector<uchar> is_used;
+    std::vector<int>   free_slots;
+    std::unordered_map<int3, int, Int3Hash, Int3Equal> block_indices;
+    /// Blocks copied or dropped by the last download
+    std::vector<int3>  changed_positions;
+  };
+  /// Drop the blocks of @param shard_idx not seen by this download,
+  /// then copy in the downloaded ones, @param entries[download_indices[d]]
+  /// with voxels d
+  void FillShard(uint shard_idx,
+                 const std::vector<HashEntry> &entries,
+                 const std::vector<int> &modified_frames,
+                 const std::vector<uint> &download_indices,
+                 const std::vector<Voxel> &voxels);
+  /// After every shard is filled: neighbors may be in other shards.
+  /// Links the upper neighbors of @param positions, those of the shard
+  void FindSurfaces(uint shard_idx, const PositionSet &positions);
+
+  std::vector<Shard> shards_;
+  uint download_id_ = 0;
+};
+
+#endif //VISUALIZATION_HOST_BLOCKS_H